@@ -0,0 +1,399 @@
+#include "CPUSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+// per-thread buffers the neighbors of one particle are gathered into, so the
+// kernels can be evaluated over the whole list in one batch
+struct NeighborScratch {
+    AlignedVector<float> rx, ry, rz;    // pos_i - pos_j
+    AlignedVector<float> w;             // Poly6
+    AlignedVector<float> gx, gy, gz;    // SpikyGradient
+    AlignedVector<float> lambda;        // lambda_j, only filled by ComputeDelta
+    std::vector<int> index;             // sorted slot j
+
+    // grows only, so it stops allocating after the first few particles
+    void Reserve(int n)
+    {
+        if ((int)index.size() >= n) return;
+        size_t cap = index.size() * 2 > (size_t)n ? index.size() * 2 : (size_t)n;
+        rx.resize(cap); ry.resize(cap); rz.resize(cap);
+        w.resize(cap);
+        gx.resize(cap); gy.resize(cap); gz.resize(cap);
+        lambda.resize(cap);
+        index.resize(cap);
+    }
+};
+
+static thread_local NeighborScratch t_scratch;
+
+// fills scratch with r = pos_i - points[j] for every j in the stencil, returns the count
+template <typename Grid>
+static int GatherNeighbors(const Grid& grid, float3 pos_i, const Float3Stream& points, NeighborScratch& s)
+{
+    int n = 0;
+    grid.ForEachNeighborCell(pos_i, [&](int start, int count) {
+        s.Reserve(n + count);
+        for (int j = start; j < start + count; j++, n++) {
+            s.rx[n] = pos_i.x - points.x[j];
+            s.ry[n] = pos_i.y - points.y[j];
+            s.rz[n] = pos_i.z - points.z[j];
+            s.index[n] = j;
+        }
+    });
+    return n;
+}
+
+// the branch is the same for every particle, so it predicts perfectly
+static int GatherNeighbors(GridType type, const UniformGrid& grid, const SpatialHashGrid& hashGrid,
+    float3 pos_i, const Float3Stream& points, NeighborScratch& s)
+{
+    if (type == GridType::Hashed)
+        return GatherNeighbors(hashGrid, pos_i, points, s);
+    return GatherNeighbors(grid, pos_i, points, s);
+}
+
+// the neighbors of one particle and their kernel values, pointing either
+// into the neighbor list or into the gather scratch
+struct NeighborView {
+    int n;
+    const int* index;
+    const float* w;
+    const float* gx;
+    const float* gy;
+    const float* gz;
+};
+
+void CPUSolver::SetConstants(const CPUSolverConstants& constants)
+{
+    // a kept neighbor list survives the per-frame SetConstants, just not a new layout
+    if (constants.numParticles != m_cb.numParticles || constants.H != m_cb.H || constants.cellSize != m_cb.cellSize)
+        m_neighborList.Invalidate();
+    m_cb = constants;
+}
+
+void CPUSolver::SetNeighborList(bool enabled, float skin)
+{
+    m_useNeighborList = enabled;
+    m_skin = skin > 0.0f ? skin : 0.0f;
+    m_neighborList.Invalidate();
+}
+
+NeighborView CPUSolver::FindNeighbors(int i, float3 pos_i, NeighborScratch& s, bool gradient) const
+{
+    if (m_useNeighborList) {
+        int first = m_neighborList.GetBegin(i);
+        return {
+            m_neighborList.GetEnd(i) - first,
+            m_neighborList.m_index.data() + first,
+            m_neighborList.m_w.data() + first,
+            m_neighborList.m_gx.data() + first,
+            m_neighborList.m_gy.data() + first,
+            m_neighborList.m_gz.data() + first,
+        };
+    }
+
+    const SPHKernelTable& kernels = GetSPHKernels();
+    int n = GatherNeighbors(m_gridType, m_grid, m_hashGrid, pos_i, m_sortedPredicted, s);
+    kernels.poly6(m_kernel, s.rx.data(), s.ry.data(), s.rz.data(), s.w.data(), n);
+    if (gradient)
+        kernels.spikyGradient(m_kernel, s.rx.data(), s.ry.data(), s.rz.data(), s.gx.data(), s.gy.data(), s.gz.data(), n);
+
+    return { n, s.index.data(), s.w.data(), s.gx.data(), s.gy.data(), s.gz.data() };
+}
+
+unsigned CPUSolver::GetThreadCount()
+{
+    return GetPool().GetThreadCount();
+}
+
+ThreadPool& CPUSolver::GetPool()
+{
+    if (!m_pool)
+        m_pool = std::make_unique<ThreadPool>(m_numThreads, m_pinThreads);
+    return *m_pool;
+}
+
+void CPUSolver::DispatchCPUCommands(ParticleStore& particles, float dt)
+{
+    DispatchInit(dt);
+    DispatchPrediction(particles, dt); // step 1: predict position
+    DispatchNeighborSearch(particles); // step 2: perform neighbor search
+
+    for (int i = 0; i < m_cb.iterations; i++) {
+        ComputeLambda(particles);
+        ComputeDelta(particles);
+        CollisionConstraints(particles);
+    }
+
+    ComputeXSPH(particles);
+}
+
+void CPUSolver::DispatchInit(float dt)
+{
+    m_cb.dt = dt;
+    m_kernel = SPHKernelConstants::Make(m_cb.H);
+
+    // a verlet list needs every pair inside h + skin in the 27-cell stencil,
+    // so the cells grow with the skin
+    float cellSize = m_cb.cellSize;
+    int3 gridDim = m_cb.gridDim;
+    float listCutoff = m_kernel.h + m_skin;
+    if (m_useNeighborList && listCutoff > cellSize) {
+        float scale = cellSize / listCutoff;
+        gridDim = {
+            (int)std::ceil(gridDim.x * scale),
+            (int)std::ceil(gridDim.y * scale),
+            (int)std::ceil(gridDim.z * scale),
+        };
+        cellSize = listCutoff;
+    }
+
+    // no-ops once sized, so steady state frames don't allocate
+    m_grid.Configure(m_cb.gridOrigin, cellSize, gridDim, m_cellOrder);
+    m_hashGrid.Configure(m_cb.gridOrigin, cellSize);
+
+    m_sortedPosition.Resize(m_cb.numParticles);
+    m_sortedPredicted.Resize(m_cb.numParticles);
+    m_sortedVelocity.Resize(m_cb.numParticles);
+    m_sortedLambda.resize(m_cb.numParticles);
+    m_sortedIndex.resize(m_cb.numParticles);
+}
+
+void CPUSolver::DispatchPrediction(ParticleStore& particles, float dt)
+{
+    if (dt <= 0.0f) return;
+
+    Float3Stream& pos = particles.position;
+    Float3Stream& pred = particles.predictedPosition;
+    Float3Stream& vel = particles.velocity;
+
+    GetPool().ParallelFor(m_cb.numParticles, m_grain, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            // apply forces
+            vel.y[i] += -3.0f * dt;
+
+            // predict position
+            pred.x[i] = pos.x[i] + dt * vel.x[i];
+            pred.y[i] = pos.y[i] + dt * vel.y[i];
+            pred.z[i] = pos.z[i] + dt * vel.z[i];
+        }
+    });
+}
+
+void CPUSolver::Reorder(ParticleStore& particles, const std::vector<int>& order)
+{
+    // gathers in sorted order so the writes stream
+    GetPool().ParallelFor(m_cb.numParticles, m_grain, [&](int begin, int end) {
+        for (int sortedIdx = begin; sortedIdx < end; sortedIdx++) {
+            int i = order[sortedIdx];
+
+            m_sortedIndex[sortedIdx] = i;
+            m_sortedPosition.Set(sortedIdx, particles.position.Get(i));
+            m_sortedPredicted.Set(sortedIdx, particles.predictedPosition.Get(i));
+            m_sortedVelocity.Set(sortedIdx, particles.velocity.Get(i));
+        }
+    });
+}
+
+void CPUSolver::DispatchNeighborSearch(ParticleStore& particles)
+{
+    const Float3Stream& pred = particles.predictedPosition;
+
+    // verlet list: keep last frame's order and pairs while nothing moved more
+    // than half the skin since they were built
+    bool reuse = m_useNeighborList && m_skin > 0.0f && m_neighborList.IsBuilt();
+    if (reuse) {
+        Reorder(particles, m_sortedIndex);
+        reuse = m_neighborList.IsStillValid(GetPool(), m_sortedPredicted, m_cb.numParticles, 0.5f * m_skin);
+    }
+
+    if (!reuse) {
+        // count + scan + scatter, see CellSort
+        if (m_gridType == GridType::Hashed)
+            m_hashGrid.Build(GetPool(), pred, m_cb.numParticles);
+        else
+            m_grid.Build(GetPool(), pred, m_cb.numParticles);
+
+        Reorder(particles, m_gridType == GridType::Hashed ? m_hashGrid.GetSortedOrder() : m_grid.GetSortedOrder());
+
+        if (m_useNeighborList) {
+            float cutoff = m_kernel.h + m_skin;
+            if (m_gridType == GridType::Hashed)
+                m_neighborList.Build(GetPool(), m_hashGrid, m_sortedPredicted, m_cb.numParticles, cutoff);
+            else
+                m_neighborList.Build(GetPool(), m_grid, m_sortedPredicted, m_cb.numParticles, cutoff);
+        }
+    }
+
+    // the sorted predicted positions stay put until the next search, so the
+    // kernel values are good for every iteration of this frame
+    if (m_useNeighborList)
+        m_neighborList.EvaluateKernels(GetPool(), GetSPHKernels(), m_kernel, m_sortedPredicted, m_cb.numParticles);
+}
+
+void CPUSolver::ComputeLambda(ParticleStore& particles)
+{
+    const float RHO_0 = m_cb.rho0;
+
+    GetPool().ParallelFor(m_cb.numParticles, m_grain, [&](int begin, int end) {
+        NeighborScratch& s = t_scratch;
+
+        for (int i = begin; i < end; i++) {
+            // go in order of position/cell (sorted) instead of unsorted
+            float3 pos_i = m_sortedPredicted.Get(i);
+
+            NeighborView nb = FindNeighbors(i, pos_i, s, true);
+
+            float density = 0.0f;
+            float gradLenSum = 0.0f;
+            float3 gradSum = { 0, 0, 0 };
+
+            for (int k = 0; k < nb.n; k++) {
+                density += nb.w[k];     // numerator calcs
+                gradSum += { nb.gx[k], nb.gy[k], nb.gz[k] };    // accumulate self term
+                gradLenSum += nb.gx[k] * nb.gx[k] + nb.gy[k] * nb.gy[k] + nb.gz[k] * nb.gz[k];
+            }
+
+            // denominator: sum of |-grad_j / rho_0|^2 plus the self term
+            float numerator = (density / RHO_0) - 1.0f;
+            float3 gradSumFinalized = gradSum / RHO_0;
+            float denominator = gradLenSum / (RHO_0 * RHO_0);
+            denominator += dot(gradSumFinalized, gradSumFinalized);
+            denominator += m_cb.epsilon;
+
+            float lambda = -numerator / denominator;
+            particles.lambda[m_sortedIndex[i]] = lambda;
+            m_sortedLambda[i] = lambda;
+        }
+    });
+}
+
+void CPUSolver::ComputeDelta(ParticleStore& particles)
+{
+    // tensile correction constants
+    const float corr_h = 0.30f;
+    const float corr_k = 1e-02f;
+    const float corr_r2 = corr_h * m_kernel.h * corr_h * m_kernel.h;
+    const float corr_diff = m_kernel.h2 - corr_r2;
+    const float corr_w = m_kernel.poly6Coeff * corr_diff * corr_diff * corr_diff;   // Poly6(corr_h * H)
+    const float inv_corr_w = (corr_w > 1e-12f) ? 1.0f / corr_w : 0.0f;
+
+    GetPool().ParallelFor(m_cb.numParticles, m_grain, [&](int begin, int end) {
+        NeighborScratch& s = t_scratch;
+
+        for (int i = begin; i < end; i++) {
+            float3 pos_i = m_sortedPredicted.Get(i);     // sorted slot i
+            float lambda_i = m_sortedLambda[i];
+
+            NeighborView nb = FindNeighbors(i, pos_i, s, true);
+            s.Reserve(nb.n);    // no-op unless nb comes from the neighbor list
+            for (int k = 0; k < nb.n; k++)
+                s.lambda[k] = m_sortedLambda[nb.index[k]];
+
+            float3 delta = { 0, 0, 0 };
+            for (int k = 0; k < nb.n; k++) {
+                float ratio = nb.w[k] * inv_corr_w;
+                float ratio2 = ratio * ratio;
+                float corr = -corr_k * ratio2 * ratio2;    // corr_n = 4
+
+                float coeff = lambda_i + s.lambda[k] + corr;
+                delta += { coeff * nb.gx[k], coeff * nb.gy[k], coeff * nb.gz[k] };
+            }
+
+            delta /= m_cb.rho0;
+
+            particles.delta.Set(m_sortedIndex[i], delta);
+        }
+    });
+}
+
+void CPUSolver::CollisionConstraints(ParticleStore& particles)
+{
+    const float particleRadius = 0.15f;
+    const float3 posMin = { -m_cb.size.x + particleRadius, particleRadius, -m_cb.size.z + particleRadius };
+    const float3 posMax = { m_cb.size.x - particleRadius, m_cb.size.y - particleRadius, m_cb.size.z - particleRadius };
+
+    Float3Stream& pred = particles.predictedPosition;
+    const Float3Stream& delta = particles.delta;
+
+    GetPool().ParallelFor(m_cb.numParticles, m_grain, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            pred.x[i] = clampf(pred.x[i] + delta.x[i], posMin.x, posMax.x);
+            pred.y[i] = clampf(pred.y[i] + delta.y[i], posMin.y, posMax.y);
+            pred.z[i] = clampf(pred.z[i] + delta.z[i], posMin.z, posMax.z);
+        }
+    });
+}
+
+void CPUSolver::ComputeXSPH(ParticleStore& particles)
+{
+    const SPHKernelTable& kernels = GetSPHKernels();
+
+    GetPool().ParallelFor(m_cb.numParticles, m_grain, [&](int begin, int end) {
+        NeighborScratch& s = t_scratch;
+
+        for (int i = begin; i < end; i++) {
+            float3 pos_i = m_sortedPredicted.Get(i);
+            float3 vel_i = m_sortedVelocity.Get(i);
+
+            // 1: compute density
+            NeighborView nb = FindNeighbors(i, pos_i, s, false);
+            int n = nb.n;
+
+            float density = 0.0f;
+            for (int k = 0; k < n; k++)
+                density += nb.w[k];
+
+            // guard against zero density
+            float invDensity = (density > 1e-6f) ? (1.0f / density) : 0.0f;
+
+            // 2: XSPH viscosity, same neighbors but measured on the current (not predicted) positions
+            float3 pos_i_cur = m_sortedPosition.Get(i);
+            s.Reserve(n);
+            for (int k = 0; k < n; k++) {
+                int j = nb.index[k];
+                s.index[k] = j;
+                s.rx[k] = pos_i_cur.x - m_sortedPosition.x[j];
+                s.ry[k] = pos_i_cur.y - m_sortedPosition.y[j];
+                s.rz[k] = pos_i_cur.z - m_sortedPosition.z[j];
+            }
+            kernels.poly6(m_kernel, s.rx.data(), s.ry.data(), s.rz.data(), s.w.data(), n);
+
+            float3 xsph = { 0, 0, 0 };
+            for (int k = 0; k < n; k++) {
+                int j = s.index[k];
+                float3 dv = m_sortedVelocity.Get(j) - vel_i;
+                xsph += (invDensity * s.w[k]) * dv;
+            }
+
+            int orig = m_sortedIndex[i];
+            particles.density[orig] = density;
+            particles.xsph.Set(orig, xsph);
+        }
+    });
+}
+
+void CPUSolver::UpdatePBD(ParticleStore& particles, float dt)
+{
+    if (dt <= 0.0f) return;
+
+    Float3Stream& pos = particles.position;
+    const Float3Stream& pred = particles.predictedPosition;
+    Float3Stream& vel = particles.velocity;
+    const Float3Stream& xsph = particles.xsph;
+    const float scale = m_cb.damping / dt;
+
+    GetPool().ParallelFor(m_cb.numParticles, m_grain, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            // derive velocity from the displacement, then apply XSPH
+            vel.x[i] = scale * (pred.x[i] - pos.x[i]) + xsph.x[i] * m_cb.viscosity;
+            vel.y[i] = scale * (pred.y[i] - pos.y[i]) + xsph.y[i] * m_cb.viscosity;
+            vel.z[i] = scale * (pred.z[i] - pos.z[i]) + xsph.z[i] * m_cb.viscosity;
+
+            pos.x[i] = pred.x[i];
+            pos.y[i] = pred.y[i];
+            pos.z[i] = pred.z[i];
+        }
+    });
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <memory>
+
+#include "NeighborList.h"
+#include "ParticleStore.h"
+#include "SimMath.h"
+#include "SPHKernels.h"
+#include "SpatialHashGrid.h"
+#include "ThreadPool.h"
+#include "UniformGrid.h"
+
+// which neighbor grid the cpu solver builds every frame
+enum class GridType {
+    Dense,      // UniformGrid over the whole bounding box, what the gpu does
+    Hashed,     // SpatialHashGrid, only occupied cells
+};
+
+struct NeighborScratch;
+struct NeighborView;
+
+// cpu copy of the NSConstants cbuffer in particles.hlsl
+struct CPUSolverConstants {
+    float3 gridOrigin;      // bottom right of the bounding box
+    float cellSize;         // size of each of the boxes, this is the same as H
+    int3 gridDim;           // how many cells in each dimension
+    int numParticles;
+    float3 size;            // size of the bounding box
+    int numCells;
+    float dt;
+    float H;                // smoothing radius
+    float rho0;             // rest density
+    float epsilon;
+    int iterations;         // ITERATIONS in ParticleSystem.h
+    float damping;          // DAMPING/VISCOSITY in ParticleSystem.h, only used by UpdatePBD
+    float viscosity;
+};
+
+// headless, multithreaded port of the pbf kernels in shaders/particles.hlsl.
+// every Compute*/Dispatch* function is one Dispatch() on the gpu side. the
+// ParticleStore passed in plays the role of particlesIn (original order), the
+// solver keeps its own cell-sorted copy of the fields the stencil walks read,
+// which is what particlesOut is for on the gpu.
+class CPUSolver {
+public:
+    CPUSolver() = default;
+    explicit CPUSolver(unsigned numThreads, bool pinThreads = false)
+        : m_numThreads(numThreads), m_pinThreads(pinThreads) {}
+
+    // equivalent of filling the b0 constant buffer, call before dispatching
+    void SetConstants(const CPUSolverConstants& constants);
+    const CPUSolverConstants& GetConstants() const { return m_cb; }
+
+    // layout of the neighbor grid and therefore of the sorted particles.
+    // RowMajor matches the gpu, Morton keeps the stencil walks more local.
+    void SetCellOrder(CellOrder order) { m_cellOrder = order; }
+    CellOrder GetCellOrder() const { return m_cellOrder; }
+    const UniformGrid& GetGrid() const { return m_grid; }
+
+    // Hashed ignores the cell order, it is always morton
+    void SetGridType(GridType type) { m_gridType = type; }
+    GridType GetGridType() const { return m_gridType; }
+    const SpatialHashGrid& GetHashGrid() const { return m_hashGrid; }
+
+    // build a neighbor list once per frame instead of walking the stencil in
+    // every lambda/delta/xsph pass, see NeighborList. skin > 0 keeps the list
+    // (and the sorted order) across frames until something moves skin / 2.
+    // the xsph viscosity term then only sees pairs inside h + skin measured on
+    // the predicted positions, so results differ from the gpu in the last bits.
+    void SetNeighborList(bool enabled, float skin = 0.0f);
+    bool GetNeighborListEnabled() const { return m_useNeighborList; }
+    const NeighborList& GetNeighborList() const { return m_neighborList; }
+
+    // same call sequence as ParticleSystem::DispatchGPUCommands
+    void DispatchCPUCommands(ParticleStore& particles, float dt);
+    void DispatchInit(float dt);
+    void DispatchPrediction(ParticleStore& particles, float dt);
+    void DispatchNeighborSearch(ParticleStore& particles);
+
+    // pbf kernels
+    void ComputeLambda(ParticleStore& particles);
+    void ComputeDelta(ParticleStore& particles);
+    void CollisionConstraints(ParticleStore& particles);
+    void ComputeXSPH(ParticleStore& particles);
+
+    // host side finalization, same as ParticleSystem::UpdatePBD.
+    // the renderer does this itself, headless callers use this one.
+    void UpdatePBD(ParticleStore& particles, float dt);
+
+    // particles per chunk in the per-particle passes. smaller balances
+    // better on many cores, bigger has less scheduling overhead
+    void SetGrain(int grain) { m_grain = grain > 0 ? grain : 1; }
+    int GetGrain() const { return m_grain; }
+
+    unsigned GetThreadCount();
+
+    // the solver's workers, ParticleSystem and the headless meshing stage run
+    // their host loops on it too instead of spinning up a second set of threads
+    ThreadPool& GetPool();
+
+private:
+    void Reorder(ParticleStore& particles, const std::vector<int>& order);
+    NeighborView FindNeighbors(int i, float3 pos_i, NeighborScratch& s, bool gradient) const;
+
+    CPUSolverConstants m_cb = {};
+    SPHKernelConstants m_kernel = {};     // h-dependent kernel factors, rebuilt in DispatchInit
+    unsigned m_numThreads = 0;
+    bool m_pinThreads = false;
+    int m_grain = 256;     // particles per chunk, the cpu version of numthreads(64)
+    std::unique_ptr<ThreadPool> m_pool;     // created on first use so the gpu path never spawns threads
+
+    CellOrder m_cellOrder = CellOrder::RowMajor;
+    GridType m_gridType = GridType::Dense;
+    UniformGrid m_grid;     // cellCount (u0) / cellStart (u3) + sorted order
+    SpatialHashGrid m_hashGrid;
+
+    bool m_useNeighborList = false;
+    float m_skin = 0.0f;
+    NeighborList m_neighborList;
+
+    // particlesOut: sorted copies of what the neighbor loops read, so they
+    // stream through memory instead of chasing originalIndex
+    Float3Stream m_sortedPosition;
+    Float3Stream m_sortedPredicted;
+    Float3Stream m_sortedVelocity;
+    AlignedVector<float> m_sortedLambda;
+    std::vector<int> m_sortedIndex;     // originalIndex
+};
@@ -0,0 +1,115 @@
+#include "CachePlayer.h"
+
+#include <algorithm>
+#include <chrono>
+
+CachePlayer::CachePlayer(const ParticleCache& cache, int prefetchFrames)
+    : m_cache(cache), m_slots(prefetchFrames > 0 ? prefetchFrames : 1)
+{
+    m_thread = std::thread([this] { PrefetchLoop(); });
+}
+
+CachePlayer::~CachePlayer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+}
+
+int CachePlayer::Window() const
+{
+    return (std::min)((int)m_slots.size(), m_cache.GetNumFrames());
+}
+
+int CachePlayer::WindowFrame(int k) const
+{
+    int n = m_cache.GetNumFrames();
+    return ((m_playhead + k * m_direction) % n + n) % n;
+}
+
+bool CachePlayer::InWindow(int frame) const
+{
+    int n = m_cache.GetNumFrames();
+    int k = ((frame - m_playhead) * m_direction % n + n) % n;
+    return k < Window();
+}
+
+int CachePlayer::FindSlot(int frame) const
+{
+    for (size_t s = 0; s < m_slots.size(); s++)
+        if (m_slots[s].frame == frame) return (int)s;
+    return -1;
+}
+
+bool CachePlayer::NextLoad(int& frame, int& slot) const
+{
+    // the window has as many frames as there are slots, so while one of
+    // them is missing some slot holds a frame outside of it
+    for (int k = 0; k < Window(); k++) {
+        frame = WindowFrame(k);
+        if (FindSlot(frame) >= 0) continue;
+        for (size_t s = 0; s < m_slots.size(); s++) {
+            if (m_slots[s].frame < 0 || !InWindow(m_slots[s].frame)) {
+                slot = (int)s;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+const ParticleStore& CachePlayer::Get(int frame)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // going backwards prefetches backwards. the step from the last frame
+    // back to 0 is playback wrapping around, not a scrub
+    const int n = m_cache.GetNumFrames();
+    if (frame < m_playhead && !(m_playhead == n - 1 && frame == 0)) m_direction = -1;
+    else if (frame > m_playhead || frame == 0) m_direction = 1;
+    m_playhead = frame;
+    m_wake.notify_one();
+
+    int slot = FindSlot(frame);
+    if (slot >= 0 && m_slots[slot].ready) {
+        m_hits++;
+        return m_slots[slot].particles;
+    }
+
+    // it's the nearest frame in the window now, the prefetcher does it next
+    m_misses++;
+    auto start = std::chrono::steady_clock::now();
+    m_loaded.wait(lock, [&] {
+        slot = FindSlot(frame);
+        return slot >= 0 && m_slots[slot].ready;
+    });
+    m_waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return m_slots[slot].particles;
+}
+
+void CachePlayer::PrefetchLoop()
+{
+    while (true) {
+        int frame, slot;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_quit || NextLoad(frame, slot); });
+            if (m_quit) return;
+
+            // claimed, nobody else touches the slot until it's ready
+            m_slots[slot].frame = frame;
+            m_slots[slot].ready = false;
+        }
+
+        m_cache.Load(frame, m_slots[slot].particles);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_slots[slot].ready = true;
+        }
+        m_loaded.notify_all();
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ParticleCache.h"
+#include "ParticleStore.h"
+
+// plays a ParticleCache back instead of running the solver (cache_play).
+// a thread of its own copies the frames ahead of the playhead out of the
+// mapping into a ring of ParticleStores, so the page faults of reading the
+// file happen there and not in Get. ahead means in the direction the
+// playhead last moved, and past the end it wraps around to frame 0 like
+// the playback does.
+//
+// Get jumps anywhere, that's all scrubbing is. a frame that wasn't
+// prefetched yet (a scrub, or a disk that can't keep up) is a miss, Get
+// waits for the thread to load it. GetHitRate is how often it didn't.
+class CachePlayer {
+public:
+    // prefetchFrames is the size of the ring, the frame Get returned last included
+    CachePlayer(const ParticleCache& cache, int prefetchFrames);
+    ~CachePlayer();
+
+    CachePlayer(const CachePlayer&) = delete;
+    CachePlayer& operator=(const CachePlayer&) = delete;
+
+    // 0 <= frame < GetNumFrames of the cache. valid until the next Get
+    const ParticleStore& Get(int frame);
+
+    const ParticleCache& GetCache() const { return m_cache; }
+
+    unsigned long long GetHits() const { return m_hits; }
+    unsigned long long GetMisses() const { return m_misses; }
+    double GetHitRate() const { return m_hits + m_misses > 0 ? (double)m_hits / (m_hits + m_misses) : 0.0; }
+    double GetWaitSeconds() const { return m_waitSeconds; }    // Get waiting on misses
+
+private:
+    struct Slot {
+        int frame = -1;
+        bool ready = false;
+        ParticleStore particles;
+    };
+
+    void PrefetchLoop();
+    int Window() const;                 // frames the ring covers, numFrames at most
+    int WindowFrame(int k) const;       // k-th frame ahead of the playhead
+    bool InWindow(int frame) const;
+    int FindSlot(int frame) const;      // -1 if no slot holds (or is loading) it
+    bool NextLoad(int& frame, int& slot) const;  // nearest missing frame and a slot to put it in
+
+    const ParticleCache& m_cache;
+    std::vector<Slot> m_slots;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;     // prefetcher: playhead moved, or quit
+    std::condition_variable m_loaded;   // Get: a frame is ready
+    int m_playhead = 0;
+    int m_direction = 1;
+    bool m_quit = false;
+
+    // caller's thread only
+    unsigned long long m_hits = 0;
+    unsigned long long m_misses = 0;
+    double m_waitSeconds = 0.0;
+
+    std::thread m_thread;   // last, starts once everything above exists
+};
@@ -0,0 +1,63 @@
+#include "CellSort.h"
+
+#include <algorithm>
+
+// cells per chunk for the per-cell passes
+static const int CELL_GRAIN = 4096;
+
+void CellSort::Sort(ThreadPool& pool, const int* particleCell, int count, int numCells)
+{
+    const int numSlices = (int)pool.GetThreadCount();
+    const int sliceSize = count > 0 ? (count + numSlices - 1) / numSlices : 1;
+
+    m_cellCount.resize(numCells);
+    m_cellStart.resize(numCells);
+    m_sortedOrder.resize(count);
+    m_histograms.resize((size_t)numSlices * numCells);
+
+    // pass 1: per-slice histograms (CSClearCells + CSCounting)
+    pool.ParallelFor(count, sliceSize, [&](int begin, int end) {
+        int* hist = &m_histograms[(size_t)(begin / sliceSize) * numCells];
+        std::fill(hist, hist + numCells, 0);
+
+        for (int i = begin; i < end; i++)
+            hist[particleCell[i]]++;
+    });
+
+    // a slice can come up empty when count < numSlices, its histogram was never cleared
+    int usedSlices = count > 0 ? (count + sliceSize - 1) / sliceSize : 0;
+
+    // pass 2: per cell totals, exclusive scan into cellStart (CSPrefixSum),
+    // then turn every slice's histogram into its write offsets
+    pool.ParallelFor(numCells, CELL_GRAIN, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            int total = 0;
+            for (int s = 0; s < usedSlices; s++)
+                total += m_histograms[(size_t)s * numCells + c];
+            m_cellCount[c] = total;
+        }
+    });
+
+    m_scan.Scan(pool, reinterpret_cast<const uint32_t*>(m_cellCount.data()),
+        reinterpret_cast<uint32_t*>(m_cellStart.data()), numCells, ScanMode::Exclusive);
+
+    pool.ParallelFor(numCells, CELL_GRAIN, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            int offset = m_cellStart[c];
+            for (int s = 0; s < usedSlices; s++) {
+                int& h = m_histograms[(size_t)s * numCells + c];
+                int n = h;
+                h = offset;
+                offset += n;
+            }
+        }
+    });
+
+    // pass 3: scatter (CSReorder). same slices as pass 1, so every slice owns
+    // a disjoint set of output slots in every cell.
+    pool.ParallelFor(count, sliceSize, [&](int begin, int end) {
+        int* offsets = &m_histograms[(size_t)(begin / sliceSize) * numCells];
+        for (int i = begin; i < end; i++)
+            m_sortedOrder[offsets[particleCell[i]]++] = i;
+    });
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "PrefixScan.h"
+#include "ThreadPool.h"
+
+// counting sort of particles by cell id, the CSCounting -> CSPrefixSum ->
+// CSReorder part that UniformGrid and SpatialHashGrid share. they only differ
+// in how a position turns into a cell id.
+//
+// instead of one InterlockedAdd per particle, every worker counts its slice of
+// the particles into a private histogram, the histograms are scanned into
+// per-worker write offsets and then each worker scatters its slice again.
+// no atomics, and within a cell particles stay in original order so the
+// result is deterministic.
+class CellSort {
+public:
+    // particleCell[i] must be in [0, numCells)
+    void Sort(ThreadPool& pool, const int* particleCell, int count, int numCells);
+
+    // same contents as the u0 / u3 buffers after CSPrefixSum
+    std::vector<int> m_cellCount;
+    std::vector<int> m_cellStart;
+    std::vector<int> m_sortedOrder;     // sorted slot -> original index (originalIndex in particlesOut)
+
+private:
+    std::vector<int> m_histograms;      // numSlices x numCells, counts then write offsets
+    PrefixScan<uint32_t> m_scan;        // cellCount -> cellStart
+};
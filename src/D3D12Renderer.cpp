@@ -19,6 +19,27 @@ D3D12Renderer::D3D12Renderer(UINT width, UINT height) :
 
 void D3D12Renderer::OnInit()
 {
+	// has to happen before anything is sized from the particle system
+	if (!m_configPath.empty())
+		m_particleSystem.Configure(SimulationConfig::LoadFromFile(m_configPath));
+
+	const SimulationConfig& config = m_particleSystem.GetConfig();
+	m_scheduler.SetFixedDt(config.fixedDt);
+	m_scheduler.SetMaxSubsteps(config.maxSubsteps);
+	if (!config.meshExportDir.empty())
+		m_meshExporter = std::make_unique<MeshExporter>(config.meshExportDir, config.meshExportQueue);
+	if (!config.cacheRecord.empty())
+		m_cacheWriter = std::make_unique<ParticleCacheWriter>(config.cacheRecord, config.GetNumParticles());
+	if (!config.cachePlay.empty())
+	{
+		m_cache = std::make_unique<ParticleCache>(config.cachePlay);
+		if (m_cache->GetNumParticles() != config.GetNumParticles())
+			throw std::runtime_error(config.cachePlay + " was recorded with " + std::to_string(m_cache->GetNumParticles()) +
+				" particles, the config has " + std::to_string(config.GetNumParticles()));
+		m_cachePlayer = std::make_unique<CachePlayer>(*m_cache, config.cachePrefetch);
+		m_playTime = m_cache->GetTime(0);
+	}
+
 	LoadPipeline();
 	m_particleSystem.LoadParticles();
 	LoadAssets();
@@ -26,12 +47,17 @@ void D3D12Renderer::OnInit()
 
 void D3D12Renderer::OnUpdate()
 {
-	// update camera and stuff here
-	UINT64 now = GetTickCount64();
-    float dt = (m_lastFrameTime == 0) ? 0.0f : (now - m_lastFrameTime) / 1000.0f;
-    m_lastFrameTime = now;
+	// how many fixed steps this frame needs. the camera and the fps counter
+	// still run on the real frame time
+	int steps = m_scheduler.Advance();
+	float frameTime = (float)m_scheduler.GetFrameTime();
+
+	// playing a cache back, a new cached frame takes the place of the steps
+	if (m_cachePlayer)
+		steps = UpdatePlayback(frameTime);
 
-    m_camera.Update(dt);
+	// update camera and stuff here
+    m_camera.Update(frameTime);
 
     // build mvp
     XMMATRIX model = XMMatrixIdentity();
@@ -47,18 +73,91 @@ void D3D12Renderer::OnUpdate()
     
 	memcpy(m_pCbvDataBegin, &m_cbData, sizeof(m_cbData));
 
-	// write per instance data
-	// change this into particles...
-	ThrowIfFailed(m_computeAllocator->Reset());
+	// simulate this frame. every substep goes into one submit, the particle
+	// state stays on the gpu between steps. nothing blocks here unless the gpu
+	// is a whole ring of frames behind. no steps means the simulation is ahead
+	// of the clock
+	m_computeWaitSeconds = 0.0;
+	if (steps > 0)
+		SubmitSimulationFrame(steps, m_scheduler.GetFixedDt());
+
+	// and show an older one that's (nearly) done, so the gpu works on frame N
+	// while the cpu records N+1 and the graphics queue draws N-1
+	RetireSimulationFrame(steps > 0);
+
+	// printf("Vertex count: %u\n", vertCount);
+
+	static float fpsTimer = 0.0f;
+	fpsTimer += frameTime;
+	if (fpsTimer >= 0.5f && frameTime > 0.0f)  // update twice per second so it's readable
+	{
+		const FixedStepScheduler::Stats& stats = m_scheduler.GetStats();
+		char buf[160];
+		int len = sprintf_s(buf, "%.2f ms  |  %.0f fps  |  %d steps  |  dropped %.0f ms  |  gpu wait %.2f ms",
+			frameTime * 1000.0f, 1.0f / frameTime, steps, stats.droppedSeconds * 1000.0, m_computeWaitSeconds * 1000.0);
+		if (m_cachePlayer)
+		{
+			len += sprintf_s(buf + len, sizeof(buf) - len, "  |  %s frame %d/%d  prefetch hit %.0f%%",
+				m_playPaused ? "paused" : "play", m_playFrame, m_cache->GetNumFrames(), m_cachePlayer->GetHitRate() * 100.0);
+		}
+		if (m_meshExporter)
+		{
+			double seconds = m_meshExporter->GetWriteSeconds();
+			sprintf_s(buf + len, sizeof(buf) - len, "  |  export %.0f MB/s",
+				seconds > 0.0 ? m_meshExporter->GetBytesWritten() / (1024.0 * 1024.0) / seconds : 0.0);
+		}
+		SetCustomWindowText(std::wstring(buf, buf + strlen(buf)).c_str());
+		fpsTimer = 0.0f;
+	}
+}
+
+void D3D12Renderer::SubmitSimulationFrame(int steps, float dt)
+{
+	const UINT slot = (UINT)(m_simFramesSubmitted % ParticleSystem::FRAMES_IN_FLIGHT);
+
+	// the slot's allocator and staging buffers were last used FRAMES_IN_FLIGHT
+	// frames ago, that frame has to be done
+	WaitForCompute(m_simFenceValues[slot]);
+
+	ThrowIfFailed(m_computeAllocators[slot]->Reset());
 	ThrowIfFailed(m_computeCommandList->Reset(
-		m_computeAllocator.Get(), m_particleSystem.GetPsoClear().Get()));
+		m_computeAllocators[slot].Get(), m_particleSystem.GetPsoClear().Get()));
+	m_particleSystem.BeginFrame(slot);
+	m_particleSystem.SetMeshCamera(m_camera.GetCameraPos());
 
-	// dispatch gpu commands
-	m_particleSystem.DispatchGPUCommands(m_computeCommandList.Get(), dt);
+	if (m_cachePlayer)
+	{
+		// the cached frame is in m_particles already, upload it like the cpu
+		// solver's and only mesh it
+		m_particleSystem.DispatchInit(m_computeCommandList.Get(), dt);
+		m_particleSystem.DispatchPrediction(m_computeCommandList.Get(), 0.0f);
+	}
+	else
+	{
+#if CPU_SOLVER
+		// solve on the cpu, then only upload the particles (dt = 0 skips the prediction kernel)
+		// so marching cubes sees the same input as on the gpu path. the gpu meshes
+		// this frame while the cpu solves the next one
+		for (int i = 0; i < steps; i++)
+		{
+			m_particleSystem.DispatchCPUCommands(dt);
+			if (i == steps - 1)
+			{
+				m_particleSystem.DispatchInit(m_computeCommandList.Get(), dt);
+				m_particleSystem.DispatchPrediction(m_computeCommandList.Get(), 0.0f);
+			}
+			m_particleSystem.UpdatePBD(dt, m_computeCommandList.Get());
+		}
+#else
+		for (int i = 0; i < steps; i++)
+			m_particleSystem.DispatchGPUCommands(m_computeCommandList.Get(), dt);
+#endif
+	}
 	m_particleSystem.DispatchMarchingCubes(m_computeCommandList.Get());
+	m_particleSystem.DispatchSDF(m_computeCommandList.Get());
 	m_particleSystem.CopyBackResources(m_computeCommandList.Get());
 
-	// close, execute, and wait
+	// close and execute, RetireSimulationFrame picks the results up later
 	ThrowIfFailed(m_computeCommandList->Close());
 	ID3D12CommandList* lists[] = { m_computeCommandList.Get() };
 	m_computeCommandQueue->ExecuteCommandLists(1, lists);
@@ -66,40 +165,137 @@ void D3D12Renderer::OnUpdate()
 	m_computeFenceValue++;
 	ThrowIfFailed(m_computeCommandQueue->Signal(
 		m_computeFence.Get(), m_computeFenceValue));
-	ThrowIfFailed(m_computeFence->SetEventOnCompletion(
-		m_computeFenceValue, m_fenceEvent));
-	WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
+	m_simFenceValues[slot] = m_computeFenceValue;
+	m_simTime += steps * dt;
+	m_simFrameTimes[slot] = m_simTime;
+	m_simFramesSubmitted++;
+}
 
-	m_particleSystem.ReadbackParticleData(m_computeCommandList.Get());
-	m_particleSystem.UpdatePBD(dt, m_computeCommandList.Get());
+void D3D12Renderer::RetireSimulationFrame(bool submitted)
+{
+	if (m_simFramesSubmitted == 0) return;
 
-	m_particleSystem.ReadbackVertexData(m_computeCommandList.Get());
+	// right after a submit, wait for the frame before it, it's had a whole
+	// frame of cpu time to finish. otherwise take the newest if it's done
+	UINT64 frame;
+	if (submitted)
+	{
+		if (m_simFramesSubmitted < 2) return;
+		frame = m_simFramesSubmitted - 2;
+	}
+	else
+	{
+		frame = m_simFramesSubmitted - 1;
+		UINT newest = (UINT)(frame % ParticleSystem::FRAMES_IN_FLIGHT);
+		if (m_computeFence->GetCompletedValue() < m_simFenceValues[newest]) return;
+	}
+	if (frame < m_simFramesRetired) return;     // already showing it
 
-	auto& verts = m_particleSystem.m_vertices;
-	UINT vertCount = (UINT)verts.size();
-	if (vertCount > 0 && vertCount <= m_mcMaxVertices)
+	const UINT slot = (UINT)(frame % ParticleSystem::FRAMES_IN_FLIGHT);
+	WaitForCompute(m_simFenceValues[slot]);
+	m_simFramesRetired = frame + 1;
+
+#if !CPU_SOLVER && !MARCHING_CUBES
+	// the instanced spheres need the particles on the host, the mesh doesn't
+	m_particleSystem.ReadbackParticleData(slot);
+	m_particleSystem.UpdateInstances();
+#endif
+
+	// the cpu solver's m_particles is already a frame or two further, so
+	// this goes through its own store. frames dropped by a mesh overflow
+	// below are missing from the cache, the index times show the gap
+	if (m_cacheWriter)
 	{
-		Vertex* mapped = nullptr;
-		CD3DX12_RANGE readRange(0, 0);
-		m_mcVertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&mapped));
-		memcpy(mapped, verts.data(), vertCount * sizeof(Vertex));
-		m_mcVertexBuffer->Unmap(0, nullptr);
+		m_particleSystem.ReadbackParticleData(slot, m_cacheParticles);
+		m_cacheWriter->Append(m_cacheParticles, m_simFrameTimes[slot]);
 	}
-	m_mcVertexCount = vertCount;
 
-	// printf("Vertex count: %u\n", vertCount);
+	// draw straight from the slot's buffer, the vertices never come back to the cpu.
+	// with three slots compute is at most writing frame+2's, never this one
+	m_mcIndexCount = m_particleSystem.ReadbackIndexCount(slot);
 
-	static float fpsTimer = 0.0f;
-	fpsTimer += dt;
-	if (fpsTimer >= 0.5f)  // update twice per second so it's readable
+	// the surface needed more than the mesh buffers hold, this frame came out
+	// short. grow them once nothing uses the old ones anymore. every mesh in
+	// flight goes with them, so show nothing until the next frame is done
+	if (m_particleSystem.MeshOverflowed(slot))
 	{
-		char buf[64];
-		sprintf_s(buf, "%.2f ms  |  %.0f fps", dt * 1000.0f, 1.0f / dt);
-		SetCustomWindowText(std::wstring(buf, buf + strlen(buf)).c_str());
-		fpsTimer = 0.0f;
+		WaitForCompute(m_computeFenceValue);
+		WaitForGPU();
+		m_particleSystem.GrowMeshBuffers(m_device.Get(), slot);
+		m_simFramesRetired = m_simFramesSubmitted;
+		m_mcIndexCount = 0;
+	}
+	else if (m_meshExporter)
+	{
+		// a short mesh isn't worth writing, an overflowed frame leaves a gap
+		// in the numbering. a full queue holds the whole renderer up here
+		m_particleSystem.ReadbackVertexData(slot, m_exportVertices, m_exportIndices);
+		m_meshExporter->Submit(frame, m_exportVertices, m_exportIndices);
+	}
+
+	m_mcMaxVertices = m_particleSystem.GetMCVertexCapacity();
+	m_mcVertexBufferView.BufferLocation = m_particleSystem.GetMCDrawVertexBuffer(slot)->GetGPUVirtualAddress();
+	m_mcVertexBufferView.SizeInBytes = m_mcMaxVertices * m_particleSystem.MC_VERTEX_STRIDE;
+	m_mcIndexBufferView.BufferLocation = m_particleSystem.GetMCDrawIndexBuffer(slot)->GetGPUVirtualAddress();
+	m_mcIndexBufferView.SizeInBytes = m_particleSystem.GetMCTriCapacity() * 3 * sizeof(UINT);
+}
+
+int D3D12Renderer::UpdatePlayback(float frameTime)
+{
+	// real time through the recording, looping at the end
+	const double first = m_cache->GetTime(0);
+	const double last = m_cache->GetTime(m_cache->GetNumFrames() - 1);
+	if (!m_playPaused)
+		m_playTime += frameTime;
+	if (m_playTime > last) m_playTime = first + (m_playTime - last);
+	if (m_playTime < first) m_playTime = first;
+
+	int frame = m_cache->FrameAt(m_playTime);
+	if (frame == m_playFrame) return 0;
+	m_playFrame = frame;
+	m_particleSystem.LoadPlaybackFrame(m_cachePlayer->Get(frame));
+
+#if MARCHING_CUBES
+	return 1;
+#else
+	// straight into the instance buffer, there's nothing to compute
+	m_particleSystem.UpdateInstances();
+	return 0;
+#endif
+}
+
+void D3D12Renderer::OnPlaybackKey(UINT8 key)
+{
+	// space pauses, left/right scrub a second (one frame while paused), home rewinds
+	switch (key)
+	{
+	case VK_SPACE:
+		m_playPaused = !m_playPaused;
+		break;
+	case VK_LEFT:
+		if (!m_playPaused) m_playTime -= 1.0;
+		else if (m_playFrame > 0) m_playTime = m_cache->GetTime(m_playFrame - 1);
+		break;
+	case VK_RIGHT:
+		if (!m_playPaused) m_playTime += 1.0;
+		else if (m_playFrame + 1 < m_cache->GetNumFrames()) m_playTime = m_cache->GetTime(m_playFrame + 1);
+		break;
+	case VK_HOME:
+		m_playTime = m_cache->GetTime(0);
+		break;
 	}
 }
 
+void D3D12Renderer::WaitForCompute(UINT64 fenceValue)
+{
+	if (m_computeFence->GetCompletedValue() >= fenceValue) return;
+
+	auto start = std::chrono::steady_clock::now();
+	ThrowIfFailed(m_computeFence->SetEventOnCompletion(fenceValue, m_fenceEvent));
+	WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
+	m_computeWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
 void D3D12Renderer::OnRender()
 {
 	// add all the rendering commands into our command list...
@@ -118,8 +314,15 @@ void D3D12Renderer::OnRender()
 void D3D12Renderer::OnDestroy()
 {
 	// make sure we wait so we don't reference destroyed resources on the GPU
+	WaitForCompute(m_computeFenceValue);
 	WaitForGPU();
 
+	// whatever's still queued goes to disk before we're gone
+	if (m_meshExporter)
+		m_meshExporter->Finish();
+	if (m_cacheWriter)
+		m_cacheWriter->Finish();
+
 	CloseHandle(m_fenceEvent);
 }
 
@@ -221,7 +424,7 @@ void D3D12Renderer::LoadAssets()
         m_device.Get(),
         GetAssetFullPath(L"particles.hlsl"),
 		GetAssetFullPath(L"marchingCubes.hlsl"),
-        m_computeAllocator,
+        m_computeAllocators,
         m_computeCommandList);
 
 	CreateBuffers();
@@ -283,16 +486,28 @@ void D3D12Renderer::CreateGraphicsPipeline()
 #endif
 
 #if MARCHING_CUBES
-	ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, nullptr, "VSMain", "vs_5_0", compileFlags, 0, &vertexShader, nullptr));
+	// mc_compact_vertices: the mesh is PackedVertex (VertexCodec.h), VSMainPacked decodes it
+	const bool compactVertices = m_particleSystem.GetConfig().mcCompactVertices;
+	const char* vsEntry = compactVertices ? "VSMainPacked" : "VSMain";
+	ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, nullptr, vsEntry, "vs_5_0", compileFlags, 0, &vertexShader, nullptr));
 	ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, nullptr, "PSMain", "ps_5_0", compileFlags, 0, &pixelShader, nullptr));
 
 	// define vertex input layout
-	// needs to be consistent with Vertex struct in SphereMesh.h
-	D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
+	// needs to be consistent with Vertex struct in stdafx.h
+	D3D12_INPUT_ELEMENT_DESC floatElementDescs[] =
 	{
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
+	// and with PackedVertex
+	D3D12_INPUT_ELEMENT_DESC packedElementDescs[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
+	D3D12_INPUT_LAYOUT_DESC inputLayout = compactVertices
+		? D3D12_INPUT_LAYOUT_DESC{ packedElementDescs, _countof(packedElementDescs) }
+		: D3D12_INPUT_LAYOUT_DESC{ floatElementDescs, _countof(floatElementDescs) };
 #else
 	ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"instance_shaders.hlsl").c_str(), nullptr, nullptr, "VSMain", "vs_5_0", compileFlags, 0, &vertexShader, nullptr));
 	ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"instance_shaders.hlsl").c_str(), nullptr, nullptr, "PSMain", "ps_5_0", compileFlags, 0, &pixelShader, nullptr));
@@ -311,6 +526,7 @@ void D3D12Renderer::CreateGraphicsPipeline()
 		{ "INSTANCE_TRANSFORM", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
 		{ "INSTANCE_TRANSFORM", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
 	};
+	D3D12_INPUT_LAYOUT_DESC inputLayout = { inputElementDescs, _countof(inputElementDescs) };
 #endif
 
 	// depth stencil buffer
@@ -349,7 +565,7 @@ void D3D12Renderer::CreateGraphicsPipeline()
 
 	// describe the graphics pipeline state object (PSO)
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-	psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
+	psoDesc.InputLayout = inputLayout;
 	psoDesc.pRootSignature = m_rootSignature.Get();
 	psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader.Get());
 	psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShader.Get());
@@ -488,25 +704,29 @@ void D3D12Renderer::CreateBuffers()
 		m_particleSystem.m_instancer.m_instanceBufferView.SizeInBytes = instanceBufferSize;
 	}
 
-	// create the vertex buffer
+	// vertex buffer view for the mesh. the buffers themselves are the
+	// particle system's per-frame draw buffers, RetireSimulationFrame points
+	// the view at the newest finished one
 	{
-		const UINT maxMCVerts = m_particleSystem.MC_MAX_TRIS * 3;
+		// sizes change when the particle system grows the buffers
+		const UINT maxMCVerts = m_particleSystem.GetMCVertexCapacity();
 		m_mcMaxVertices = maxMCVerts;
-		const UINT bufferSize = maxMCVerts * sizeof(Vertex);
 
-		CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
-		CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(bufferSize);
-		ThrowIfFailed(m_device->CreateCommittedResource(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&bufferDesc,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&m_mcVertexBuffer)));
-
-		m_mcVertexBufferView.BufferLocation = m_mcVertexBuffer->GetGPUVirtualAddress();
-		m_mcVertexBufferView.StrideInBytes = sizeof(Vertex);
-		m_mcVertexBufferView.SizeInBytes = bufferSize;
+		m_mcVertexBufferView.BufferLocation = 0;
+		m_mcVertexBufferView.StrideInBytes = m_particleSystem.MC_VERTEX_STRIDE;
+		m_mcVertexBufferView.SizeInBytes = maxMCVerts * m_particleSystem.MC_VERTEX_STRIDE;
+
+		// the box PackedVertex positions are relative to, see VertexQuantizer
+		const SimulationConfig& config = m_particleSystem.GetConfig();
+		float3 origin = config.GetMCOrigin();
+		float cellSize = config.GetMCCellSize();
+		m_cbData.meshOrigin = XMFLOAT3(origin.x, origin.y, origin.z);
+		m_cbData.meshExtent = XMFLOAT3(config.mcDimX * cellSize, config.mcDimY * cellSize, config.mcDimZ * cellSize);
+
+		// welded mesh, the triangles index into the vertices above
+		m_mcIndexBufferView.BufferLocation = 0;
+		m_mcIndexBufferView.Format = DXGI_FORMAT_R32_UINT;
+		m_mcIndexBufferView.SizeInBytes = m_particleSystem.GetMCTriCapacity() * 3 * sizeof(UINT);
 	}
 
 }
@@ -526,16 +746,10 @@ void D3D12Renderer::PopulateCommandList()
 	m_commandList->RSSetScissorRects(1, &m_scissorRect);
 	m_commandList->SetGraphicsRootConstantBufferView(0, m_constantBuffer->GetGPUVirtualAddress());
 
-	// resource barrier for vertex buffer
+	// resource barrier for the back buffer. the mesh draw buffer needs none,
+	// it's promoted from COMMON, and the compute queue's own buffers are never
+	// touched here since compute runs ahead of this queue now
 	CD3DX12_RESOURCE_BARRIER preDraw[] = {
-		CD3DX12_RESOURCE_BARRIER::Transition(
-			m_particleSystem.GetMCVertexBuffer(),
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-			D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER),
-		CD3DX12_RESOURCE_BARRIER::Transition(
-			m_particleSystem.GetMCArgBuffer(),
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-			D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
 		CD3DX12_RESOURCE_BARRIER::Transition(
 			m_renderTargets[m_frameIndex].Get(),
 			D3D12_RESOURCE_STATE_PRESENT,
@@ -555,7 +769,8 @@ void D3D12Renderer::PopulateCommandList()
 #if MARCHING_CUBES
 	m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	m_commandList->IASetVertexBuffers(0, 1, &m_mcVertexBufferView);
-	m_commandList->DrawInstanced(m_mcVertexCount, 1, 0, 0);
+	m_commandList->IASetIndexBuffer(&m_mcIndexBufferView);
+	m_commandList->DrawIndexedInstanced(m_mcIndexCount, 1, 0, 0, 0);
 #else
 	// indexed draw
 	m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -567,14 +782,6 @@ void D3D12Renderer::PopulateCommandList()
 
 	// transition back resources
 	CD3DX12_RESOURCE_BARRIER postDraw[] = {
-		CD3DX12_RESOURCE_BARRIER::Transition(
-			m_particleSystem.GetMCVertexBuffer(),
-			D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
-		CD3DX12_RESOURCE_BARRIER::Transition(
-			m_particleSystem.GetMCArgBuffer(),
-			D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
 		CD3DX12_RESOURCE_BARRIER::Transition(
 			m_renderTargets[m_frameIndex].Get(),
 			D3D12_RESOURCE_STATE_RENDER_TARGET,
@@ -4,12 +4,19 @@
 #include "Camera.h"
 #include "ParticleSystem.h"
 #include "Instancer.h"
+#include "FixedStepScheduler.h"
+#include "MeshExporter.h"
+#include "ParticleCache.h"
+#include "CachePlayer.h"
+
+#include <memory>
 
 using namespace DirectX;
 
 using Microsoft::WRL::ComPtr;
 
 #define MARCHING_CUBES true
+#define CPU_SOLVER false     // run the pbf solver on the cpu, the gpu only does marching cubes + drawing
 
 class D3D12Renderer : public DXApplication {
 public:
@@ -98,20 +105,51 @@ private:
     void MoveToNextFrame();
     void WaitForGPU();
 
+    // simulation frames in flight, see SubmitSimulationFrame
+    void SubmitSimulationFrame(int steps, float dt);
+    void RetireSimulationFrame(bool submitted);
+    void WaitForCompute(UINT64 fenceValue);
+
     // ----- Compute stuff -----
     // move all this to a different compute class later
-    ComPtr<ID3D12CommandAllocator> m_computeAllocator;
+    ComPtr<ID3D12CommandAllocator> m_computeAllocators[ParticleSystem::FRAMES_IN_FLIGHT];
     ComPtr<ID3D12CommandQueue> m_computeCommandQueue;
     ComPtr<ID3D12GraphicsCommandList> m_computeCommandList;
 
     ComPtr<ID3D12Fence> m_computeFence;
     UINT64 m_computeFenceValue = 0;
 
+    // frame n uses ring slot n % FRAMES_IN_FLIGHT, m_simFenceValues says when it's done
+    UINT64 m_simFenceValues[ParticleSystem::FRAMES_IN_FLIGHT] = {};
+    UINT64 m_simFramesSubmitted = 0;
+    UINT64 m_simFramesRetired = 0;
+    double m_computeWaitSeconds = 0.0;      // host time blocked on the compute fence this frame
+    double m_simTime = 0.0;                 // simulated seconds up to the last submitted frame
+    double m_simFrameTimes[ParticleSystem::FRAMES_IN_FLIGHT] = {};     // m_simTime of the frame in each slot
+
     // marching cubes
-    ComPtr<ID3D12Resource> m_mcVertexBuffer;
     D3D12_VERTEX_BUFFER_VIEW m_mcVertexBufferView;
+    D3D12_INDEX_BUFFER_VIEW m_mcIndexBufferView;
     UINT m_mcMaxVertices = 0;
-    UINT m_mcVertexCount = 0;
+    UINT m_mcIndexCount = 0;
+
+    // mesh_export_dir, fed by RetireSimulationFrame
+    std::unique_ptr<MeshExporter> m_meshExporter;
+    std::vector<MCVertex> m_exportVertices;     // reused between frames
+    std::vector<uint32_t> m_exportIndices;
+
+    // cache_record, also fed by RetireSimulationFrame
+    std::unique_ptr<ParticleCacheWriter> m_cacheWriter;
+    ParticleStore m_cacheParticles;     // m_particles may be ahead of the frame being retired
+
+    // cache_play: the cache stands in for the solver, see UpdatePlayback
+    std::unique_ptr<ParticleCache> m_cache;
+    std::unique_ptr<CachePlayer> m_cachePlayer;
+    double m_playTime = 0.0;        // playhead in recorded seconds
+    int m_playFrame = -1;           // the one in m_particles
+    bool m_playPaused = false;
+    int UpdatePlayback(float frameTime);    // 1 if a new frame needs meshing
+    void OnPlaybackKey(UINT8 key);
 
     // ----- Camera stuff -----
     ComPtr<ID3D12Resource> m_constantBuffer;
@@ -120,10 +158,12 @@ private:
     VPConstantBuffer m_cbData;
 
     Camera m_camera;
-    UINT64 m_lastFrameTime = 0;
+
+    // wall clock -> fixed solver steps
+    FixedStepScheduler m_scheduler;
 
     // ----- controls -----
-    void D3D12Renderer::OnKeyDown(UINT8 key) { m_camera.OnKeyDown(key); }
+    void D3D12Renderer::OnKeyDown(UINT8 key) { m_camera.OnKeyDown(key); if (m_cachePlayer) OnPlaybackKey(key); }
     void D3D12Renderer::OnKeyUp  (UINT8 key) { m_camera.OnKeyUp(key);   }
     void D3D12Renderer::OnMouseMove(int dx, int dy) { m_camera.OnMouseMove(dx, dy); }
 };
\ No newline at end of file
@@ -129,5 +129,9 @@ void DXApplication::ParseCommandLineArgs(WCHAR* argv[], int argc)
             m_useWarpDevice = true;
             m_title = m_title + L" (WARP)";
         }
+        else if ((_wcsicmp(argv[i], L"-config") == 0 || _wcsicmp(argv[i], L"/config") == 0) && i + 1 < argc)
+        {
+            m_configPath = argv[++i];
+        }
     }
 }
@@ -45,6 +45,9 @@ protected:
     // Adapter info.
     bool m_useWarpDevice;
 
+    // -config <file>, empty = built-in SimulationConfig defaults
+    std::wstring m_configPath;
+
 private:
     // Root assets path.
     std::wstring m_assetsPath;
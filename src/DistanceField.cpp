@@ -0,0 +1,169 @@
+#include "DistanceField.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const int CELL_GRAIN = 1024;
+
+void DistanceField::Configure(float3 origin, float cellSize, int3 dim, int band, float radius)
+{
+    m_origin = origin;
+    m_cellSize = cellSize;
+    m_dim = dim;
+    m_band = std::max(band, 1);
+    m_radius = radius;
+
+    m_grid.Configure(origin, cellSize, dim);
+    int numCells = GetNumCells();
+    m_seed.resize(numCells);
+    m_flooded.resize(numCells);
+    m_distance.resize(numCells);
+}
+
+// largest power of two within the band down to 1, then 1 again (jfa+1),
+// which catches most of what the big steps got wrong
+std::vector<int> DistanceField::FloodSteps(int band)
+{
+    int first = 1;
+    while (first * 2 <= band)
+        first *= 2;
+
+    std::vector<int> steps;
+    for (int step = first; step >= 1; step /= 2)
+        steps.push_back(step);
+    steps.push_back(1);
+    return steps;
+}
+
+// CSSDFFlood, once per step. m_seed holds the result afterwards
+void DistanceField::Flood(ThreadPool& pool)
+{
+    const int3 dim = m_dim;
+    for (int step : FloodSteps(m_band)) {
+        pool.ParallelFor(GetNumCells(), CELL_GRAIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int x = i % dim.x, y = (i / dim.x) % dim.y, z = i / (dim.x * dim.y);
+                float3 center = CellCenter(x, y, z);
+
+                Seed best = m_seed[i];
+                float bestScore = best.w >= 0.0f ? length(center - best.p) - best.w : 0.0f;
+
+                for (int dz = -1; dz <= 1; dz++)
+                for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++) {
+                    int nx = x + dx * step, ny = y + dy * step, nz = z + dz * step;
+                    if (nx < 0 || ny < 0 || nz < 0 || nx >= dim.x || ny >= dim.y || nz >= dim.z) continue;
+
+                    const Seed& s = m_seed[CellIndex(nx, ny, nz)];
+                    if (s.w < 0.0f) continue;
+                    float score = length(center - s.p) - s.w;
+                    if (best.w < 0.0f || score < bestScore) {
+                        best = s;
+                        bestScore = score;
+                    }
+                }
+                m_flooded[i] = best;
+            }
+        });
+        m_seed.swap(m_flooded);
+    }
+}
+
+void DistanceField::Build(ThreadPool& pool, const Float3Stream& points, int count)
+{
+    const int3 dim = m_dim;
+    const int numCells = GetNumCells();
+    const float bandWidth = GetBandWidth();
+
+    m_grid.Build(pool, points, count);
+    const std::vector<int>& order = m_grid.GetSortedOrder();
+
+    // CSSDFSeed
+    pool.ParallelFor(numCells, CELL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int3 c = { i % dim.x, (i / dim.x) % dim.y, i / (dim.x * dim.y) };
+            float3 center = CellCenter(c.x, c.y, c.z);
+
+            Seed seed = { { 0.0f, 0.0f, 0.0f }, -1.0f };
+            float bestDist = 0.0f;
+            m_grid.ForEachCellInBox(c, c, [&](int start, int n) {
+                for (int s = start; s < start + n; s++) {
+                    float3 p = points.Get(order[s]);
+                    float d = length(center - p);
+                    if (seed.w < 0.0f || d < bestDist) {
+                        seed = { p, 0.0f };
+                        bestDist = d;
+                    }
+                }
+            });
+            m_seed[i] = seed;
+        }
+    });
+    Flood(pool);
+
+    // CSSDFOutside: the outside distance goes into m_distance for now, the
+    // cells it puts outside seed the inside flood.
+    // a cell only passes on one particle, the one closest to its own center,
+    // so the flooded seed is near the answer but often not it. the nearest
+    // particle is almost always in the 27 cells around the seed
+    pool.ParallelFor(numCells, CELL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float3 center = CellCenter(i % dim.x, (i / dim.x) % dim.y, i / (dim.x * dim.y));
+            const Seed& s = m_seed[i];
+            float nearest = bandWidth + m_radius;
+            if (s.w >= 0.0f) {
+                nearest = length(center - s.p);
+                m_grid.ForEachNeighborCell(s.p, [&](int start, int n) {
+                    for (int k = start; k < start + n; k++)
+                        nearest = std::min(nearest, length(center - points.Get(order[k])));
+                });
+            }
+            float outside = nearest - m_radius;
+            m_distance[i] = outside;
+            m_seed[i] = outside > 0.0f ? Seed{ center, outside } : Seed{ { 0.0f, 0.0f, 0.0f }, -1.0f };
+        }
+    });
+    Flood(pool);
+
+    // CSSDFResolve
+    m_numBandCells = pool.ParallelReduce(numCells, CELL_GRAIN, 0, [&](int begin, int end) {
+        int inBand = 0;
+        for (int i = begin; i < end; i++) {
+            float outside = m_distance[i];
+            float d;
+            if (outside > 0.0f) {
+                d = std::min(outside, bandWidth);
+            } else {
+                // through the nearest outside cell, never shallower than the
+                // sphere the center sits in
+                float3 center = CellCenter(i % dim.x, (i / dim.x) % dim.y, i / (dim.x * dim.y));
+                const Seed& s = m_seed[i];
+                float inside = s.w >= 0.0f ? std::max(length(center - s.p) - s.w, 0.0f) : bandWidth;
+                d = std::max(std::min(outside, -inside), -bandWidth);
+            }
+            m_distance[i] = d;
+            inBand += std::fabs(d) < bandWidth;
+        }
+        return inBand;
+    }, [](int a, int b) { return a + b; });
+}
+
+float DistanceField::Sample(float3 pos) const
+{
+    float3 g = (pos - m_origin) / m_cellSize - float3{ 0.5f, 0.5f, 0.5f };
+    g = clamp(g, { 0.0f, 0.0f, 0.0f }, { (float)(m_dim.x - 1), (float)(m_dim.y - 1), (float)(m_dim.z - 1) });
+
+    int x0 = std::min((int)g.x, m_dim.x - 1), x1 = std::min(x0 + 1, m_dim.x - 1);
+    int y0 = std::min((int)g.y, m_dim.y - 1), y1 = std::min(y0 + 1, m_dim.y - 1);
+    int z0 = std::min((int)g.z, m_dim.z - 1), z1 = std::min(z0 + 1, m_dim.z - 1);
+    float fx = g.x - x0, fy = g.y - y0, fz = g.z - z0;
+
+    auto at = [&](int x, int y, int z) { return m_distance[CellIndex(x, y, z)]; };
+    float c00 = at(x0, y0, z0) + (at(x1, y0, z0) - at(x0, y0, z0)) * fx;
+    float c10 = at(x0, y1, z0) + (at(x1, y1, z0) - at(x0, y1, z0)) * fx;
+    float c01 = at(x0, y0, z1) + (at(x1, y0, z1) - at(x0, y0, z1)) * fx;
+    float c11 = at(x0, y1, z1) + (at(x1, y1, z1) - at(x0, y1, z1)) * fx;
+    float c0 = c00 + (c10 - c00) * fy;
+    float c1 = c01 + (c11 - c01) * fy;
+    return c0 + (c1 - c0) * fz;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+
+#include "ParticleStore.h"
+#include "SimMath.h"
+#include "ThreadPool.h"
+#include "UniformGrid.h"
+
+// narrow band signed distance to the fluid, one value per neighbor search
+// cell (m_nsSDFVolume on the gpu, same layout as cellStart). cpu version of
+// the CSSDF* kernels in shaders/particles.hlsl.
+//
+// the fluid is the union of spheres of the given radius around the particles.
+// both sides are found with jump flooding: every cell keeps the best seed
+// seen so far and looks at its 26 neighbors step cells away, step halving
+// down to 1 plus one more pass at 1. starting at the band width that reaches
+// far enough, so the floods cost a handful of passes no matter how big the
+// box is.
+//
+//   1. seed: every cell takes the particle inside it closest to its center
+//   2. flood the particles, then the nearest particle in the 27 cells around
+//      the one that arrived -> outside distance, |center - p| - radius
+//   3. seed: every cell outside with its center and that distance
+//   4. flood those -> inside distance, |center - q| - distance(q)
+//
+// anything further than band cells from the surface is clamped to
+// +-band * cellSize, deep inside and far outside look the same as the edge
+// of the band. values live at the cell centers.
+class DistanceField {
+public:
+    // band in cells
+    void Configure(float3 origin, float cellSize, int3 dim, int band, float radius);
+
+    void Build(ThreadPool& pool, const Float3Stream& points, int count);
+
+    int3 GetDim() const { return m_dim; }
+    int GetNumCells() const { return m_dim.x * m_dim.y * m_dim.z; }
+    int CellIndex(int x, int y, int z) const { return x + y * m_dim.x + z * m_dim.x * m_dim.y; }
+    float GetBandWidth() const { return (float)m_band * m_cellSize; }
+
+    float GetValue(int cell) const { return m_distance[cell]; }
+    const std::vector<float>& GetValues() const { return m_distance; }
+
+    // trilinear between the cell centers, clamped to the grid
+    float Sample(float3 pos) const;
+
+    // cells with |distance| inside the band
+    int GetNumBandCells() const { return m_numBandCells; }
+
+    // the flood's step sizes for a band, the gpu dispatches the same ones
+    static std::vector<int> FloodSteps(int band);
+
+private:
+    // best seed so far, w < 0 is none. the flood picks the smallest |center - p| - w
+    struct Seed {
+        float3 p;
+        float w;
+    };
+
+    void Flood(ThreadPool& pool);
+    float3 CellCenter(int x, int y, int z) const
+    {
+        return m_origin + float3{ x + 0.5f, y + 0.5f, z + 0.5f } * m_cellSize;
+    }
+
+    float3 m_origin = { 0.0f, 0.0f, 0.0f };
+    float m_cellSize = 1.0f;
+    int3 m_dim = { 0, 0, 0 };
+    int m_band = 3;
+    float m_radius = 0.5f;
+
+    UniformGrid m_grid;
+    std::vector<Seed> m_seed;       // flood input
+    std::vector<Seed> m_flooded;    // and output, swapped every pass
+    std::vector<float> m_distance;
+    int m_numBandCells = 0;
+};
@@ -0,0 +1,57 @@
+#include "FixedStepScheduler.h"
+
+FixedStepScheduler::FixedStepScheduler(float fixedDt, int maxSubsteps)
+{
+    SetFixedDt(fixedDt);
+    SetMaxSubsteps(maxSubsteps);
+}
+
+void FixedStepScheduler::SetFixedDt(float fixedDt)
+{
+    m_fixedDt = fixedDt > 0.0f ? fixedDt : 1.0f / 60.0f;
+}
+
+void FixedStepScheduler::SetMaxSubsteps(int maxSubsteps)
+{
+    m_maxSubsteps = maxSubsteps > 0 ? maxSubsteps : 1;
+}
+
+int FixedStepScheduler::Advance()
+{
+    Clock::time_point now = Clock::now();
+    if (!m_started) {
+        m_started = true;
+        m_last = now;
+        m_frameTime = 0.0;
+        return 0;
+    }
+
+    double elapsed = std::chrono::duration<double>(now - m_last).count();
+    m_last = now;
+    return AdvanceBy(elapsed);
+}
+
+int FixedStepScheduler::AdvanceBy(double elapsedSeconds)
+{
+    if (elapsedSeconds < 0.0) elapsedSeconds = 0.0;
+    m_frameTime = elapsedSeconds;
+    m_accumulator += elapsedSeconds;
+
+    // counted in whole steps so float drift can't make the accumulator creep
+    long long steps = (long long)(m_accumulator / m_fixedDt);
+    m_accumulator -= steps * (double)m_fixedDt;
+
+    if (steps > m_maxSubsteps) {
+        double dropped = (steps - m_maxSubsteps) * (double)m_fixedDt;
+        m_stats.droppedSeconds += dropped;
+        m_stats.cappedFrames++;
+        steps = m_maxSubsteps;
+    }
+
+    m_stats.frames++;
+    m_stats.steps += steps;
+    m_stats.simulatedSeconds += steps * (double)m_fixedDt;
+    if (steps > m_stats.maxStepsInFrame) m_stats.maxStepsInFrame = (int)steps;
+
+    return (int)steps;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+
+// turns variable frame times into a whole number of fixed solver steps.
+// wall time goes into an accumulator, every full fixedDt in it is one step.
+// when a frame would need more than maxSubsteps (a hitch, a breakpoint, a
+// window drag) the extra time is thrown away instead of being paid back
+// later, so one frame never costs more than maxSubsteps solver steps.
+// dropped time is counted so it shows up in the stats instead of silently
+// slowing the simulation down.
+class FixedStepScheduler {
+public:
+    struct Stats {
+        unsigned long long frames = 0;
+        unsigned long long steps = 0;
+        unsigned long long cappedFrames = 0;    // frames that hit maxSubsteps and dropped time
+        double simulatedSeconds = 0.0;
+        double droppedSeconds = 0.0;
+        int maxStepsInFrame = 0;
+    };
+
+    explicit FixedStepScheduler(float fixedDt = 1.0f / 60.0f, int maxSubsteps = 4);
+
+    void SetFixedDt(float fixedDt);
+    void SetMaxSubsteps(int maxSubsteps);
+    float GetFixedDt() const { return m_fixedDt; }
+    int GetMaxSubsteps() const { return m_maxSubsteps; }
+
+    // call once per frame. measures the time since the last call on
+    // steady_clock and returns how many fixed steps to run now. the very first
+    // call only starts the clock and returns 0.
+    int Advance();
+
+    // same with an externally measured frame time, in seconds
+    int AdvanceBy(double elapsedSeconds);
+
+    // wall time of the last frame, for the camera and the fps counter
+    double GetFrameTime() const { return m_frameTime; }
+
+    // leftover fraction of a step, [0, 1), for interpolating between states
+    double GetAlpha() const { return m_accumulator / m_fixedDt; }
+
+    const Stats& GetStats() const { return m_stats; }
+    void ResetStats() { m_stats = Stats(); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    float m_fixedDt;
+    int m_maxSubsteps;
+    double m_accumulator = 0.0;
+    double m_frameTime = 0.0;
+
+    bool m_started = false;
+    Clock::time_point m_last;
+
+    Stats m_stats;
+};
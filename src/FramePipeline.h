@@ -0,0 +1,156 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+// cpu version of the frames-in-flight scheme D3D12Renderer uses on the gpu.
+// a ring of K frame slots: the main thread fills slot N % K (simulate) and
+// submits it, a stage thread works on it in the background (readback/mesh),
+// and some frames later the main thread retires it (present). the stage only
+// ever touches submitted slots and the main thread only touches slots it
+// hasn't submitted or already retired, so the two never share a slot.
+//
+//   main:   simulate(N+1)   present(N-1)
+//   stage:  mesh(N)
+//
+// the completed counter plays the role of the compute fence: frame n is done
+// with the stage once GetCompletedValue() > n. with K = 1 every Retire waits
+// on the frame just submitted, which is the old serial loop.
+template <typename Frame>
+class FramePipeline {
+public:
+    using Stage = std::function<void(Frame& frame, unsigned long long frameIndex)>;
+
+    FramePipeline(int framesInFlight, Stage stage)
+        : m_size(framesInFlight > 0 ? framesInFlight : 1), m_stage(std::move(stage))
+    {
+        m_slots.reset(new Frame[m_size]);
+        m_thread = std::thread([this] { StageLoop(); });
+    }
+
+    // lets the stage finish what was submitted, unretired frames are dropped
+    ~FramePipeline()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    int GetFramesInFlight() const { return m_size; }
+
+    // for allocating the slots up front
+    Frame& GetSlot(int i) { return m_slots[i]; }
+
+    // submitted but not retired yet
+    int GetPending() const { return (int)(m_submitted - m_retired); }
+    bool IsFull() const { return GetPending() == m_size; }
+
+    // slot for the next frame. every slot still in flight is an error, Retire first
+    Frame& Begin()
+    {
+        if (IsFull())
+            throw std::logic_error("FramePipeline::Begin with every slot in flight");
+        return m_slots[m_submitted % m_size];
+    }
+
+    // hands the slot from Begin to the stage thread
+    void Submit()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_submitted++;
+        }
+        m_wake.notify_one();
+    }
+
+    // waits for the stage to finish the oldest pending frame and returns it.
+    // the slot stays valid until it comes around in Begin again
+    Frame& Retire()
+    {
+        if (GetPending() == 0)
+            throw std::logic_error("FramePipeline::Retire with nothing in flight");
+
+        unsigned long long frame = m_retired;
+        {
+            auto start = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [&] { return m_completed > frame; });
+            m_waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        m_retired++;
+        return m_slots[frame % m_size];
+    }
+
+    unsigned long long GetCompletedValue() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_completed;
+    }
+
+    unsigned long long GetRetiredCount() const { return m_retired; }
+
+    // time the main thread spent blocked in Retire, and the stage spent working
+    double GetWaitSeconds() const { return m_waitSeconds; }
+    double GetStageSeconds() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stageSeconds;
+    }
+
+private:
+    void StageLoop()
+    {
+        while (true) {
+            unsigned long long frame;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this] { return m_quit || m_completed < m_submitted; });
+                if (m_completed == m_submitted) return;     // quit and nothing left
+                frame = m_completed;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            m_stage(m_slots[frame % m_size], frame);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_completed = frame + 1;
+                m_stageSeconds += seconds;
+            }
+            m_done.notify_all();
+        }
+    }
+
+    const int m_size;
+    std::unique_ptr<Frame[]> m_slots;
+    Stage m_stage;
+    std::thread m_thread;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    bool m_quit = false;
+
+    // frame counters, the slot of frame n is n % m_size.
+    // m_submitted and m_completed are shared with the stage thread (under the
+    // mutex), m_retired is main thread only
+    unsigned long long m_submitted = 0;
+    unsigned long long m_completed = 0;
+    unsigned long long m_retired = 0;
+
+    double m_waitSeconds = 0.0;
+    double m_stageSeconds = 0.0;
+};
@@ -0,0 +1,499 @@
+#include "LodSurface.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const int LOD_SLAB = (ScalarField::BLOCK_SIZE + 1) * (ScalarField::BLOCK_SIZE + 1) * (ScalarField::BLOCK_SIZE + 1);
+
+// most directed triangle sides one face fill looks at: 5 triangles in the
+// coarse cell and in each of the 4 fine ones
+static const int LOD_FILL_SIDES = 5 * 3 * 5;
+
+static int& Coord(int3& v, int axis)
+{
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// the blocks with grid vertex c in their closed range, lo to hi per axis
+static void TouchingBlocks(const ScalarField& field, const int (&c)[3], int (&lo)[3], int (&hi)[3])
+{
+    const int B = ScalarField::BLOCK_SIZE;
+    const int3 blockDim = field.GetBlockDim();
+    const int bd[3] = { blockDim.x, blockDim.y, blockDim.z };
+    for (int axis = 0; axis < 3; axis++) {
+        hi[axis] = std::min(c[axis] / B, bd[axis] - 1);
+        lo[axis] = c[axis] > 0 && c[axis] % B == 0 ? std::min(c[axis] / B - 1, hi[axis]) : hi[axis];
+    }
+}
+
+// MarchingCubes' FieldGradient, on the full resolution field
+static float3 Gradient(const ScalarField& field, int x, int y, int z)
+{
+    float3 g = {
+        field.Sample(x + 1, y, z) - field.Sample(x - 1, y, z),
+        field.Sample(x, y + 1, z) - field.Sample(x, y - 1, z),
+        field.Sample(x, y, z + 1) - field.Sample(x, y, z - 1),
+    };
+    float len = length(g);
+    return len > 0.0f ? g / len : float3{ 0.0f, 0.0f, 0.0f };
+}
+
+int LodSurface::DesiredLevel(const ScalarField& field, int3 b, float3 camera, float distance, int levels)
+{
+    const int B = ScalarField::BLOCK_SIZE;
+    const int3 dim = field.GetDim();
+    if ((b.x + 1) * B > dim.x || (b.y + 1) * B > dim.y || (b.z + 1) * B > dim.z)
+        return 0;
+
+    float3 center = field.GetOrigin() + float3{ (b.x + 0.5f) * B, (b.y + 0.5f) * B, (b.z + 0.5f) * B } * field.GetCellSize();
+    float d = length(center - camera);
+    int level = 0;
+    while (level < levels && d >= distance * (float)(1 << level))
+        level++;
+    return level;
+}
+
+// every block -> the min or max of the 27 around it (those in the grid), one
+// axis at a time
+template <typename Op>
+static void Filter27(const ScalarField& field, std::vector<int>& values, std::vector<int>& scratch, Op op)
+{
+    const int3 blockDim = field.GetBlockDim();
+    const int dims[3] = { blockDim.x, blockDim.y, blockDim.z };
+    const int strides[3] = { 1, blockDim.x, blockDim.x * blockDim.y };
+
+    scratch.resize(values.size());
+    for (int axis = 0; axis < 3; axis++) {
+        for (int block = 0; block < (int)values.size(); block++) {
+            int c = block / strides[axis] % dims[axis];
+            int v = values[block];
+            if (c > 0) v = op(v, values[block - strides[axis]]);
+            if (c < dims[axis] - 1) v = op(v, values[block + strides[axis]]);
+            scratch[block] = v;
+        }
+        values.swap(scratch);
+    }
+}
+
+// a block can't be more than its distance (in blocks) above any other
+// block's wish, which is the 2:1 rule run to the end. only blocks within
+// levels of it can pull it down, so levels rounds of "at most one above the
+// lowest around" get there. m_around ends up the coarsest around
+void LodSurface::ComputeLevels(const ScalarField& field, float3 camera, float distance, int levels)
+{
+    const int numBlocks = field.GetNumBlocks();
+    auto lower = [](int a, int b) { return std::min(a, b); };
+    auto higher = [](int a, int b) { return std::max(a, b); };
+
+    m_level.resize(numBlocks);
+    for (int block = 0; block < numBlocks; block++)
+        m_level[block] = DesiredLevel(field, field.BlockCoord(block), camera, distance, levels);
+
+    for (int round = 0; round < levels; round++) {
+        m_around = m_level;
+        Filter27(field, m_around, m_scratch, lower);
+        for (int block = 0; block < numBlocks; block++)
+            m_level[block] = std::min(m_level[block], m_around[block] + 1);
+    }
+
+    m_around = m_level;
+    Filter27(field, m_around, m_scratch, higher);
+}
+
+// the coarsest block with (x, y, z) in its closed range decides. on its
+// lattice that's the field, anywhere else the point is on that block's face
+// or edge, between 2 or 4 of its lattice points, and takes their mean. those
+// are on the finer block's boundary too, 2:1 keeps anything coarser away
+// from them, so one step is enough
+float LodSurface::LodValue(const ScalarField& field, int x, int y, int z) const
+{
+    const int c[3] = { x, y, z };
+    int lo[3], hi[3];
+    TouchingBlocks(field, c, lo, hi);
+
+    int level = 0;
+    for (int bz = lo[2]; bz <= hi[2]; bz++)
+    for (int by = lo[1]; by <= hi[1]; by++)
+    for (int bx = lo[0]; bx <= hi[0]; bx++)
+        level = std::max(level, m_level[field.BlockIndex(bx, by, bz)]);
+
+    const int s = 1 << level;
+    int from[3], to[3];
+    for (int axis = 0; axis < 3; axis++) {
+        from[axis] = c[axis] - c[axis] % s;
+        to[axis] = c[axis] % s ? from[axis] + s : from[axis];
+    }
+
+    float sum = 0.0f;
+    int count = 0;
+    for (int pz = from[2]; pz <= to[2]; pz += s)
+    for (int py = from[1]; py <= to[1]; py += s)
+    for (int px = from[0]; px <= to[0]; px += s) {
+        sum += field.GetValue(field.VertexIndex(px, py, pz));
+        count++;
+    }
+    return sum / count;
+}
+
+// the blocks an edge is in are at two levels at most (2:1). if the coarser
+// ones have a lattice line along it, their edge is the one: the finer
+// blocks' halves of it give the same vertex, see LodValue. otherwise it's
+// between their lines, on their face, and only the finer blocks have it.
+// the vertex is made by the first of those blocks, upper side first like
+// ExtractSparse's owner, that's at the edge's level or finer. with all of
+// them at one level that's the owner itself
+LodSurface::Edge LodSurface::FileEdge(const ScalarField& field, int3 p, int axis) const
+{
+    const int c[3] = { p.x, p.y, p.z };
+    int lo[3], hi[3];
+    TouchingBlocks(field, c, lo, hi);
+    lo[axis] = hi[axis];    // along the edge, the block it runs into
+
+    int level = 0;
+    for (int bz = lo[2]; bz <= hi[2]; bz++)
+    for (int by = lo[1]; by <= hi[1]; by++)
+    for (int bx = lo[0]; bx <= hi[0]; bx++)
+        level = std::max(level, m_level[field.BlockIndex(bx, by, bz)]);
+
+    int length = 1 << level;
+    const int u = axis == 0 ? 1 : 0, w = axis == 2 ? 1 : 2;
+    if (c[u] % length || c[w] % length)
+        length >>= 1;
+
+    Edge e;
+    e.start = p;
+    Coord(e.start, axis) -= c[axis] % length;
+    e.length = length;
+    e.block = -1;
+    for (int bz = hi[2]; bz >= lo[2] && e.block < 0; bz--)
+    for (int by = hi[1]; by >= lo[1] && e.block < 0; by--)
+    for (int bx = hi[0]; bx >= lo[0] && e.block < 0; bx--) {
+        int block = field.BlockIndex(bx, by, bz);
+        if ((1 << m_level[block]) <= length) e.block = block;
+    }
+    return e;
+}
+
+// CSLodWeldBlocks + CSLodEmitBlocks for one block. the lattice has n + 1
+// points per side with n = 8 >> level (less for a block the grid cuts short,
+// those are always at 0). vertices come out in lattice order then axis like
+// ExtractSparse's slab, triangles in cell order, every cell's marching cubes
+// triangles then its face fills
+void LodSurface::PolygonizeBlock(const ScalarField& field, float iso, int slot, int block)
+{
+    const int B = ScalarField::BLOCK_SIZE;
+    const int S = B + 1;
+    const int level = m_level[block];
+    const int s = 1 << level;
+    const int3 b = field.BlockCoord(block);
+    const int3 first = { b.x * B, b.y * B, b.z * B };
+    const int3 dim = field.GetDim();
+    const int3 blockDim = field.GetBlockDim();
+    const int3 n = { std::min(B, dim.x - first.x) >> level, std::min(B, dim.y - first.y) >> level, std::min(B, dim.z - first.z) >> level };
+    const int nc[3] = { n.x, n.y, n.z };
+    const int fc[3] = { first.x, first.y, first.z };
+    const float3 origin = field.GetOrigin();
+    const float cellSize = field.GetCellSize();
+
+    auto localIndex = [&](int3 i) {
+        return i.x + i.y * S + i.z * S * S;
+    };
+    auto gridPoint = [&](int3 i) {
+        return int3{ first.x + i.x * s, first.y + i.y * s, first.z + i.z * s };
+    };
+    auto gridEdge = [&](const Edge& e, int axis) {
+        return (uint32_t)field.VertexIndex(e.start.x, e.start.y, e.start.z) * 3 + axis;
+    };
+
+    // with nothing coarser touching it, a lattice point is on the lattice of
+    // every block it's in, and an edge is filed as it is: LodValue and
+    // FileEdge are only needed next to a coarser block. the levels of the
+    // 27 blocks around tell, -1 past the end of the grid
+    const bool coarserAround = m_around[block] > level;
+    int around[27];
+    for (int k = 0; k < 27; k++) {
+        int3 c = { b.x + k % 3 - 1, b.y + (k / 3) % 3 - 1, b.z + k / 9 - 1 };
+        bool inGrid = c.x >= 0 && c.y >= 0 && c.z >= 0 && c.x < blockDim.x && c.y < blockDim.y && c.z < blockDim.z;
+        around[k] = inGrid ? m_level[field.BlockIndex(c.x, c.y, c.z)] : -1;
+    }
+    // the blocks with lattice point i in them, or the edge from it along axis
+    auto coarserTouching = [&](int3 i, int along) {
+        if (!coarserAround) return false;
+        const int ic[3] = { i.x * s, i.y * s, i.z * s };
+        int lo[3], hi[3];
+        for (int k = 0; k < 3; k++) {
+            lo[k] = k != along && ic[k] == 0 ? 0 : 1;
+            hi[k] = k != along && ic[k] == B ? 2 : 1;
+        }
+        for (int dz = lo[2]; dz <= hi[2]; dz++)
+        for (int dy = lo[1]; dy <= hi[1]; dy++)
+        for (int dx = lo[0]; dx <= hi[0]; dx++)
+            if (around[dx + dy * 3 + dz * 9] > level) return true;
+        return false;
+    };
+
+    // lattice points in 9^3 slab order, whatever the level
+    float value[LOD_SLAB];
+    for (int z = 0; z <= n.z; z++)
+    for (int y = 0; y <= n.y; y++)
+    for (int x = 0; x <= n.x; x++) {
+        int3 p = gridPoint({ x, y, z });
+        value[localIndex({ x, y, z })] = coarserTouching({ x, y, z }, -1) ? LodValue(field, p.x, p.y, p.z) : field.GetValue(field.VertexIndex(p.x, p.y, p.z));
+    }
+
+    // the grid edge every crossing lattice edge is filed under, and the
+    // vertices of the ones this block makes. an edge inside the block is
+    // only this block's, only the ones on its boundary need FileEdge
+    uint32_t edgeKey[LOD_SLAB * 3];
+    std::vector<MCVertex>& vertices = m_blockVertices[slot];
+    std::vector<uint32_t>& keys = m_blockEdges[slot];
+    vertices.clear();
+    keys.clear();
+    for (int z = 0; z <= n.z; z++)
+    for (int y = 0; y <= n.y; y++)
+    for (int x = 0; x <= n.x; x++) {
+        const int3 i = { x, y, z };
+        const int ic[3] = { x, y, z };
+        const int local = localIndex(i);
+        const int3 p = gridPoint(i);
+        for (int axis = 0; axis < 3; axis++) {
+            if (ic[axis] == nc[axis]) continue;
+
+            const int u = axis == 0 ? 1 : 0, w = axis == 2 ? 1 : 2;
+            const int step[3] = { 1, S, S * S };
+            const bool crosses = (value[local] < iso) != (value[local + step[axis]] < iso);
+            // a longer edge is two of this block's at most, if neither
+            // crosses there's no key to file and no vertex to make
+            const bool nextCrosses = ic[axis] + 1 < nc[axis] && (value[local + step[axis]] < iso) != (value[local + step[axis] * 2] < iso);
+            if (!crosses && !nextCrosses) continue;
+
+            Edge e = { p, s, block };
+            if (ic[u] == 0 || ic[u] == nc[u] || ic[w] == 0 || ic[w] == nc[w]) {
+                if (coarserTouching(i, axis))
+                    e = FileEdge(field, p, axis);
+                else
+                    e.block = field.BlockIndex(std::min(p.x / B, blockDim.x - 1), std::min(p.y / B, blockDim.y - 1), std::min(p.z / B, blockDim.z - 1));
+            }
+            if (crosses)
+                edgeKey[local * 3 + axis] = gridEdge(e, axis);
+            if (e.block != block || e.start.x != p.x || e.start.y != p.y || e.start.z != p.z) continue;
+
+            // the whole edge, which can be two of this block's
+            float va = value[local];
+            float vb = value[local + step[axis] * (e.length / s)];
+            if ((va < iso) == (vb < iso)) continue;
+
+            // low end to high end, whichever block asks
+            int3 q = p;
+            Coord(q, axis) += e.length;
+            float t = (iso - va) / (vb - va + 1e-9f);
+            float3 a = origin + float3{ (float)p.x, (float)p.y, (float)p.z } * cellSize;
+            float3 c = origin + float3{ (float)q.x, (float)q.y, (float)q.z } * cellSize;
+            float3 na = Gradient(field, p.x, p.y, p.z);
+            float3 nb = Gradient(field, q.x, q.y, q.z);
+            float3 normal = na + (nb - na) * t;
+            float len = length(normal);
+
+            MCVertex v;
+            v.position = a + (c - a) * t;
+            v.normal = len > 0.0f ? normal / len : float3{ 0.0f, 0.0f, 0.0f };
+            keys.push_back(gridEdge(e, axis));
+            vertices.push_back(v);
+        }
+    }
+
+    // the corners and cube edges of a cell as offsets into value and edgeKey
+    int cornerLocal[8], cubeEdgeKey[12];
+    for (int k = 0; k < 8; k++) {
+        const int* o = MarchingCubes::GetCorner(k);
+        cornerLocal[k] = localIndex({ o[0], o[1], o[2] });
+    }
+    for (int k = 0; k < 12; k++) {
+        const int* o = MarchingCubes::GetCubeEdge(k);
+        cubeEdgeKey[k] = localIndex({ o[0], o[1], o[2] }) * 3 + o[3];
+    }
+    auto cubeIndex = [&](int3 i) {
+        const int base = localIndex(i);
+        int index = 0;
+        for (int k = 0; k < 8; k++)
+            if (value[base + cornerLocal[k]] < iso) index |= 1 << k;
+        return index;
+    };
+
+    // the face of cell i (even in the face's axes) on side hi of axis a, when
+    // the block across it is one level coarser: one coarse face square with
+    // the 4 fine ones of cells i to i + 1. every triangle side both cells
+    // leave in it is an edge of the gap, or of a triangle that has the other
+    // side too and cancels out. the rest goes round the gap in loops, the
+    // other way round they're fans that close it
+    std::vector<uint32_t>& indices = m_blockIndices[slot];
+    uint32_t sideFrom[LOD_FILL_SIDES], sideTo[LOD_FILL_SIDES];
+    int numSides = 0;
+    auto addSides = [&](const signed char* tris, int a, int hi, auto&& key) {
+        for (int t = 0; t < 15 && tris[t] != -1; t += 3) {
+            for (int k = 0; k < 3; k++) {
+                const int* oa = MarchingCubes::GetCubeEdge(tris[t + k]);
+                const int* ob = MarchingCubes::GetCubeEdge(tris[t + (k + 1) % 3]);
+                if (oa[3] == a || ob[3] == a || oa[a] != hi || ob[a] != hi) continue;
+
+                uint32_t from = key(oa), to = key(ob);
+                int m = 0;
+                while (m < numSides && (sideFrom[m] != to || sideTo[m] != from)) m++;
+                if (m < numSides) {
+                    numSides--;
+                    sideFrom[m] = sideFrom[numSides];
+                    sideTo[m] = sideTo[numSides];
+                } else {
+                    sideFrom[numSides] = from;
+                    sideTo[numSides] = to;
+                    numSides++;
+                }
+            }
+        }
+    };
+    auto fillFace = [&](int3 i, int a, int hi) {
+        const int u = a == 0 ? 1 : 0, w = a == 2 ? 1 : 2;
+        numSides = 0;
+
+        // the 9 points of the square are both sides' corners on it, if they
+        // agree neither side has a line in it
+        int3 q = i;
+        Coord(q, a) += hi;
+        const int face = localIndex(q);
+        const int du = localIndex(a == 0 ? int3{ 0, 1, 0 } : int3{ 1, 0, 0 });
+        const int dw = localIndex(a == 2 ? int3{ 0, 1, 0 } : int3{ 0, 0, 1 });
+        int below = 0;
+        for (int k = 0; k < 9; k++)
+            if (value[face + (k % 3) * du + (k / 3) * dw] < iso) below++;
+        if (below == 0 || below == 9) return;
+
+        // the coarse cell, from the field as the coarse block has it
+        int3 corner = gridPoint(i);
+        Coord(corner, a) = hi ? fc[a] + nc[a] * s : fc[a] - 2 * s;
+        int coarseIndex = 0;
+        for (int k = 0; k < 8; k++) {
+            const int* o = MarchingCubes::GetCorner(k);
+            if (LodValue(field, corner.x + o[0] * 2 * s, corner.y + o[1] * 2 * s, corner.z + o[2] * 2 * s) < iso)
+                coarseIndex |= 1 << k;
+        }
+        addSides(MarchingCubes::GetTriangles(coarseIndex), a, 1 - hi, [&](const int* o) {
+            int3 p = { corner.x + o[0] * 2 * s, corner.y + o[1] * 2 * s, corner.z + o[2] * 2 * s };
+            return gridEdge(FileEdge(field, p, o[3]), o[3]);
+        });
+
+        for (int k = 0; k < 4; k++) {
+            int3 cell = i;
+            Coord(cell, u) += k & 1;
+            Coord(cell, w) += k >> 1;
+            addSides(MarchingCubes::GetTriangles(cubeIndex(cell)), a, hi, [&](const int* o) {
+                return edgeKey[localIndex(cell) * 3 + localIndex({ o[0], o[1], o[2] }) * 3 + o[3]];
+            });
+        }
+
+        bool used[LOD_FILL_SIDES] = {};
+        for (int k = 0; k < numSides; k++) {
+            uint32_t loop[LOD_FILL_SIDES];
+            int len = 0;
+            for (int e = k; e >= 0 && !used[e];) {
+                used[e] = true;
+                loop[len++] = sideTo[e];
+                int next = -1;
+                for (int m = 0; m < numSides && next < 0; m++)
+                    if (!used[m] && sideTo[m] == sideFrom[e]) next = m;
+                e = next;
+            }
+            for (int m = 1; m + 1 < len; m++) {
+                const uint32_t tri[3] = { loop[0], loop[m], loop[m + 1] };
+                indices.insert(indices.end(), tri, tri + 3);
+            }
+        }
+    };
+
+    indices.clear();
+    for (int cell = 0; cell < B * B * B; cell++) {
+        int3 i = { cell % B, (cell / B) % B, cell / (B * B) };
+        if (i.x >= n.x || i.y >= n.y || i.z >= n.z) continue;
+
+        const signed char* tris = MarchingCubes::GetTriangles(cubeIndex(i));
+        const uint32_t* cellEdgeKey = edgeKey + localIndex(i) * 3;
+        for (int t = 0; t < 15 && tris[t] != -1; t++)
+            indices.push_back(cellEdgeKey[cubeEdgeKey[tris[t]]]);
+
+        const int ic[3] = { i.x, i.y, i.z };
+        const int bc[3] = { b.x, b.y, b.z };
+        const int bd[3] = { blockDim.x, blockDim.y, blockDim.z };
+        for (int a = 0; a < 3 && coarserAround; a++) {
+            const int u = a == 0 ? 1 : 0, w = a == 2 ? 1 : 2;
+            if (ic[u] % 2 || ic[w] % 2) continue;
+            for (int hi = 0; hi < 2; hi++) {
+                int nb[3] = { bc[0], bc[1], bc[2] };
+                nb[a] += hi ? 1 : -1;
+                if (ic[a] != (hi ? nc[a] - 1 : 0) || nb[a] < 0 || nb[a] >= bd[a]) continue;
+                if (m_level[field.BlockIndex(nb[0], nb[1], nb[2])] == level + 1)
+                    fillFace(i, a, hi);
+            }
+        }
+    }
+}
+
+void LodSurface::Extract(ThreadPool& pool, const ScalarField& field, float iso, float3 camera, float distance, int levels)
+{
+    levels = clampi(levels, 0, MAX_LEVELS);
+    ComputeLevels(field, camera, distance, levels);
+
+    // outside the active blocks the field is 0, which only counts as outside
+    // the surface for a positive iso
+    if (field.IsSparse() && iso > 0.0f) {
+        m_blocks = field.GetActiveBlocks();
+    } else {
+        m_blocks.resize(field.GetNumBlocks());
+        for (int block = 0; block < field.GetNumBlocks(); block++)
+            m_blocks[block] = block;
+    }
+
+    const int numListed = (int)m_blocks.size();
+    std::fill(std::begin(m_blocksAtLevel), std::end(m_blocksAtLevel), 0);
+    for (int i = 0; i < numListed; i++)
+        m_blocksAtLevel[m_level[m_blocks[i]]]++;
+
+    m_blockVertices.resize(numListed);
+    m_blockEdges.resize(numListed);
+    m_blockIndices.resize(numListed);
+    pool.ParallelFor(numListed, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            PolygonizeBlock(field, iso, i, m_blocks[i]);
+    });
+
+    // block order, like the scan over the block counts on the gpu
+    m_blockFirstVertex.resize(numListed);
+    m_blockFirstIndex.resize(numListed);
+    uint32_t numVertices = 0;
+    uint32_t numIndices = 0;
+    for (int i = 0; i < numListed; i++) {
+        m_blockFirstVertex[i] = numVertices;
+        m_blockFirstIndex[i] = numIndices;
+        numVertices += (uint32_t)m_blockVertices[i].size();
+        numIndices += (uint32_t)m_blockIndices[i].size();
+    }
+    m_vertices.resize(numVertices);
+    m_indices.resize(numIndices);
+    m_edgeVertex.resize((size_t)field.GetNumVertices() * 3);
+
+    // a block's triangles can use the vertices of the blocks around it, so
+    // every block files its vertices before any triangle looks them up
+    pool.ParallelFor(numListed, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            std::copy(m_blockVertices[i].begin(), m_blockVertices[i].end(), m_vertices.begin() + m_blockFirstVertex[i]);
+            for (size_t k = 0; k < m_blockEdges[i].size(); k++)
+                m_edgeVertex[m_blockEdges[i][k]] = m_blockFirstVertex[i] + (uint32_t)k;
+        }
+    });
+    pool.ParallelFor(numListed, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const std::vector<uint32_t>& indices = m_blockIndices[i];
+            uint32_t* out = m_indices.data() + m_blockFirstIndex[i];
+            for (size_t k = 0; k < indices.size(); k++)
+                out[k] = m_edgeVertex[indices[k]];
+        }
+    });
+}
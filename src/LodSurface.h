@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "MarchingCubes.h"
+#include "ScalarField.h"
+#include "SimMath.h"
+#include "ThreadPool.h"
+
+// camera distance level of detail for the surface (mc_lod_levels), cpu
+// reference for the CSLod* kernels in shaders/marchingCubes.hlsl.
+//
+// every 8^3 block picks its cell size from how far its center is from the
+// camera: 1 closer than mc_lod_distance, 2 up to twice that, 4 up to four
+// times, and so on up to 2^levels. then blocks come down until any two that
+// touch (face, edge or corner) are at most one level apart (2:1).
+//
+// every block is welded marching cubes on its own lattice. a lattice point
+// on the face or edge of a coarser block, in between that block's points,
+// takes the mean of the 2 or 4 coarse points around it. along a coarse edge
+// the field is linear then, so a fine half edge crosses right where the
+// coarse edge does, and both sides file the vertex under the coarse edge
+// (FileEdge). inside a coarse face square the two sides can still cut
+// different lines, so the fine block fills the gap between them in the face
+// plane, from the lines both sides' triangles leave on the square. no cracks
+// and no t-junctions, and the fills only grow with the area between levels.
+//
+// a vertex is made by the block that owns its edge's start like in
+// ExtractSparse, and the order is block by block too, so with every block
+// at level 0 this is ExtractSparse's mesh.
+class LodSurface {
+public:
+    static const int MAX_LEVELS = 3;    // cells up to 8 wide, one per block
+
+    // levels 0 is ExtractSparse's mesh. the list of blocks is the active one
+    // for a sparse field, every block otherwise
+    void Extract(ThreadPool& pool, const ScalarField& field, float iso, float3 camera, float distance, int levels);
+
+    int GetNumVertices() const { return (int)m_vertices.size(); }
+    int GetNumTriangles() const { return (int)m_indices.size() / 3; }
+    const std::vector<MCVertex>& GetVertices() const { return m_vertices; }
+    const std::vector<uint32_t>& GetIndices() const { return m_indices; }
+
+    // last Extract: balanced level per block of the grid, and how many of the
+    // polygonized blocks ended up at each
+    int GetLevel(int block) const { return m_level[block]; }
+    int GetBlocksAtLevel(int level) const { return m_blocksAtLevel[level]; }
+
+    // before balancing. blocks cut off by the end of the grid stay at 0
+    static int DesiredLevel(const ScalarField& field, int3 b, float3 camera, float distance, int levels);
+
+private:
+    // a lattice edge the way every block that has it files it: the longest
+    // lattice edge along it, and the block that makes its vertex
+    struct Edge {
+        int3 start;
+        int length;
+        int block;
+    };
+
+    void ComputeLevels(const ScalarField& field, float3 camera, float distance, int levels);
+
+    // the field as the blocks touching grid vertex (x, y, z) agree on it
+    float LodValue(const ScalarField& field, int x, int y, int z) const;
+
+    // the lattice edge from p along axis
+    Edge FileEdge(const ScalarField& field, int3 p, int axis) const;
+
+    void PolygonizeBlock(const ScalarField& field, float iso, int slot, int block);
+
+    std::vector<int> m_level;           // per block of the grid
+    std::vector<int> m_around;          // per block of the grid too, the coarsest of the 27 around it
+    std::vector<int> m_scratch;
+    std::vector<int> m_blocks;          // the ones that get polygonized
+    int m_blocksAtLevel[MAX_LEVELS + 1] = {};
+
+    // per m_blocks entry. vertices are keyed by the grid edge their lattice
+    // edge starts with (vertex * 3 + axis), triangles refer to them by it
+    std::vector<std::vector<MCVertex>> m_blockVertices;
+    std::vector<std::vector<uint32_t>> m_blockEdges;
+    std::vector<std::vector<uint32_t>> m_blockIndices;
+    std::vector<uint32_t> m_blockFirstVertex;
+    std::vector<uint32_t> m_blockFirstIndex;
+    std::vector<uint32_t> m_edgeVertex; // grid edge -> vertex, junk for edges nobody made one for
+
+    std::vector<MCVertex> m_vertices;
+    std::vector<uint32_t> m_indices;
+};
@@ -0,0 +1,94 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("can't open '" + path.string() + "'");
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        throw std::runtime_error("'" + path.string() + "' is empty");
+    }
+    m_size = (size_t)size.QuadPart;
+
+    // the mapping keeps the file open, the handle isn't needed after this
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        throw std::runtime_error("can't map '" + path.string() + "'");
+
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data) {
+        CloseHandle(mapping);
+        throw std::runtime_error("can't map '" + path.string() + "'");
+    }
+    m_mapping = mapping;
+}
+
+MappedFile::~MappedFile()
+{
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const
+{
+    WIN32_MEMORY_RANGE_ENTRY range = { const_cast<uint8_t*>(m_data) + offset, size };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("can't open '" + path.string() + "'");
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("'" + path.string() + "' is empty");
+    }
+    m_size = (size_t)info.st_size;
+
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        throw std::runtime_error("can't map '" + path.string() + "'");
+    m_data = static_cast<const uint8_t*>(data);
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const
+{
+    // madvise wants a page aligned start
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t begin = offset / page * page;
+    madvise(const_cast<uint8_t*>(m_data) + begin, offset + size - begin, MADV_WILLNEED);
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// whole file mapped read only, pages come in as they're touched. the only
+// file with a windows and a posix half, the header stays clean of both.
+class MappedFile {
+public:
+    // throws std::runtime_error if it can't be opened or mapped
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+    // hint that [offset, offset + size) is about to be read, fine to ignore
+    void Prefetch(size_t offset, size_t size) const;
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    void* m_mapping = nullptr;  // windows: the file mapping handle
+};
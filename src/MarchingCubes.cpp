@@ -0,0 +1,843 @@
+#include "MarchingCubes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+static const int VERTEX_GRAIN = 4096;
+static const int CELL_GRAIN = 4096;
+
+// triangle table from https://graphics.stanford.edu/~mdfisher/MarchingCubes.html,
+// same as triTable in shaders/marchingCubes.hlsl
+static const signed char TRI_TABLE[256][16] = {
+    { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 8, 3, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 8, 3, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 2, 10, 0, 2, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 2, 8, 3, 2, 10, 8, 10, 9, 8, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 11, 2, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 9, 0, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 11, 2, 1, 9, 11, 9, 8, 11, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 10, 1, 11, 10, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 10, 1, 0, 8, 10, 8, 11, 10, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 9, 0, 3, 11, 9, 11, 10, 9, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 3, 0, 7, 3, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 1, 9, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 1, 9, 4, 7, 1, 7, 3, 1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 2, 10, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 4, 7, 3, 0, 4, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 2, 10, 9, 0, 2, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1 },
+    { 2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1, -1, -1, -1 },
+    { 8, 4, 7, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 11, 4, 7, 11, 2, 4, 2, 0, 4, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 0, 1, 8, 4, 7, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1, -1, -1, -1 },
+    { 3, 10, 1, 3, 11, 10, 7, 8, 4, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1, -1, -1, -1 },
+    { 4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1, -1, -1, -1 },
+    { 4, 7, 11, 4, 11, 9, 9, 11, 10, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 5, 4, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 5, 4, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 8, 5, 4, 8, 3, 5, 3, 1, 5, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 2, 10, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 0, 8, 1, 2, 10, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1 },
+    { 5, 2, 10, 5, 4, 2, 4, 0, 2, -1, -1, -1, -1, -1, -1, -1 },
+    { 2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1, -1, -1, -1 },
+    { 9, 5, 4, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 11, 2, 0, 8, 11, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 5, 4, 0, 1, 5, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1 },
+    { 2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1, -1, -1, -1 },
+    { 10, 3, 11, 10, 1, 3, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1, -1, -1, -1 },
+    { 5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1, -1, -1, -1 },
+    { 5, 4, 8, 5, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 7, 8, 5, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 3, 0, 9, 5, 3, 5, 7, 3, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 7, 8, 0, 1, 7, 1, 5, 7, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 7, 8, 9, 5, 7, 10, 1, 2, -1, -1, -1, -1, -1, -1, -1 },
+    { 10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1, -1, -1, -1 },
+    { 8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1, -1, -1, -1 },
+    { 2, 10, 5, 2, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1 },
+    { 7, 9, 5, 7, 8, 9, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1, -1, -1, -1 },
+    { 2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1, -1, -1, -1 },
+    { 11, 2, 1, 11, 1, 7, 7, 1, 5, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1, -1, -1, -1 },
+    { 5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1 },
+    { 11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1 },
+    { 11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 8, 3, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 0, 1, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 8, 3, 1, 9, 8, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 6, 5, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 6, 5, 1, 2, 6, 3, 0, 8, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 6, 5, 9, 0, 6, 0, 2, 6, -1, -1, -1, -1, -1, -1, -1 },
+    { 5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1, -1, -1, -1 },
+    { 2, 3, 11, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 11, 0, 8, 11, 2, 0, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 1, 9, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1 },
+    { 5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1, -1, -1, -1 },
+    { 6, 3, 11, 6, 5, 3, 5, 1, 3, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1, -1, -1, -1 },
+    { 3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1, -1, -1, -1 },
+    { 6, 5, 9, 6, 9, 11, 11, 9, 8, -1, -1, -1, -1, -1, -1, -1 },
+    { 5, 10, 6, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 3, 0, 4, 7, 3, 6, 5, 10, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 9, 0, 5, 10, 6, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1 },
+    { 10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1, -1, -1, -1 },
+    { 6, 1, 2, 6, 5, 1, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1, -1, -1, -1 },
+    { 8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1, -1, -1, -1 },
+    { 7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1 },
+    { 3, 11, 2, 7, 8, 4, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1 },
+    { 5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1, -1, -1, -1 },
+    { 0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1 },
+    { 9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1 },
+    { 8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1, -1, -1, -1 },
+    { 5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1 },
+    { 0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1 },
+    { 6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1, -1, -1, -1 },
+    { 10, 4, 9, 6, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 10, 6, 4, 9, 10, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1 },
+    { 10, 0, 1, 10, 6, 0, 6, 4, 0, -1, -1, -1, -1, -1, -1, -1 },
+    { 8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1, -1, -1, -1 },
+    { 1, 4, 9, 1, 2, 4, 2, 6, 4, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1, -1, -1, -1 },
+    { 0, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 8, 3, 2, 8, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1 },
+    { 10, 4, 9, 10, 6, 4, 11, 2, 3, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1, -1, -1, -1 },
+    { 3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1, -1, -1, -1 },
+    { 6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1 },
+    { 9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1, -1, -1, -1 },
+    { 8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1 },
+    { 3, 11, 6, 3, 6, 0, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1 },
+    { 6, 4, 8, 11, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 7, 10, 6, 7, 8, 10, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1, -1, -1, -1 },
+    { 10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1, -1, -1, -1 },
+    { 10, 6, 7, 10, 7, 1, 1, 7, 3, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1, -1, -1, -1 },
+    { 2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1 },
+    { 7, 8, 0, 7, 0, 6, 6, 0, 2, -1, -1, -1, -1, -1, -1, -1 },
+    { 7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1, -1, -1, -1 },
+    { 2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1 },
+    { 1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1 },
+    { 11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1, -1, -1, -1 },
+    { 8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1 },
+    { 0, 9, 1, 11, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1, -1, -1, -1 },
+    { 7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 0, 8, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 1, 9, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 8, 1, 9, 8, 3, 1, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1 },
+    { 10, 1, 2, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 2, 10, 3, 0, 8, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1 },
+    { 2, 9, 0, 2, 10, 9, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1 },
+    { 6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1, -1, -1, -1 },
+    { 7, 2, 3, 6, 2, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 7, 0, 8, 7, 6, 0, 6, 2, 0, -1, -1, -1, -1, -1, -1, -1 },
+    { 2, 7, 6, 2, 3, 7, 0, 1, 9, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1, -1, -1, -1 },
+    { 10, 7, 6, 10, 1, 7, 1, 3, 7, -1, -1, -1, -1, -1, -1, -1 },
+    { 10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1, -1, -1, -1 },
+    { 0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1, -1, -1, -1 },
+    { 7, 6, 10, 7, 10, 8, 8, 10, 9, -1, -1, -1, -1, -1, -1, -1 },
+    { 6, 8, 4, 11, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 6, 11, 3, 0, 6, 0, 4, 6, -1, -1, -1, -1, -1, -1, -1 },
+    { 8, 6, 11, 8, 4, 6, 9, 0, 1, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1, -1, -1, -1 },
+    { 6, 8, 4, 6, 11, 8, 2, 10, 1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1, -1, -1, -1 },
+    { 4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1, -1, -1, -1 },
+    { 10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1 },
+    { 8, 2, 3, 8, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1, -1, -1, -1 },
+    { 1, 9, 4, 1, 4, 2, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1 },
+    { 8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1, -1, -1, -1 },
+    { 10, 1, 0, 10, 0, 6, 6, 0, 4, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1 },
+    { 10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 9, 5, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 8, 3, 4, 9, 5, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1 },
+    { 5, 0, 1, 5, 4, 0, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1 },
+    { 11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1, -1, -1, -1 },
+    { 9, 5, 4, 10, 1, 2, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1 },
+    { 6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1, -1, -1, -1 },
+    { 7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1, -1, -1, -1 },
+    { 3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1 },
+    { 7, 2, 3, 7, 6, 2, 5, 4, 9, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1, -1, -1, -1 },
+    { 3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1, -1, -1, -1 },
+    { 6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1 },
+    { 9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1, -1, -1, -1 },
+    { 1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1 },
+    { 4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1 },
+    { 7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1, -1, -1, -1 },
+    { 6, 9, 5, 6, 11, 9, 11, 8, 9, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1, -1, -1, -1 },
+    { 0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1, -1, -1, -1 },
+    { 6, 11, 3, 6, 3, 5, 5, 3, 1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1, -1, -1, -1 },
+    { 0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1 },
+    { 11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1 },
+    { 6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1, -1, -1, -1 },
+    { 5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1, -1, -1, -1 },
+    { 9, 5, 6, 9, 6, 0, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1 },
+    { 1, 5, 6, 2, 1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1 },
+    { 10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1, -1, -1, -1 },
+    { 0, 3, 8, 5, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 10, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 11, 5, 10, 7, 5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 11, 5, 10, 11, 7, 5, 8, 3, 0, -1, -1, -1, -1, -1, -1, -1 },
+    { 5, 11, 7, 5, 10, 11, 1, 9, 0, -1, -1, -1, -1, -1, -1, -1 },
+    { 10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1, -1, -1, -1 },
+    { 11, 1, 2, 11, 7, 1, 7, 5, 1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1, -1, -1, -1 },
+    { 9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1, -1, -1, -1 },
+    { 7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1 },
+    { 2, 5, 10, 2, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1 },
+    { 8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1, -1, -1, -1 },
+    { 9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1, -1, -1, -1 },
+    { 9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1 },
+    { 1, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 8, 7, 0, 7, 1, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 0, 3, 9, 3, 5, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 8, 7, 5, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 5, 8, 4, 5, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1 },
+    { 5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1, -1, -1, -1 },
+    { 0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1, -1, -1, -1 },
+    { 10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1 },
+    { 2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1, -1, -1, -1 },
+    { 0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1 },
+    { 0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1 },
+    { 9, 4, 5, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1, -1, -1, -1 },
+    { 5, 10, 2, 5, 2, 4, 4, 2, 0, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1 },
+    { 5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1, -1, -1, -1 },
+    { 8, 4, 5, 8, 5, 3, 3, 5, 1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 4, 5, 1, 0, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1, -1, -1, -1 },
+    { 9, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 11, 7, 4, 9, 11, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1, -1, -1, -1 },
+    { 1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1, -1, -1, -1 },
+    { 3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1 },
+    { 4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1, -1, -1, -1 },
+    { 9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1 },
+    { 11, 7, 4, 11, 4, 2, 2, 4, 0, -1, -1, -1, -1, -1, -1, -1 },
+    { 11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1, -1, -1, -1 },
+    { 2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1, -1, -1, -1 },
+    { 9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1 },
+    { 3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1 },
+    { 1, 10, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 9, 1, 4, 1, 7, 7, 1, 3, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1, -1, -1, -1 },
+    { 4, 0, 3, 7, 4, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 4, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 0, 9, 3, 9, 11, 11, 9, 10, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 1, 10, 0, 10, 8, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 1, 10, 11, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 2, 11, 1, 11, 9, 9, 11, 8, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1, -1, -1, -1 },
+    { 0, 2, 11, 8, 0, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 3, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 2, 3, 8, 2, 8, 10, 10, 8, 9, -1, -1, -1, -1, -1, -1, -1 },
+    { 9, 10, 2, 0, 9, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1, -1, -1, -1 },
+    { 1, 10, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 1, 3, 8, 9, 1, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { 0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+};
+
+// the 12 cube edges as (corner offset, axis) of the grid edge that owns them.
+// corners are numbered like CSMarchingCubes: 0 (0,0,0) 1 (1,0,0) 2 (1,0,1)
+// 3 (0,0,1) 4 (0,1,0) 5 (1,1,0) 6 (1,1,1) 7 (0,1,1)
+static const int CUBE_EDGE_OWNER[12][4] = {
+    { 0, 0, 0, 0 }, { 1, 0, 0, 2 }, { 0, 0, 1, 0 }, { 0, 0, 0, 2 },
+    { 0, 1, 0, 0 }, { 1, 1, 0, 2 }, { 0, 1, 1, 0 }, { 0, 1, 0, 2 },
+    { 0, 0, 0, 1 }, { 1, 0, 0, 1 }, { 1, 0, 1, 1 }, { 0, 0, 1, 1 },
+};
+
+static const int CORNER_OFFSET[8][3] = {
+    { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 },
+    { 0, 1, 0 }, { 1, 1, 0 }, { 1, 1, 1 }, { 0, 1, 1 },
+};
+
+static int CountTriangles(int cubeIndex)
+{
+    int n = 0;
+    while (n < 15 && TRI_TABLE[cubeIndex][n] != -1)
+        n += 3;
+    return n / 3;
+}
+
+// ScalarFieldGradient. a flat spot has no direction, the shader's normalize
+// gives NaNs there, this gives 0
+static float3 NormalizeOrZero(float3 v)
+{
+    float len = length(v);
+    return len > 0.0f ? v / len : float3{ 0.0f, 0.0f, 0.0f };
+}
+
+// the helpers below take a ScalarField, or the FieldSnapshot an incremental
+// mesh is built from
+template <typename Field>
+static float3 FieldGradient(const Field& field, int x, int y, int z)
+{
+    float3 g = {
+        field.Sample(x + 1, y, z) - field.Sample(x - 1, y, z),
+        field.Sample(x, y + 1, z) - field.Sample(x, y - 1, z),
+        field.Sample(x, y, z + 1) - field.Sample(x, y, z - 1),
+    };
+    return NormalizeOrZero(g);
+}
+
+template <typename Field>
+static float FieldValue(const Field& field, int x, int y, int z)
+{
+    return field.GetValue(field.VertexIndex(x, y, z));
+}
+
+// an edge crosses when its ends land on different sides, the same test that
+// puts it in edgeTable for every cell around it
+template <typename Field>
+static bool EdgeCrosses(const Field& field, float iso, int x, int y, int z, int axis)
+{
+    int3 dim = field.GetDim();
+    int bx = x + (axis == 0), by = y + (axis == 1), bz = z + (axis == 2);
+    if (bx > dim.x || by > dim.y || bz > dim.z) return false;
+    return (FieldValue(field, x, y, z) < iso) != (FieldValue(field, bx, by, bz) < iso);
+}
+
+// always interpolated from the low end to the high end, so every cell around
+// the edge would have come up with this exact vertex
+template <typename Field>
+static MCVertex EdgeVertex(const Field& field, float iso, int x, int y, int z, int axis)
+{
+    int bx = x + (axis == 0), by = y + (axis == 1), bz = z + (axis == 2);
+    float va = FieldValue(field, x, y, z);
+    float vb = FieldValue(field, bx, by, bz);
+    float t = (iso - va) / (vb - va + 1e-9f);
+
+    float3 a = field.GetOrigin() + float3{ (float)x, (float)y, (float)z } * field.GetCellSize();
+    float3 b = field.GetOrigin() + float3{ (float)bx, (float)by, (float)bz } * field.GetCellSize();
+    float3 na = FieldGradient(field, x, y, z);
+    float3 nb = FieldGradient(field, bx, by, bz);
+
+    MCVertex v;
+    v.position = a + (b - a) * t;
+    v.normal = NormalizeOrZero(na + (nb - na) * t);
+    return v;
+}
+
+template <typename Field>
+static int CubeIndex(const Field& field, float iso, int x, int y, int z)
+{
+    int cubeIndex = 0;
+    for (int i = 0; i < 8; i++)
+        if (FieldValue(field, x + CORNER_OFFSET[i][0], y + CORNER_OFFSET[i][1], z + CORNER_OFFSET[i][2]) < iso)
+            cubeIndex |= 1 << i;
+    return cubeIndex;
+}
+
+// the field as an incremental mesh last saw it, with as much of
+// ScalarField's interface as the helpers above use. the layout is the real one's
+struct FieldSnapshot {
+    const ScalarField& layout;
+    const float* values;
+
+    int3 GetDim() const { return layout.GetDim(); }
+    float3 GetOrigin() const { return layout.GetOrigin(); }
+    float GetCellSize() const { return layout.GetCellSize(); }
+    int VertexIndex(int x, int y, int z) const { return layout.VertexIndex(x, y, z); }
+    float GetValue(int index) const { return values[index]; }
+    float Sample(int x, int y, int z) const
+    {
+        int3 dim = layout.GetDim();
+        return values[VertexIndex(clampi(x, 0, dim.x), clampi(y, 0, dim.y), clampi(z, 0, dim.z))];
+    }
+};
+
+// local vertex of a block's 9^3 slab -> grid vertex, false if the block doesn't own it
+static bool OwnedVertex(const ScalarField& field, int3 b, int local, int& x, int& y, int& z)
+{
+    const int B = ScalarField::BLOCK_SIZE;
+    const int S = B + 1;
+    const int3 dim = field.GetDim();
+    const int3 blockDim = field.GetBlockDim();
+
+    int lx = local % S, ly = (local / S) % S, lz = local / (S * S);
+    x = b.x * B + lx;
+    y = b.y * B + ly;
+    z = b.z * B + lz;
+    if (x > dim.x || y > dim.y || z > dim.z) return false;
+    return (lx < B || b.x == blockDim.x - 1) && (ly < B || b.y == blockDim.y - 1) && (lz < B || b.z == blockDim.z - 1);
+}
+
+// grid edge -> the block that owns it and its place in that block's 9^3 x 3 slab
+static void EdgeOwner(const ScalarField& field, int x, int y, int z, int axis, int& block, int& slabEdge)
+{
+    const int B = ScalarField::BLOCK_SIZE;
+    const int S = B + 1;
+    const int3 blockDim = field.GetBlockDim();
+
+    int bx = std::min(x / B, blockDim.x - 1);
+    int by = std::min(y / B, blockDim.y - 1);
+    int bz = std::min(z / B, blockDim.z - 1);
+    block = field.BlockIndex(bx, by, bz);
+    slabEdge = ((x - bx * B) + (y - by * B) * S + (z - bz * B) * S * S) * 3 + axis;
+}
+
+// the blocks around a block whose slab reads its own vertex at local (lx, ly,
+// lz), bit (dx + 1) + (dy + 1) * 3 + (dz + 1) * 9. cells read one vertex up,
+// so the block below reads layer 0. an edge vertex's normal is the gradient
+// at the edge's ends, which reads one more on either side: layer 1 for the
+// block below, layer B - 1 for the block above
+static uint32_t VertexReaders(int lx, int ly, int lz)
+{
+    const int B = ScalarField::BLOCK_SIZE;
+    auto axis = [&](int l) { return 2 | (l <= 1 ? 1 : 0) | (l == B - 1 ? 4 : 0); };
+    const int ax = axis(lx), ay = axis(ly), az = axis(lz);
+
+    uint32_t readers = 0;
+    for (int dz = 0; dz < 3; dz++)
+    for (int dy = 0; dy < 3; dy++)
+    for (int dx = 0; dx < 3; dx++)
+        if ((ax >> dx) & (ay >> dy) & (az >> dz) & 1)
+            readers |= 1u << (dx + dy * 3 + dz * 9);
+    return readers;
+}
+
+void MarchingCubes::SetIncremental(bool incremental, float tolerance)
+{
+    m_incremental = incremental;
+    m_tolerance = tolerance;
+    m_meshValid = false;
+}
+
+void MarchingCubes::Extract(ThreadPool& pool, const ScalarField& field, float iso)
+{
+    // outside the active blocks the field is 0, which only counts as
+    // outside the surface for a positive iso
+    if (field.IsSparse() && iso > 0.0f && m_incremental) {
+        ExtractIncremental(pool, field, iso);
+        return;
+    }
+
+    m_meshValid = false;
+    if (field.IsSparse() && iso > 0.0f)
+        ExtractSparse(pool, field, iso);
+    else
+        ExtractDense(pool, field, iso);
+}
+
+void MarchingCubes::ExtractDense(ThreadPool& pool, const ScalarField& field, float iso)
+{
+    const int3 dim = field.GetDim();
+    const int numGridVertices = field.GetNumVertices();
+    const int numEdges = GetNumEdges(field);
+    const int numCells = dim.x * dim.y * dim.z;
+
+    m_edgeCrossing.resize(numEdges);
+    m_edgeVertex.resize(numEdges);
+    m_cellCase.resize(numCells);
+    m_cellFirst.resize(numCells);
+
+    // 1.
+    pool.ParallelFor(numGridVertices, VERTEX_GRAIN, [&](int begin, int end) {
+        for (int v = begin; v < end; v++) {
+            int x = v % (dim.x + 1);
+            int y = (v / (dim.x + 1)) % (dim.y + 1);
+            int z = v / ((dim.x + 1) * (dim.y + 1));
+            for (int axis = 0; axis < 3; axis++)
+                m_edgeCrossing[v * 3 + axis] = EdgeCrosses(field, iso, x, y, z, axis);
+        }
+    });
+
+    // 2.
+    uint32_t numVertices = m_scan.Scan(pool, m_edgeCrossing.data(), m_edgeVertex.data(), numEdges, ScanMode::Exclusive);
+    m_vertices.resize(numVertices);
+
+    // 3.
+    pool.ParallelFor(numEdges, VERTEX_GRAIN * 3, [&](int begin, int end) {
+        for (int e = begin; e < end; e++) {
+            if (!m_edgeCrossing[e]) continue;
+            int v = e / 3;
+            int x = v % (dim.x + 1);
+            int y = (v / (dim.x + 1)) % (dim.y + 1);
+            int z = v / ((dim.x + 1) * (dim.y + 1));
+            m_vertices[m_edgeVertex[e]] = EdgeVertex(field, iso, x, y, z, e % 3);
+        }
+    });
+
+    // 4.
+    pool.ParallelFor(numCells, CELL_GRAIN, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            int x = c % dim.x;
+            int y = (c / dim.x) % dim.y;
+            int z = c / (dim.x * dim.y);
+            int cubeIndex = CubeIndex(field, iso, x, y, z);
+            m_cellCase[c] = (unsigned char)cubeIndex;
+            m_cellFirst[c] = CountTriangles(cubeIndex) * 3;
+        }
+    });
+
+    uint32_t numIndices = m_scan.Scan(pool, m_cellFirst.data(), m_cellFirst.data(), numCells, ScanMode::Exclusive);
+    m_indices.resize(numIndices);
+
+    // 5. the owning edge of each cube edge, relative to the cell's first corner
+    int edgeOffset[12];
+    for (int i = 0; i < 12; i++) {
+        const int* o = CUBE_EDGE_OWNER[i];
+        edgeOffset[i] = field.VertexIndex(o[0], o[1], o[2]) * 3 + o[3];
+    }
+
+    pool.ParallelFor(numCells, CELL_GRAIN, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            const signed char* tris = TRI_TABLE[m_cellCase[c]];
+            if (tris[0] == -1) continue;
+
+            int x = c % dim.x;
+            int y = (c / dim.x) % dim.y;
+            int z = c / (dim.x * dim.y);
+            int firstEdge = field.VertexIndex(x, y, z) * 3;
+
+            uint32_t* out = &m_indices[m_cellFirst[c]];
+            for (int t = 0; t < 15 && tris[t] != -1; t++)
+                out[t] = m_edgeVertex[firstEdge + edgeOffset[tris[t]]];
+        }
+    });
+}
+
+// same five steps, but the edge and cell arrays only cover the active blocks.
+// a block owns the edges of its vertices [8b, 8b + 8) (the last block along
+// an axis also the ones at dim), stored as a 9^3 x 3 slab per active block.
+// every crossing edge has an end >= iso > 0, that end was touched by the
+// splat, so every block it's a corner of is active, including the owner.
+void MarchingCubes::ExtractSparse(ThreadPool& pool, const ScalarField& field, float iso)
+{
+    const int B = ScalarField::BLOCK_SIZE;
+    const int S = B + 1;                    // vertices per block side
+    const int edgesPerBlock = S * S * S * 3;
+    const int cellsPerBlock = B * B * B;
+
+    const int3 dim = field.GetDim();
+    const std::vector<int>& blocks = field.GetActiveBlocks();
+    const int numBlocks = (int)blocks.size();
+    const int numEdges = numBlocks * edgesPerBlock;
+    const int numCells = numBlocks * cellsPerBlock;
+
+    m_blockSlot.assign(field.GetNumBlocks(), -1);
+    for (int i = 0; i < numBlocks; i++)
+        m_blockSlot[blocks[i]] = i;
+
+    m_edgeCrossing.resize(numEdges);
+    m_edgeVertex.resize(numEdges);
+    m_cellCase.resize(numCells);
+    m_cellFirst.resize(numCells);
+
+    // grid edge -> its slot in the slabs
+    auto edgeSlot = [&](int x, int y, int z, int axis) {
+        int block, slabEdge;
+        EdgeOwner(field, x, y, z, axis, block, slabEdge);
+        return m_blockSlot[block] * edgesPerBlock + slabEdge;
+    };
+
+    // 1.
+    pool.ParallelFor(numBlocks, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int3 b = field.BlockCoord(blocks[i]);
+            uint32_t* crossing = &m_edgeCrossing[(size_t)i * edgesPerBlock];
+            for (int local = 0; local < S * S * S; local++) {
+                int x, y, z;
+                bool owned = OwnedVertex(field, b, local, x, y, z);
+                for (int axis = 0; axis < 3; axis++)
+                    crossing[local * 3 + axis] = owned && EdgeCrosses(field, iso, x, y, z, axis);
+            }
+        }
+    });
+
+    // 2.
+    uint32_t numVertices = m_scan.Scan(pool, m_edgeCrossing.data(), m_edgeVertex.data(), numEdges, ScanMode::Exclusive);
+    m_vertices.resize(numVertices);
+
+    // 3.
+    pool.ParallelFor(numBlocks, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int3 b = field.BlockCoord(blocks[i]);
+            size_t first = (size_t)i * edgesPerBlock;
+            for (int e = 0; e < edgesPerBlock; e++) {
+                if (!m_edgeCrossing[first + e]) continue;
+                int x, y, z;
+                OwnedVertex(field, b, e / 3, x, y, z);
+                m_vertices[m_edgeVertex[first + e]] = EdgeVertex(field, iso, x, y, z, e % 3);
+            }
+        }
+    });
+
+    // 4. cells past the end of the grid in the last blocks just get no triangles
+    pool.ParallelFor(numBlocks, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int3 b = field.BlockCoord(blocks[i]);
+            for (int local = 0; local < cellsPerBlock; local++) {
+                int x = b.x * B + local % B;
+                int y = b.y * B + (local / B) % B;
+                int z = b.z * B + local / (B * B);
+                int cubeIndex = x < dim.x && y < dim.y && z < dim.z ? CubeIndex(field, iso, x, y, z) : 0;
+                m_cellCase[(size_t)i * cellsPerBlock + local] = (unsigned char)cubeIndex;
+                m_cellFirst[(size_t)i * cellsPerBlock + local] = CountTriangles(cubeIndex) * 3;
+            }
+        }
+    });
+
+    uint32_t numIndices = m_scan.Scan(pool, m_cellFirst.data(), m_cellFirst.data(), numCells, ScanMode::Exclusive);
+    m_indices.resize(numIndices);
+
+    // 5. the owner of a cube edge can be the next block over
+    pool.ParallelFor(numBlocks, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int3 b = field.BlockCoord(blocks[i]);
+            for (int local = 0; local < cellsPerBlock; local++) {
+                size_t c = (size_t)i * cellsPerBlock + local;
+                const signed char* tris = TRI_TABLE[m_cellCase[c]];
+                if (tris[0] == -1) continue;
+
+                int x = b.x * B + local % B;
+                int y = b.y * B + (local / B) % B;
+                int z = b.z * B + local / (B * B);
+
+                uint32_t* out = &m_indices[m_cellFirst[c]];
+                for (int t = 0; t < 15 && tris[t] != -1; t++) {
+                    const int* o = CUBE_EDGE_OWNER[tris[t]];
+                    out[t] = m_edgeVertex[edgeSlot(x + o[0], y + o[1], z + o[2], o[3])];
+                }
+            }
+        }
+    });
+}
+
+// ExtractSparse's slabs, kept per block of the whole grid from one call to
+// the next.
+//
+//   1. dirty: a block active now or last time with one of its own vertices
+//      more than the tolerance away from m_meshField. it copies all of its
+//      own vertices over, no other block's change
+//   2. the dirty blocks and those around them that read one of the copied
+//      vertices that changed (VertexReaders), if they're active now or were
+//      last time, are polygonized again from m_meshField: vertices in slab
+//      order, triangles as slab edges
+//   3. stitch: first vertex per block in block order, then every triangle's
+//      slab edges -> owner's first vertex + the edge's vertex in the owner
+//
+// a block's slab only depends on m_meshField in the blocks around it, so
+// after 2. every cached block matches m_meshField. and every crossing edge
+// has an end >= iso > tolerance there, that end is touched, so its blocks
+// were checked: a block nobody checked has no triangles to lose.
+void MarchingCubes::ExtractIncremental(ThreadPool& pool, const ScalarField& field, float iso)
+{
+    const int B = ScalarField::BLOCK_SIZE;
+    const int S = B + 1;
+    const int edgesPerBlock = S * S * S * 3;
+    const int3 blockDim = field.GetBlockDim();
+    const int numBlocks = field.GetNumBlocks();
+
+    // a different grid or iso, or the first call: empty mesh, and everything
+    // active counts as dirty
+    const int3 dim = field.GetDim();
+    const float3 origin = field.GetOrigin();
+    bool reset = !m_meshValid || m_meshIso != iso || m_meshCellSize != field.GetCellSize()
+        || m_meshDim.x != dim.x || m_meshDim.y != dim.y || m_meshDim.z != dim.z
+        || m_meshOrigin.x != origin.x || m_meshOrigin.y != origin.y || m_meshOrigin.z != origin.z;
+    if (reset) {
+        m_meshField.assign(field.GetNumVertices(), 0.0f);
+        m_blockState.assign(numBlocks, 0);
+        m_blockReaders.resize(numBlocks);
+        m_blockVertices.assign(numBlocks, {});
+        m_blockEdges.assign(numBlocks, {});
+        m_edgeLocal.resize((size_t)numBlocks * edgesPerBlock);
+        m_blockFirstVertex.resize(numBlocks);
+        m_lastActive.clear();
+        m_meshValid = true;
+        m_meshIso = iso;
+        m_meshDim = dim;
+        m_meshOrigin = origin;
+        m_meshCellSize = field.GetCellSize();
+    }
+
+    // 1. a block that just went inactive has 0 everywhere now, which is
+    // dirty if it had anything
+    const std::vector<int>& active = field.GetActiveBlocks();
+    m_checkBlocks.clear();
+    std::set_union(active.begin(), active.end(), m_lastActive.begin(), m_lastActive.end(),
+        std::back_inserter(m_checkBlocks));
+    m_lastActive = active;
+
+    pool.ParallelFor((int)m_checkBlocks.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int block = m_checkBlocks[i];
+            int3 b = field.BlockCoord(block);
+
+            bool dirty = reset;
+            for (int local = 0; local < S * S * S && !dirty; local++) {
+                int x, y, z;
+                if (!OwnedVertex(field, b, local, x, y, z)) continue;
+                int v = field.VertexIndex(x, y, z);
+                dirty = std::fabs(field.GetValue(v) - m_meshField[v]) > m_tolerance;
+            }
+            if (!dirty) continue;
+
+            // the block itself always, the others only if a vertex they read changed
+            uint32_t readers = 1u << 13;
+            for (int local = 0; local < S * S * S; local++) {
+                int x, y, z;
+                if (!OwnedVertex(field, b, local, x, y, z)) continue;
+                int v = field.VertexIndex(x, y, z);
+                if (field.GetValue(v) == m_meshField[v]) continue;
+                m_meshField[v] = field.GetValue(v);
+                readers |= VertexReaders(local % S, (local / S) % S, local / (S * S));
+            }
+            m_blockState[block] = BLOCK_DIRTY;
+            m_blockReaders[block] = readers;
+        }
+    });
+
+    m_dirtyBlocks.clear();
+    for (int block : m_checkBlocks)
+        if (m_blockState[block] & BLOCK_DIRTY)
+            m_dirtyBlocks.push_back(block);
+
+    // 2. a block that's inactive now and was last time has no triangles and
+    // doesn't get any, ExtractSparse doesn't walk it
+    m_rebuildBlocks.clear();
+    for (int block : m_dirtyBlocks) {
+        int3 b = field.BlockCoord(block);
+        for (int dz = -1; dz <= 1; dz++)
+        for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -1; dx <= 1; dx++) {
+            if (!((m_blockReaders[block] >> ((dx + 1) + (dy + 1) * 3 + (dz + 1) * 9)) & 1)) continue;
+            int3 n = { b.x + dx, b.y + dy, b.z + dz };
+            if (n.x < 0 || n.y < 0 || n.z < 0 || n.x >= blockDim.x || n.y >= blockDim.y || n.z >= blockDim.z) continue;
+            int neighbor = field.BlockIndex(n.x, n.y, n.z);
+            if (m_blockState[neighbor] & BLOCK_REBUILD) continue;
+            if (!std::binary_search(m_checkBlocks.begin(), m_checkBlocks.end(), neighbor)) continue;
+            m_blockState[neighbor] |= BLOCK_REBUILD;
+            m_rebuildBlocks.push_back(neighbor);
+        }
+    }
+
+    pool.ParallelFor((int)m_rebuildBlocks.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            RebuildBlock(field, iso, m_rebuildBlocks[i]);
+    });
+
+    for (int block : m_rebuildBlocks)
+        m_blockState[block] = 0;
+    m_numDirty = (int)m_dirtyBlocks.size();
+    m_numRebuilt = (int)m_rebuildBlocks.size();
+
+    // 3. same order as ExtractSparse: block by block, slab order inside
+    m_meshBlocks.clear();
+    m_blockFirstIndex.clear();
+    uint32_t numVertices = 0;
+    uint32_t numIndices = 0;
+    for (int block = 0; block < numBlocks; block++) {
+        if (m_blockVertices[block].empty() && m_blockEdges[block].empty()) continue;
+        m_meshBlocks.push_back(block);
+        m_blockFirstVertex[block] = numVertices;
+        m_blockFirstIndex.push_back(numIndices);
+        numVertices += (uint32_t)m_blockVertices[block].size();
+        numIndices += (uint32_t)m_blockEdges[block].size();
+    }
+    m_vertices.resize(numVertices);
+    m_indices.resize(numIndices);
+
+    pool.ParallelFor((int)m_meshBlocks.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int block = m_meshBlocks[i];
+            const std::vector<MCVertex>& vertices = m_blockVertices[block];
+            std::copy(vertices.begin(), vertices.end(), m_vertices.begin() + m_blockFirstVertex[block]);
+
+            const std::vector<uint32_t>& edges = m_blockEdges[block];
+            uint32_t* out = m_indices.data() + m_blockFirstIndex[i];
+            for (size_t k = 0; k < edges.size(); k++)
+                out[k] = m_blockFirstVertex[edges[k] / edgesPerBlock] + m_edgeLocal[edges[k]];
+        }
+    });
+}
+
+// one block of ExtractSparse's steps 1, 3 and 5, from m_meshField
+void MarchingCubes::RebuildBlock(const ScalarField& field, float iso, int block)
+{
+    const int B = ScalarField::BLOCK_SIZE;
+    const int S = B + 1;
+    const int edgesPerBlock = S * S * S * 3;
+    const int3 dim = field.GetDim();
+    const int3 b = field.BlockCoord(block);
+    const FieldSnapshot mesh = { field, m_meshField.data() };
+
+    std::vector<MCVertex>& vertices = m_blockVertices[block];
+    uint32_t* edgeLocal = &m_edgeLocal[(size_t)block * edgesPerBlock];
+    vertices.clear();
+    for (int local = 0; local < S * S * S; local++) {
+        int x, y, z;
+        if (!OwnedVertex(field, b, local, x, y, z)) continue;
+        for (int axis = 0; axis < 3; axis++) {
+            if (!EdgeCrosses(mesh, iso, x, y, z, axis)) continue;
+            edgeLocal[local * 3 + axis] = (uint32_t)vertices.size();
+            vertices.push_back(EdgeVertex(mesh, iso, x, y, z, axis));
+        }
+    }
+
+    // the owner of a cube edge can be the next block over, its slab is
+    // looked up at stitch time
+    std::vector<uint32_t>& edges = m_blockEdges[block];
+    edges.clear();
+    for (int local = 0; local < B * B * B; local++) {
+        int x = b.x * B + local % B;
+        int y = b.y * B + (local / B) % B;
+        int z = b.z * B + local / (B * B);
+        if (x >= dim.x || y >= dim.y || z >= dim.z) continue;
+
+        const signed char* tris = TRI_TABLE[CubeIndex(mesh, iso, x, y, z)];
+        for (int t = 0; t < 15 && tris[t] != -1; t++) {
+            const int* o = CUBE_EDGE_OWNER[tris[t]];
+            int owner, slabEdge;
+            EdgeOwner(field, x + o[0], y + o[1], z + o[2], o[3], owner, slabEdge);
+            edges.push_back((uint32_t)owner * edgesPerBlock + slabEdge);
+        }
+    }
+}
+
+const signed char* MarchingCubes::GetTriangles(int cubeIndex)
+{
+    return TRI_TABLE[cubeIndex];
+}
+
+const int* MarchingCubes::GetCubeEdge(int edge)
+{
+    return CUBE_EDGE_OWNER[edge];
+}
+
+const int* MarchingCubes::GetCorner(int corner)
+{
+    return CORNER_OFFSET[corner];
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "PrefixScan.h"
+#include "ScalarField.h"
+#include "SimMath.h"
+#include "ThreadPool.h"
+
+// one welded vertex. the gpu Vertex (stdafx.h) is the same thing padded to
+// two float4s
+struct MCVertex {
+    float3 position;
+    float3 normal;
+};
+
+// cpu reference for the welded marching cubes path (CSMCWeldVertices +
+// CSMCEmitIndices in shaders/marchingCubes.hlsl).
+//
+// CSMarchingCubes used to write 3 fresh vertices per triangle, so every
+// surface vertex was stored ~6 times. here every grid vertex owns its +x, +y
+// and +z edge, a crossing edge gets exactly one vertex, and the up to 4 cells
+// around the edge refer to it through the index buffer.
+//
+//   1. flag the edges that cross the iso value
+//   2. scan the flags -> vertex index per crossing edge
+//   3. interpolate the vertices, one per crossing edge
+//   4. count triangles per cell and scan -> first index per cell
+//   5. write the indices, cell edge -> owning grid edge -> vertex
+//
+// both scans make the output order fixed (by edge and by cell), so the mesh
+// is the same no matter how the pool schedules, and the output is sized
+// exactly.
+//
+// on a sparse ScalarField only the active blocks are walked, so the cost
+// follows the fluid instead of the whole box. same triangles, different
+// order: block by block. that's the order the gpu writes in as well
+// (CSMCCountBlocks and on), it does the same count -> scan -> emit per block,
+// with every block listed when mc_sparse is off.
+//
+// incremental mode (mc_incremental) keeps the mesh per block between calls.
+// the triangles come from a copy of the field that's only refreshed for the
+// blocks whose own vertices moved more than the tolerance (dirty). only those
+// and the blocks around them whose cells or normals read one of the vertices
+// that changed are polygonized again, every other block keeps its vertices
+// and triangles and just gets copied into the output. a change in the middle
+// of a block stays in the block, one on a face brings the block across the
+// face along. with tolerance 0 the mesh is exactly ExtractSparse's, above
+// that the surface lags the field by up to the tolerance, which is what a
+// settling shot wants. needs a sparse field, anything else is extracted whole.
+class MarchingCubes {
+public:
+    void Extract(ThreadPool& pool, const ScalarField& field, float iso);
+
+    // the next Extract starts over either way
+    void SetIncremental(bool incremental, float tolerance);
+    bool IsIncremental() const { return m_incremental; }
+
+    // last incremental Extract: blocks past the tolerance, blocks polygonized
+    int GetDirtyBlocks() const { return m_numDirty; }
+    int GetRebuiltBlocks() const { return m_numRebuilt; }
+
+    int GetNumVertices() const { return (int)m_vertices.size(); }
+    int GetNumTriangles() const { return (int)m_indices.size() / 3; }
+    const std::vector<MCVertex>& GetVertices() const { return m_vertices; }
+    const std::vector<uint32_t>& GetIndices() const { return m_indices; }
+
+    // edges are numbered vertexIndex * 3 + axis (0 = x, 1 = y, 2 = z)
+    static int GetNumEdges(const ScalarField& field) { return field.GetNumVertices() * 3; }
+
+    // the tables, for LodSurface's coarse lattices: a cube index's triangles
+    // as cube edges (-1 after the last), the corner offset and axis of the
+    // grid edge a cube edge is, and the corner offsets cube indices go by
+    static const signed char* GetTriangles(int cubeIndex);
+    static const int* GetCubeEdge(int edge);
+    static const int* GetCorner(int corner);
+
+private:
+    void ExtractDense(ThreadPool& pool, const ScalarField& field, float iso);
+    void ExtractSparse(ThreadPool& pool, const ScalarField& field, float iso);
+    void ExtractIncremental(ThreadPool& pool, const ScalarField& field, float iso);
+    void RebuildBlock(const ScalarField& field, float iso, int block);
+
+    // per grid edge/cell, or per active block slab in sparse mode
+    std::vector<uint32_t> m_edgeCrossing;   // 1 if the edge crosses iso
+    std::vector<uint32_t> m_edgeVertex;     // vertex of a crossing edge, junk for the others
+    std::vector<unsigned char> m_cellCase;  // cube index per cell
+    std::vector<uint32_t> m_cellFirst;      // triangles per cell, then the first index after the scan
+    std::vector<int> m_blockSlot;           // sparse: block -> position in the active list, -1 if inactive
+
+    std::vector<MCVertex> m_vertices;
+    std::vector<uint32_t> m_indices;
+
+    PrefixScan<uint32_t> m_scan;
+
+    // incremental mode, per block of the whole grid
+    enum : unsigned char { BLOCK_DIRTY = 1, BLOCK_REBUILD = 2 };
+    bool m_incremental = false;
+    float m_tolerance = 0.0f;
+    bool m_meshValid = false;                       // the caches below go with m_meshField
+    float m_meshIso = 0.0f;
+    int3 m_meshDim = { 0, 0, 0 };
+    float3 m_meshOrigin = { 0.0f, 0.0f, 0.0f };
+    float m_meshCellSize = 0.0f;
+    std::vector<float> m_meshField;                 // the field the cached blocks were built from
+    std::vector<unsigned char> m_blockState;        // BLOCK_* flags, only set during Extract
+    std::vector<uint32_t> m_blockReaders;           // dirty blocks: the neighbors to redo, VertexReaders bits
+    std::vector<int> m_lastActive;                  // active blocks of the last call
+    std::vector<int> m_checkBlocks;                 // those and the ones active now
+    std::vector<int> m_dirtyBlocks;
+    std::vector<int> m_rebuildBlocks;
+    std::vector<int> m_meshBlocks;                  // blocks with vertices or triangles, ascending
+    std::vector<std::vector<MCVertex>> m_blockVertices;
+    std::vector<std::vector<uint32_t>> m_blockEdges;    // 3 per triangle, owner block * slab size + slab edge
+    std::vector<uint32_t> m_edgeLocal;              // slab edge -> vertex within its block, junk if it doesn't cross
+    std::vector<uint32_t> m_blockFirstVertex;
+    std::vector<uint32_t> m_blockFirstIndex;        // per m_meshBlocks entry
+    int m_numDirty = 0;
+    int m_numRebuilt = 0;
+};
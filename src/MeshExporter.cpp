@@ -0,0 +1,167 @@
+#include "MeshExporter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+MeshExporter::MeshExporter(const std::filesystem::path& directory, int queueFrames)
+    : m_directory(directory), m_slots(queueFrames > 0 ? queueFrames : 1)
+{
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    if (error)
+        throw std::runtime_error("can't create mesh export directory '" + m_directory.string() + "': " + error.message());
+
+    m_thread = std::thread([this] { WriterLoop(); });
+}
+
+MeshExporter::~MeshExporter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+}
+
+void MeshExporter::RethrowError()
+{
+    if (m_error)
+        std::rethrow_exception(m_error);
+}
+
+void MeshExporter::Submit(unsigned long long frame, const MCVertex* vertices, int numVertices, const uint32_t* indices, int numIndices)
+{
+    Slot* slot;
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_queued < m_slots.size() || m_error; });
+        m_stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        RethrowError();
+        slot = &m_slots[(m_head + m_queued) % m_slots.size()];
+    }
+
+    // nobody else touches a slot that isn't queued, copy without the lock
+    slot->frame = frame;
+    slot->vertices.assign(vertices, vertices + numVertices);
+    slot->indices.assign(indices, indices + numIndices);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued++;
+    }
+    m_wake.notify_one();
+}
+
+void MeshExporter::Finish()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_queued == 0 || m_error; });
+    RethrowError();
+}
+
+std::filesystem::path MeshExporter::FramePath(unsigned long long frame) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "mesh_%06llu.ply", frame);
+    return m_directory / name;
+}
+
+size_t MeshExporter::WritePLY(const std::filesystem::path& path, const MCVertex* vertices, int numVertices,
+    const uint32_t* indices, int numIndices)
+{
+    const int numFaces = numIndices / 3;
+    char header[512];
+    int headerSize = snprintf(header, sizeof(header),
+        "ply\n"
+        "format binary_little_endian 1.0\n"
+        "element vertex %d\n"
+        "property float x\nproperty float y\nproperty float z\n"
+        "property float nx\nproperty float ny\nproperty float nz\n"
+        "element face %d\n"
+        "property list uchar uint vertex_indices\n"
+        "end_header\n", numVertices, numFaces);
+
+    // the whole file in one buffer, one write. MCVertex is exactly the 6
+    // floats of a vertex and every target we build for is little endian
+    static_assert(sizeof(MCVertex) == 6 * sizeof(float), "MCVertex isn't the ply vertex layout");
+    const size_t faceBytes = 1 + 3 * sizeof(uint32_t);
+    std::vector<char> data(headerSize + numVertices * sizeof(MCVertex) + numFaces * faceBytes);
+    char* out = data.data();
+    memcpy(out, header, headerSize);
+    out += headerSize;
+    memcpy(out, vertices, numVertices * sizeof(MCVertex));
+    out += numVertices * sizeof(MCVertex);
+    for (int f = 0; f < numFaces; f++) {
+        *out = 3;
+        memcpy(out + 1, indices + f * 3, 3 * sizeof(uint32_t));
+        out += faceBytes;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), (std::streamsize)data.size());
+    file.close();
+    if (!file)
+        throw std::runtime_error("can't write '" + path.string() + "'");
+    return data.size();
+}
+
+void MeshExporter::WriterLoop()
+{
+    while (true) {
+        Slot* slot;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_quit || m_queued > 0; });
+            if (m_queued == 0 || m_error) return;   // quit and nothing left, or no point going on
+            slot = &m_slots[m_head];
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::exception_ptr error;
+        size_t bytes = 0;
+        try {
+            bytes = WritePLY(FramePath(slot->frame), slot->vertices.data(), (int)slot->vertices.size(),
+                slot->indices.data(), (int)slot->indices.size());
+        } catch (...) {
+            error = std::current_exception();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (error) {
+                m_error = error;
+            } else {
+                m_framesWritten++;
+                m_bytesWritten += bytes;
+                m_writeSeconds += seconds;
+            }
+            m_head = (m_head + 1) % m_slots.size();
+            m_queued--;
+        }
+        m_done.notify_all();
+    }
+}
+
+unsigned long long MeshExporter::GetFramesWritten() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_framesWritten;
+}
+
+unsigned long long MeshExporter::GetBytesWritten() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytesWritten;
+}
+
+double MeshExporter::GetWriteSeconds() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_writeSeconds;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MarchingCubes.h"
+
+// surface mesh per frame as a numbered binary ply sequence (mesh_export_dir),
+// for offline rendering. Submit copies the mesh into one of queueFrames
+// slots and returns, an i/o thread of its own writes them out in order.
+// when every slot is still waiting for the disk, Submit waits for one
+// instead of dropping the frame, so a slow disk slows the simulation down
+// rather than leaving holes in the sequence. the time spent there is
+// GetStallSeconds.
+//
+// a failed write is rethrown by the next Submit or Finish, nothing after it
+// gets written.
+class MeshExporter {
+public:
+    MeshExporter(const std::filesystem::path& directory, int queueFrames);
+    ~MeshExporter();    // writes out what's queued, errors are lost here, call Finish first
+
+    MeshExporter(const MeshExporter&) = delete;
+    MeshExporter& operator=(const MeshExporter&) = delete;
+
+    // frame is only the number in the file name
+    void Submit(unsigned long long frame, const MCVertex* vertices, int numVertices, const uint32_t* indices, int numIndices);
+    void Submit(unsigned long long frame, const std::vector<MCVertex>& vertices, const std::vector<uint32_t>& indices)
+    {
+        Submit(frame, vertices.data(), (int)vertices.size(), indices.data(), (int)indices.size());
+    }
+
+    // waits until everything submitted is on disk
+    void Finish();
+
+    // <directory>/mesh_000042.ply
+    std::filesystem::path FramePath(unsigned long long frame) const;
+
+    // little endian floats x y z nx ny nz, faces as uchar 3 + 3 uints.
+    // returns the file size
+    static size_t WritePLY(const std::filesystem::path& path, const MCVertex* vertices, int numVertices,
+        const uint32_t* indices, int numIndices);
+
+    int GetQueueFrames() const { return (int)m_slots.size(); }
+
+    // written so far, by the i/o thread
+    unsigned long long GetFramesWritten() const;
+    unsigned long long GetBytesWritten() const;
+    double GetWriteSeconds() const;
+
+    // Submit waiting for a free slot
+    double GetStallSeconds() const { return m_stallSeconds; }
+
+private:
+    struct Slot {
+        unsigned long long frame = 0;
+        std::vector<MCVertex> vertices;     // kept between frames, only grow
+        std::vector<uint32_t> indices;
+    };
+
+    void WriterLoop();
+    void RethrowError();    // under m_mutex
+
+    std::filesystem::path m_directory;
+    std::vector<Slot> m_slots;      // ring, [m_head, m_head + m_queued) wait for the writer
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;     // writer: something queued or quit
+    std::condition_variable m_done;     // Submit/Finish: a slot came free
+    size_t m_head = 0;
+    size_t m_queued = 0;
+    bool m_quit = false;
+    std::exception_ptr m_error;
+
+    unsigned long long m_framesWritten = 0;
+    unsigned long long m_bytesWritten = 0;
+    double m_writeSeconds = 0.0;
+    double m_stallSeconds = 0.0;    // caller's thread only
+
+    std::thread m_thread;   // last, starts once everything above exists
+};
@@ -0,0 +1,79 @@
+#include "NeighborList.h"
+
+static const int PARTICLE_GRAIN = 256;
+
+void NeighborList::Allocate(int count)
+{
+    m_offset.resize(count + 1);
+    m_buildPoints.Resize(count);
+}
+
+void NeighborList::FinishOffsets(ThreadPool& pool, int count)
+{
+    // counts -> offsets, the last entry becomes the total
+    m_offset[count] = 0;
+    m_scan.Scan(pool, m_offset.data(), m_offset.data(), count + 1, ScanMode::Exclusive);
+
+    size_t numPairs = m_offset[count];
+    m_index.resize(numPairs);
+    m_w.resize(numPairs);
+    m_gx.resize(numPairs);
+    m_gy.resize(numPairs);
+    m_gz.resize(numPairs);
+}
+
+bool NeighborList::IsStillValid(ThreadPool& pool, const Float3Stream& points, int count, float maxDisplacement) const
+{
+    if (count != m_count) return false;
+
+    const float max2 = maxDisplacement * maxDisplacement;
+
+    return pool.ParallelReduce(count, PARTICLE_GRAIN, true,
+        [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                float3 d = points.Get(i) - m_buildPoints.Get(i);
+                if (dot(d, d) > max2) return false;
+            }
+            return true;
+        },
+        [](bool a, bool b) { return a && b; });
+}
+
+// r = pos_i - pos_j for one chunk of pairs, reused by every thread
+struct PairScratch {
+    AlignedVector<float> rx, ry, rz;
+};
+
+static thread_local PairScratch t_pairScratch;
+
+void NeighborList::EvaluateKernels(ThreadPool& pool, const SPHKernelTable& kernels, const SPHKernelConstants& k,
+    const Float3Stream& points, int count)
+{
+    pool.ParallelFor(count, PARTICLE_GRAIN, [&](int begin, int end) {
+        // the pairs of a range of particles are contiguous, so one kernel
+        // call covers the whole chunk
+        size_t first = m_offset[begin];
+        size_t last = m_offset[end];
+        int n = (int)(last - first);
+
+        PairScratch& s = t_pairScratch;
+        if (s.rx.size() < (size_t)n) {
+            s.rx.resize(n);
+            s.ry.resize(n);
+            s.rz.resize(n);
+        }
+
+        for (int i = begin; i < end; i++) {
+            float3 pos_i = points.Get(i);
+            for (uint32_t p = m_offset[i]; p < m_offset[i + 1]; p++) {
+                int j = m_index[p];
+                s.rx[p - first] = pos_i.x - points.x[j];
+                s.ry[p - first] = pos_i.y - points.y[j];
+                s.rz[p - first] = pos_i.z - points.z[j];
+            }
+        }
+
+        kernels.poly6(k, s.rx.data(), s.ry.data(), s.rz.data(), m_w.data() + first, n);
+        kernels.spikyGradient(k, s.rx.data(), s.ry.data(), s.rz.data(), m_gx.data() + first, m_gy.data() + first, m_gz.data() + first, n);
+    });
+}
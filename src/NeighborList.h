@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ParticleStore.h"
+#include "PrefixScan.h"
+#include "SimMath.h"
+#include "SPHKernels.h"
+#include "ThreadPool.h"
+
+// per-frame neighbor list for the cpu solver, compressed sparse rows over the
+// sorted particles: the neighbors of sorted slot i are
+// m_index[m_offset[i] .. m_offset[i + 1]).
+//
+// lambda, delta and the density half of xsph all measure distances on the same
+// sorted predicted positions, which don't move within a frame. so the stencil
+// walk, the distance test and both kernels are done once per pair per frame
+// and every pass after that just streams through the cached values.
+//
+// with a skin radius the list is built with cutoff h + skin and kept across
+// frames (verlet list) until some particle has moved more than skin / 2 since
+// the build. the sorted order is kept too, so the slot indices stay valid.
+class NeighborList {
+public:
+    // walks the stencil of every sorted point (twice, count then fill) and
+    // keeps the pairs closer than cutoff. points are in sorted order.
+    template <typename Grid>
+    void Build(ThreadPool& pool, const Grid& grid, const Float3Stream& points, int count, float cutoff);
+
+    // false once any point moved further than maxDisplacement since Build
+    bool IsStillValid(ThreadPool& pool, const Float3Stream& points, int count, float maxDisplacement) const;
+
+    // Poly6 and SpikyGradient for every pair at the current positions
+    void EvaluateKernels(ThreadPool& pool, const SPHKernelTable& kernels, const SPHKernelConstants& k,
+        const Float3Stream& points, int count);
+
+    bool IsBuilt() const { return m_count > 0; }
+    void Invalidate() { m_count = 0; }
+
+    int GetBegin(int i) const { return (int)m_offset[i]; }
+    int GetEnd(int i) const { return (int)m_offset[i + 1]; }
+    size_t GetNumPairs() const { return m_count > 0 ? m_offset[m_count] : 0; }
+    unsigned long long GetBuildCount() const { return m_buildCount; }
+
+    // per pair, indexed like m_index
+    std::vector<int> m_index;       // sorted slot j
+    AlignedVector<float> m_w;       // Poly6
+    AlignedVector<float> m_gx;      // SpikyGradient
+    AlignedVector<float> m_gy;
+    AlignedVector<float> m_gz;
+
+private:
+    void Allocate(int count);
+    void FinishOffsets(ThreadPool& pool, int count);
+
+    std::vector<uint32_t> m_offset;     // count + 1 entries, neighbor counts before the scan
+    Float3Stream m_buildPoints;         // positions at the last build, for the skin test
+    PrefixScan<uint32_t> m_scan;
+    int m_count = 0;
+    unsigned long long m_buildCount = 0;
+};
+
+template <typename Grid>
+void NeighborList::Build(ThreadPool& pool, const Grid& grid, const Float3Stream& points, int count, float cutoff)
+{
+    const float cutoff2 = cutoff * cutoff;
+    const int grain = 256;
+
+    Allocate(count);
+
+    // count
+    pool.ParallelFor(count, grain, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float3 pos_i = points.Get(i);
+            uint32_t n = 0;
+            grid.ForEachNeighborCell(pos_i, [&](int start, int cellCount) {
+                for (int j = start; j < start + cellCount; j++) {
+                    float3 r = pos_i - points.Get(j);
+                    n += dot(r, r) <= cutoff2;
+                }
+            });
+            m_offset[i] = n;
+        }
+    });
+
+    FinishOffsets(pool, count);
+
+    // fill, same walk so the pairs come out in the same order the gather visits them
+    pool.ParallelFor(count, grain, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float3 pos_i = points.Get(i);
+            int* out = &m_index[m_offset[i]];
+            grid.ForEachNeighborCell(pos_i, [&](int start, int cellCount) {
+                for (int j = start; j < start + cellCount; j++) {
+                    float3 r = pos_i - points.Get(j);
+                    if (dot(r, r) <= cutoff2)
+                        *out++ = j;
+                }
+            });
+
+            m_buildPoints.Set(i, pos_i);
+        }
+    });
+
+    m_count = count;
+    m_buildCount++;
+}
@@ -0,0 +1,177 @@
+#include "ParticleCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+static const char CACHE_MAGIC[8] = { 'P', 'H', 'C', 'A', 'C', 'H', 'E', '\0' };
+static const uint64_t CACHE_ALIGNMENT = 64;
+
+static uint64_t ArrayBytes(int numParticles)
+{
+    return (numParticles * sizeof(float) + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+// the store's array for one component of a channel, const or not
+template <typename Store>
+static auto& StoreComponent(Store& particles, CacheChannel channel, int component)
+{
+    if (channel == CacheChannel::Density) return particles.density;
+    auto& stream = channel == CacheChannel::Position ? particles.position : particles.velocity;
+    return component == 0 ? stream.x : component == 1 ? stream.y : stream.z;
+}
+
+uint64_t ParticleCache::ComponentOffset(uint32_t channels, int numParticles, CacheChannel channel, int component)
+{
+    int arrays = 0;
+    for (int c = 0; c < (int)channel; c++)
+        if ((channels >> c) & 1)
+            arrays += GetComponents((CacheChannel)c);
+    return (arrays + component) * ArrayBytes(numParticles);
+}
+
+uint64_t ParticleCache::FrameBytes(uint32_t channels, int numParticles)
+{
+    return ComponentOffset(channels, numParticles, CacheChannel::Count, 0);
+}
+
+ParticleCache::ParticleCache(const std::filesystem::path& path)
+    : m_file(path)
+{
+    const std::string name = "'" + path.string() + "'";
+    if (m_file.GetSize() < sizeof(CacheHeader))
+        throw std::runtime_error(name + " is too short for a particle cache");
+    memcpy(&m_header, m_file.GetData(), sizeof(CacheHeader));
+
+    if (memcmp(m_header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0)
+        throw std::runtime_error(name + " isn't a particle cache");
+    if (m_header.version != VERSION)
+        throw std::runtime_error(name + " is cache version " + std::to_string(m_header.version) +
+            ", this build reads " + std::to_string(VERSION));
+    if (m_header.numFrames == 0)
+        throw std::runtime_error(name + " has no frames, the recording wasn't finished");
+    if ((m_header.channels & ~ALL_CHANNELS) != 0 ||
+        m_header.frameBytes != FrameBytes(m_header.channels, m_header.numParticles))
+        throw std::runtime_error(name + " has a broken header");
+
+    // everything the index points at has to be inside the file, then
+    // nothing after this needs to check
+    const uint64_t size = m_file.GetSize();
+    if (m_header.indexOffset % CACHE_ALIGNMENT != 0 ||
+        m_header.indexOffset + (uint64_t)m_header.numFrames * sizeof(CacheIndexEntry) > size)
+        throw std::runtime_error(name + " is truncated");
+    m_index = reinterpret_cast<const CacheIndexEntry*>(m_file.GetData() + m_header.indexOffset);
+    for (uint32_t f = 0; f < m_header.numFrames; f++) {
+        if (m_index[f].offset % CACHE_ALIGNMENT != 0 || m_index[f].offset + m_header.frameBytes > size)
+            throw std::runtime_error(name + ": frame " + std::to_string(f) + " is out of range");
+    }
+}
+
+int ParticleCache::FrameAt(double time) const
+{
+    const CacheIndexEntry* end = m_index + m_header.numFrames;
+    const CacheIndexEntry* next = std::upper_bound(m_index, end, time,
+        [](double t, const CacheIndexEntry& entry) { return t < entry.time; });
+    return next == m_index ? 0 : (int)(next - m_index) - 1;
+}
+
+const float* ParticleCache::GetComponent(int frame, CacheChannel channel, int component) const
+{
+    if (!HasChannel(channel)) return nullptr;
+    uint64_t offset = m_index[frame].offset + ComponentOffset(m_header.channels, m_header.numParticles, channel, component);
+    return reinterpret_cast<const float*>(m_file.GetData() + offset);
+}
+
+void ParticleCache::Load(int frame, ParticleStore& particles) const
+{
+    const size_t n = m_header.numParticles;
+    if (particles.Size() != n)
+        particles.Resize(n);
+
+    for (int c = 0; c < (int)CacheChannel::Count; c++) {
+        CacheChannel channel = (CacheChannel)c;
+        for (int i = 0; i < GetComponents(channel); i++) {
+            const float* src = GetComponent(frame, channel, i);
+            if (!src) break;
+            memcpy(StoreComponent(particles, channel, i).data(), src, n * sizeof(float));
+        }
+    }
+}
+
+void ParticleCache::Prefetch(int frame) const
+{
+    m_file.Prefetch(m_index[frame].offset, m_header.frameBytes);
+}
+
+ParticleCacheWriter::ParticleCacheWriter(const std::filesystem::path& path, int numParticles, uint32_t channels)
+    : m_path(path), m_file(path, std::ios::binary | std::ios::trunc)
+{
+    if (!m_file)
+        throw std::runtime_error("can't create particle cache '" + path.string() + "'");
+    if (numParticles <= 0 || channels == 0 || (channels & ~ParticleCache::ALL_CHANNELS) != 0)
+        throw std::logic_error("particle cache needs particles and a set of channels");
+
+    // numFrames stays 0 in here until Finish, a crashed run isn't mistaken for a short one
+    m_header = {};
+    memcpy(m_header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    m_header.version = ParticleCache::VERSION;
+    m_header.numParticles = (uint32_t)numParticles;
+    m_header.channels = channels;
+    m_header.frameBytes = ParticleCache::FrameBytes(channels, numParticles);
+    m_file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+    m_offset = sizeof(m_header);
+}
+
+ParticleCacheWriter::~ParticleCacheWriter()
+{
+    try {
+        Finish();
+    } catch (...) {
+    }
+}
+
+void ParticleCacheWriter::WriteArray(const float* data)
+{
+    static const char zeros[CACHE_ALIGNMENT] = {};
+    const uint64_t bytes = m_header.numParticles * sizeof(float);
+    m_file.write(reinterpret_cast<const char*>(data), (std::streamsize)bytes);
+    m_file.write(zeros, (std::streamsize)(ArrayBytes(m_header.numParticles) - bytes));
+}
+
+void ParticleCacheWriter::Append(const ParticleStore& particles, double time)
+{
+    if (m_finished)
+        throw std::logic_error("Append after Finish");
+    if (particles.Size() < m_header.numParticles)
+        throw std::logic_error("particle cache frame has fewer particles than the header");
+
+    m_index.push_back({ m_offset, time });
+    for (int c = 0; c < (int)CacheChannel::Count; c++) {
+        CacheChannel channel = (CacheChannel)c;
+        if (!((m_header.channels >> c) & 1)) continue;
+        for (int i = 0; i < ParticleCache::GetComponents(channel); i++)
+            WriteArray(StoreComponent(particles, channel, i).data());
+    }
+    m_offset += m_header.frameBytes;
+
+    if (!m_file)
+        throw std::runtime_error("can't write particle cache '" + m_path.string() + "'");
+}
+
+void ParticleCacheWriter::Finish()
+{
+    if (m_finished) return;
+    m_finished = true;
+
+    // frames are whole multiples of 64 after a 64 byte header, so the index is aligned too
+    m_header.numFrames = (uint32_t)m_index.size();
+    m_header.indexOffset = m_offset;
+    m_file.write(reinterpret_cast<const char*>(m_index.data()), (std::streamsize)(m_index.size() * sizeof(CacheIndexEntry)));
+    m_file.seekp(0);
+    m_file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+    m_file.close();
+
+    if (!m_file)
+        throw std::runtime_error("can't write particle cache '" + m_path.string() + "'");
+}
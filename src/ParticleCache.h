@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "MappedFile.h"
+#include "ParticleStore.h"
+
+// recorded simulation, one file per run (cache_record). the reader maps the
+// file and hands out pointers straight into it, any frame is an index lookup
+// away and nothing needs a solver.
+//
+// layout, little endian, everything 64 byte aligned:
+//
+//     CacheHeader
+//     frame 0, frame 1, ...        every frame the same size
+//     CacheIndexEntry per frame    at header.indexOffset
+//
+// a frame is one chunk per recorded channel in CacheChannel order, the
+// components of a channel as separate float arrays like Float3Stream (x for
+// all particles, then y, then z), each padded to 64 bytes. the channels are
+// the GPUParticle fields worth replaying, the solver's scratch
+// (predictedPosition, lambda, xsph, delta) isn't recorded.
+enum class CacheChannel {
+    Position,   // 3 floats
+    Velocity,   // 3 floats
+    Density,    // 1 float
+    Count
+};
+
+struct CacheHeader {
+    char magic[8];              // "PHCACHE\0"
+    uint32_t version;
+    uint32_t numParticles;
+    uint32_t channels;          // bit per CacheChannel
+    uint32_t numFrames;         // 0 until the writer finished, the index isn't there before that
+    uint64_t frameBytes;
+    uint64_t indexOffset;
+    uint8_t reserved[24];
+};
+
+struct CacheIndexEntry {
+    uint64_t offset;            // of the frame's first chunk
+    double time;                // simulated seconds
+};
+
+static_assert(sizeof(CacheHeader) == 64, "CacheHeader is part of the file format");
+static_assert(sizeof(CacheIndexEntry) == 16, "CacheIndexEntry is part of the file format");
+
+class ParticleCache {
+public:
+    static const uint32_t VERSION = 1;
+    static const uint32_t ALL_CHANNELS = (1u << (int)CacheChannel::Count) - 1;
+
+    static int GetComponents(CacheChannel channel) { return channel == CacheChannel::Density ? 1 : 3; }
+    // where a component's array starts inside a frame
+    static uint64_t ComponentOffset(uint32_t channels, int numParticles, CacheChannel channel, int component);
+    static uint64_t FrameBytes(uint32_t channels, int numParticles);
+
+    // throws std::runtime_error unless it's a finished cache
+    explicit ParticleCache(const std::filesystem::path& path);
+
+    int GetNumFrames() const { return (int)m_header.numFrames; }
+    int GetNumParticles() const { return (int)m_header.numParticles; }
+    bool HasChannel(CacheChannel channel) const { return (m_header.channels >> (int)channel) & 1; }
+    double GetTime(int frame) const { return m_index[frame].time; }
+    // last frame recorded at or before time, clamped to the recording
+    int FrameAt(double time) const;
+    uint64_t GetFrameBytes() const { return m_header.frameBytes; }
+
+    // numParticles floats inside the mapping, nullptr if the channel wasn't recorded
+    const float* GetComponent(int frame, CacheChannel channel, int component) const;
+
+    // copies the recorded channels of frame into particles (resized to fit),
+    // everything else is left alone
+    void Load(int frame, ParticleStore& particles) const;
+
+    // asks the os to start reading the frame in
+    void Prefetch(int frame) const;
+
+private:
+    MappedFile m_file;
+    CacheHeader m_header;
+    const CacheIndexEntry* m_index = nullptr;
+};
+
+// appends frames as they come, the index and frame count go in on Finish.
+// a run that never finishes leaves a file the reader refuses
+class ParticleCacheWriter {
+public:
+    ParticleCacheWriter(const std::filesystem::path& path, int numParticles, uint32_t channels = ParticleCache::ALL_CHANNELS);
+    ~ParticleCacheWriter();     // calls Finish, errors are lost there
+
+    ParticleCacheWriter(const ParticleCacheWriter&) = delete;
+    ParticleCacheWriter& operator=(const ParticleCacheWriter&) = delete;
+
+    // the first numParticles of particles, time in simulated seconds
+    void Append(const ParticleStore& particles, double time);
+    void Finish();
+
+    int GetNumFrames() const { return (int)m_index.size(); }
+    uint64_t GetBytesWritten() const { return m_offset; }
+
+private:
+    void WriteArray(const float* data);
+
+    std::filesystem::path m_path;
+    std::ofstream m_file;
+    CacheHeader m_header;
+    std::vector<CacheIndexEntry> m_index;
+    uint64_t m_offset = 0;      // end of what's written so far
+    bool m_finished = false;
+};
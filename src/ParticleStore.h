@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "SimMath.h"
+
+// cache line (and avx-512 register) aligned allocator for the attribute arrays
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+    static const size_t ALIGNMENT = 64;
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT)));
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        ::operator delete(p, std::align_val_t(ALIGNMENT));
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// one float3 attribute stored as three separate component arrays
+struct Float3Stream {
+    AlignedVector<float> x, y, z;
+
+    void Resize(size_t n) { x.resize(n); y.resize(n); z.resize(n); }
+
+    float3 Get(size_t i) const { return { x[i], y[i], z[i] }; }
+    void Set(size_t i, float3 v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+};
+
+// structure-of-arrays particle storage, replaces the old AoS Particle struct.
+// same attributes as GPUParticle in stdafx.h (originalIndex is a sort artifact
+// and lives with whoever does the sorting). loops only touch the arrays they
+// need instead of dragging whole particles through the cache.
+struct ParticleStore {
+    Float3Stream position;
+    Float3Stream predictedPosition;
+    Float3Stream velocity;
+    AlignedVector<float> density;
+    AlignedVector<float> lambda;
+    Float3Stream xsph;
+    Float3Stream delta;
+
+    size_t Size() const { return density.size(); }
+
+    // new particles come back zeroed
+    void Resize(size_t n)
+    {
+        position.Resize(n);
+        predictedPosition.Resize(n);
+        velocity.Resize(n);
+        density.resize(n);
+        lambda.resize(n);
+        xsph.Resize(n);
+        delta.Resize(n);
+    }
+};
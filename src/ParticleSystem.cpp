@@ -1,51 +1,97 @@
 #include "stdafx.h"
 #include "ParticleSystem.h"
+#include "VertexCodec.h"
 #include <iostream>
 #include <algorithm>
 
+// particles per chunk for the host loops below, they're only a few flops each
+static const int HOST_GRAIN = 4096;
+
 ParticleSystem::ParticleSystem() 
 {
+    Configure(SimulationConfig());
+}
+
+void ParticleSystem::Configure(const SimulationConfig& config)
+{
+    config.Validate();
+    m_config = config;
+
+    NUM_X = config.numX;
+    NUM_Y = config.numY;
+    NUM_Z = config.numZ;
+    NUM_PARTICLES = config.GetNumParticles();
+    PARTICLE_SIZE = config.particleSize;
+    PARTICLE_SPACING = config.particleSpacing;
+    PARTICLE_OFFSET = XMFLOAT3(config.particleOffset.x, config.particleOffset.y, config.particleOffset.z);
+
+    BBOX_SIZE_XZ = config.bboxSizeXZ;
+    BBOX_SIZE_Y = config.bboxSizeY;
+    CELL_SIZE = config.cellSize;
+    RHO_0 = config.rho0;
+    EPSILON = config.epsilon;
+
+    DAMPING = config.damping;
+    VISCOSITY = config.viscosity;
+    ITERATIONS = config.iterations;
+
+    int3 nsDim = config.GetNSDim();
+    NS_DIM_X = nsDim.x;
+    NS_DIM_Y = nsDim.y;
+    NS_DIM_Z = nsDim.z;
+    NS_NUM_CELLS = config.GetNSNumCells();
+
+    MC_DIM_X = config.mcDimX;
+    MC_DIM_Y = config.mcDimY;
+    MC_DIM_Z = config.mcDimZ;
+    MC_NUM_CELLS = config.GetMCNumCells();
+    MC_CELL_SIZE = config.GetMCCellSize();
+    MC_ISO = config.mcIso;
+    MC_MAX_TRIS = config.GetMCMaxTris();
+    MC_MAX_VERTICES = config.GetMCMaxVertices();
+    // welded meshes come out at about half a vertex per triangle, so the
+    // same number for both leaves plenty of room for vertices
+    m_mcTriCapacity = min((UINT)config.mcReserveTris, MC_MAX_TRIS);
+    m_mcVertexCapacity = min((UINT)config.mcReserveTris, MC_MAX_VERTICES);
+    MC_VERTEX_STRIDE = config.mcCompactVertices ? sizeof(PackedVertex) : sizeof(Vertex);
+    MC_BLOCK_DIM_X = (MC_DIM_X + MC_BLOCK_SIZE - 1) / MC_BLOCK_SIZE;
+    MC_BLOCK_DIM_Y = (MC_DIM_Y + MC_BLOCK_SIZE - 1) / MC_BLOCK_SIZE;
+    MC_BLOCK_DIM_Z = (MC_DIM_Z + MC_BLOCK_SIZE - 1) / MC_BLOCK_SIZE;
+    MC_NUM_BLOCKS = MC_BLOCK_DIM_X * MC_BLOCK_DIM_Y * MC_BLOCK_DIM_Z;
+
     m_instancer = Instancer(PARTICLE_SIZE);
 }
 
 void ParticleSystem::LoadParticles()
 {
-    m_particles.resize(NUM_PARTICLES);
+    m_config.SpawnParticles(m_particles, &m_cpuSolver.GetPool());
     m_instancer.m_instances.resize(NUM_PARTICLES);
-
-    int i = 0;
-    for (int x = 0; x < NUM_X; x++)
-    for (int y = 0; y < NUM_Y; y++)
-    for (int z = 0; z < NUM_Z; z++)
-    {
-        float particleRadius = 0.15f;
-
-        m_particles[i].position = {
-            (x - NUM_X / 2.0f) * PARTICLE_SPACING + PARTICLE_OFFSET.x,
-            y * PARTICLE_SPACING + PARTICLE_OFFSET.y,
-            (z - NUM_Z / 2.0f) * PARTICLE_SPACING + PARTICLE_OFFSET.z,
-        };
-
-        m_particles[i].velocity = { 0, 0, 0 };
-        m_particles[i].predictedPosition = m_particles[i].position;
-        m_particles[i].density = 0.0f;
-        m_particles[i].lambda = 0.0f;
-        m_particles[i].delta = { 0, 0, 0 };
-        m_particles[i].xsph = { 0, 0, 0 };
-        i++;
-    }
+    m_gpuParticlesCurrent = false;
 }
 
-ComPtr<ID3DBlob> CompileHelper(std::wstring shaderPath, const char* entry) 
+ComPtr<ID3DBlob> CompileHelper(std::wstring shaderPath, const char* entry, const D3D_SHADER_MACRO* defines = nullptr) 
 {
     ComPtr<ID3DBlob> computeShader, computeError;
     HRESULT hr = D3DCompileFromFile(shaderPath.c_str(),
-        nullptr, nullptr, entry, "cs_5_0", 0, 0, &computeShader, &computeError);
+        defines, nullptr, entry, "cs_5_0", 0, 0, &computeShader, &computeError);
     if (computeError) OutputDebugStringA((char*)computeError->GetBufferPointer());
     ThrowIfFailed(hr);
     return computeShader;
 };
 
+// cpu-visible buffer on an upload or readback heap
+ComPtr<ID3D12Resource> MakeHostBufferHelper(UINT byteSize, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_STATES state, ID3D12Device* device)
+{
+    ComPtr<ID3D12Resource> buffer;
+    CD3DX12_HEAP_PROPERTIES heap(heapType);
+    auto desc = CD3DX12_RESOURCE_DESC::Buffer(byteSize);
+    ThrowIfFailed(device->CreateCommittedResource(
+        &heap, D3D12_HEAP_FLAG_NONE, &desc,
+        state, nullptr,
+        IID_PPV_ARGS(&buffer)));
+    return buffer;
+}
+
 ComPtr<ID3D12PipelineState> MakePSOHelper(ComPtr<ID3DBlob> computeShader, ComPtr<ID3D12RootSignature> rootSignature, ID3D12Device* device) 
 {
     D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
@@ -57,6 +103,21 @@ ComPtr<ID3D12PipelineState> MakePSOHelper(ComPtr<ID3DBlob> computeShader, ComPtr
     return pso;
 };
 
+// gpu-only buffer for the renderer to draw from. starts in COMMON so the copy
+// on the compute queue and the draw on the direct queue both get there by
+// implicit promotion, no cross-queue barriers
+ComPtr<ID3D12Resource> MakeDrawBufferHelper(UINT byteSize, ID3D12Device* device)
+{
+    ComPtr<ID3D12Resource> buffer;
+    CD3DX12_HEAP_PROPERTIES heap(D3D12_HEAP_TYPE_DEFAULT);
+    auto desc = CD3DX12_RESOURCE_DESC::Buffer(byteSize);
+    ThrowIfFailed(device->CreateCommittedResource(
+        &heap, D3D12_HEAP_FLAG_NONE, &desc,
+        D3D12_RESOURCE_STATE_COMMON, nullptr,
+        IID_PPV_ARGS(&buffer)));
+    return buffer;
+}
+
 ComPtr<ID3D12Resource> MakeBufferHelper(UINT byteSize, ID3D12Device* device) 
 {
     auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(byteSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
@@ -72,12 +133,12 @@ void ParticleSystem::CreateComputePipeline(
     ID3D12Device *device,
     std::wstring shaderPath,
     std::wstring mcShaderPath,
-    ComPtr<ID3D12CommandAllocator> &commandAllocator,
+    ComPtr<ID3D12CommandAllocator> (&commandAllocators)[FRAMES_IN_FLIGHT],
     ComPtr<ID3D12GraphicsCommandList> &commandList)
 {
     // 1. root signature for shaders.hlsl
     {
-        CD3DX12_ROOT_PARAMETER params[12];
+        CD3DX12_ROOT_PARAMETER params[24];
         params[0].InitAsConstantBufferView(0);  // b0: NSConstants
         params[1].InitAsConstantBufferView(1);  // b1: MCConstants
 
@@ -94,9 +155,21 @@ void ParticleSystem::CreateComputePipeline(
         params[9].InitAsUnorderedAccessView(7); // u7: mcVertexBuffer
         params[10].InitAsUnorderedAccessView(8); // u8: mcArgs
         params[11].InitAsUnorderedAccessView(9); // u9: sdfVolume
+        params[12].InitAsUnorderedAccessView(10); // u10: mcEdgeMap
+        params[13].InitAsUnorderedAccessView(11); // u11: mcIndexBuffer
+        params[14].InitAsUnorderedAccessView(12); // u12: mcBlockActive
+        params[15].InitAsUnorderedAccessView(13); // u13: mcBlockList
+        params[16].InitAsUnorderedAccessView(14); // u14: mcBlockArgs
+        params[17].InitAsUnorderedAccessView(15); // u15: mcBlockScan
+        params[18].InitAsUnorderedAccessView(16); // u16: sdfSeeds
+        params[19].InitAsConstants(4, 2);          // b2: SDFPass, changes per dispatch
+        params[20].InitAsUnorderedAccessView(17); // u17: mcMeshField
+        params[21].InitAsUnorderedAccessView(18); // u18: mcBlockState
+        params[22].InitAsUnorderedAccessView(19); // u19: mcPrevVertexBuffer
+        params[23].InitAsUnorderedAccessView(20); // u20: mcBlockLevel
 
         CD3DX12_ROOT_SIGNATURE_DESC rootDesc = {};
-        rootDesc.NumParameters = 12;
+        rootDesc.NumParameters = 24;
         rootDesc.pParameters = params;
         rootDesc.NumStaticSamplers = 0;
         rootDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
@@ -128,6 +201,7 @@ void ParticleSystem::CreateComputePipeline(
     ComPtr<ID3DBlob> collisionConstraints = CompileHelper(shaderPath, "CSCollisionConstraints");
     ComPtr<ID3DBlob> updateVelocity = CompileHelper(shaderPath, "CSUpdateVelocity");
     ComPtr<ID3DBlob> computeXSPH = CompileHelper(shaderPath, "CSComputeXSPH");
+    ComPtr<ID3DBlob> finalize = CompileHelper(shaderPath, "CSFinalize");
 
     m_psoPrediction = MakePSOHelper(prediction.Get(), m_computeRootSignature.Get(), device);
     m_psoComputeLambda = MakePSOHelper(computeLambda.Get(), m_computeRootSignature.Get(), device);
@@ -135,16 +209,78 @@ void ParticleSystem::CreateComputePipeline(
     m_psoCollisionConstraints = MakePSOHelper(collisionConstraints.Get(), m_computeRootSignature.Get(), device);
     m_psoUpdateVelocity = MakePSOHelper(updateVelocity.Get(), m_computeRootSignature.Get(), device);
     m_psoComputeXSPH = MakePSOHelper(computeXSPH.Get(), m_computeRootSignature.Get(), device);
+    m_psoFinalize = MakePSOHelper(finalize.Get(), m_computeRootSignature.Get(), device);
+
+    // ----- narrow band sdf kernels -----
+    ComPtr<ID3DBlob> sdfSeed = CompileHelper(shaderPath, "CSSDFSeed");
+    ComPtr<ID3DBlob> sdfFlood = CompileHelper(shaderPath, "CSSDFFlood");
+    ComPtr<ID3DBlob> sdfOutside = CompileHelper(shaderPath, "CSSDFOutside");
+    ComPtr<ID3DBlob> sdfResolve = CompileHelper(shaderPath, "CSSDFResolve");
+    m_psoSDFSeed = MakePSOHelper(sdfSeed.Get(), m_computeRootSignature.Get(), device);
+    m_psoSDFFlood = MakePSOHelper(sdfFlood.Get(), m_computeRootSignature.Get(), device);
+    m_psoSDFOutside = MakePSOHelper(sdfOutside.Get(), m_computeRootSignature.Get(), device);
+    m_psoSDFResolve = MakePSOHelper(sdfResolve.Get(), m_computeRootSignature.Get(), device);
 
     // ----- marching cubes kernels ----- 
-    ComPtr<ID3DBlob> clearArgs = CompileHelper(mcShaderPath, "CSClearArgs");
-    ComPtr<ID3DBlob> clearField = CompileHelper(mcShaderPath, "CSClearField");
-    ComPtr<ID3DBlob> buildScalarField = CompileHelper(mcShaderPath, "CSBuildScalarField");
-    ComPtr<ID3DBlob> marchingCubes = CompileHelper(mcShaderPath, "CSMarchingCubes");
-    m_psoClearArgs = MakePSOHelper(clearArgs.Get(), m_computeRootSignature.Get(), device);
+    // mc_compact_vertices switches the vertex buffer to PackedVertex,
+    // mc_gather the scalar field to float bits, mc_incremental meshes mcMeshField
+    std::vector<D3D_SHADER_MACRO> mcMacros;
+    if (m_config.mcCompactVertices) mcMacros.push_back({ "MC_COMPACT_VERTICES", "1" });
+    if (m_config.mcGather) mcMacros.push_back({ "MC_GATHER_FIELD", "1" });
+    if (m_config.mcIncremental) mcMacros.push_back({ "MC_INCREMENTAL_MESH", "1" });
+    mcMacros.push_back({ nullptr, nullptr });
+    const D3D_SHADER_MACRO* mcDefines = mcMacros.data();
+    ComPtr<ID3DBlob> clearField = CompileHelper(mcShaderPath, "CSClearField", mcDefines);
+    ComPtr<ID3DBlob> buildScalarField = CompileHelper(mcShaderPath, "CSBuildScalarField", mcDefines);
+    ComPtr<ID3DBlob> markFieldBlocks = CompileHelper(mcShaderPath, "CSMarkFieldBlocks", mcDefines);
+    ComPtr<ID3DBlob> gatherScalarField = CompileHelper(mcShaderPath, "CSGatherScalarField", mcDefines);
+    ComPtr<ID3DBlob> clearBlocks = CompileHelper(mcShaderPath, "CSClearBlocks", mcDefines);
+    ComPtr<ID3DBlob> clearActiveBlocks = CompileHelper(mcShaderPath, "CSClearActiveBlocks", mcDefines);
+    ComPtr<ID3DBlob> compactBlocks = CompileHelper(mcShaderPath, "CSCompactBlocks", mcDefines);
+    ComPtr<ID3DBlob> writeBlockArgs = CompileHelper(mcShaderPath, "CSWriteBlockArgs", mcDefines);
+    ComPtr<ID3DBlob> countBlocks = CompileHelper(mcShaderPath, "CSMCCountBlocks", mcDefines);
+    ComPtr<ID3DBlob> scanBlocks = CompileHelper(mcShaderPath, "CSMCScanBlocks", mcDefines);
+    ComPtr<ID3DBlob> weldBlocks = CompileHelper(mcShaderPath, "CSMCWeldBlocks", mcDefines);
+    ComPtr<ID3DBlob> emitBlocks = CompileHelper(mcShaderPath, "CSMCEmitBlocks", mcDefines);
+    ComPtr<ID3DBlob> clearBlockState = CompileHelper(mcShaderPath, "CSMCClearBlockState", mcDefines);
+    ComPtr<ID3DBlob> dirtyVertices = CompileHelper(mcShaderPath, "CSMCDirtyVertices", mcDefines);
+    ComPtr<ID3DBlob> updateMeshField = CompileHelper(mcShaderPath, "CSMCUpdateMeshField", mcDefines);
+    ComPtr<ID3DBlob> rebuildBlocks = CompileHelper(mcShaderPath, "CSMCRebuildBlocks", mcDefines);
+    ComPtr<ID3DBlob> lodLevels = CompileHelper(mcShaderPath, "CSLodLevels", mcDefines);
+    ComPtr<ID3DBlob> lodCountBlocks = CompileHelper(mcShaderPath, "CSLodCountBlocks", mcDefines);
+    ComPtr<ID3DBlob> lodWeldBlocks = CompileHelper(mcShaderPath, "CSLodWeldBlocks", mcDefines);
+    ComPtr<ID3DBlob> lodEmitBlocks = CompileHelper(mcShaderPath, "CSLodEmitBlocks", mcDefines);
     m_psoClearField = MakePSOHelper(clearField.Get(), m_computeRootSignature.Get(), device);
     m_psoBuildField = MakePSOHelper(buildScalarField.Get(), m_computeRootSignature.Get(), device);
-    m_psoMarchingCubes = MakePSOHelper(marchingCubes.Get(), m_computeRootSignature.Get(), device);
+    m_psoMarkFieldBlocks = MakePSOHelper(markFieldBlocks.Get(), m_computeRootSignature.Get(), device);
+    m_psoGatherField = MakePSOHelper(gatherScalarField.Get(), m_computeRootSignature.Get(), device);
+    m_psoClearBlocks = MakePSOHelper(clearBlocks.Get(), m_computeRootSignature.Get(), device);
+    m_psoClearActiveBlocks = MakePSOHelper(clearActiveBlocks.Get(), m_computeRootSignature.Get(), device);
+    m_psoCompactBlocks = MakePSOHelper(compactBlocks.Get(), m_computeRootSignature.Get(), device);
+    m_psoWriteBlockArgs = MakePSOHelper(writeBlockArgs.Get(), m_computeRootSignature.Get(), device);
+    m_psoCountBlocks = MakePSOHelper(countBlocks.Get(), m_computeRootSignature.Get(), device);
+    m_psoScanBlocks = MakePSOHelper(scanBlocks.Get(), m_computeRootSignature.Get(), device);
+    m_psoWeldBlocks = MakePSOHelper(weldBlocks.Get(), m_computeRootSignature.Get(), device);
+    m_psoEmitBlocks = MakePSOHelper(emitBlocks.Get(), m_computeRootSignature.Get(), device);
+    m_psoClearBlockState = MakePSOHelper(clearBlockState.Get(), m_computeRootSignature.Get(), device);
+    m_psoDirtyVertices = MakePSOHelper(dirtyVertices.Get(), m_computeRootSignature.Get(), device);
+    m_psoUpdateMeshField = MakePSOHelper(updateMeshField.Get(), m_computeRootSignature.Get(), device);
+    m_psoRebuildBlocks = MakePSOHelper(rebuildBlocks.Get(), m_computeRootSignature.Get(), device);
+    m_psoLodLevels = MakePSOHelper(lodLevels.Get(), m_computeRootSignature.Get(), device);
+    m_psoLodCountBlocks = MakePSOHelper(lodCountBlocks.Get(), m_computeRootSignature.Get(), device);
+    m_psoLodWeldBlocks = MakePSOHelper(lodWeldBlocks.Get(), m_computeRootSignature.Get(), device);
+    m_psoLodEmitBlocks = MakePSOHelper(lodEmitBlocks.Get(), m_computeRootSignature.Get(), device);
+
+    // plain dispatch args, nothing else changes between the indirect calls
+    {
+        D3D12_INDIRECT_ARGUMENT_DESC arg = {};
+        arg.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH;
+        D3D12_COMMAND_SIGNATURE_DESC sigDesc = {};
+        sigDesc.ByteStride = sizeof(D3D12_DISPATCH_ARGUMENTS);
+        sigDesc.NumArgumentDescs = 1;
+        sigDesc.pArgumentDescs = &arg;
+        ThrowIfFailed(device->CreateCommandSignature(&sigDesc, nullptr, IID_PPV_ARGS(&m_mcBlockDispatch)));
+    }
 
     // 4. all of the buffers
     m_nsParticlesIn = MakeBufferHelper(NUM_PARTICLES * sizeof(GPUParticle), device);
@@ -157,78 +293,61 @@ void ParticleSystem::CreateComputePipeline(
 
     // marching cubes
     m_mcScalarField = MakeBufferHelper((MC_DIM_X+1) * (MC_DIM_Y+1) * (MC_DIM_Z+1) * sizeof(float), device);
-    m_mcVertexBuffer = MakeBufferHelper(MC_MAX_TRIS * 3 * sizeof(Vertex), device);
-    m_mcIndirectArgs = MakeBufferHelper(sizeof(int), device);   // TODO: change this later
+    m_mcEdgeMap = MakeBufferHelper(MC_MAX_VERTICES * sizeof(UINT), device);     // one entry per possible vertex either way
+    m_mcIndirectArgs = MakeBufferHelper(2 * sizeof(UINT), device);     // index count, vertex count
+    m_mcBlockActive = MakeBufferHelper(MC_NUM_BLOCKS * sizeof(UINT), device);
+    m_mcBlockList = MakeBufferHelper((MC_NUM_BLOCKS + 1) * sizeof(UINT), device);
+    m_mcBlockArgs = MakeBufferHelper(sizeof(D3D12_DISPATCH_ARGUMENTS), device);
+    m_mcBlockScan = MakeBufferHelper(MC_NUM_BLOCKS * 2 * sizeof(UINT), device);
+    m_mcFieldCleared = false;
+    m_mcMeshField = MakeBufferHelper((MC_DIM_X+1) * (MC_DIM_Y+1) * (MC_DIM_Z+1) * sizeof(float), device);
+    m_mcBlockState = MakeBufferHelper(MC_NUM_BLOCKS * 2 * sizeof(UINT), device);
+    m_mcBlockLevel = MakeBufferHelper(MC_NUM_BLOCKS * sizeof(UINT), device);
 
     // sdf 
     m_nsSDFVolume = MakeBufferHelper(NS_NUM_CELLS * sizeof(float), device);
-
-    // upload buffer, which CPU writes to, then CopyResource to m_nsParticlesIn
-    {
-        CD3DX12_HEAP_PROPERTIES heap(D3D12_HEAP_TYPE_UPLOAD);
-        auto desc = CD3DX12_RESOURCE_DESC::Buffer(
-            NUM_PARTICLES * sizeof(GPUParticle));
-        ThrowIfFailed(device->CreateCommittedResource(
-            &heap, D3D12_HEAP_FLAG_NONE, &desc,
-            D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-            IID_PPV_ARGS(&m_nsUploadBuffer)));
+    m_sdfSeeds = MakeBufferHelper(2 * NS_NUM_CELLS * sizeof(XMFLOAT4), device);
+
+    // everything the host writes or reads per frame, one per frame in flight
+    for (UINT slot = 0; slot < FRAMES_IN_FLIGHT; slot++) {
+        // upload buffer, which CPU writes to, then CopyResource to m_nsParticlesIn
+        m_nsUploadBuffer[slot] = MakeHostBufferHelper(NUM_PARTICLES * sizeof(GPUParticle),
+            D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ, device);
+
+        // const buffers (256-byte aligned)
+        m_nsConstantBuffer[slot] = MakeHostBufferHelper((sizeof(NSConstants) + 255) & ~255,
+            D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ, device);
+        m_mcConstantBuffer[slot] = MakeHostBufferHelper((sizeof(MCConstants) + 255) & ~255,
+            D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ, device);
+
+        // readback buffers
+        m_nsReadbackParticlesIn[slot] = MakeHostBufferHelper(NUM_PARTICLES * sizeof(GPUParticle),
+            D3D12_HEAP_TYPE_READBACK, D3D12_RESOURCE_STATE_COPY_DEST, device);
+        m_mcReadbackArgs[slot] = MakeHostBufferHelper(2 * sizeof(UINT),
+            D3D12_HEAP_TYPE_READBACK, D3D12_RESOURCE_STATE_COPY_DEST, device);
+
+        // map once and keep them mapped, d3d12 allows it for upload and
+        // readback heaps. saves a Map/Unmap pair per buffer per frame
+        CD3DX12_RANGE noRead(0, 0);
+        ThrowIfFailed(m_nsUploadBuffer[slot]->Map(0, &noRead, reinterpret_cast<void**>(&m_nsUploadMapped[slot])));
+        ThrowIfFailed(m_nsConstantBuffer[slot]->Map(0, &noRead, &m_nsConstantMapped[slot]));
+        ThrowIfFailed(m_mcConstantBuffer[slot]->Map(0, &noRead, &m_mcConstantMapped[slot]));
+
+        // readback: whole range, we read all of it
+        ThrowIfFailed(m_nsReadbackParticlesIn[slot]->Map(0, nullptr, reinterpret_cast<void**>(&m_nsReadbackMapped[slot])));
+        ThrowIfFailed(m_mcReadbackArgs[slot]->Map(0, nullptr, reinterpret_cast<void**>(&m_mcReadbackArgsMapped[slot])));
     }
 
-    // const buffers (256-byte aligned)
-    {
-        CD3DX12_HEAP_PROPERTIES heap(D3D12_HEAP_TYPE_UPLOAD);
-        UINT sz = (sizeof(NSConstants) + 255) & ~255;
-        auto desc = CD3DX12_RESOURCE_DESC::Buffer(sz);
-        ThrowIfFailed(device->CreateCommittedResource(
-            &heap, D3D12_HEAP_FLAG_NONE, &desc,
-            D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-            IID_PPV_ARGS(&m_nsConstantBuffer)));
-    }
-
-    {
-        CD3DX12_HEAP_PROPERTIES heap(D3D12_HEAP_TYPE_UPLOAD);
-        UINT sz = (sizeof(MCConstants) + 255) & ~255;
-        auto desc = CD3DX12_RESOURCE_DESC::Buffer(sz);
-        ThrowIfFailed(device->CreateCommittedResource(
-            &heap, D3D12_HEAP_FLAG_NONE, &desc,
-            D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-            IID_PPV_ARGS(&m_mcConstantBuffer)));
-    }
-
-    // readback buffers
-    {
-        CD3DX12_HEAP_PROPERTIES heap(D3D12_HEAP_TYPE_READBACK);
-        auto desc = CD3DX12_RESOURCE_DESC::Buffer(NUM_PARTICLES * sizeof(GPUParticle));
-        ThrowIfFailed(device->CreateCommittedResource(
-            &heap, D3D12_HEAP_FLAG_NONE, &desc,
-            D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
-            IID_PPV_ARGS(&m_nsReadbackParticlesIn))); // new ComPtr member
-    }
+    // the mesh itself, sized for mc_reserve_tris to start with
+    CreateMeshBuffers(device);
 
-    {
-        CD3DX12_HEAP_PROPERTIES heap(D3D12_HEAP_TYPE_READBACK);
-        auto desc = CD3DX12_RESOURCE_DESC::Buffer(MC_MAX_TRIS * 3 * sizeof(Vertex));
-        ThrowIfFailed(device->CreateCommittedResource(
-            &heap, D3D12_HEAP_FLAG_NONE, &desc,
-            D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
-            IID_PPV_ARGS(&m_mcReadbackVertexBuffer))); // new ComPtr member
-    }
-
-    {
-        CD3DX12_HEAP_PROPERTIES heap(D3D12_HEAP_TYPE_READBACK);
-        auto desc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(int));
-        ThrowIfFailed(device->CreateCommittedResource(
-            &heap, D3D12_HEAP_FLAG_NONE, &desc,
-            D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
-            IID_PPV_ARGS(&m_mcReadbackArgs))); // new ComPtr member
-    }
-
-    // 5. command allocator + list
-    ThrowIfFailed(device->CreateCommandAllocator(
-        D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&commandAllocator)));
+    // 5. command allocators (one per frame in flight) + list
+    for (UINT slot = 0; slot < FRAMES_IN_FLIGHT; slot++)
+        ThrowIfFailed(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&commandAllocators[slot])));
     ThrowIfFailed(device->CreateCommandList(0,
         D3D12_COMMAND_LIST_TYPE_COMPUTE,
-        commandAllocator.Get(),
+        commandAllocators[0].Get(),
         m_psoClear.Get(),
         IID_PPV_ARGS(&commandList)));
     ThrowIfFailed(commandList->Close());
@@ -272,7 +391,24 @@ void ParticleSystem::DispatchGPUCommands(ID3D12GraphicsCommandList *cmdList, flo
     auto b3 = CD3DX12_RESOURCE_BARRIER::UAV(m_nsParticlesIn.Get());
     cmdList->ResourceBarrier(1, &b3);
 
-    // insert kernel to update position
+    // finalize: velocity from the displacement plus xsph, position = predicted.
+    // same math as UpdatePBD, but the state stays on the gpu so the next step
+    // (or frame) doesn't have to wait for a readback
+    cmdList->SetPipelineState(m_psoFinalize.Get());
+    cmdList->Dispatch((NUM_PARTICLES + 63) / 64, 1, 1);
+    auto b5 = CD3DX12_RESOURCE_BARRIER::UAV(m_nsParticlesIn.Get());
+    cmdList->ResourceBarrier(1, &b5);
+}
+
+void ParticleSystem::DispatchCPUCommands(float dt)
+{
+    // same constants as DispatchInit uploads to b0
+    CPUSolverConstants cb = m_config.GetSolverConstants();
+    cb.dt = dt;
+    m_cpuSolver.SetConstants(cb);
+
+    m_cpuSolver.DispatchCPUCommands(m_particles, dt);
+    m_gpuParticlesCurrent = false;
 }
 
 void ParticleSystem::DispatchInit(ID3D12GraphicsCommandList *cmdList, float dt)
@@ -291,7 +427,9 @@ void ParticleSystem::DispatchInit(ID3D12GraphicsCommandList *cmdList, float dt)
         float H;
         float rho_0;        // rest density
         float epsilon;
-        float _pad1[3];
+        float damping;      // finalize step
+        float viscosity;
+        float _pad1;
     };
     NSConstants cb;
     cb.gridOrigin = XMFLOAT3(-(NS_DIM_X * CELL_SIZE) / 2.0f, -CELL_SIZE, -(NS_DIM_Z * CELL_SIZE) / 2.0f);
@@ -308,11 +446,11 @@ void ParticleSystem::DispatchInit(ID3D12GraphicsCommandList *cmdList, float dt)
     cb.H = CELL_SIZE;   // cell size is also the smoothing radius
     cb.rho_0 = RHO_0;
     cb.epsilon = EPSILON;
+    cb.damping = DAMPING;
+    cb.viscosity = VISCOSITY;
+    cb._pad1 = 0.0f;
 
-    void* ns_mapped = nullptr;
-    m_nsConstantBuffer->Map(0, nullptr, &ns_mapped);
-    memcpy(ns_mapped, &cb, sizeof(cb));
-    m_nsConstantBuffer->Unmap(0, nullptr);
+    memcpy(m_nsConstantMapped[m_frameSlot], &cb, sizeof(cb));
 
     struct MCConstants {
         XMFLOAT3 mcOrigin; 
@@ -320,24 +458,36 @@ void ParticleSystem::DispatchInit(ID3D12GraphicsCommandList *cmdList, float dt)
         XMINT3 mcDims;
         float mcIso;
         int mcMaxTris;
-        float _pad[3];
+        XMINT3 mcBlockDim;
+        int mcMaxVertices;
+        int mcSparse;
+        float mcTolerance;
+        int mcRebuildAll;
+        XMFLOAT3 mcCameraPos;
+        float mcLodDistance;
+        int mcLodLevels;
     };
     MCConstants mc_cb;
     mc_cb.mcOrigin = XMFLOAT3(-BBOX_SIZE_XZ - MC_CELL_SIZE, - CELL_SIZE, -BBOX_SIZE_XZ - MC_CELL_SIZE);
     mc_cb.mcCellSize = MC_CELL_SIZE;
     mc_cb.mcDims = XMINT3(MC_DIM_X, MC_DIM_Y, MC_DIM_Z);
     mc_cb.mcIso = MC_ISO;
-    mc_cb.mcMaxTris = MC_MAX_TRIS;
-
-    void* mc_mapped = nullptr;
-    m_mcConstantBuffer->Map(0, nullptr, &mc_mapped);
-    memcpy(mc_mapped, &mc_cb, sizeof(mc_cb));
-    m_mcConstantBuffer->Unmap(0, nullptr);
+    mc_cb.mcMaxTris = m_mcTriCapacity;
+    mc_cb.mcBlockDim = XMINT3(MC_BLOCK_DIM_X, MC_BLOCK_DIM_Y, MC_BLOCK_DIM_Z);
+    mc_cb.mcMaxVertices = m_mcVertexCapacity;
+    mc_cb.mcSparse = MeshIsSparse() ? 1 : 0;
+    mc_cb.mcTolerance = m_config.mcIncrementalTolerance;
+    mc_cb.mcRebuildAll = m_mcMeshValid ? 0 : 1;
+    mc_cb.mcCameraPos = m_mcCamera;
+    mc_cb.mcLodDistance = m_config.mcLodDistance;
+    mc_cb.mcLodLevels = m_config.mcLodLevels;
+
+    memcpy(m_mcConstantMapped[m_frameSlot], &mc_cb, sizeof(mc_cb));
 
     // set root signature
     cmdList->SetComputeRootSignature(m_computeRootSignature.Get());
-    cmdList->SetComputeRootConstantBufferView(0, m_nsConstantBuffer->GetGPUVirtualAddress());
-    cmdList->SetComputeRootConstantBufferView(1, m_mcConstantBuffer->GetGPUVirtualAddress());
+    cmdList->SetComputeRootConstantBufferView(0, m_nsConstantBuffer[m_frameSlot]->GetGPUVirtualAddress());
+    cmdList->SetComputeRootConstantBufferView(1, m_mcConstantBuffer[m_frameSlot]->GetGPUVirtualAddress());
 
     cmdList->SetComputeRootUnorderedAccessView(2, m_nsCellCount->GetGPUVirtualAddress());
     cmdList->SetComputeRootUnorderedAccessView(3, m_nsIntraOffset->GetGPUVirtualAddress());
@@ -353,26 +503,60 @@ void ParticleSystem::DispatchInit(ID3D12GraphicsCommandList *cmdList, float dt)
 
     // params for sdf
     cmdList->SetComputeRootUnorderedAccessView(11, m_nsSDFVolume->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(12, m_mcEdgeMap->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(13, m_mcIndexBuffer->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(14, m_mcBlockActive->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(15, m_mcBlockList->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(16, m_mcBlockArgs->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(17, m_mcBlockScan->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(18, m_sdfSeeds->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(20, m_mcMeshField->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(21, m_mcBlockState->GetGPUVirtualAddress());
+    // only read with mc_incremental, which is the only time it exists
+    ID3D12Resource* prevVertices = m_mcPrevVertexBuffer ? m_mcPrevVertexBuffer.Get() : m_mcVertexBuffer.Get();
+    cmdList->SetComputeRootUnorderedAccessView(22, prevVertices->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(23, m_mcBlockLevel->GetGPUVirtualAddress());
 }
 
 void ParticleSystem::DispatchPrediction(ID3D12GraphicsCommandList *cmdList, float dt) 
 {
-    // upload particle positions to the gpu
-    std::vector<GPUParticle> gpu(NUM_PARTICLES);
-    for (int i = 0; i < NUM_PARTICLES; i++) {
-        gpu[i].position = m_particles[i].position;
-        gpu[i].predictedPosition = m_particles[i].predictedPosition;
-        gpu[i].velocity = m_particles[i].velocity;
-        gpu[i].density = m_particles[i].density;
-        gpu[i].lambda = m_particles[i].lambda;
-        gpu[i].xsph = m_particles[i].xsph;
-        gpu[i].delta = m_particles[i].delta;
+    // upload particle positions to the gpu, only when the host copy is newer.
+    // on the gpu path the state stays resident from frame to frame
+    if (!m_gpuParticlesCurrent) {
+        UploadParticles(cmdList);
+        m_gpuParticlesCurrent = true;
+    }
+
+    // --- 3. Dispatch the prediction kernel ---
+    if (dt > 0.0f) {
+        cmdList->SetPipelineState(m_psoPrediction.Get());
+        cmdList->Dispatch((NUM_PARTICLES + 63) / 64, 1, 1);
+
+        // barrier
+        auto uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(m_nsParticlesIn.Get());
+        cmdList->ResourceBarrier(1, &uavBarrier);
     }
+}
 
-    void* mapped = nullptr;
-    m_nsUploadBuffer->Map(0, nullptr, &mapped);
-    memcpy(mapped, gpu.data(), NUM_PARTICLES * sizeof(GPUParticle));
-    m_nsUploadBuffer->Unmap(0, nullptr);
+void ParticleSystem::UploadParticles(ID3D12GraphicsCommandList* cmdList)
+{
+    // written straight into the mapped upload heap. it's write-combined memory,
+    // so every particle is built in a local and stored front to back in one go,
+    // and the padding is written too so no partial lines get flushed
+    GPUParticle* gpu = m_nsUploadMapped[m_frameSlot];
+    m_cpuSolver.GetPool().ParallelFor(NUM_PARTICLES, HOST_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            GPUParticle p = {};
+            p.position = { m_particles.position.x[i], m_particles.position.y[i], m_particles.position.z[i] };
+            p.predictedPosition = { m_particles.predictedPosition.x[i], m_particles.predictedPosition.y[i], m_particles.predictedPosition.z[i] };
+            p.velocity = { m_particles.velocity.x[i], m_particles.velocity.y[i], m_particles.velocity.z[i] };
+            p.density = m_particles.density[i];
+            p.lambda = m_particles.lambda[i];
+            p.xsph = { m_particles.xsph.x[i], m_particles.xsph.y[i], m_particles.xsph.z[i] };
+            p.delta = { m_particles.delta.x[i], m_particles.delta.y[i], m_particles.delta.z[i] };
+            gpu[i] = p;
+        }
+    });
 
     // copy resource to gpu
     auto toDst = CD3DX12_RESOURCE_BARRIER::Transition(
@@ -380,22 +564,12 @@ void ParticleSystem::DispatchPrediction(ID3D12GraphicsCommandList *cmdList, floa
         D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
         D3D12_RESOURCE_STATE_COPY_DEST);
     cmdList->ResourceBarrier(1, &toDst);
-    cmdList->CopyResource(m_nsParticlesIn.Get(), m_nsUploadBuffer.Get());
+    cmdList->CopyResource(m_nsParticlesIn.Get(), m_nsUploadBuffer[m_frameSlot].Get());
     auto toUAV = CD3DX12_RESOURCE_BARRIER::Transition(
         m_nsParticlesIn.Get(),
         D3D12_RESOURCE_STATE_COPY_DEST,
         D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     cmdList->ResourceBarrier(1, &toUAV);
-
-    // --- 3. Dispatch the prediction kernel ---
-    if (dt > 0.0f) {
-        cmdList->SetPipelineState(m_psoPrediction.Get());
-        cmdList->Dispatch((NUM_PARTICLES + 63) / 64, 1, 1);
-
-        // barrier
-        auto uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(m_nsParticlesIn.Get());
-        cmdList->ResourceBarrier(1, &uavBarrier);
-    }
 }
 
 void ParticleSystem::DispatchNeighborSearch(ID3D12GraphicsCommandList *cmdList)
@@ -444,34 +618,183 @@ void ParticleSystem::DispatchNeighborSearch(ID3D12GraphicsCommandList *cmdList)
     cmdList->ResourceBarrier(1, &reorderBarrier);
 }
 
+// count -> scan -> weld/emit over 8^3 blocks, see the comment above
+// CSMCCountBlocks. with mc_gather the field is filled per listed block
+// instead of splatted. with mc_sparse only the blocks the splat touched are
+// listed, and the clear only touches the blocks last frame's splat marked.
+// with mc_incremental the blocks whose field didn't move keep last frame's
+// vertices, with mc_lod_levels the blocks get coarser away from the camera
+// and go through the CSLod* kernels instead. m_mcBlockArgs is a UAV except while the ExecuteIndirects read it
 void ParticleSystem::DispatchMarchingCubes(ID3D12GraphicsCommandList *cmdList)
 {
-    // 0: clear args
-    cmdList->SetPipelineState(m_psoClearArgs.Get());
-    cmdList->Dispatch(1, 1, 1);
-    auto b0 = CD3DX12_RESOURCE_BARRIER::UAV(m_mcIndirectArgs.Get());
-    cmdList->ResourceBarrier(1, &b0);
-
-    // 1: clear scalar field
-    UINT fieldVerts = (MC_DIM_X+1)*(MC_DIM_Y+1)*(MC_DIM_Z+1);
-    cmdList->SetPipelineState(m_psoClearField.Get());
-    cmdList->Dispatch((fieldVerts + 63) / 64, 1, 1);
-    auto b1 = CD3DX12_RESOURCE_BARRIER::UAV(m_mcScalarField.Get());
-    cmdList->ResourceBarrier(1, &b1);
-
-    // 2. splat particles
-    cmdList->SetPipelineState(m_psoBuildField.Get());
+    auto toIndirect = CD3DX12_RESOURCE_BARRIER::Transition(m_mcBlockArgs.Get(),
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+    auto toUAV = CD3DX12_RESOURCE_BARRIER::Transition(m_mcBlockArgs.Get(),
+        D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+    // mc_gather reads the particles through the neighbor search grid, which
+    // was binned before the solver iterations moved them. bin them again
+    if (m_config.mcGather)
+        DispatchNeighborSearch(cmdList);
+
+    // 1: clear scalar field. the first time round (and always when dense)
+    // nothing is known about the field, so all of it
+    if (!MeshIsSparse() || !m_mcFieldCleared) {
+        UINT fieldVerts = (MC_DIM_X+1)*(MC_DIM_Y+1)*(MC_DIM_Z+1);
+        cmdList->SetPipelineState(m_psoClearField.Get());
+        cmdList->Dispatch((fieldVerts + 63) / 64, 1, 1);
+        cmdList->SetPipelineState(m_psoClearBlocks.Get());
+        cmdList->Dispatch((MC_NUM_BLOCKS + 63) / 64, 1, 1);
+        m_mcFieldCleared = MeshIsSparse();
+    } else {
+        cmdList->ResourceBarrier(1, &toIndirect);
+        cmdList->SetPipelineState(m_psoClearActiveBlocks.Get());
+        cmdList->ExecuteIndirect(m_mcBlockDispatch.Get(), 1, m_mcBlockArgs.Get(), 0, nullptr, 0);
+        cmdList->ResourceBarrier(1, &toUAV);
+    }
+    CD3DX12_RESOURCE_BARRIER b1[] = {
+        CD3DX12_RESOURCE_BARRIER::UAV(m_mcScalarField.Get()),
+        CD3DX12_RESOURCE_BARRIER::UAV(m_mcBlockActive.Get()),
+        CD3DX12_RESOURCE_BARRIER::UAV(m_mcBlockList.Get()),
+    };
+    cmdList->ResourceBarrier(_countof(b1), b1);
+
+    // 2. splat particles, marks their blocks. mc_gather only marks here and
+    // fills the field per block after the compaction
+    cmdList->SetPipelineState(m_config.mcGather ? m_psoMarkFieldBlocks.Get() : m_psoBuildField.Get());
     cmdList->Dispatch((NUM_PARTICLES + 63) / 64, 1, 1);
-    auto b2 = CD3DX12_RESOURCE_BARRIER::UAV(m_mcScalarField.Get());
-    cmdList->ResourceBarrier(1, &b2);
-
-    // 3. perform marching cubes
-    UINT numCells = MC_DIM_X * MC_DIM_Y * MC_DIM_Z;
-    cmdList->SetPipelineState(m_psoMarchingCubes.Get());
-    cmdList->Dispatch((numCells + 63) / 64, 1, 1);
-    auto b3 = CD3DX12_RESOURCE_BARRIER::UAV(m_mcVertexBuffer.Get());
+    CD3DX12_RESOURCE_BARRIER b2[] = {
+        CD3DX12_RESOURCE_BARRIER::UAV(m_mcScalarField.Get()),
+        CD3DX12_RESOURCE_BARRIER::UAV(m_mcBlockActive.Get()),
+    };
+    cmdList->ResourceBarrier(_countof(b2), b2);
+
+    // 3. flags -> list -> dispatch args
+    cmdList->SetPipelineState(m_psoCompactBlocks.Get());
+    cmdList->Dispatch(1, 1, 1);
+    auto b3 = CD3DX12_RESOURCE_BARRIER::UAV(m_mcBlockList.Get());
     cmdList->ResourceBarrier(1, &b3);
+    cmdList->SetPipelineState(m_psoWriteBlockArgs.Get());
+    cmdList->Dispatch(1, 1, 1);
+    cmdList->ResourceBarrier(1, &toIndirect);
+
+    if (m_config.mcGather) {
+        cmdList->SetPipelineState(m_psoGatherField.Get());
+        cmdList->ExecuteIndirect(m_mcBlockDispatch.Get(), 1, m_mcBlockArgs.Get(), 0, nullptr, 0);
+        auto gathered = CD3DX12_RESOURCE_BARRIER::UAV(m_mcScalarField.Get());
+        cmdList->ResourceBarrier(1, &gathered);
+    }
+
+    // mc_incremental: last frame's vertices become the ones to copy from, this
+    // frame's go into the other buffer. then which blocks moved, see the
+    // comment above CSMCClearBlockState
+    if (m_config.mcIncremental) {
+        m_mcVertexBuffer.Swap(m_mcPrevVertexBuffer);
+        cmdList->SetComputeRootUnorderedAccessView(9, m_mcVertexBuffer->GetGPUVirtualAddress());
+        cmdList->SetComputeRootUnorderedAccessView(22, m_mcPrevVertexBuffer->GetGPUVirtualAddress());
+
+        UINT fieldVerts = (MC_DIM_X+1)*(MC_DIM_Y+1)*(MC_DIM_Z+1);
+        auto state = CD3DX12_RESOURCE_BARRIER::UAV(m_mcBlockState.Get());
+        cmdList->SetPipelineState(m_psoClearBlockState.Get());
+        cmdList->Dispatch((MC_NUM_BLOCKS + 63) / 64, 1, 1);
+        cmdList->ResourceBarrier(1, &state);
+        cmdList->SetPipelineState(m_psoDirtyVertices.Get());
+        cmdList->Dispatch((fieldVerts + 63) / 64, 1, 1);
+        cmdList->ResourceBarrier(1, &state);
+        cmdList->SetPipelineState(m_psoUpdateMeshField.Get());
+        cmdList->Dispatch((fieldVerts + 63) / 64, 1, 1);
+        // only adds the rebuild bit, the update only looks at the dirty one
+        cmdList->SetPipelineState(m_psoRebuildBlocks.Get());
+        cmdList->Dispatch((MC_NUM_BLOCKS + 63) / 64, 1, 1);
+        CD3DX12_RESOURCE_BARRIER updated[] = {
+            CD3DX12_RESOURCE_BARRIER::UAV(m_mcMeshField.Get()),
+            CD3DX12_RESOURCE_BARRIER::UAV(m_mcBlockState.Get()),
+        };
+        cmdList->ResourceBarrier(_countof(updated), updated);
+        m_mcMeshValid = true;
+    }
 
+    // mc_lod_levels: every block's level first, the lattices of the blocks
+    // around decide what a block's boundary looks like
+    const bool lod = m_config.mcLodLevels > 0;
+    if (lod) {
+        cmdList->SetPipelineState(m_psoLodLevels.Get());
+        cmdList->Dispatch((MC_NUM_BLOCKS + 63) / 64, 1, 1);
+        auto levels = CD3DX12_RESOURCE_BARRIER::UAV(m_mcBlockLevel.Get());
+        cmdList->ResourceBarrier(1, &levels);
+    }
+
+    // 4. vertices and indices per block, then where each block's start
+    cmdList->SetPipelineState(lod ? m_psoLodCountBlocks.Get() : m_psoCountBlocks.Get());
+    cmdList->ExecuteIndirect(m_mcBlockDispatch.Get(), 1, m_mcBlockArgs.Get(), 0, nullptr, 0);
+    auto b4 = CD3DX12_RESOURCE_BARRIER::UAV(m_mcBlockScan.Get());
+    cmdList->ResourceBarrier(1, &b4);
+    cmdList->SetPipelineState(m_psoScanBlocks.Get());
+    cmdList->Dispatch(1, 1, 1);
+    CD3DX12_RESOURCE_BARRIER b5[] = {
+        CD3DX12_RESOURCE_BARRIER::UAV(m_mcBlockScan.Get()),
+        CD3DX12_RESOURCE_BARRIER::UAV(m_mcIndirectArgs.Get()),
+    };
+    cmdList->ResourceBarrier(_countof(b5), b5);
+
+    // 5. welded vertices, one per crossing grid edge
+    cmdList->SetPipelineState(lod ? m_psoLodWeldBlocks.Get() : m_psoWeldBlocks.Get());
+    cmdList->ExecuteIndirect(m_mcBlockDispatch.Get(), 1, m_mcBlockArgs.Get(), 0, nullptr, 0);
+    CD3DX12_RESOURCE_BARRIER b6[] = {
+        CD3DX12_RESOURCE_BARRIER::UAV(m_mcVertexBuffer.Get()),
+        CD3DX12_RESOURCE_BARRIER::UAV(m_mcEdgeMap.Get()),
+    };
+    cmdList->ResourceBarrier(_countof(b6), b6);
+
+    // 6. triangles as indices into them
+    cmdList->SetPipelineState(lod ? m_psoLodEmitBlocks.Get() : m_psoEmitBlocks.Get());
+    cmdList->ExecuteIndirect(m_mcBlockDispatch.Get(), 1, m_mcBlockArgs.Get(), 0, nullptr, 0);
+    auto b7 = CD3DX12_RESOURCE_BARRIER::UAV(m_mcIndexBuffer.Get());
+    cmdList->ResourceBarrier(1, &b7);
+    cmdList->ResourceBarrier(1, &toUAV);
+}
+
+// narrow band distance field into m_nsSDFVolume, the passes of DistanceField.h.
+// it reads the neighbor search grid, so that gets binned on the final
+// positions first, unless mc_gather just did
+void ParticleSystem::DispatchSDF(ID3D12GraphicsCommandList* cmdList)
+{
+    if (m_config.sdfBand <= 0) return;
+    if (!m_config.mcGather)
+        DispatchNeighborSearch(cmdList);
+
+    struct {
+        int step;
+        int src;
+        float radius;
+        float band;
+    } pass = { 1, 0, m_config.sdfRadius, m_config.sdfBand * CELL_SIZE };
+
+    const UINT groups = (NS_NUM_CELLS + 63) / 64;
+    auto run = [&](ID3D12PipelineState* pso) {
+        cmdList->SetComputeRoot32BitConstants(19, 4, &pass, 0);
+        cmdList->SetPipelineState(pso);
+        cmdList->Dispatch(groups, 1, 1);
+        CD3DX12_RESOURCE_BARRIER barriers[] = {
+            CD3DX12_RESOURCE_BARRIER::UAV(m_sdfSeeds.Get()),
+            CD3DX12_RESOURCE_BARRIER::UAV(m_nsSDFVolume.Get()),
+        };
+        cmdList->ResourceBarrier(_countof(barriers), barriers);
+    };
+    auto flood = [&]() {
+        for (int step : DistanceField::FloodSteps(m_config.sdfBand)) {
+            pass.step = step;
+            run(m_psoSDFFlood.Get());
+            pass.src ^= 1;
+        }
+    };
+
+    run(m_psoSDFSeed.Get());    // into half 0
+    flood();
+    run(m_psoSDFOutside.Get()); // into the other half
+    pass.src ^= 1;
+    flood();
+    run(m_psoSDFResolve.Get());
 }
 
 ComPtr<ID3D12PipelineState> ParticleSystem::GetPsoClear()
@@ -485,7 +808,7 @@ void ParticleSystem::CopyBackResources(ID3D12GraphicsCommandList* cmdList)
         D3D12_RESOURCE_BARRIER toSrc = CD3DX12_RESOURCE_BARRIER::Transition(m_nsParticlesIn.Get(),
                 D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
         cmdList->ResourceBarrier(1, &toSrc);
-        cmdList->CopyResource(m_nsReadbackParticlesIn.Get(),  m_nsParticlesIn.Get());
+        cmdList->CopyResource(m_nsReadbackParticlesIn[m_frameSlot].Get(),  m_nsParticlesIn.Get());
         D3D12_RESOURCE_BARRIER toUAV = CD3DX12_RESOURCE_BARRIER::Transition(m_nsParticlesIn.Get(),
                 D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
         cmdList->ResourceBarrier(1, &toUAV);
@@ -495,63 +818,156 @@ void ParticleSystem::CopyBackResources(ID3D12GraphicsCommandList* cmdList)
         D3D12_RESOURCE_BARRIER toSrc = CD3DX12_RESOURCE_BARRIER::Transition(m_mcVertexBuffer.Get(),
                 D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
         cmdList->ResourceBarrier(1, &toSrc);
-        cmdList->CopyResource(m_mcReadbackVertexBuffer.Get(),  m_mcVertexBuffer.Get());
+        // into this frame's draw buffer, the scratch one gets overwritten next frame
+        cmdList->CopyResource(m_mcDrawVertexBuffer[m_frameSlot].Get(),  m_mcVertexBuffer.Get());
+        if (m_mcReadbackVertices[m_frameSlot])
+            cmdList->CopyResource(m_mcReadbackVertices[m_frameSlot].Get(),  m_mcVertexBuffer.Get());
         D3D12_RESOURCE_BARRIER toUAV = CD3DX12_RESOURCE_BARRIER::Transition(m_mcVertexBuffer.Get(),
                 D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
         cmdList->ResourceBarrier(1, &toUAV);
     }
 
+    {
+        D3D12_RESOURCE_BARRIER toSrc = CD3DX12_RESOURCE_BARRIER::Transition(m_mcIndexBuffer.Get(),
+                D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+        cmdList->ResourceBarrier(1, &toSrc);
+        cmdList->CopyResource(m_mcDrawIndexBuffer[m_frameSlot].Get(),  m_mcIndexBuffer.Get());
+        if (m_mcReadbackIndices[m_frameSlot])
+            cmdList->CopyResource(m_mcReadbackIndices[m_frameSlot].Get(),  m_mcIndexBuffer.Get());
+        D3D12_RESOURCE_BARRIER toUAV = CD3DX12_RESOURCE_BARRIER::Transition(m_mcIndexBuffer.Get(),
+                D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        cmdList->ResourceBarrier(1, &toUAV);
+    }
+
     {
         D3D12_RESOURCE_BARRIER toSrc = CD3DX12_RESOURCE_BARRIER::Transition(m_mcIndirectArgs.Get(),
                 D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
         cmdList->ResourceBarrier(1, &toSrc);
-        cmdList->CopyResource(m_mcReadbackArgs.Get(),  m_mcIndirectArgs.Get());
+        cmdList->CopyResource(m_mcReadbackArgs[m_frameSlot].Get(),  m_mcIndirectArgs.Get());
         D3D12_RESOURCE_BARRIER toUAV = CD3DX12_RESOURCE_BARRIER::Transition(m_mcIndirectArgs.Get(),
                 D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
         cmdList->ResourceBarrier(1, &toUAV);
     }
 }
 
-void ParticleSystem::ReadbackParticleData(ID3D12GraphicsCommandList* cmdList)
+void ParticleSystem::ReadbackParticleData(UINT slot)
 {
-    GPUParticle* readback = nullptr;
-    CD3DX12_RANGE readRange(0, NUM_PARTICLES * sizeof(GPUParticle));
-    m_nsReadbackParticlesIn->Map(0, &readRange,
-        reinterpret_cast<void**>(&readback));
-
-    for (int i = 0; i < NUM_PARTICLES; i++) {
-        m_particles[i].position = readback[i].position;
-        m_particles[i].predictedPosition = readback[i].predictedPosition;
-        m_particles[i].velocity = readback[i].velocity;
-        m_particles[i].lambda = readback[i].lambda;
-        m_particles[i].xsph = readback[i].xsph;
-    }
+    ReadbackParticleData(slot, m_particles);
+}
+
+void ParticleSystem::ReadbackParticleData(UINT slot, ParticleStore& particles)
+{
+    // the readback heap stays mapped, the caller already waited on the slot's fence
+    const GPUParticle* readback = m_nsReadbackMapped[slot];
+    if (particles.Size() != NUM_PARTICLES)
+        particles.Resize(NUM_PARTICLES);
+
+    m_cpuSolver.GetPool().ParallelFor(NUM_PARTICLES, HOST_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const GPUParticle& p = readback[i];
+            particles.position.Set(i, { p.position.x, p.position.y, p.position.z });
+            particles.predictedPosition.Set(i, { p.predictedPosition.x, p.predictedPosition.y, p.predictedPosition.z });
+            particles.velocity.Set(i, { p.velocity.x, p.velocity.y, p.velocity.z });
+            particles.density[i] = p.density;
+            particles.lambda[i] = p.lambda;
+            particles.xsph.Set(i, { p.xsph.x, p.xsph.y, p.xsph.z });
+        }
+    });
+}
+
+void ParticleSystem::LoadPlaybackFrame(const ParticleStore& frame)
+{
+    if (frame.Size() != NUM_PARTICLES)
+        throw std::runtime_error("playback frame has " + std::to_string(frame.Size()) + " particles, the scene has " + std::to_string(NUM_PARTICLES));
+
+    // same sizes, the copies don't reallocate
+    m_particles.position = frame.position;
+    m_particles.predictedPosition = frame.position;
+    m_particles.velocity = frame.velocity;
+    m_particles.density = frame.density;
+    m_gpuParticlesCurrent = false;
+}
+
+UINT ParticleSystem::ReadbackIndexCount(UINT slot) const
+{
+    // the mesh itself stays on the gpu in m_mcDrawVertexBuffer/m_mcDrawIndexBuffer[slot]
+    return min(m_mcReadbackArgsMapped[slot][0], m_mcTriCapacity * 3);
+}
 
-    CD3DX12_RANGE writeRange(0, 0);
-    m_nsReadbackParticlesIn->Unmap(0, &writeRange);
+UINT ParticleSystem::ReadbackVertexCount(UINT slot) const
+{
+    return min(m_mcReadbackArgsMapped[slot][1], m_mcVertexCapacity);
 }
 
-void ParticleSystem::ReadbackVertexData(ID3D12GraphicsCommandList *cmdList)
+void ParticleSystem::ReadbackVertexData(UINT slot, std::vector<MCVertex>& vertices, std::vector<uint32_t>& indices) const
 {
-    uint32_t* args = nullptr;
-    m_mcReadbackArgs->Map(0, nullptr, (void**)&args);
-    uint32_t vertexCount = args[0];
-    m_mcReadbackArgs->Unmap(0, nullptr);
+    if (!m_mcReadbackVerticesMapped[slot])
+        throw std::logic_error("ReadbackVertexData without mesh_export_dir");
+
+    const UINT numVertices = ReadbackVertexCount(slot);
+    const UINT numIndices = ReadbackIndexCount(slot);
+    vertices.resize(numVertices);
+    indices.assign(m_mcReadbackIndicesMapped[slot], m_mcReadbackIndicesMapped[slot] + numIndices);
+
+    if (m_config.mcCompactVertices) {
+        VertexQuantizer quantizer(m_config.GetMCOrigin(), MC_CELL_SIZE, { m_config.mcDimX, m_config.mcDimY, m_config.mcDimZ });
+        const PackedVertex* packed = static_cast<const PackedVertex*>(m_mcReadbackVerticesMapped[slot]);
+        for (UINT i = 0; i < numVertices; i++)
+            quantizer.Decode(packed[i], vertices[i].position, vertices[i].normal);
+    } else {
+        const Vertex* full = static_cast<const Vertex*>(m_mcReadbackVerticesMapped[slot]);
+        for (UINT i = 0; i < numVertices; i++) {
+            vertices[i].position = { full[i].x, full[i].y, full[i].z };
+            vertices[i].normal = { full[i].normal.x, full[i].normal.y, full[i].normal.z };
+        }
+    }
+}
 
-    vertexCount = min(vertexCount, MC_MAX_TRIS * 3);
-    m_vertices.resize(vertexCount);
+bool ParticleSystem::MeshOverflowed(UINT slot) const
+{
+    return m_mcReadbackArgsMapped[slot][0] > m_mcTriCapacity * 3 || m_mcReadbackArgsMapped[slot][1] > m_mcVertexCapacity;
+}
 
-    Vertex* readback = nullptr;
-    CD3DX12_RANGE readRange(0, 0);
-    m_mcReadbackVertexBuffer->Map(0, &readRange,
-        reinterpret_cast<void**>(&readback));
+void ParticleSystem::CreateMeshBuffers(ID3D12Device* device)
+{
+    m_mcVertexBuffer = MakeBufferHelper(m_mcVertexCapacity * MC_VERTEX_STRIDE, device);
+    m_mcIndexBuffer = MakeBufferHelper(m_mcTriCapacity * 3 * sizeof(UINT), device);
+
+    // mc_incremental copies clean blocks out of last frame's vertices, which
+    // are gone with the old buffers, so the next frame redoes everything
+    if (m_config.mcIncremental)
+        m_mcPrevVertexBuffer = MakeBufferHelper(m_mcVertexCapacity * MC_VERTEX_STRIDE, device);
+    m_mcMeshValid = false;
+
+    // finished mesh for the renderer, stays on the gpu
+    for (UINT slot = 0; slot < FRAMES_IN_FLIGHT; slot++) {
+        m_mcDrawVertexBuffer[slot] = MakeDrawBufferHelper(m_mcVertexCapacity * MC_VERTEX_STRIDE, device);
+        m_mcDrawIndexBuffer[slot] = MakeDrawBufferHelper(m_mcTriCapacity * 3 * sizeof(UINT), device);
+    }
 
-    for (int i = 0; i < vertexCount; i++) {
-        m_vertices[i] = readback[i];
+    // host copy for the mesh exporter. whole buffers, the counts aren't
+    // known when the copy is recorded
+    if (!m_config.meshExportDir.empty()) {
+        for (UINT slot = 0; slot < FRAMES_IN_FLIGHT; slot++) {
+            m_mcReadbackVertices[slot] = MakeHostBufferHelper(m_mcVertexCapacity * MC_VERTEX_STRIDE,
+                D3D12_HEAP_TYPE_READBACK, D3D12_RESOURCE_STATE_COPY_DEST, device);
+            m_mcReadbackIndices[slot] = MakeHostBufferHelper(m_mcTriCapacity * 3 * sizeof(UINT),
+                D3D12_HEAP_TYPE_READBACK, D3D12_RESOURCE_STATE_COPY_DEST, device);
+            ThrowIfFailed(m_mcReadbackVertices[slot]->Map(0, nullptr, const_cast<void**>(&m_mcReadbackVerticesMapped[slot])));
+            ThrowIfFailed(m_mcReadbackIndices[slot]->Map(0, nullptr, reinterpret_cast<void**>(&m_mcReadbackIndicesMapped[slot])));
+        }
     }
+}
 
-    CD3DX12_RANGE writeRange(0, 0);
-    m_mcReadbackVertexBuffer->Unmap(0, &writeRange);
+void ParticleSystem::GrowMeshBuffers(ID3D12Device* device, UINT slot)
+{
+    // 50% on top of what the frame needed, so a slowly growing surface
+    // doesn't land here every few frames
+    UINT indices = m_mcReadbackArgsMapped[slot][0];
+    UINT vertices = m_mcReadbackArgsMapped[slot][1];
+    m_mcTriCapacity = min(max(m_mcTriCapacity, indices / 3 + indices / 6), MC_MAX_TRIS);
+    m_mcVertexCapacity = min(max(m_mcVertexCapacity, vertices + vertices / 2), MC_MAX_VERTICES);
+    CreateMeshBuffers(device);
 }
 
 
@@ -561,41 +977,48 @@ void ParticleSystem::UpdatePBD(float dt, ID3D12GraphicsCommandList* cmdList)
 {
     if (dt <= 0.0f) return;  // skip PBD on frame 1
 
-	// update positions and velocity
-	for (int i = 0; i < NUM_PARTICLES; i++) {
-        XMFLOAT3& pred = m_particles[i].predictedPosition;
-        XMFLOAT3& pos  = m_particles[i].position;
-
-        // derive velocity from the displacement (this is PBD -- velocity comes last)
-        m_particles[i].velocity.x = DAMPING * (pred.x - pos.x) / dt;
-        m_particles[i].velocity.y = DAMPING * (pred.y - pos.y) / dt;
-        m_particles[i].velocity.z = DAMPING * (pred.z - pos.z) / dt;
-
-        // todo: vorticity
-
-        // apply XSPH (fix: use per-axis components)
-        m_particles[i].velocity.x += m_particles[i].xsph.x * VISCOSITY;
-        m_particles[i].velocity.y += m_particles[i].xsph.y * VISCOSITY;
-        m_particles[i].velocity.z += m_particles[i].xsph.z * VISCOSITY;
-
-        pos = pred;
-    }
+    // update positions and velocity.
+    // one pass per axis inside each chunk so each loop only streams the four arrays it needs
+    const float scale = DAMPING / dt;
+    float* pos[3]  = { m_particles.position.x.data(), m_particles.position.y.data(), m_particles.position.z.data() };
+    float* vel[3]  = { m_particles.velocity.x.data(), m_particles.velocity.y.data(), m_particles.velocity.z.data() };
+    const float* pred[3] = { m_particles.predictedPosition.x.data(), m_particles.predictedPosition.y.data(), m_particles.predictedPosition.z.data() };
+    const float* xsph[3] = { m_particles.xsph.x.data(), m_particles.xsph.y.data(), m_particles.xsph.z.data() };
+
+    m_cpuSolver.GetPool().ParallelFor(NUM_PARTICLES, HOST_GRAIN, [&](int begin, int end) {
+        for (int axis = 0; axis < 3; axis++) {
+            float* p = pos[axis];
+            float* v = vel[axis];
+            const float* pr = pred[axis];
+            const float* xs = xsph[axis];
+
+            for (int i = begin; i < end; i++) {
+                // derive velocity from the displacement (this is PBD -- velocity comes last)
+                // todo: vorticity
+                v[i] = scale * (pr[i] - p[i]) + xs[i] * VISCOSITY;   // apply XSPH
+                p[i] = pr[i];
+            }
+        }
+    });
 
 	UpdateInstances();
 }
 
 void ParticleSystem::UpdateInstances() 
 {
-    // push to instances vector
-	for (int i = 0; i < NUM_PARTICLES; i++) {
-        XMMATRIX mat = XMMatrixTranslation(
-            m_particles[i].position.x,
-            m_particles[i].position.y,
-            m_particles[i].position.z
-        );
-
-        XMStoreFloat4x4(&m_instancer.m_instances[i].worldMatrix, mat);
-    }
-
-    memcpy(m_instancer.m_pInstanceDataBegin, m_instancer.m_instances.data(), sizeof(InstanceData) * NUM_PARTICLES);
+    // push to instances vector, only the translation row changes
+    const float* px = m_particles.position.x.data();
+    const float* py = m_particles.position.y.data();
+    const float* pz = m_particles.position.z.data();
+
+    // each chunk copies its own slice into the mapped buffer while it's still in cache
+    InstanceData* instances = m_instancer.m_instances.data();
+    UINT8* mapped = m_instancer.m_pInstanceDataBegin;
+    m_cpuSolver.GetPool().ParallelFor(NUM_PARTICLES, HOST_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            XMMATRIX mat = XMMatrixTranslation(px[i], py[i], pz[i]);
+            XMStoreFloat4x4(&instances[i].worldMatrix, mat);
+        }
+        memcpy(mapped + sizeof(InstanceData) * begin, instances + begin, sizeof(InstanceData) * (end - begin));
+    });
 }
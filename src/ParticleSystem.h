@@ -3,25 +3,63 @@
 
 #include "Instancer.h"
 #include "DXApplication.h"
+#include "CPUSolver.h"
+#include "DistanceField.h"
+#include "MarchingCubes.h"
+#include "SimulationConfig.h"
 
 using namespace DirectX;
 
 class ParticleSystem {
 public:
+    // ring size for everything that's written or read on the host per frame.
+    // three so the draw buffer compute writes for frame N+1 is never the one
+    // the graphics queue may still be drawing for frame N-1
+    static const UINT FRAMES_IN_FLIGHT = 3;
+
     ParticleSystem();
 
+    // sizes everything below from the config. call before LoadParticles and
+    // CreateComputePipeline, the buffers can't be resized afterwards.
+    void Configure(const SimulationConfig& config);
+    const SimulationConfig& GetConfig() const { return m_config; }
+
     void LoadParticles();
     void CreateComputePipeline(
         ID3D12Device* device,
         std::wstring shaderPath,
         std::wstring mcShaderPath,
-        ComPtr<ID3D12CommandAllocator>& commandAllocator,
+        ComPtr<ID3D12CommandAllocator> (&commandAllocators)[FRAMES_IN_FLIGHT],
         ComPtr<ID3D12GraphicsCommandList>& commandList
     );
 
-    // update calls
-    void ReadbackParticleData(ID3D12GraphicsCommandList* cmdList);  // load back the particles to CPU
-    void ReadbackVertexData(ID3D12GraphicsCommandList* cmdList);
+    // picks the ring slot every following Dispatch*/CopyBack call uses. the
+    // caller makes sure the gpu is done with whatever used it last
+    void BeginFrame(UINT slot) { m_frameSlot = slot; }
+
+    // mc_lod_levels measures from here, picked up by the next DispatchInit
+    void SetMeshCamera(XMFLOAT3 position) { m_mcCamera = position; }
+
+    // update calls, read what CopyBackResources left in a finished slot
+    void ReadbackParticleData(UINT slot);   // load back the particles to CPU
+    void ReadbackParticleData(UINT slot, ParticleStore& particles);   // somewhere else than m_particles
+
+    // cache_play: replaces m_particles with a recorded frame (position,
+    // velocity, density), the next DispatchPrediction uploads it
+    void LoadPlaybackFrame(const ParticleStore& frame);
+    UINT ReadbackIndexCount(UINT slot) const;     // clamped to what the buffers hold
+    UINT ReadbackVertexCount(UINT slot) const;
+    // the slot's whole mesh, decoded from Vertex/PackedVertex. only with
+    // mesh_export_dir set, nothing else copies the mesh back to the host
+    void ReadbackVertexData(UINT slot, std::vector<MCVertex>& vertices, std::vector<uint32_t>& indices) const;
+
+    // the mesh buffers start at mc_reserve_tris and grow when a frame counts
+    // more than fits, that frame is drawn short. GrowMeshBuffers replaces
+    // every mesh buffer, so nothing in flight may still use them
+    bool MeshOverflowed(UINT slot) const;
+    void GrowMeshBuffers(ID3D12Device* device, UINT slot);
+    UINT GetMCTriCapacity() const { return m_mcTriCapacity; }
+    UINT GetMCVertexCapacity() const { return m_mcVertexCapacity; }
 
     void CopyBackResources(ID3D12GraphicsCommandList* cmdList);
     void UpdatePBD(float dt, ID3D12GraphicsCommandList* cmdList);
@@ -33,68 +71,108 @@ public:
     void DispatchPrediction(ID3D12GraphicsCommandList* cmdList, float dt);
     void DispatchNeighborSearch(ID3D12GraphicsCommandList* cmdList);
 
+    // headless alternative to DispatchGPUCommands, runs the same kernels on the cpu.
+    // works on m_particles in place, so no readback is needed afterwards.
+    // the next DispatchPrediction uploads them again.
+    void DispatchCPUCommands(float dt);
+
     void DispatchMarchingCubes(ID3D12GraphicsCommandList* cmdList);
+    void DispatchSDF(ID3D12GraphicsCommandList* cmdList);    // nothing unless sdf_band > 0
     void DispatchMCInit(ID3D12GraphicsCommandList* cmdList);
 
     // various getters for private variables
     ComPtr<ID3D12PipelineState> GetPsoClear();
     ID3D12Resource* GetMCVertexBuffer() const { return m_mcVertexBuffer.Get(); }
     ID3D12Resource* GetMCArgBuffer() const { return m_mcIndirectArgs.Get(); }
+    ID3D12Resource* GetMCDrawVertexBuffer(UINT slot) const { return m_mcDrawVertexBuffer[slot].Get(); }
+    ID3D12Resource* GetMCDrawIndexBuffer(UINT slot) const { return m_mcDrawIndexBuffer[slot].Get(); }
+    ID3D12Resource* GetSDFVolume() const { return m_nsSDFVolume.Get(); }
 
     // instancing member variables
-    std::vector<Particle> m_particles;
+    ParticleStore m_particles;      // SoA, see ParticleStore.h
     Instancer m_instancer;
 
-    std::vector<Vertex> m_vertices;
+    CPUSolver m_cpuSolver;
 
-    // --------- CONSTANTS --------
-    static const UINT NUM_X = 50;
-    static const UINT NUM_Y = 50;
-    static const UINT NUM_Z = 20;
-    static const UINT NUM_PARTICLES = NUM_X * NUM_Y * NUM_Z;
-    const float PARTICLE_SIZE = 0.1f;
-    const float PARTICLE_SPACING = 0.3f;    // how far the particles spawn from each other
-    const XMFLOAT3 PARTICLE_OFFSET = {0.0f, 4.0f, 4.0f};    // offsets where the particles spawn 
+    // --------- SIZES --------
+    // copied out of m_config by Configure and fixed after that
+    UINT NUM_X = 0;
+    UINT NUM_Y = 0;
+    UINT NUM_Z = 0;
+    UINT NUM_PARTICLES = 0;
+    float PARTICLE_SIZE = 0.0f;
+    float PARTICLE_SPACING = 0.0f;      // how far the particles spawn from each other
+    XMFLOAT3 PARTICLE_OFFSET = {};      // offsets where the particles spawn
 
     // simulation consts
-    const float BBOX_SIZE_XZ = 10.0f;
-    const float BBOX_SIZE_Y = 100.0f;
-    const float CELL_SIZE = 1.0f;
-    const float RHO_0 = 40.0f;          // rest density
-    const float EPSILON = 100.0f;
+    float BBOX_SIZE_XZ = 0.0f;
+    float BBOX_SIZE_Y = 0.0f;
+    float CELL_SIZE = 0.0f;
+    float RHO_0 = 0.0f;                 // rest density
+    float EPSILON = 0.0f;
 
     // consts we use in finalization step
-    const float DAMPING = 0.999f;
-    const float VISCOSITY = 0.1f;
-    const int ITERATIONS = 3;
+    float DAMPING = 0.0f;
+    float VISCOSITY = 0.0f;
+    int ITERATIONS = 0;
 
     // uniform grid search consts
-    const UINT NS_DIM_X = (UINT)ceil((BBOX_SIZE_XZ * 2) / CELL_SIZE) + 2;
-    const UINT NS_DIM_Y = (UINT)ceil(BBOX_SIZE_Y / CELL_SIZE) + 2;
-    const UINT NS_DIM_Z = (UINT)ceil((BBOX_SIZE_XZ * 2) / CELL_SIZE) + 2;
-    const UINT NS_NUM_CELLS = NS_DIM_X * NS_DIM_Y * NS_DIM_Z;
+    UINT NS_DIM_X = 0;
+    UINT NS_DIM_Y = 0;
+    UINT NS_DIM_Z = 0;
+    UINT NS_NUM_CELLS = 0;
 
     // marching cube grid consts
-    const UINT MC_DIM_X = 64;
-    const UINT MC_DIM_Y = 128;
-    const UINT MC_DIM_Z = 64;
-    const UINT MC_NUM_CELLS = MC_DIM_X * MC_DIM_Y * MC_DIM_Z;
-    const float MC_CELL_SIZE = (BBOX_SIZE_XZ * 2.0f) / MC_DIM_X;
-    const float MC_ISO = 4.0f; //isosurface threshold
-    const UINT MC_MAX_TRIS = MC_NUM_CELLS * 5;
-    
+    UINT MC_DIM_X = 0;
+    UINT MC_DIM_Y = 0;
+    UINT MC_DIM_Z = 0;
+    UINT MC_NUM_CELLS = 0;
+    float MC_CELL_SIZE = 0.0f;
+    float MC_ISO = 0.0f;                //isosurface threshold
+    UINT MC_MAX_TRIS = 0;               // worst case, the buffers only grow up to it
+    UINT MC_MAX_VERTICES = 0;           // welded, one per grid edge at most
+    UINT MC_VERTEX_STRIDE = 0;          // Vertex, or PackedVertex with mc_compact_vertices
+    static const UINT MC_BLOCK_SIZE = 8; // ScalarField::BLOCK_SIZE, cells per block side for mc_sparse
+    UINT MC_BLOCK_DIM_X = 0;
+    UINT MC_BLOCK_DIM_Y = 0;
+    UINT MC_BLOCK_DIM_Z = 0;
+    UINT MC_NUM_BLOCKS = 0;
+
     bool m_nsFirstFrame = true;
 
 private:
+    SimulationConfig m_config;
 
     // ----- upload, readback, etc.
     ComPtr<ID3D12RootSignature> m_computeRootSignature;
-    ComPtr<ID3D12Resource> m_nsUploadBuffer;    // CPU -> GPU staging
-    ComPtr<ID3D12Resource> m_nsReadbackParticlesIn;
-    ComPtr<ID3D12Resource> m_mcReadbackVertexBuffer;
-    ComPtr<ID3D12Resource> m_mcReadbackArgs;
-    ComPtr<ID3D12Resource> m_nsConstantBuffer;  // b0: constant buffer
-    ComPtr<ID3D12Resource> m_mcConstantBuffer;  // b1: constant buffer for marching cubes
+    // one of each per frame in flight, indexed by m_frameSlot
+    ComPtr<ID3D12Resource> m_nsUploadBuffer[FRAMES_IN_FLIGHT];        // CPU -> GPU staging
+    ComPtr<ID3D12Resource> m_nsReadbackParticlesIn[FRAMES_IN_FLIGHT];
+    ComPtr<ID3D12Resource> m_mcReadbackArgs[FRAMES_IN_FLIGHT];
+    ComPtr<ID3D12Resource> m_nsConstantBuffer[FRAMES_IN_FLIGHT];      // b0: constant buffer
+    ComPtr<ID3D12Resource> m_mcConstantBuffer[FRAMES_IN_FLIGHT];      // b1: constant buffer for marching cubes
+    ComPtr<ID3D12Resource> m_mcDrawVertexBuffer[FRAMES_IN_FLIGHT];    // finished mesh, the renderer draws from here
+    ComPtr<ID3D12Resource> m_mcDrawIndexBuffer[FRAMES_IN_FLIGHT];
+    ComPtr<ID3D12Resource> m_mcReadbackVertices[FRAMES_IN_FLIGHT];    // mesh_export_dir only, sized like the mesh buffers
+    ComPtr<ID3D12Resource> m_mcReadbackIndices[FRAMES_IN_FLIGHT];
+
+    // persistently mapped views of the buffers above, valid until they're released
+    GPUParticle* m_nsUploadMapped[FRAMES_IN_FLIGHT] = {};
+    const GPUParticle* m_nsReadbackMapped[FRAMES_IN_FLIGHT] = {};
+    const uint32_t* m_mcReadbackArgsMapped[FRAMES_IN_FLIGHT] = {};
+    const void* m_mcReadbackVerticesMapped[FRAMES_IN_FLIGHT] = {};
+    const uint32_t* m_mcReadbackIndicesMapped[FRAMES_IN_FLIGHT] = {};
+    void* m_nsConstantMapped[FRAMES_IN_FLIGHT] = {};
+    void* m_mcConstantMapped[FRAMES_IN_FLIGHT] = {};
+
+    UINT m_frameSlot = 0;
+
+    // m_particles -> upload heap -> m_nsParticlesIn, recorded into cmdList
+    void UploadParticles(ID3D12GraphicsCommandList* cmdList);
+
+    // particle state lives on the gpu between frames once uploaded. only the
+    // cpu solver (or a reload) changes m_particles behind its back
+    bool m_gpuParticlesCurrent = false;
 
     // ----- resources for uniform grid search -----
     // first pass: counting kernel
@@ -121,18 +199,71 @@ private:
     ComPtr<ID3D12PipelineState> m_psoCollisionConstraints;
     ComPtr<ID3D12PipelineState> m_psoUpdateVelocity;    // TODO: make this work lol
     ComPtr<ID3D12PipelineState> m_psoComputeXSPH;
+    ComPtr<ID3D12PipelineState> m_psoFinalize;
 
     // all of the resources for marching cubes
     ComPtr<ID3D12Resource> m_mcScalarField;       // float per grid vertex
-    ComPtr<ID3D12Resource> m_mcVertexBuffer;      // output triangles
-    ComPtr<ID3D12Resource> m_mcIndirectArgs;      // DrawInstanced args
+    ComPtr<ID3D12Resource> m_mcVertexBuffer;      // welded vertices
+    ComPtr<ID3D12Resource> m_mcEdgeMap;           // grid edge -> vertex index
+    ComPtr<ID3D12Resource> m_mcIndexBuffer;       // 3 per triangle
+    ComPtr<ID3D12Resource> m_mcIndirectArgs;      // index count, vertex count, before clamping to the capacity
     ComPtr<ID3D12Resource> m_mcVertexCounter;     // atomic counter
 
-    ComPtr<ID3D12PipelineState> m_psoClearArgs;
+    // which 8^3 blocks the splat touched (all of them without mc_sparse),
+    // compacted into a list and dispatch args for ExecuteIndirect
+    ComPtr<ID3D12Resource> m_mcBlockActive;       // uint per block
+    ComPtr<ID3D12Resource> m_mcBlockList;         // count, then block ids
+    ComPtr<ID3D12Resource> m_mcBlockArgs;         // D3D12_DISPATCH_ARGUMENTS, one group per block
+    ComPtr<ID3D12Resource> m_mcBlockScan;         // vertices/indices per listed block, then their offsets
+    ComPtr<ID3D12CommandSignature> m_mcBlockDispatch;
+    bool m_mcFieldCleared = false;  // the whole field and all flags have been zeroed once
+
     ComPtr<ID3D12PipelineState> m_psoClearField;
     ComPtr<ID3D12PipelineState> m_psoBuildField;
-    ComPtr<ID3D12PipelineState> m_psoMarchingCubes;
+    ComPtr<ID3D12PipelineState> m_psoMarkFieldBlocks;  // mc_gather: flags only, then
+    ComPtr<ID3D12PipelineState> m_psoGatherField;      // the field per listed block
+    ComPtr<ID3D12PipelineState> m_psoClearBlocks;
+    ComPtr<ID3D12PipelineState> m_psoClearActiveBlocks;
+    ComPtr<ID3D12PipelineState> m_psoCompactBlocks;
+    ComPtr<ID3D12PipelineState> m_psoWriteBlockArgs;
+    ComPtr<ID3D12PipelineState> m_psoCountBlocks;
+    ComPtr<ID3D12PipelineState> m_psoScanBlocks;
+    ComPtr<ID3D12PipelineState> m_psoWeldBlocks;
+    ComPtr<ID3D12PipelineState> m_psoEmitBlocks;
+
+    // mc_incremental: the mesh is built from m_mcMeshField, which only changes
+    // for blocks whose field moved past mc_incremental_tolerance. the other
+    // blocks copy their vertices from last frame's buffer
+    ComPtr<ID3D12Resource> m_mcMeshField;         // u17: float per grid vertex
+    ComPtr<ID3D12Resource> m_mcBlockState;        // u18: uint2 per block, dirty/rebuild bits and first vertex last frame
+    ComPtr<ID3D12Resource> m_mcPrevVertexBuffer;  // u19: swapped with m_mcVertexBuffer every frame
+    ComPtr<ID3D12PipelineState> m_psoClearBlockState;
+    ComPtr<ID3D12PipelineState> m_psoDirtyVertices;
+    ComPtr<ID3D12PipelineState> m_psoUpdateMeshField;
+    ComPtr<ID3D12PipelineState> m_psoRebuildBlocks;
+    bool m_mcMeshValid = false;     // m_mcMeshField and m_mcPrevVertexBuffer hold last frame's mesh
+
+    // mc_lod_levels: blocks away from the camera mesh coarser lattices, see
+    // LodSurface.h. the edge map stays per grid edge, a coarse edge goes under the one it starts with
+    ComPtr<ID3D12Resource> m_mcBlockLevel;        // u20: uint per block
+    ComPtr<ID3D12PipelineState> m_psoLodLevels;
+    ComPtr<ID3D12PipelineState> m_psoLodCountBlocks;
+    ComPtr<ID3D12PipelineState> m_psoLodWeldBlocks;
+    ComPtr<ID3D12PipelineState> m_psoLodEmitBlocks;
+    XMFLOAT3 m_mcCamera = {};
+
+    // what the mesh buffers hold right now
+    UINT m_mcTriCapacity = 0;
+    UINT m_mcVertexCapacity = 0;
+    void CreateMeshBuffers(ID3D12Device* device);
+
+    bool MeshIsSparse() const { return m_config.mcSparse && MC_ISO > 0.0f; }
 
     // resources for sdf generation
-    ComPtr<ID3D12Resource> m_nsSDFVolume;
+    ComPtr<ID3D12Resource> m_nsSDFVolume;         // u9: float per neighbor search cell
+    ComPtr<ID3D12Resource> m_sdfSeeds;            // u16: float4 per cell, twice
+    ComPtr<ID3D12PipelineState> m_psoSDFSeed;
+    ComPtr<ID3D12PipelineState> m_psoSDFFlood;
+    ComPtr<ID3D12PipelineState> m_psoSDFOutside;
+    ComPtr<ID3D12PipelineState> m_psoSDFResolve;
 };
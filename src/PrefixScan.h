@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+#include "ThreadPool.h"
+
+enum class ScanMode {
+    Inclusive,
+    Exclusive,
+};
+
+// single pass prefix scan on cpu threads, same algorithm as CSPrefixSum
+// (decoupled look-back, [MG16] Merrill and Garland).
+//
+// every tile publishes its local aggregate as soon as it has it, then walks
+// left over its predecessors adding up aggregates until it finds one that
+// already knows its inclusive prefix. the input is read twice per tile but the
+// second read hits cache, so it's ~1 trip through memory instead of 2.
+//
+// differences to the shader:
+// - the status flag and the values live in separate fields, published with a
+//   release store on the flag. the shader packs both into one uint with a
+//   30-bit VALUE_MASK, which wraps silently past ~1 billion. here the payload
+//   is a full T, use uint64_t for big grids.
+// - tile ids come from an atomic counter instead of the group id, so a tile
+//   only ever waits on tiles some running thread already owns (no deadlock
+//   no matter how the pool schedules chunks).
+//
+// T must be an unsigned integer type. out may alias in.
+template <typename T>
+class PrefixScan {
+    static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value, "PrefixScan wants an unsigned integer type");
+
+public:
+    // elements per tile, 4096 x 8 bytes still fits in L1/L2 for the second read
+    explicit PrefixScan(size_t tileSize = 4096) : m_tileSize(tileSize ? tileSize : 1) {}
+
+    PrefixScan(const PrefixScan&) = delete;
+    PrefixScan& operator=(const PrefixScan&) = delete;
+
+    // returns the total (sum of all inputs)
+    T Scan(ThreadPool& pool, const T* in, T* out, size_t count, ScanMode mode)
+    {
+        if (count == 0) return 0;
+
+        size_t numTiles = (count + m_tileSize - 1) / m_tileSize;
+        Reserve(numTiles);
+        for (size_t t = 0; t < numTiles; t++)
+            m_status[t].flag.store(STATUS_EMPTY, std::memory_order_relaxed);
+        m_nextTile.store(0, std::memory_order_relaxed);
+
+        // one tile per chunk, the chunk index itself is ignored
+        pool.ParallelFor((int)numTiles, 1, [&](int begin, int end) {
+            for (int c = begin; c < end; c++)
+                ScanTile(in, out, count, mode);
+        });
+
+        return m_status[numTiles - 1].inclusive;
+    }
+
+    // reference: reduce per block, scan the block sums, then scan each block.
+    // two full passes over the input.
+    T ScanTwoPass(ThreadPool& pool, const T* in, T* out, size_t count, ScanMode mode)
+    {
+        if (count == 0) return 0;
+
+        size_t numTiles = (count + m_tileSize - 1) / m_tileSize;
+        Reserve(numTiles);
+
+        pool.ParallelFor((int)numTiles, 1, [&](int begin, int end) {
+            for (int t = begin; t < end; t++) {
+                size_t first = (size_t)t * m_tileSize;
+                size_t last = first + m_tileSize < count ? first + m_tileSize : count;
+                T sum = 0;
+                for (size_t i = first; i < last; i++)
+                    sum += in[i];
+                m_status[t].aggregate = sum;
+            }
+        });
+
+        T running = 0;
+        for (size_t t = 0; t < numTiles; t++) {
+            m_status[t].inclusive = running;    // used as the exclusive tile prefix here
+            running += m_status[t].aggregate;
+        }
+
+        pool.ParallelFor((int)numTiles, 1, [&](int begin, int end) {
+            for (int t = begin; t < end; t++) {
+                size_t first = (size_t)t * m_tileSize;
+                size_t last = first + m_tileSize < count ? first + m_tileSize : count;
+                ScanRange(in, out, first, last, m_status[t].inclusive, mode);
+            }
+        });
+
+        return running;
+    }
+
+    static T ScanSerial(const T* in, T* out, size_t count, ScanMode mode)
+    {
+        return ScanRange(in, out, 0, count, 0, mode);
+    }
+
+private:
+    static const uint32_t STATUS_EMPTY = 0;        // not started yet
+    static const uint32_t STATUS_AGGREGATE = 1;    // local aggregate ready (partial)
+    static const uint32_t STATUS_INCLUSIVE = 2;    // inclusive prefix ready (final)
+
+    // one cache line per tile so neighbors spinning on each other don't false share
+    struct alignas(64) TileStatus {
+        std::atomic<uint32_t> flag{ STATUS_EMPTY };
+        T aggregate = 0;
+        T inclusive = 0;
+    };
+
+    void Reserve(size_t numTiles)
+    {
+        if (numTiles <= m_capacity) return;
+        m_status.reset(new TileStatus[numTiles]);
+        m_capacity = numTiles;
+    }
+
+    static T ScanRange(const T* in, T* out, size_t first, size_t last, T prefix, ScanMode mode)
+    {
+        T running = prefix;
+        if (mode == ScanMode::Inclusive) {
+            for (size_t i = first; i < last; i++) {
+                running += in[i];
+                out[i] = running;
+            }
+        } else {
+            for (size_t i = first; i < last; i++) {
+                T value = in[i];    // read before the write, out may alias in
+                out[i] = running;
+                running += value;
+            }
+        }
+        return running;
+    }
+
+    void ScanTile(const T* in, T* out, size_t count, ScanMode mode)
+    {
+        size_t tile = m_nextTile.fetch_add(1, std::memory_order_relaxed);
+        size_t first = tile * m_tileSize;
+        size_t last = first + m_tileSize < count ? first + m_tileSize : count;
+        TileStatus& status = m_status[tile];
+
+        // 1. local aggregate
+        T aggregate = 0;
+        for (size_t i = first; i < last; i++)
+            aggregate += in[i];
+
+        // 2. publish it. the first tile is already final
+        if (tile == 0) {
+            status.inclusive = aggregate;
+            status.flag.store(STATUS_INCLUSIVE, std::memory_order_release);
+            ScanRange(in, out, first, last, 0, mode);
+            return;
+        }
+        status.aggregate = aggregate;
+        status.flag.store(STATUS_AGGREGATE, std::memory_order_release);
+
+        // 3. look-back
+        T exclusivePrefix = 0;
+        for (size_t look = tile; look-- > 0;) {
+            TileStatus& pred = m_status[look];
+
+            uint32_t flag;
+            while ((flag = pred.flag.load(std::memory_order_acquire)) == STATUS_EMPTY)
+                std::this_thread::yield();
+
+            if (flag == STATUS_INCLUSIVE) {
+                exclusivePrefix += pred.inclusive;
+                break;  // got a final inclusive prefix, stop
+            }
+            exclusivePrefix += pred.aggregate;
+        }
+
+        status.inclusive = exclusivePrefix + aggregate;
+        status.flag.store(STATUS_INCLUSIVE, std::memory_order_release);
+
+        // 4. write the results, the tile is still in cache
+        ScanRange(in, out, first, last, exclusivePrefix, mode);
+    }
+
+    size_t m_tileSize;
+    std::unique_ptr<TileStatus[]> m_status;
+    size_t m_capacity = 0;
+    std::atomic<size_t> m_nextTile{ 0 };
+};
@@ -0,0 +1,138 @@
+#include "SPHKernels.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if SPH_KERNELS_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+SPHKernelConstants SPHKernelConstants::Make(float h)
+{
+    const double PI = 3.14159265358979;
+    double hd = std::fabs((double)h);
+
+    SPHKernelConstants k;
+    k.h = h;
+    k.h2 = h * h;
+    k.poly6Coeff = (float)(315.0 / (64.0 * PI * std::pow(hd, 9.0)));
+    k.spikyCoeff = (float)(-45.0 / (PI * std::pow(hd, 6.0)));
+    return k;
+}
+
+// ----- scalar fallback -----
+
+static void Poly6Scalar(const SPHKernelConstants& k,
+    const float* rx, const float* ry, const float* rz, float* w, int n)
+{
+    for (int i = 0; i < n; i++) {
+        float r2 = rx[i] * rx[i] + ry[i] * ry[i] + rz[i] * rz[i];
+        float diff = k.h2 - r2;
+        w[i] = (r2 > k.h2) ? 0.0f : k.poly6Coeff * diff * diff * diff;
+    }
+}
+
+static void SpikyGradientScalar(const SPHKernelConstants& k,
+    const float* rx, const float* ry, const float* rz,
+    float* gx, float* gy, float* gz, int n)
+{
+    for (int i = 0; i < n; i++) {
+        float norm = std::sqrt(rx[i] * rx[i] + ry[i] * ry[i] + rz[i] * rz[i]);
+
+        float scalar = 0.0f;
+        if (norm <= k.h && norm >= 1e-12f) {
+            float diff = k.h - norm;
+            scalar = k.spikyCoeff * diff * diff / norm;
+        }
+
+        gx[i] = rx[i] * scalar;
+        gy[i] = ry[i] * scalar;
+        gz[i] = rz[i] * scalar;
+    }
+}
+
+const SPHKernelTable& GetSPHKernelsScalar()
+{
+    static const SPHKernelTable table = { "scalar", 1, Poly6Scalar, SpikyGradientScalar };
+    return table;
+}
+
+// ----- runtime selection -----
+
+#if SPH_KERNELS_X86
+static void CpuId(int leaf, int subleaf, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int i = 0; i < 4; i++) regs[i] = (unsigned)r[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long XGetBV()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+// 0 = scalar, 1 = avx2 + fma, 2 = avx-512f
+static int DetectSimdLevel()
+{
+    unsigned regs[4];
+    CpuId(0, 0, regs);
+    if (regs[0] < 7) return 0;
+
+    CpuId(1, 0, regs);
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    bool fma = (regs[2] & (1u << 12)) != 0;
+    if (!osxsave) return 0;
+
+    // the os has to save the ymm (and zmm) state on context switches
+    unsigned long long xcr0 = XGetBV();
+    bool osYmm = (xcr0 & 0x6) == 0x6;
+    bool osZmm = (xcr0 & 0xE6) == 0xE6;
+
+    CpuId(7, 0, regs);
+    bool avx2 = (regs[1] & (1u << 5)) != 0;
+    bool avx512f = (regs[1] & (1u << 16)) != 0;
+
+    if (avx512f && osZmm) return 2;
+    if (avx2 && fma && osYmm) return 1;
+    return 0;
+}
+#endif
+
+static const SPHKernelTable& SelectSPHKernels()
+{
+#if SPH_KERNELS_X86
+    int level = DetectSimdLevel();
+
+    // optional override, can only narrow what the cpu supports
+    if (const char* force = std::getenv("PHTHALO_SIMD")) {
+        if (strcmp(force, "scalar") == 0) level = 0;
+        else if (strcmp(force, "avx2") == 0 && level > 1) level = 1;
+    }
+
+    if (level == 2) return GetSPHKernelsAVX512();
+    if (level == 1) return GetSPHKernelsAVX2();
+#endif
+    return GetSPHKernelsScalar();
+}
+
+const SPHKernelTable& GetSPHKernels()
+{
+    static const SPHKernelTable& table = SelectSPHKernels();
+    return table;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// batched Poly6 / SpikyGradient for the cpu solver.
+// the per-pair versions in SimMath.h call pow(h, 9) and pow(h, 6) every time,
+// these take the h-dependent factors from SPHKernelConstants (built once per
+// step) and evaluate a whole neighbor list at once. inputs are r = pos_i - pos_j
+// split into component arrays, same layout as ParticleStore.
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SPH_KERNELS_X86 1
+#else
+#define SPH_KERNELS_X86 0
+#endif
+
+struct SPHKernelConstants {
+    float h;
+    float h2;
+    float poly6Coeff;   // 315 / (64 pi h^9)
+    float spikyCoeff;   // -45 / (pi h^6)
+
+    static SPHKernelConstants Make(float h);
+};
+
+// w[k] = Poly6(r[k], h)
+typedef void (*Poly6BatchFn)(const SPHKernelConstants& k,
+    const float* rx, const float* ry, const float* rz, float* w, int n);
+
+// g[k] = SpikyGradient(r[k], h)
+typedef void (*SpikyGradientBatchFn)(const SPHKernelConstants& k,
+    const float* rx, const float* ry, const float* rz,
+    float* gx, float* gy, float* gz, int n);
+
+struct SPHKernelTable {
+    const char* name;       // "scalar", "avx2", "avx512"
+    int width;              // pairs per instruction
+    Poly6BatchFn poly6;
+    SpikyGradientBatchFn spikyGradient;
+};
+
+// picks the widest implementation the cpu (and os) supports, checked once via cpuid.
+// set PHTHALO_SIMD=scalar|avx2|avx512 to force a narrower one.
+const SPHKernelTable& GetSPHKernels();
+
+// individual implementations, exposed so they can be compared against each other
+const SPHKernelTable& GetSPHKernelsScalar();
+#if SPH_KERNELS_X86
+const SPHKernelTable& GetSPHKernelsAVX2();
+const SPHKernelTable& GetSPHKernelsAVX512();
+#endif
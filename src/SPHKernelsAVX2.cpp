@@ -0,0 +1,74 @@
+// 8-wide versions of the batched sph kernels.
+// built with avx2/fma enabled (see CMakeLists.txt), only called when cpuid says so.
+
+#include "SPHKernels.h"
+
+#if SPH_KERNELS_X86
+
+#include <immintrin.h>
+
+static void Poly6AVX2(const SPHKernelConstants& k,
+    const float* rx, const float* ry, const float* rz, float* w, int n)
+{
+    const __m256 h2 = _mm256_set1_ps(k.h2);
+    const __m256 coeff = _mm256_set1_ps(k.poly6Coeff);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(rx + i);
+        __m256 y = _mm256_loadu_ps(ry + i);
+        __m256 z = _mm256_loadu_ps(rz + i);
+
+        __m256 r2 = _mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_mul_ps(z, z)));
+        __m256 diff = _mm256_sub_ps(h2, r2);
+        __m256 value = _mm256_mul_ps(coeff, _mm256_mul_ps(diff, _mm256_mul_ps(diff, diff)));
+
+        // r2 > h2 -> 0
+        __m256 inside = _mm256_cmp_ps(r2, h2, _CMP_LE_OQ);
+        _mm256_storeu_ps(w + i, _mm256_and_ps(value, inside));
+    }
+
+    // tail
+    GetSPHKernelsScalar().poly6(k, rx + i, ry + i, rz + i, w + i, n - i);
+}
+
+static void SpikyGradientAVX2(const SPHKernelConstants& k,
+    const float* rx, const float* ry, const float* rz,
+    float* gx, float* gy, float* gz, int n)
+{
+    const __m256 h = _mm256_set1_ps(k.h);
+    const __m256 coeff = _mm256_set1_ps(k.spikyCoeff);
+    const __m256 tiny = _mm256_set1_ps(1e-12f);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(rx + i);
+        __m256 y = _mm256_loadu_ps(ry + i);
+        __m256 z = _mm256_loadu_ps(rz + i);
+
+        __m256 r2 = _mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_mul_ps(z, z)));
+        __m256 norm = _mm256_sqrt_ps(r2);
+        __m256 diff = _mm256_sub_ps(h, norm);
+
+        // norm == 0 gives inf/nan here, the mask below zeroes those lanes
+        __m256 scalar = _mm256_div_ps(_mm256_mul_ps(coeff, _mm256_mul_ps(diff, diff)), norm);
+        __m256 valid = _mm256_and_ps(
+            _mm256_cmp_ps(norm, h, _CMP_LE_OQ),
+            _mm256_cmp_ps(norm, tiny, _CMP_GE_OQ));
+        scalar = _mm256_and_ps(scalar, valid);
+
+        _mm256_storeu_ps(gx + i, _mm256_mul_ps(x, scalar));
+        _mm256_storeu_ps(gy + i, _mm256_mul_ps(y, scalar));
+        _mm256_storeu_ps(gz + i, _mm256_mul_ps(z, scalar));
+    }
+
+    GetSPHKernelsScalar().spikyGradient(k, rx + i, ry + i, rz + i, gx + i, gy + i, gz + i, n - i);
+}
+
+const SPHKernelTable& GetSPHKernelsAVX2()
+{
+    static const SPHKernelTable table = { "avx2", 8, Poly6AVX2, SpikyGradientAVX2 };
+    return table;
+}
+
+#endif
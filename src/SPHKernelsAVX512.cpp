@@ -0,0 +1,74 @@
+// 16-wide versions of the batched sph kernels.
+// built with avx-512f enabled (see CMakeLists.txt), only called when cpuid says so.
+// the tail is handled with a lane mask instead of falling back to scalar.
+
+#include "SPHKernels.h"
+
+#if SPH_KERNELS_X86
+
+#include <immintrin.h>
+
+static __mmask16 TailMask(int remaining)
+{
+    return remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1);
+}
+
+static void Poly6AVX512(const SPHKernelConstants& k,
+    const float* rx, const float* ry, const float* rz, float* w, int n)
+{
+    const __m512 h2 = _mm512_set1_ps(k.h2);
+    const __m512 coeff = _mm512_set1_ps(k.poly6Coeff);
+
+    for (int i = 0; i < n; i += 16) {
+        __mmask16 m = TailMask(n - i);
+        __m512 x = _mm512_maskz_loadu_ps(m, rx + i);
+        __m512 y = _mm512_maskz_loadu_ps(m, ry + i);
+        __m512 z = _mm512_maskz_loadu_ps(m, rz + i);
+
+        __m512 r2 = _mm512_fmadd_ps(x, x, _mm512_fmadd_ps(y, y, _mm512_mul_ps(z, z)));
+        __m512 diff = _mm512_sub_ps(h2, r2);
+
+        // r2 > h2 -> 0
+        __mmask16 inside = _mm512_cmp_ps_mask(r2, h2, _CMP_LE_OQ);
+        __m512 value = _mm512_maskz_mul_ps(inside, coeff, _mm512_mul_ps(diff, _mm512_mul_ps(diff, diff)));
+
+        _mm512_mask_storeu_ps(w + i, m, value);
+    }
+}
+
+static void SpikyGradientAVX512(const SPHKernelConstants& k,
+    const float* rx, const float* ry, const float* rz,
+    float* gx, float* gy, float* gz, int n)
+{
+    const __m512 h = _mm512_set1_ps(k.h);
+    const __m512 coeff = _mm512_set1_ps(k.spikyCoeff);
+    const __m512 tiny = _mm512_set1_ps(1e-12f);
+
+    for (int i = 0; i < n; i += 16) {
+        __mmask16 m = TailMask(n - i);
+        __m512 x = _mm512_maskz_loadu_ps(m, rx + i);
+        __m512 y = _mm512_maskz_loadu_ps(m, ry + i);
+        __m512 z = _mm512_maskz_loadu_ps(m, rz + i);
+
+        __m512 r2 = _mm512_fmadd_ps(x, x, _mm512_fmadd_ps(y, y, _mm512_mul_ps(z, z)));
+        __m512 norm = _mm512_sqrt_ps(r2);
+        __m512 diff = _mm512_sub_ps(h, norm);
+
+        // only divide in the lanes that survive, so norm == 0 never produces nan
+        __mmask16 valid = _mm512_cmp_ps_mask(norm, h, _CMP_LE_OQ)
+                        & _mm512_cmp_ps_mask(norm, tiny, _CMP_GE_OQ);
+        __m512 scalar = _mm512_maskz_div_ps(valid, _mm512_mul_ps(coeff, _mm512_mul_ps(diff, diff)), norm);
+
+        _mm512_mask_storeu_ps(gx + i, m, _mm512_mul_ps(x, scalar));
+        _mm512_mask_storeu_ps(gy + i, m, _mm512_mul_ps(y, scalar));
+        _mm512_mask_storeu_ps(gz + i, m, _mm512_mul_ps(z, scalar));
+    }
+}
+
+const SPHKernelTable& GetSPHKernelsAVX512()
+{
+    static const SPHKernelTable table = { "avx512", 16, Poly6AVX512, SpikyGradientAVX512 };
+    return table;
+}
+
+#endif
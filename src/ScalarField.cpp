@@ -0,0 +1,337 @@
+#include "ScalarField.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const int VERTEX_GRAIN = 4096;
+static const int PARTICLE_GRAIN = 256;
+
+void ScalarField::Configure(float3 origin, float cellSize, int3 dim, float h)
+{
+    m_origin = origin;
+    m_cellSize = cellSize;
+    m_dim = dim;
+    m_h = h;
+
+    int numVertices = GetNumVertices();
+    if (numVertices > m_capacity) {
+        m_value.reset(new std::atomic<int>[numVertices]);
+        m_boundaryHit.reset(new std::atomic<unsigned char>[numVertices]);
+        m_capacity = numVertices;
+    }
+
+    m_blockDim = {
+        (dim.x + BLOCK_SIZE - 1) / BLOCK_SIZE,
+        (dim.y + BLOCK_SIZE - 1) / BLOCK_SIZE,
+        (dim.z + BLOCK_SIZE - 1) / BLOCK_SIZE,
+    };
+    int numBlocks = GetNumBlocks();
+    if (numBlocks > m_blockCapacity) {
+        m_blockActive.reset(new std::atomic<unsigned char>[numBlocks]);
+        m_blockCapacity = numBlocks;
+    }
+    m_activeBlocks.clear();
+    m_fullClear = true;
+}
+
+void ScalarField::SetSparse(bool sparse)
+{
+    if (sparse != m_sparse)
+        m_fullClear = true;
+    m_sparse = sparse;
+    m_activeBlocks.clear();
+}
+
+void ScalarField::SetGather(bool gather)
+{
+    if (gather != m_gather)
+        m_fullClear = true;
+    m_gather = gather;
+    m_activeBlocks.clear();
+}
+
+// the closed vertex range of a block, [8b, 8b + 8] clamped to the grid
+template <typename Fn>
+void ScalarField::ForEachBlockVertex(int block, Fn&& fn) const
+{
+    int3 b = BlockCoord(block);
+    int x0 = b.x * BLOCK_SIZE, x1 = std::min(x0 + BLOCK_SIZE, m_dim.x);
+    int y0 = b.y * BLOCK_SIZE, y1 = std::min(y0 + BLOCK_SIZE, m_dim.y);
+    int z0 = b.z * BLOCK_SIZE, z1 = std::min(z0 + BLOCK_SIZE, m_dim.z);
+
+    for (int z = z0; z <= z1; z++)
+    for (int y = y0; y <= y1; y++)
+    for (int x = x0; x <= x1; x++)
+        fn(VertexIndex(x, y, z));
+}
+
+// blocks whose closed vertex range overlaps [lo, hi] along one axis
+static void BlockRange(int lo, int hi, int numBlocks, int& first, int& last)
+{
+    first = lo > 0 ? (lo - 1) / ScalarField::BLOCK_SIZE : 0;
+    last = std::min(hi / ScalarField::BLOCK_SIZE, numBlocks - 1);
+}
+
+void ScalarField::Build(ThreadPool& pool, const Float3Stream& points, int count)
+{
+    if (m_gather) {
+        BuildGather(pool, points, count);
+        return;
+    }
+
+    const int numVertices = GetNumVertices();
+    const int3 dim = m_dim;
+    const float h2 = m_h * 2.0f;
+
+    auto clearVertex = [&](int i) {
+        m_value[i].store(0, std::memory_order_relaxed);
+        m_boundaryHit[i].store(0, std::memory_order_relaxed);
+    };
+
+    if (!m_sparse || m_fullClear) {
+        // CSClearField
+        pool.ParallelFor(numVertices, VERTEX_GRAIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                clearVertex(i);
+        });
+        for (int b = 0; b < GetNumBlocks(); b++)
+            m_blockActive[b].store(0, std::memory_order_relaxed);
+        m_fullClear = false;
+    } else {
+        // CSClearActiveBlocks: only last frame's blocks can hold anything
+        pool.ParallelFor((int)m_activeBlocks.size(), 1, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                ForEachBlockVertex(m_activeBlocks[i], clearVertex);
+                m_blockActive[m_activeBlocks[i]].store(0, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    // CSBuildScalarField
+    pool.ParallelFor(count, PARTICLE_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float3 pos = points.Get(i);
+
+            // the grid vertex this particle is closest to
+            int cx = (int)std::floor((pos.x - m_origin.x) / m_cellSize);
+            int cy = (int)std::floor((pos.y - m_origin.y) / m_cellSize);
+            int cz = (int)std::floor((pos.z - m_origin.z) / m_cellSize);
+
+            if (m_sparse)
+                MarkBlocks({ cx, cy, cz });
+
+            for (int dx = -2; dx <= 2; dx++)
+            for (int dy = -2; dy <= 2; dy++)
+            for (int dz = -2; dz <= 2; dz++) {
+                int gx = cx + dx, gy = cy + dy, gz = cz + dz;
+                if (gx < 0 || gy < 0 || gz < 0 || gx > dim.x || gy > dim.y || gz > dim.z) continue;
+
+                float3 gvPos = {
+                    m_origin.x + (float)gx * m_cellSize,
+                    m_origin.y + (float)gy * m_cellSize,
+                    m_origin.z + (float)gz * m_cellSize,
+                };
+                int w = (int)(Poly6(pos - gvPos, h2) * 100.0f);
+
+                int idx = VertexIndex(gx, gy, gz);
+                if (w != 0)
+                    m_value[idx].fetch_add(w, std::memory_order_relaxed);
+
+                bool onBoundary = gx <= 0 || gx >= dim.x - 1 || gy <= 0 || gz <= 0 || gz >= dim.z - 1;
+                if (onBoundary)
+                    m_boundaryHit[idx].store(1, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    // the shader's InterlockedMin(-100), applied once everything is in
+    auto clampBoundary = [&](int i) {
+        if (m_boundaryHit[i].load(std::memory_order_relaxed)) {
+            int v = m_value[i].load(std::memory_order_relaxed);
+            if (v > -100) m_value[i].store(-100, std::memory_order_relaxed);
+        }
+    };
+
+    if (!m_sparse) {
+        pool.ParallelFor(numVertices, VERTEX_GRAIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                clampBoundary(i);
+        });
+        return;
+    }
+
+    // CSCompactBlocks, in block order so the mesh comes out the same every run
+    m_activeBlocks.clear();
+    for (int b = 0; b < GetNumBlocks(); b++)
+        if (m_blockActive[b].load(std::memory_order_relaxed))
+            m_activeBlocks.push_back(b);
+
+    pool.ParallelFor((int)m_activeBlocks.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            ForEachBlockVertex(m_activeBlocks[i], clampBoundary);
+    });
+}
+
+// flags every block whose closed vertex range the 5x5x5 footprint around
+// center reaches, relaxed stores only, several threads may flag the same one
+void ScalarField::MarkBlocks(int3 center)
+{
+    int x0 = std::max(center.x - 2, 0), x1 = std::min(center.x + 2, m_dim.x);
+    int y0 = std::max(center.y - 2, 0), y1 = std::min(center.y + 2, m_dim.y);
+    int z0 = std::max(center.z - 2, 0), z1 = std::min(center.z + 2, m_dim.z);
+    if (x0 > x1 || y0 > y1 || z0 > z1) return;
+
+    int bx0, bx1, by0, by1, bz0, bz1;
+    BlockRange(x0, x1, m_blockDim.x, bx0, bx1);
+    BlockRange(y0, y1, m_blockDim.y, by0, by1);
+    BlockRange(z0, z1, m_blockDim.z, bz0, bz1);
+    for (int bz = bz0; bz <= bz1; bz++)
+    for (int by = by0; by <= by1; by++)
+    for (int bx = bx0; bx <= bx1; bx++) {
+        std::atomic<unsigned char>& active = m_blockActive[BlockIndex(bx, by, bz)];
+        if (!active.load(std::memory_order_relaxed))
+            active.store(1, std::memory_order_relaxed);
+    }
+}
+
+// CSMarkFieldBlocks + CSGatherScalarField. a block owns the vertices
+// [8b, 8b + 8) per axis, the last block along an axis also the ones at dim,
+// so every vertex is written by exactly one block and nothing needs to be
+// cleared first. only blocks flagged now or last time have anything to write
+void ScalarField::BuildGather(ThreadPool& pool, const Float3Stream& points, int count)
+{
+    const int B = BLOCK_SIZE;
+    const int3 dim = m_dim;
+    const float h2 = m_h * 2.0f;
+    const int numBlocks = GetNumBlocks();
+
+    int numVertices = GetNumVertices();
+    if (numVertices > m_gatheredCapacity) {
+        m_gathered.reset(new float[numVertices]);
+        m_gatheredCapacity = numVertices;
+        m_fullClear = true;
+    }
+
+    // bucket by mc cell. CellCoord clamps, so particles outside the grid end up
+    // in an edge cell and the footprint test below throws them out again
+    m_grid.Configure(m_origin, m_cellSize, dim);
+    m_grid.Build(pool, points, count);
+
+    const std::vector<int>& order = m_grid.GetSortedOrder();
+    m_sortedPos.resize(count);
+    m_sortedCenter.resize(count);
+    pool.ParallelFor(count, PARTICLE_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float3 pos = points.Get(order[i]);
+            m_sortedPos[i] = pos;
+            m_sortedCenter[i] = {
+                (int)std::floor((pos.x - m_origin.x) / m_cellSize),
+                (int)std::floor((pos.y - m_origin.y) / m_cellSize),
+                (int)std::floor((pos.z - m_origin.z) / m_cellSize),
+            };
+        }
+    });
+
+    // last time's blocks still hold values, they get rewritten even if empty now
+    m_gatherBlocks.clear();
+    for (int b = 0; b < numBlocks; b++) {
+        if (m_fullClear || m_blockActive[b].load(std::memory_order_relaxed))
+            m_gatherBlocks.push_back(b);
+        m_blockActive[b].store(0, std::memory_order_relaxed);
+    }
+    size_t previous = m_gatherBlocks.size();
+
+    pool.ParallelFor(count, PARTICLE_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            MarkBlocks(m_sortedCenter[i]);
+    });
+
+    m_activeBlocks.clear();
+    for (int b = 0; b < numBlocks; b++)
+        if (m_blockActive[b].load(std::memory_order_relaxed))
+            m_activeBlocks.push_back(b);
+    if (!m_fullClear) {
+        for (int b : m_activeBlocks)
+            m_gatherBlocks.push_back(b);
+        std::inplace_merge(m_gatherBlocks.begin(), m_gatherBlocks.begin() + previous, m_gatherBlocks.end());
+        m_gatherBlocks.erase(std::unique(m_gatherBlocks.begin(), m_gatherBlocks.end()), m_gatherBlocks.end());
+    }
+    m_fullClear = false;
+
+    pool.ParallelFor((int)m_gatherBlocks.size(), 1, [&](int begin, int end) {
+        const int N = B + 1;
+        float sum[N * N * N];
+        unsigned char hit[N * N * N];
+
+        for (int i = begin; i < end; i++) {
+            int3 b = BlockCoord(m_gatherBlocks[i]);
+            int3 lo = { b.x * B, b.y * B, b.z * B };
+            int3 own = {
+                b.x == m_blockDim.x - 1 ? dim.x : lo.x + B - 1,
+                b.y == m_blockDim.y - 1 ? dim.y : lo.y + B - 1,
+                b.z == m_blockDim.z - 1 ? dim.z : lo.z + B - 1,
+            };
+
+            std::fill(sum, sum + N * N * N, 0.0f);
+            std::fill(hit, hit + N * N * N, (unsigned char)0);
+
+            // a particle centered on c covers c-2..c+2
+            int3 c0 = { lo.x - 2, lo.y - 2, lo.z - 2 };
+            int3 c1 = { own.x + 2, own.y + 2, own.z + 2 };
+            m_grid.ForEachCellInBox(c0, c1, [&](int start, int n) {
+                for (int s = start; s < start + n; s++) {
+                    int3 c = m_sortedCenter[s];
+                    int x0 = std::max(c.x - 2, lo.x), x1 = std::min(c.x + 2, own.x);
+                    int y0 = std::max(c.y - 2, lo.y), y1 = std::min(c.y + 2, own.y);
+                    int z0 = std::max(c.z - 2, lo.z), z1 = std::min(c.z + 2, own.z);
+
+                    float3 pos = m_sortedPos[s];
+                    for (int z = z0; z <= z1; z++)
+                    for (int y = y0; y <= y1; y++)
+                    for (int x = x0; x <= x1; x++) {
+                        float3 gvPos = {
+                            m_origin.x + (float)x * m_cellSize,
+                            m_origin.y + (float)y * m_cellSize,
+                            m_origin.z + (float)z * m_cellSize,
+                        };
+                        int local = (x - lo.x) + (y - lo.y) * N + (z - lo.z) * N * N;
+                        sum[local] += Poly6(pos - gvPos, h2);
+                        hit[local] = 1;
+                    }
+                }
+            });
+
+            for (int z = lo.z; z <= own.z; z++)
+            for (int y = lo.y; y <= own.y; y++)
+            for (int x = lo.x; x <= own.x; x++) {
+                int local = (x - lo.x) + (y - lo.y) * N + (z - lo.z) * N * N;
+                float v = sum[local];
+
+                // the scatter's InterlockedMin(-100)
+                bool onBoundary = x <= 0 || x >= dim.x - 1 || y <= 0 || z <= 0 || z >= dim.z - 1;
+                if (hit[local] && onBoundary && v > -1.0f)
+                    v = -1.0f;
+                m_gathered[VertexIndex(x, y, z)] = v;
+            }
+        }
+    });
+
+    if (!m_sparse)
+        m_activeBlocks.clear();
+}
+
+float ScalarField::Sample(int x, int y, int z) const
+{
+    x = clampi(x, 0, m_dim.x);
+    y = clampi(y, 0, m_dim.y);
+    z = clampi(z, 0, m_dim.z);
+    return GetValue(VertexIndex(x, y, z));
+}
+
+long long ScalarField::GetChecksum() const
+{
+    long long sum = 0;
+    for (int i = 0, n = GetNumVertices(); i < n; i++)
+        sum += m_gather ? std::llround(m_gathered[i] * 100.0f) : GetRaw(i);
+    return sum;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "ParticleStore.h"
+#include "SimMath.h"
+#include "ThreadPool.h"
+#include "UniformGrid.h"
+
+// cpu port of CSClearField + CSBuildScalarField in shaders/marchingCubes.hlsl.
+// every particle splats Poly6(r, 2h) onto the 5x5x5 grid vertices around it.
+// values are ints scaled by 100 like on the gpu (there's no float
+// InterlockedAdd), so the sums come out the same in any order.
+//
+// one deliberate difference: the shader clamps boundary vertices to -100 with
+// an InterlockedMin that races the adds, so what's left there depends on
+// scheduling. here every boundary vertex a particle touched is clamped after
+// all the adds, which is what the gpu gives when the min happens to land last.
+//
+// sparse mode (mc_sparse, the *Blocks kernels on the gpu): the grid is cut into BLOCK_SIZE^3
+// cell blocks, the splat records every block that has a touched vertex, and
+// the next Build only clears those instead of the whole volume. blocks share
+// their face vertices, so a touched vertex marks every block it's a corner of.
+// everything outside the active blocks is 0.
+//
+// gather mode (mc_gather, CSGatherScalarField): the same sum turned around.
+// the particles are bucketed by mc cell in a UniformGrid, then every block
+// adds up, for each of its own vertices, the particles whose 5x5x5 footprint
+// covers it. nothing is shared between blocks, so there are no atomics, and
+// the sum stays in float instead of truncating every splat to 1/100. the
+// footprint and the boundary clamp are the scatter's, only the rounding differs.
+class ScalarField {
+public:
+    static const int BLOCK_SIZE = 8;
+
+    // dim is in cells, the field stores (dim + 1)^3 vertices
+    void Configure(float3 origin, float cellSize, int3 dim, float h);
+
+    void Build(ThreadPool& pool, const Float3Stream& points, int count);
+
+    // the first Build after switching clears everything
+    void SetSparse(bool sparse);
+    bool IsSparse() const { return m_sparse; }
+
+    // same, the first Build after switching clears everything
+    void SetGather(bool gather);
+    bool IsGather() const { return m_gather; }
+
+    int3 GetBlockDim() const { return m_blockDim; }
+    int GetNumBlocks() const { return m_blockDim.x * m_blockDim.y * m_blockDim.z; }
+    int BlockIndex(int bx, int by, int bz) const { return bx + by * m_blockDim.x + bz * m_blockDim.x * m_blockDim.y; }
+    int3 BlockCoord(int block) const
+    {
+        return { block % m_blockDim.x, (block / m_blockDim.x) % m_blockDim.y, block / (m_blockDim.x * m_blockDim.y) };
+    }
+
+    // blocks the last Build touched, ascending. sparse mode only
+    const std::vector<int>& GetActiveBlocks() const { return m_activeBlocks; }
+
+    int3 GetDim() const { return m_dim; }
+    float3 GetOrigin() const { return m_origin; }
+    float GetCellSize() const { return m_cellSize; }
+    int GetNumVertices() const { return (m_dim.x + 1) * (m_dim.y + 1) * (m_dim.z + 1); }
+    int VertexIndex(int x, int y, int z) const { return x + y * (m_dim.x + 1) + z * (m_dim.x + 1) * (m_dim.y + 1); }
+
+    // SampleField in the shader: clamped to the grid and divided by 100
+    float Sample(int x, int y, int z) const;
+    float GetValue(int index) const { return m_gather ? m_gathered[index] : GetRaw(index) / 100.0f; }
+    int GetRaw(int index) const { return m_value[index].load(std::memory_order_relaxed); }
+
+    // sum of the raw values, cheap way to compare two runs. in gather mode
+    // every value is scaled by 100 and rounded first
+    long long GetChecksum() const;
+
+private:
+    float3 m_origin = { 0.0f, 0.0f, 0.0f };
+    float m_cellSize = 1.0f;
+    int3 m_dim = { 0, 0, 0 };
+    float m_h = 1.0f;
+
+    std::unique_ptr<std::atomic<int>[]> m_value;
+    std::unique_ptr<std::atomic<unsigned char>[]> m_boundaryHit;   // set when a particle touched a boundary vertex
+    int m_capacity = 0;
+
+    template <typename Fn>
+    void ForEachBlockVertex(int block, Fn&& fn) const;
+
+    void MarkBlocks(int3 center);
+    void BuildGather(ThreadPool& pool, const Float3Stream& points, int count);
+
+    bool m_gather = false;
+    std::unique_ptr<float[]> m_gathered;
+    int m_gatheredCapacity = 0;
+    UniformGrid m_grid;                 // one cell per mc cell
+    std::vector<float3> m_sortedPos;    // the particles in grid order
+    std::vector<int3> m_sortedCenter;   // and the vertex each one's footprint is centered on
+    std::vector<int> m_gatherBlocks;    // flagged now or last time, ascending
+
+    bool m_sparse = false;
+    bool m_fullClear = true;    // values outside the active blocks aren't known to be 0
+    int3 m_blockDim = { 0, 0, 0 };
+    std::unique_ptr<std::atomic<unsigned char>[]> m_blockActive;
+    int m_blockCapacity = 0;
+    std::vector<int> m_activeBlocks;
+};
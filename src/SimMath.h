@@ -0,0 +1,80 @@
+#pragma once
+
+// portable math for the cpu solver.
+// mirrors the hlsl types/intrinsics used in shaders/particles.hlsl so the
+// kernels can be ported line by line without pulling in DirectXMath/windows.h.
+
+#include <cmath>
+
+struct float3 {
+    float x, y, z;
+};
+
+struct int3 {
+    int x, y, z;
+};
+
+inline float3 operator+(float3 a, float3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+inline float3 operator-(float3 a, float3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline float3 operator-(float3 a) { return { -a.x, -a.y, -a.z }; }
+inline float3 operator*(float3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+inline float3 operator*(float s, float3 a) { return { a.x * s, a.y * s, a.z * s }; }
+inline float3 operator/(float3 a, float s) { return { a.x / s, a.y / s, a.z / s }; }
+inline float3& operator+=(float3& a, float3 b) { a.x += b.x; a.y += b.y; a.z += b.z; return a; }
+inline float3& operator-=(float3& a, float3 b) { a.x -= b.x; a.y -= b.y; a.z -= b.z; return a; }
+inline float3& operator/=(float3& a, float s) { a.x /= s; a.y /= s; a.z /= s; return a; }
+
+inline float dot(float3 a, float3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(float3 a) { return std::sqrt(dot(a, a)); }
+
+inline float clampf(float v, float lo, float hi) { return v < lo ? lo : (v > hi ? hi : v); }
+inline int clampi(int v, int lo, int hi) { return v < lo ? lo : (v > hi ? hi : v); }
+
+inline float3 clamp(float3 v, float3 lo, float3 hi)
+{
+    return { clampf(v.x, lo.x, hi.x), clampf(v.y, lo.y, hi.y), clampf(v.z, lo.z, hi.z) };
+}
+
+// same as (int3)floor((pos - origin) / cellSize) clamped to [0, dim - 1]
+inline int3 CellCoord(float3 pos, float3 origin, float cellSize, int3 dim)
+{
+    return {
+        clampi((int)std::floor((pos.x - origin.x) / cellSize), 0, dim.x - 1),
+        clampi((int)std::floor((pos.y - origin.y) / cellSize), 0, dim.y - 1),
+        clampi((int)std::floor((pos.z - origin.z) / cellSize), 0, dim.z - 1),
+    };
+}
+
+// ----- sph kernels, same as particles.hlsl -----
+
+inline float Poly6(float3 r, float h)
+{
+    float coeff = 315.0f / (64.0f * 3.14159265f);
+
+    float h2 = h * h;
+    float r2 = dot(r, r);
+
+    if (r2 > h2) {
+        return 0.0f;
+    }
+
+    float h9 = std::pow(std::fabs(h), 9.0f);
+    float diff = h2 - r2;
+    float diff3 = diff * diff * diff;
+
+    return (coeff / h9) * diff3;
+}
+
+inline float3 SpikyGradient(float3 r, float h)
+{
+    float norm = length(r);
+
+    if (norm > h || norm < 1e-12f) return { 0, 0, 0 };
+
+    float h6 = std::pow(h, 6.0f);
+    float diff = h - norm;
+    float diff2 = diff * diff;
+
+    float scalar = -(45.0f / (3.14159265f * h6)) * diff2 / norm;
+    return r * scalar;
+}
@@ -0,0 +1,242 @@
+#include "SimulationConfig.h"
+
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+static std::string Trim(const std::string& s)
+{
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return std::string();
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+static int ParseInt(const std::string& key, const std::string& value)
+{
+    size_t used = 0;
+    long long v = 0;
+    try {
+        v = std::stoll(value, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size() || v < INT_MIN || v > INT_MAX)
+        throw std::runtime_error("'" + key + "' wants an integer, got '" + value + "'");
+    return (int)v;
+}
+
+static float ParseFloat(const std::string& key, const std::string& value)
+{
+    size_t used = 0;
+    float v = 0.0f;
+    try {
+        v = std::stof(value, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size())
+        throw std::runtime_error("'" + key + "' wants a number, got '" + value + "'");
+    return v;
+}
+
+static float3 ParseFloat3(const std::string& key, const std::string& value)
+{
+    std::string spaced = value;
+    for (char& c : spaced)
+        if (c == ',') c = ' ';
+
+    std::istringstream in(spaced);
+    std::string x, y, z, extra;
+    if (!(in >> x >> y >> z) || (in >> extra))
+        throw std::runtime_error("'" + key + "' wants three numbers, got '" + value + "'");
+    return { ParseFloat(key, x), ParseFloat(key, y), ParseFloat(key, z) };
+}
+
+SimulationConfig SimulationConfig::LoadFromFile(const std::filesystem::path& filePath)
+{
+    const std::string path = filePath.string();
+    std::ifstream file(filePath);
+    if (!file)
+        throw std::runtime_error("can't open config file '" + path + "'");
+
+    SimulationConfig config;
+    std::string line;
+    int lineNumber = 0;
+
+    while (std::getline(file, line)) {
+        lineNumber++;
+
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+        line = Trim(line);
+        if (line.empty()) continue;
+
+        size_t eq = line.find('=');
+        try {
+            if (eq == std::string::npos)
+                throw std::runtime_error("expected 'key = value'");
+            config.Set(Trim(line.substr(0, eq)), Trim(line.substr(eq + 1)));
+        } catch (const std::runtime_error& e) {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": " + e.what());
+        }
+    }
+
+    try {
+        config.Validate();
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error(path + ": " + e.what());
+    }
+    return config;
+}
+
+void SimulationConfig::Set(const std::string& key, const std::string& value)
+{
+    if (key == "num_x") numX = ParseInt(key, value);
+    else if (key == "num_y") numY = ParseInt(key, value);
+    else if (key == "num_z") numZ = ParseInt(key, value);
+    else if (key == "particle_size") particleSize = ParseFloat(key, value);
+    else if (key == "particle_spacing") particleSpacing = ParseFloat(key, value);
+    else if (key == "particle_offset") particleOffset = ParseFloat3(key, value);
+    else if (key == "bbox_size_xz") bboxSizeXZ = ParseFloat(key, value);
+    else if (key == "bbox_size_y") bboxSizeY = ParseFloat(key, value);
+    else if (key == "cell_size") cellSize = ParseFloat(key, value);
+    else if (key == "rho_0") rho0 = ParseFloat(key, value);
+    else if (key == "epsilon") epsilon = ParseFloat(key, value);
+    else if (key == "damping") damping = ParseFloat(key, value);
+    else if (key == "viscosity") viscosity = ParseFloat(key, value);
+    else if (key == "iterations") iterations = ParseInt(key, value);
+    else if (key == "fixed_dt") fixedDt = ParseFloat(key, value);
+    else if (key == "max_substeps") maxSubsteps = ParseInt(key, value);
+    else if (key == "mc_dim_x") mcDimX = ParseInt(key, value);
+    else if (key == "mc_dim_y") mcDimY = ParseInt(key, value);
+    else if (key == "mc_dim_z") mcDimZ = ParseInt(key, value);
+    else if (key == "mc_iso") mcIso = ParseFloat(key, value);
+    else if (key == "mc_sparse") mcSparse = ParseInt(key, value) != 0;
+    else if (key == "mc_gather") mcGather = ParseInt(key, value) != 0;
+    else if (key == "mc_incremental") mcIncremental = ParseInt(key, value) != 0;
+    else if (key == "mc_incremental_tolerance") mcIncrementalTolerance = ParseFloat(key, value);
+    else if (key == "mc_lod_levels") mcLodLevels = ParseInt(key, value);
+    else if (key == "mc_lod_distance") mcLodDistance = ParseFloat(key, value);
+    else if (key == "mc_compact_vertices") mcCompactVertices = ParseInt(key, value) != 0;
+    else if (key == "mc_reserve_tris") mcReserveTris = ParseInt(key, value);
+    else if (key == "sdf_band") sdfBand = ParseInt(key, value);
+    else if (key == "sdf_radius") sdfRadius = ParseFloat(key, value);
+    else if (key == "mesh_export_dir") meshExportDir = value;
+    else if (key == "mesh_export_queue") meshExportQueue = ParseInt(key, value);
+    else if (key == "cache_record") cacheRecord = value;
+    else if (key == "cache_play") cachePlay = value;
+    else if (key == "cache_prefetch") cachePrefetch = ParseInt(key, value);
+    else throw std::runtime_error("unknown key '" + key + "'");
+}
+
+void SimulationConfig::Validate() const
+{
+    if (numX <= 0 || numY <= 0 || numZ <= 0)
+        throw std::runtime_error("num_x/num_y/num_z must be positive");
+    // buffer sizes are computed in 32 bits on the gpu side
+    if ((long long)numX * numY * numZ > 0x7FFFFFFF / 64)
+        throw std::runtime_error("too many particles");
+    if (cellSize <= 0.0f || bboxSizeXZ <= 0.0f || bboxSizeY <= 0.0f)
+        throw std::runtime_error("cell_size and bbox sizes must be positive");
+    if ((long long)GetNSDim().x * GetNSDim().y * GetNSDim().z > 0x7FFFFFFF / 4)
+        throw std::runtime_error("neighbor search grid too big, raise cell_size or shrink the box");
+    if (iterations < 0)
+        throw std::runtime_error("iterations can't be negative");
+    if (fixedDt <= 0.0f || maxSubsteps <= 0)
+        throw std::runtime_error("fixed_dt and max_substeps must be positive");
+    if (mcDimX <= 0 || mcDimY <= 0 || mcDimZ <= 0)
+        throw std::runtime_error("mc_dim_x/y/z must be positive");
+    if ((long long)mcDimX * mcDimY * mcDimZ * (mcLodLevels > 0 ? 7 : 5) * 3 > 0x7FFFFFFF / 32)
+        throw std::runtime_error("marching cubes grid too big for the vertex buffer");
+    if (mcReserveTris <= 0)
+        throw std::runtime_error("mc_reserve_tris must be positive");
+    // blocks are only checked while the splat touches them. below mc_iso a
+    // vertex the mesh has inside the surface can't drop to 0 unnoticed
+    if (mcIncrementalTolerance < 0.0f || (mcIso > 0.0f && mcIncrementalTolerance >= mcIso))
+        throw std::runtime_error("mc_incremental_tolerance must be in [0, mc_iso)");
+    if (mcLodLevels < 0 || mcLodLevels > 3 || mcLodDistance <= 0.0f)
+        throw std::runtime_error("mc_lod_levels must be in [0, 3] and mc_lod_distance positive");
+    // the incremental mesh keeps full resolution blocks around, lod moves with the camera
+    if (mcLodLevels > 0 && mcIncremental)
+        throw std::runtime_error("mc_lod_levels and mc_incremental can't be used together");
+    if (sdfBand < 0 || sdfRadius <= 0.0f)
+        throw std::runtime_error("sdf_band can't be negative and sdf_radius must be positive");
+    if (meshExportQueue <= 0)
+        throw std::runtime_error("mesh_export_queue must be positive");
+    if (cachePrefetch <= 0)
+        throw std::runtime_error("cache_prefetch must be positive");
+    if (!cacheRecord.empty() && !cachePlay.empty())
+        throw std::runtime_error("cache_record and cache_play can't be used together");
+}
+
+int3 SimulationConfig::GetNSDim() const
+{
+    return {
+        (int)std::ceil((bboxSizeXZ * 2) / cellSize) + 2,
+        (int)std::ceil(bboxSizeY / cellSize) + 2,
+        (int)std::ceil((bboxSizeXZ * 2) / cellSize) + 2,
+    };
+}
+
+int SimulationConfig::GetNSNumCells() const
+{
+    int3 dim = GetNSDim();
+    return dim.x * dim.y * dim.z;
+}
+
+float3 SimulationConfig::GetNSOrigin() const
+{
+    int3 dim = GetNSDim();
+    return { -(dim.x * cellSize) / 2.0f, -cellSize, -(dim.z * cellSize) / 2.0f };
+}
+
+CPUSolverConstants SimulationConfig::GetSolverConstants() const
+{
+    CPUSolverConstants cb;
+    cb.gridOrigin = GetNSOrigin();
+    cb.cellSize = cellSize;
+    cb.gridDim = GetNSDim();
+    cb.numParticles = GetNumParticles();
+    cb.size = { bboxSizeXZ, bboxSizeY, bboxSizeXZ };
+    cb.numCells = GetNSNumCells();
+    cb.dt = 0.0f;
+    cb.H = cellSize;    // cell size is also the smoothing radius
+    cb.rho0 = rho0;
+    cb.epsilon = epsilon;
+    cb.iterations = iterations;
+    cb.damping = damping;
+    cb.viscosity = viscosity;
+    return cb;
+}
+
+void SimulationConfig::SpawnParticles(ParticleStore& particles, ThreadPool* pool) const
+{
+    particles.Resize(GetNumParticles());     // zeroes velocity, density, lambda, delta, xsph
+
+    // particle i is (x, y, z) with z running fastest
+    auto spawn = [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int z = i % numZ;
+            int y = (i / numZ) % numY;
+            int x = i / (numZ * numY);
+
+            float3 pos = {
+                (x - numX / 2.0f) * particleSpacing + particleOffset.x,
+                y * particleSpacing + particleOffset.y,
+                (z - numZ / 2.0f) * particleSpacing + particleOffset.z,
+            };
+
+            particles.position.Set(i, pos);
+            particles.predictedPosition.Set(i, pos);
+        }
+    };
+
+    if (pool)
+        pool->ParallelFor(GetNumParticles(), 4096, spawn);
+    else
+        spawn(0, GetNumParticles());
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+#include "CPUSolver.h"
+#include "ParticleStore.h"
+#include "SimMath.h"
+
+// everything that used to be a compile-time constant in ParticleSystem.h.
+// the defaults are the old values, a config file only has to list what it
+// changes. loaded once at startup, every buffer is sized from it.
+//
+// file format: one "key = value" per line, '#' starts a comment, vectors are
+// three numbers separated by spaces or commas. keys are the old constant names
+// in lower case, e.g.
+//
+//     num_x = 100
+//     bbox_size_y = 200
+//     particle_offset = 0, 4, 4
+struct SimulationConfig {
+    // particle block
+    int numX = 50;
+    int numY = 50;
+    int numZ = 20;
+    float particleSize = 0.1f;
+    float particleSpacing = 0.3f;               // how far the particles spawn from each other
+    float3 particleOffset = { 0.0f, 4.0f, 4.0f };   // offsets where the particles spawn
+
+    // simulation
+    float bboxSizeXZ = 10.0f;
+    float bboxSizeY = 100.0f;
+    float cellSize = 1.0f;      // also the smoothing radius
+    float rho0 = 40.0f;         // rest density
+    float epsilon = 100.0f;
+    float damping = 0.999f;
+    float viscosity = 0.1f;
+    int iterations = 3;
+
+    // time stepping, the renderer runs whole steps of fixed_dt and drops
+    // anything past max_substeps per frame (see FixedStepScheduler)
+    float fixedDt = 1.0f / 60.0f;
+    int maxSubsteps = 4;
+
+    // marching cubes grid
+    int mcDimX = 64;
+    int mcDimY = 128;
+    int mcDimZ = 64;
+    float mcIso = 4.0f;         // isosurface threshold
+    bool mcSparse = true;       // only clear and polygonize the 8^3 blocks the particles touch
+    bool mcGather = false;      // build the field per vertex in float instead of splatting ints
+    bool mcIncremental = false; // keep the mesh per block, only polygonize blocks whose field moved
+    float mcIncrementalTolerance = 1.0f;    // how far a field value can move before its block counts as moved, a quarter of mc_iso
+    int mcLodLevels = 0;        // coarser blocks away from the camera, up to 2^levels wide cells (LodSurface.h), 0 = off
+    float mcLodDistance = 20.0f;    // blocks closer than this stay at full resolution, every doubling of it is one level
+    bool mcCompactVertices = false;     // 12 byte PackedVertex (VertexCodec.h) instead of the 32 byte Vertex
+    int mcReserveTris = 65536;  // starting size of the gpu mesh buffers, they grow on demand
+
+    // narrow band distance field on the neighbor search grid (DistanceField.h)
+    int sdfBand = 0;            // cells of band around the surface, 0 = don't build it
+    float sdfRadius = 0.5f;     // sphere around every particle that counts as fluid
+
+    // surface mesh as a ply sequence (MeshExporter.h)
+    std::string meshExportDir;  // written into this directory every frame, empty = off
+    int meshExportQueue = 4;    // frames waiting for the disk before the simulation waits too
+
+    // particle cache (ParticleCache.h)
+    std::string cacheRecord;    // every frame's particles go into this file, empty = off
+    std::string cachePlay;      // play this file back instead of simulating (CachePlayer.h), empty = off
+    int cachePrefetch = 8;      // frames read ahead of the playhead
+
+    // throw std::runtime_error with the file/line on anything they don't understand
+    static SimulationConfig LoadFromFile(const std::filesystem::path& path);
+    void Set(const std::string& key, const std::string& value);
+    void Validate() const;
+
+    // derived sizes
+    int GetNumParticles() const { return numX * numY * numZ; }
+    int3 GetNSDim() const;
+    int GetNSNumCells() const;
+    float3 GetNSOrigin() const;
+    int GetMCNumCells() const { return mcDimX * mcDimY * mcDimZ; }
+    float GetMCCellSize() const { return (bboxSizeXZ * 2.0f) / mcDimX; }
+    float3 GetMCOrigin() const { return { -bboxSizeXZ - GetMCCellSize(), -cellSize, -bboxSizeXZ - GetMCCellSize() }; }
+    int GetMCNumVertices() const { return (mcDimX + 1) * (mcDimY + 1) * (mcDimZ + 1); }
+    int GetMCNumBlocks() const { return ((mcDimX + 7) / 8) * ((mcDimY + 7) / 8) * ((mcDimZ + 7) / 8); }
+    // marching cubes: up to 5 triangles per cell. with mc_lod_levels a block
+    // fills the gaps on its faces towards a coarser block, up to 8 triangles
+    // per coarse face square. coarser blocks have fewer cells than they'd
+    // have at full resolution
+    int GetMCMaxTris() const { return GetMCNumCells() * 5 + (mcLodLevels > 0 ? GetMCNumBlocks() * 6 * 16 * 8 : 0); }
+    // welded mesh: at most one vertex per grid edge, 3 edges per grid vertex.
+    // a coarse lattice edge's vertex is filed under the grid edge it starts with
+    int GetMCMaxVertices() const { return GetMCNumVertices() * 3; }
+
+    // NSConstants for the cpu solver, dt is filled in per frame
+    CPUSolverConstants GetSolverConstants() const;
+
+    // the initial block of particles, same layout LoadParticles always had.
+    // pool is optional, the big scaling scenes take a while to fill serially
+    void SpawnParticles(ParticleStore& particles, ThreadPool* pool = nullptr) const;
+};
@@ -0,0 +1,143 @@
+#include "SpatialHashGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const int PARTICLE_GRAIN = 1024;
+static const int SLOT_GRAIN = 4096;
+
+// spreads the low 21 bits of v so there are two zero bits between each
+static uint64_t Part1By2(uint64_t v)
+{
+    v &= 0x1FFFFF;
+    v = (v | (v << 32)) & 0x1F00000000FFFFull;
+    v = (v | (v << 16)) & 0x1F0000FF0000FFull;
+    v = (v | (v << 8))  & 0x100F00F00F00F00Full;
+    v = (v | (v << 4))  & 0x10C30C30C30C30C3ull;
+    v = (v | (v << 2))  & 0x1249249249249249ull;
+    return v;
+}
+
+void SpatialHashGrid::Configure(float3 origin, float cellSize)
+{
+    m_origin = origin;
+    m_invCellSize = 1.0f / cellSize;
+}
+
+int3 SpatialHashGrid::Coord(float3 pos) const
+{
+    float3 rel = (pos - m_origin) * m_invCellSize;
+    return { (int)std::floor(rel.x), (int)std::floor(rel.y), (int)std::floor(rel.z) };
+}
+
+uint64_t SpatialHashGrid::CellKey(int3 c)
+{
+    // bias so negative coordinates sort before positive ones. anything past
+    // +-1M cells wraps around, which only costs false candidates, never misses
+    const int bias = 1 << 20;
+    return Part1By2((uint64_t)(c.x + bias))
+         | Part1By2((uint64_t)(c.y + bias)) << 1
+         | Part1By2((uint64_t)(c.z + bias)) << 2;
+}
+
+void SpatialHashGrid::Reserve(int count)
+{
+    size_t wanted = 64;
+    int bits = 6;
+    while (wanted < (size_t)count * 2) {
+        wanted <<= 1;
+        bits++;
+    }
+    if (wanted == m_capacity) return;
+
+    m_keys.reset(new std::atomic<uint64_t>[wanted]);
+    m_slotCell.resize(wanted);
+    m_capacity = wanted;
+    m_mask = wanted - 1;
+    m_shift = 64 - bits;
+}
+
+size_t SpatialHashGrid::Insert(uint64_t key)
+{
+    for (size_t s = Slot(key);; s = (s + 1) & m_mask) {
+        uint64_t k = m_keys[s].load(std::memory_order_relaxed);
+        if (k == key) return s;
+        if (k == EMPTY_KEY) {
+            if (m_keys[s].compare_exchange_strong(k, key, std::memory_order_relaxed))
+                return s;
+            // somebody else took the slot, it might have been for the same key
+            if (k == key) return s;
+        }
+    }
+}
+
+void SpatialHashGrid::Build(ThreadPool& pool, const Float3Stream& points, int count)
+{
+    Reserve(count);
+    m_particleKey.resize(count);
+    m_particleCell.resize(count);
+
+    // 1. clear the table, its size follows the particle count
+    pool.ParallelFor((int)m_capacity, SLOT_GRAIN, [&](int begin, int end) {
+        for (int s = begin; s < end; s++)
+            m_keys[s].store(EMPTY_KEY, std::memory_order_relaxed);
+    });
+
+    // 2. key every particle and insert. neighbors in memory are mostly in the
+    // same cell, so skip the probe when the key repeats
+    pool.ParallelFor(count, PARTICLE_GRAIN, [&](int begin, int end) {
+        uint64_t last = EMPTY_KEY;
+        for (int i = begin; i < end; i++) {
+            uint64_t key = CellKey(Coord(points.Get(i)));
+            m_particleKey[i] = key;
+            if (key != last) {
+                Insert(key);
+                last = key;
+            }
+        }
+    });
+
+    // 3. compact the occupied slots, count per slice, scan, write
+    const int numSlices = (int)pool.GetThreadCount();
+    const int sliceSize = (int)((m_capacity + numSlices - 1) / numSlices);
+    m_sliceOccupied.assign(numSlices + 1, 0);
+
+    pool.ParallelFor((int)m_capacity, sliceSize, [&](int begin, int end) {
+        int occupied = 0;
+        for (int s = begin; s < end; s++)
+            occupied += m_keys[s].load(std::memory_order_relaxed) != EMPTY_KEY;
+        m_sliceOccupied[begin / sliceSize + 1] = occupied;
+    });
+
+    for (int i = 0; i < numSlices; i++)
+        m_sliceOccupied[i + 1] += m_sliceOccupied[i];
+    m_cellKeys.resize(m_sliceOccupied[numSlices]);
+
+    pool.ParallelFor((int)m_capacity, sliceSize, [&](int begin, int end) {
+        int out = m_sliceOccupied[begin / sliceSize];
+        for (int s = begin; s < end; s++) {
+            uint64_t k = m_keys[s].load(std::memory_order_relaxed);
+            if (k != EMPTY_KEY)
+                m_cellKeys[out++] = k;
+        }
+    });
+
+    // sorted keys make the cell ids (and with them the particle order)
+    // independent of where the keys landed in the table. only occupied cells,
+    // a few thousand for the default scene
+    std::sort(m_cellKeys.begin(), m_cellKeys.end());
+
+    const int numCells = (int)m_cellKeys.size();
+    pool.ParallelFor(numCells, SLOT_GRAIN, [&](int begin, int end) {
+        for (int c = begin; c < end; c++)
+            m_slotCell[Insert(m_cellKeys[c])] = c;
+    });
+
+    pool.ParallelFor(count, PARTICLE_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            m_particleCell[i] = FindCell(m_particleKey[i]);
+    });
+
+    // 4. counting sort over the occupied cells
+    m_sort.Sort(pool, m_particleCell.data(), count, numCells);
+}
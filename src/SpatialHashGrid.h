@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "CellSort.h"
+#include "ParticleStore.h"
+#include "SimMath.h"
+#include "ThreadPool.h"
+
+// sparse alternative to UniformGrid. only cells that actually hold particles
+// exist, so memory and per-frame work scale with the particle count instead
+// of the bounding box volume (the dense grid clears and scans all ~49k cells
+// of the 20x100x20 box every frame, most of them empty air).
+//
+// build:
+//  1. every particle gets a 64-bit key, the morton code of its unclamped cell
+//     coordinate (21 bits per axis, so the domain is effectively unbounded)
+//  2. keys go into an open-addressing hash table sized from the particle count
+//  3. the occupied keys are compacted and sorted, a cell's id is its rank, so
+//     the sorted particles come out in z-order
+//  4. CellSort does the rest, over the occupied cells only
+//
+// the lookup side is the same as UniformGrid, but every stencil cell is a hash
+// probe instead of an array index.
+class SpatialHashGrid {
+public:
+    void Configure(float3 origin, float cellSize);
+
+    void Build(ThreadPool& pool, const Float3Stream& points, int count);
+
+    // occupied cells after the last Build
+    int GetNumCells() const { return (int)m_cellKeys.size(); }
+
+    // walks the 27-cell stencil around pos and calls fn(start, count) for every
+    // occupied cell, same order as UniformGrid::ForEachNeighborCell
+    template <typename Fn>
+    void ForEachNeighborCell(float3 pos, Fn&& fn) const
+    {
+        int3 cell = Coord(pos);
+
+        for (int dx = -1; dx <= 1; dx++)
+        for (int dy = -1; dy <= 1; dy++)
+        for (int dz = -1; dz <= 1; dz++)
+        {
+            int c = FindCell(CellKey({ cell.x + dx, cell.y + dy, cell.z + dz }));
+            if (c >= 0)
+                fn(m_sort.m_cellStart[c], m_sort.m_cellCount[c]);
+        }
+    }
+
+    const std::vector<int>& GetSortedOrder() const { return m_sort.m_sortedOrder; }
+
+private:
+    static const uint64_t EMPTY_KEY = ~0ull;
+
+    int3 Coord(float3 pos) const;
+    static uint64_t CellKey(int3 c);
+
+    size_t Slot(uint64_t key) const { return (size_t)((key * 0x9E3779B97F4A7C15ull) >> m_shift); }
+
+    // cell id of key, -1 if no particle is in it
+    int FindCell(uint64_t key) const
+    {
+        for (size_t s = Slot(key);; s = (s + 1) & m_mask) {
+            uint64_t k = m_keys[s].load(std::memory_order_relaxed);
+            if (k == key) return m_slotCell[s];
+            if (k == EMPTY_KEY) return -1;
+        }
+    }
+
+    size_t Insert(uint64_t key);
+    void Reserve(int count);
+
+    float3 m_origin = { 0, 0, 0 };
+    float m_invCellSize = 1.0f;
+
+    // open addressing, linear probing. at least 2x the particle count so it
+    // never fills up even if every particle is in its own cell
+    std::unique_ptr<std::atomic<uint64_t>[]> m_keys;
+    std::vector<int> m_slotCell;
+    size_t m_capacity = 0;
+    size_t m_mask = 0;
+    int m_shift = 64;
+
+    std::vector<uint64_t> m_particleKey;
+    std::vector<int> m_particleCell;
+    std::vector<uint64_t> m_cellKeys;       // occupied cells, sorted
+    std::vector<int> m_sliceOccupied;       // scratch for compacting the table
+    CellSort m_sort;
+};
@@ -0,0 +1,199 @@
+#include "ThreadPool.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// tries before an idle worker goes to sleep
+static const int IDLE_SPINS = 64;
+
+// which pool/queue the current thread belongs to, workers only
+static thread_local const ThreadPool* t_pool = nullptr;
+static thread_local unsigned t_queue = 0;
+
+static void PinToCore(std::thread& t, unsigned core)
+{
+#if defined(_WIN32)
+    SetThreadAffinityMask(t.native_handle(), (DWORD_PTR)1 << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#else
+    (void)t;
+    (void)core;
+#endif
+}
+
+ThreadPool::ThreadPool(unsigned numThreads, bool pinThreads)
+{
+    unsigned hardware = std::thread::hardware_concurrency();
+    if (numThreads == 0)
+        numThreads = hardware;
+    if (numThreads == 0)
+        numThreads = 1;
+
+    m_numQueues = numThreads;   // workers + the shared one
+    m_queues.reset(new Queue[m_numQueues]);
+
+    // the calling thread also runs chunks, so spawn one less.
+    // worker i gets core i, core 0 is left to whoever calls ParallelFor
+    for (unsigned i = 1; i < numThreads; i++) {
+        m_workers.emplace_back([this, i] { WorkerLoop(i - 1); });
+        if (pinThreads && hardware > 1)
+            PinToCore(m_workers.back(), i % hardware);
+    }
+    m_pinned = pinThreads && hardware > 1 && !m_workers.empty();
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread& t : m_workers)
+        t.join();
+}
+
+unsigned ThreadPool::QueueIndex() const
+{
+    return t_pool == this ? t_queue : m_numQueues - 1;
+}
+
+void ThreadPool::ParallelFor(int count, int grain, const std::function<void(int, int)>& fn)
+{
+    if (count <= 0) return;
+    if (grain < 1) grain = 1;
+
+    // not worth waking anyone up
+    if (m_workers.empty() || count <= grain) {
+        for (int begin = 0; begin < count; begin += grain)
+            fn(begin, begin + grain < count ? begin + grain : count);
+        return;
+    }
+
+    Job job;
+    job.fn = &fn;
+    job.count = count;
+    job.grain = grain;
+    int numChunks = (count + grain - 1) / grain;
+    job.remaining.store(numChunks, std::memory_order_relaxed);
+
+    unsigned queue = QueueIndex();
+    Execute(queue, { &job, 0, numChunks });
+
+    // help out until the stolen halves are done too. whatever we pick up
+    // might belong to another job, that's fine, it has to run somewhere
+    while (job.remaining.load(std::memory_order_acquire) > 0) {
+        if (!RunOne(queue))
+            std::this_thread::yield();
+    }
+}
+
+void ThreadPool::Execute(unsigned queue, Range range)
+{
+    // keep the front half, leave the back half for whoever is idle
+    while (range.end - range.begin > 1) {
+        int mid = range.begin + (range.end - range.begin) / 2;
+        Push(queue, { range.job, mid, range.end });
+        range.end = mid;
+    }
+
+    Job* job = range.job;
+    int begin = range.begin * job->grain;
+    int end = begin + job->grain < job->count ? begin + job->grain : job->count;
+    (*job->fn)(begin, end);
+
+    // last touch of the job, the owner may return as soon as this hits 0
+    job->remaining.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+bool ThreadPool::RunOne(unsigned queue)
+{
+    Range range;
+    if (!Pop(queue, range) && !Steal(queue, range))
+        return false;
+    Execute(queue, range);
+    return true;
+}
+
+void ThreadPool::Push(unsigned queue, const Range& range)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queues[queue].mutex);
+        m_queues[queue].ranges.push_back(range);
+    }
+    m_queued.fetch_add(1);
+
+    // a sleeper counts itself before checking m_queued, under the lock, so
+    // either it sees the new range or we see it and wake it
+    if (m_sleepers.load() > 0) {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_wake.notify_one();
+    }
+}
+
+// newest first from our own queue, it's the smallest and still in cache
+bool ThreadPool::Pop(unsigned queue, Range& range)
+{
+    Queue& q = m_queues[queue];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.ranges.empty()) return false;
+    range = q.ranges.back();
+    q.ranges.pop_back();
+    m_queued.fetch_sub(1);
+    return true;
+}
+
+// oldest first from everyone else, it's the biggest piece left
+bool ThreadPool::Steal(unsigned queue, Range& range)
+{
+    if (m_queued.load(std::memory_order_relaxed) == 0) return false;
+
+    for (unsigned i = 1; i < m_numQueues; i++) {
+        Queue& q = m_queues[(queue + i) % m_numQueues];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.ranges.empty()) continue;
+        range = q.ranges.front();
+        q.ranges.pop_front();
+        m_queued.fetch_sub(1);
+        m_steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(unsigned index)
+{
+    t_pool = this;
+    t_queue = index;
+
+    int idle = 0;
+    while (true) {
+        if (RunOne(index)) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < IDLE_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleepers.fetch_add(1);
+        m_wake.wait(lock, [this] { return m_quit || m_queued.load() > 0; });
+        m_sleepers.fetch_sub(1);
+        if (m_quit) return;
+        idle = 0;
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// persistent worker threads for the cpu side (solver, meshing, host loops).
+// ParallelFor is the cpu equivalent of a Dispatch(): the range is cut into
+// chunks that the workers (and the calling thread) run until it's empty.
+// it blocks until every chunk is done, so consecutive calls act like the
+// UAV barriers between dispatches.
+//
+// scheduling is work stealing: every worker has its own queue of index
+// ranges. a range is split in half lazily, the running thread keeps the
+// front half and pushes the back half on its own queue, idle threads steal
+// the oldest (biggest) range from someone else's queue. a thread waiting on
+// its ParallelFor runs chunks instead of blocking, so calls can nest and any
+// number of threads can call ParallelFor on the same pool at once.
+class ThreadPool {
+public:
+    // numThreads = 0 uses every hardware thread. pinThreads locks worker i
+    // to core i (the calling thread is left alone, it's not ours)
+    explicit ThreadPool(unsigned numThreads = 0, bool pinThreads = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned GetThreadCount() const { return (unsigned)m_workers.size() + 1; }
+    bool IsPinned() const { return m_pinned; }
+
+    // calls fn(begin, end) over [0, count) in chunks of exactly grain items
+    // (the last one can be shorter), chunk k starts at k * grain
+    void ParallelFor(int count, int grain, const std::function<void(int, int)>& fn);
+
+    // map(begin, end) -> T per chunk, folded with combine. the partials are
+    // combined in chunk order, so float sums come out the same every run no
+    // matter which thread ran what
+    template <typename T, typename Map, typename Combine>
+    T ParallelReduce(int count, int grain, T identity, Map&& map, Combine&& combine)
+    {
+        if (count <= 0) return identity;
+        if (grain < 1) grain = 1;
+
+        int numChunks = (count + grain - 1) / grain;
+        std::vector<T> partial(numChunks, identity);
+        ParallelFor(count, grain, [&](int begin, int end) {
+            partial[begin / grain] = map(begin, end);
+        });
+
+        T result = identity;
+        for (const T& p : partial)
+            result = combine(result, p);
+        return result;
+    }
+
+    // ranges taken from another thread's queue since construction
+    unsigned long long GetStealCount() const { return m_steals.load(std::memory_order_relaxed); }
+
+private:
+    struct Job {
+        const std::function<void(int, int)>* fn;
+        int count;
+        int grain;
+        std::atomic<int> remaining;     // chunks not finished yet
+    };
+
+    // chunk indices [begin, end) of a job
+    struct Range {
+        Job* job;
+        int begin;
+        int end;
+    };
+
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<Range> ranges;
+    };
+
+    void WorkerLoop(unsigned index);
+    unsigned QueueIndex() const;
+    void Push(unsigned queue, const Range& range);
+    bool Pop(unsigned queue, Range& range);
+    bool Steal(unsigned queue, Range& range);
+    bool RunOne(unsigned queue);
+    void Execute(unsigned queue, Range range);
+
+    std::vector<std::thread> m_workers;
+    bool m_pinned = false;
+
+    // one per worker, plus a shared one at the end for threads that aren't ours
+    std::unique_ptr<Queue[]> m_queues;
+    unsigned m_numQueues = 0;
+    std::atomic<int> m_queued{ 0 };     // ranges sitting in any queue
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::atomic<int> m_sleepers{ 0 };
+    bool m_quit = false;
+
+    std::atomic<unsigned long long> m_steals{ 0 };
+};
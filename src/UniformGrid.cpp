@@ -0,0 +1,69 @@
+#include "UniformGrid.h"
+
+#include <algorithm>
+
+static const int PARTICLE_GRAIN = 1024;
+
+static int BitsFor(int n)
+{
+    int bits = 0;
+    while ((1 << bits) < n)
+        bits++;
+    return bits;
+}
+
+void UniformGrid::Configure(float3 origin, float cellSize, int3 dim, CellOrder order)
+{
+    bool sameLayout = m_dim.x == dim.x && m_dim.y == dim.y && m_dim.z == dim.z
+                   && m_order == order && !m_axisX.empty();
+
+    m_origin = origin;
+    m_cellSize = cellSize;
+    m_dim = dim;
+    m_order = order;
+
+    if (sameLayout) return;
+
+    m_axisX.assign(dim.x, 0);
+    m_axisY.assign(dim.y, 0);
+    m_axisZ.assign(dim.z, 0);
+
+    if (order == CellOrder::RowMajor) {
+        for (int x = 0; x < dim.x; x++) m_axisX[x] = x;
+        for (int y = 0; y < dim.y; y++) m_axisY[y] = y * dim.x;
+        for (int z = 0; z < dim.z; z++) m_axisZ[z] = z * dim.x * dim.y;
+        m_numCells = dim.x * dim.y * dim.z;
+    } else {
+        // interleave x,y,z one bit at a time, once an axis runs out of bits the
+        // others keep going. with 22x102x22 that's 5+7+5 bits instead of 3x7,
+        // so the padding stays at 32*128*32 cells.
+        int bits[3] = { BitsFor(dim.x), BitsFor(dim.y), BitsFor(dim.z) };
+        std::vector<int>* tables[3] = { &m_axisX, &m_axisY, &m_axisZ };
+        int maxBits = (std::max)(bits[0], (std::max)(bits[1], bits[2]));
+
+        int outBit = 0;
+        for (int level = 0; level < maxBits; level++)
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (level >= bits[axis]) continue;
+
+            std::vector<int>& table = *tables[axis];
+            for (int v = 0; v < (int)table.size(); v++)
+                table[v] |= ((v >> level) & 1) << outBit;
+            outBit++;
+        }
+        m_numCells = 1 << outBit;
+    }
+}
+
+void UniformGrid::Build(ThreadPool& pool, const Float3Stream& points, int count)
+{
+    m_particleCell.resize(count);
+
+    pool.ParallelFor(count, PARTICLE_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            m_particleCell[i] = CellIndex(points.Get(i));
+    });
+
+    m_sort.Sort(pool, m_particleCell.data(), count, m_numCells);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+
+#include "CellSort.h"
+#include "ParticleStore.h"
+#include "SimMath.h"
+#include "ThreadPool.h"
+
+// cpu version of the three-pass grid build in ParticleSystem::DispatchNeighborSearch
+// (CSCounting -> CSPrefixSum -> CSReorder), dense over the whole bounding box.
+// produces the same cellStart / cellCount arrays plus the sorted order
+// (sorted slot -> original particle index), see CellSort.
+//
+// the cell index is the sum of three per-axis lookup tables, so besides the
+// row-major order of particles.hlsl the grid can be laid out in morton
+// (z-order). then the 27-cell stencil and the sorted particles it points at
+// stay close in memory along every axis, not just x.
+enum class CellOrder {
+    RowMajor,   // x + y*dimX + z*dimX*dimY, same as CellIndex in particles.hlsl
+    Morton,     // interleaved bits, dims padded to powers of two
+};
+
+class UniformGrid {
+public:
+    // cheap when nothing changed, fine to call every frame
+    void Configure(float3 origin, float cellSize, int3 dim, CellOrder order = CellOrder::RowMajor);
+
+    void Build(ThreadPool& pool, const Float3Stream& points, int count);
+
+    // with morton this includes the padding cells, which just stay empty
+    int GetNumCells() const { return m_numCells; }
+    int3 GetDim() const { return m_dim; }
+    CellOrder GetCellOrder() const { return m_order; }
+
+    int FlatIndex(int3 c) const
+    {
+        return m_axisX[c.x] + m_axisY[c.y] + m_axisZ[c.z];
+    }
+
+    int CellIndex(float3 pos) const
+    {
+        return FlatIndex(CellCoord(pos, m_origin, m_cellSize, m_dim));
+    }
+
+    // walks the 27-cell stencil around pos and calls fn(start, count) for every
+    // non-empty range of sorted slots
+    template <typename Fn>
+    void ForEachNeighborCell(float3 pos, Fn&& fn) const
+    {
+        int3 cell = CellCoord(pos, m_origin, m_cellSize, m_dim);
+
+        for (int dx = -1; dx <= 1; dx++)
+        for (int dy = -1; dy <= 1; dy++)
+        for (int dz = -1; dz <= 1; dz++)
+        {
+            int3 nc = { cell.x + dx, cell.y + dy, cell.z + dz };
+            if (nc.x < 0 || nc.y < 0 || nc.z < 0) continue;
+            if (nc.x >= m_dim.x || nc.y >= m_dim.y || nc.z >= m_dim.z) continue;
+
+            int flat = FlatIndex(nc);
+            int count = m_sort.m_cellCount[flat];
+            if (count > 0)
+                fn(m_sort.m_cellStart[flat], count);
+        }
+    }
+
+    // same, for every cell in [lo, hi] (inclusive, clamped to the grid)
+    template <typename Fn>
+    void ForEachCellInBox(int3 lo, int3 hi, Fn&& fn) const
+    {
+        int x0 = lo.x > 0 ? lo.x : 0, x1 = hi.x < m_dim.x - 1 ? hi.x : m_dim.x - 1;
+        int y0 = lo.y > 0 ? lo.y : 0, y1 = hi.y < m_dim.y - 1 ? hi.y : m_dim.y - 1;
+        int z0 = lo.z > 0 ? lo.z : 0, z1 = hi.z < m_dim.z - 1 ? hi.z : m_dim.z - 1;
+
+        for (int z = z0; z <= z1; z++)
+        for (int y = y0; y <= y1; y++)
+        for (int x = x0; x <= x1; x++)
+        {
+            int flat = FlatIndex({ x, y, z });
+            int count = m_sort.m_cellCount[flat];
+            if (count > 0)
+                fn(m_sort.m_cellStart[flat], count);
+        }
+    }
+
+    const std::vector<int>& GetSortedOrder() const { return m_sort.m_sortedOrder; }
+
+private:
+    float3 m_origin = { 0, 0, 0 };
+    float m_cellSize = 1.0f;
+    int3 m_dim = { 0, 0, 0 };
+    int m_numCells = 0;
+    CellOrder m_order = CellOrder::RowMajor;
+
+    // per-axis contribution to the flat cell index
+    std::vector<int> m_axisX;
+    std::vector<int> m_axisY;
+    std::vector<int> m_axisZ;
+
+    std::vector<int> m_particleCell;
+    CellSort m_sort;
+};
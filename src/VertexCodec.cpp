@@ -0,0 +1,85 @@
+#include "VertexCodec.h"
+
+#include <cmath>
+
+static uint16_t ToUnorm16(float v)
+{
+    return (uint16_t)std::floor(clampf(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+static int16_t ToSnorm16(float v)
+{
+    return (int16_t)std::floor(clampf(v, -1.0f, 1.0f) * 32767.0f + 0.5f);
+}
+
+// snorm -> float the way the input assembler does it, -32768 and -32767 are both -1
+static float FromSnorm16(int16_t v)
+{
+    return v <= -32767 ? -1.0f : v / 32767.0f;
+}
+
+static float SignNotZero(float v)
+{
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+// project onto the octahedron |x| + |y| + |z| = 1, then fold the lower half
+// over the upper one so the whole sphere fits in [-1, 1]^2
+void OctEncode(float3 n, int16_t out[2])
+{
+    float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 <= 0.0f) {
+        out[0] = out[1] = 0;
+        return;
+    }
+
+    float ex = n.x / l1;
+    float ey = n.y / l1;
+    if (n.z < 0.0f) {
+        float fx = (1.0f - std::fabs(ey)) * SignNotZero(ex);
+        float fy = (1.0f - std::fabs(ex)) * SignNotZero(ey);
+        ex = fx;
+        ey = fy;
+    }
+    out[0] = ToSnorm16(ex);
+    out[1] = ToSnorm16(ey);
+}
+
+float3 OctDecode(const int16_t in[2])
+{
+    float ex = FromSnorm16(in[0]);
+    float ey = FromSnorm16(in[1]);
+    float3 n = { ex, ey, 1.0f - std::fabs(ex) - std::fabs(ey) };
+
+    // unfold the lower half
+    if (n.z < 0.0f) {
+        n.x = (1.0f - std::fabs(ey)) * SignNotZero(ex);
+        n.y = (1.0f - std::fabs(ex)) * SignNotZero(ey);
+    }
+    return n / length(n);
+}
+
+VertexQuantizer::VertexQuantizer(float3 origin, float cellSize, int3 dim)
+    : m_origin(origin)
+    , m_extent{ dim.x * cellSize, dim.y * cellSize, dim.z * cellSize }
+{
+}
+
+PackedVertex VertexQuantizer::Encode(float3 position, float3 normal) const
+{
+    PackedVertex v;
+    v.position[0] = ToUnorm16((position.x - m_origin.x) / m_extent.x);
+    v.position[1] = ToUnorm16((position.y - m_origin.y) / m_extent.y);
+    v.position[2] = ToUnorm16((position.z - m_origin.z) / m_extent.z);
+    v.w = 0xffff;
+    OctEncode(normal, v.normal);
+    return v;
+}
+
+void VertexQuantizer::Decode(const PackedVertex& v, float3& position, float3& normal) const
+{
+    position.x = m_origin.x + v.position[0] / 65535.0f * m_extent.x;
+    position.y = m_origin.y + v.position[1] / 65535.0f * m_extent.y;
+    position.z = m_origin.z + v.position[2] / 65535.0f * m_extent.z;
+    normal = OctDecode(v.normal);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+#include "SimMath.h"
+
+// compact surface vertex (mc_compact_vertices). Vertex in stdafx.h is 32
+// bytes, 8 of them the constant 1s in position.w and normal.w. this one is 12:
+// the position as 16 bit unorms over the marching cubes grid box and the
+// normal octahedral encoded into two 16 bit snorms.
+//
+// the layout is what the input assembler reads directly: R16G16B16A16_UNORM
+// at offset 0 (the pad is 0xffff, so w comes out as 1) and R16G16_SNORM at
+// offset 8. PackVertex in shaders/marchingCubes.hlsl writes the same bits.
+struct PackedVertex {
+    uint16_t position[3];
+    uint16_t w;
+    int16_t normal[2];
+};
+static_assert(sizeof(PackedVertex) == 12, "PackedVertex has to match the hlsl uint3");
+
+// normals. a zero normal (flat spot in the field) comes back as +z
+void OctEncode(float3 n, int16_t out[2]);
+float3 OctDecode(const int16_t in[2]);
+
+// positions, relative to one grid. anything outside its box is clamped to it,
+// inside the error is at most half of GetStep() per axis
+class VertexQuantizer {
+public:
+    VertexQuantizer() = default;
+    VertexQuantizer(float3 origin, float cellSize, int3 dim);
+
+    PackedVertex Encode(float3 position, float3 normal) const;
+    void Decode(const PackedVertex& v, float3& position, float3& normal) const;
+
+    float3 GetOrigin() const { return m_origin; }
+    float3 GetExtent() const { return m_extent; }
+    float3 GetStep() const { return m_extent / 65535.0f; }
+
+private:
+    float3 m_origin = { 0.0f, 0.0f, 0.0f };
+    float3 m_extent = { 1.0f, 1.0f, 1.0f };
+};
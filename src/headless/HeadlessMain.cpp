@@ -0,0 +1,1008 @@
+// headless batch runner.
+// steps the pbf scene on the cpu solver at a fixed dt for N frames and reports
+// throughput. no windows/d3d12 headers, so this builds on the linux sim nodes.
+//
+// usage: PhthaloHeadless [--frames N] [--dt SECONDS] [--threads T] [--warmup N] [--cell-order rowmajor|morton] [--grid dense|hashed]
+//                        [--neighbor-list] [--skin S] [--grain N] [--pin] [--config FILE] [--set KEY=VALUE]...
+//        PhthaloHeadless --bench scan [--count N] [--threads T] [--frames N]
+//        PhthaloHeadless --bench morton [--frames N] [--warmup N]
+//        PhthaloHeadless --bench mesh [--frames N] [--warmup N] [scene options]
+//        PhthaloHeadless --bench sdf [--frames N] [--warmup N] [scene options]
+//        PhthaloHeadless --bench remesh [--frames N] [--warmup N] [scene options]
+//        PhthaloHeadless --bench lod [--camera X,Y,Z] [--frames N] [--warmup N] [scene options]
+//        PhthaloHeadless --pipeline K [--stage-threads T] [scene options]
+//        PhthaloHeadless --play FILE [--scrub N] [--frames N] [--threads T] [scene options]
+//
+// --bench runs a micro benchmark instead of the scene, --frames is the
+// number of timed repetitions there (remesh: simulated frames). --camera is
+// where lod measures from, the renderer's starting camera if not given.
+//
+// --pipeline runs the scene through FramePipeline with K frames in flight:
+// the solver steps frame N+1 while a stage thread builds the marching cubes
+// scalar field and welded mesh of frame N. --pipeline 1 is the serial loop, for comparison.
+// the stage shares the solver's workers unless --stage-threads gives it its own.
+// with mesh_export_dir set every presented mesh also goes through MeshExporter.
+//
+// cache_record writes the timed frames into a ParticleCache, with --pipeline too.
+// --play meshes --frames frames of one through CachePlayer instead, no
+// solver, looping at the end. --scrub N jumps to a random frame every N
+// frames. cache_play in the config does the same as --play. the grid comes
+// from the scene options, they should be the ones it was recorded with.
+//
+// --grain is the particles per chunk of the solver passes, --pin locks every
+// worker thread to its own core.
+//
+// the scene comes from SimulationConfig: the defaults, then --config, then
+// every --set in order, e.g. a scaling sweep without recompiling:
+//     PhthaloHeadless --set num_x=200 --set num_z=100 --set bbox_size_xz=40
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CachePlayer.h"
+#include "CPUSolver.h"
+#include "DistanceField.h"
+#include "FramePipeline.h"
+#include "LodSurface.h"
+#include "MarchingCubes.h"
+#include "MeshExporter.h"
+#include "ParticleCache.h"
+#include "PerfCounters.h"
+#include "PrefixScan.h"
+#include "ScalarField.h"
+#include "SimulationConfig.h"
+#include "VertexCodec.h"
+
+struct RunnerArgs {
+    int frames = 600;
+    int warmup = 10;
+    float dt = 0.0f;        // 0 = fixed_dt from the config
+    unsigned threads = 0;   // 0 = all cores
+    int grain = 0;          // 0 = the solver's default
+    bool pin = false;
+    CellOrder cellOrder = CellOrder::RowMajor;
+    GridType gridType = GridType::Dense;
+    bool neighborList = false;
+    float skin = 0.0f;          // only with --neighbor-list
+    const char* bench = nullptr;
+    long long count = 1 << 24;  // elements for --bench scan
+    float3 camera = { -30.0f, 10.0f, 0.0f };    // --bench lod, where D3D12Renderer's camera starts
+    int pipeline = 0;           // frames in flight, 0 = plain loop
+    unsigned stageThreads = 0;  // threads of the --pipeline stage, 0 = share the solver's
+    const char* play = nullptr; // particle cache to play back
+    int scrub = 0;              // --play jumps every this many frames, 0 = never
+    SimulationConfig config;
+};
+
+static void PrintUsage()
+{
+    printf("usage: PhthaloHeadless [--frames N] [--dt SECONDS] [--threads T] [--warmup N] [--cell-order rowmajor|morton] [--grid dense|hashed]\n");
+    printf("                       [--neighbor-list] [--skin S] [--grain N] [--pin] [--config FILE] [--set KEY=VALUE]...\n");
+    printf("       PhthaloHeadless --bench scan [--count N] [--threads T] [--frames N]\n");
+    printf("       PhthaloHeadless --bench morton [--frames N] [--warmup N]\n");
+    printf("       PhthaloHeadless --bench mesh [--frames N] [--warmup N] [scene options]\n");
+    printf("       PhthaloHeadless --bench sdf [--frames N] [--warmup N] [scene options]\n");
+    printf("       PhthaloHeadless --bench remesh [--frames N] [--warmup N] [scene options]\n");
+    printf("       PhthaloHeadless --bench lod [--camera X,Y,Z] [--frames N] [--warmup N] [scene options]\n");
+    printf("       PhthaloHeadless --pipeline K [--stage-threads T] [scene options]\n");
+    printf("       PhthaloHeadless --play FILE [--scrub N] [--frames N] [--threads T] [scene options]\n");
+}
+
+static bool ParseArgs(int argc, char** argv, RunnerArgs& args)
+{
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--frames") == 0 && hasValue) args.frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && hasValue) args.warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--dt") == 0 && hasValue) args.dt = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue) args.threads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--grain") == 0 && hasValue) args.grain = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pin") == 0) args.pin = true;
+        else if (strcmp(argv[i], "--cell-order") == 0 && hasValue) {
+            const char* order = argv[++i];
+            if (strcmp(order, "rowmajor") == 0) args.cellOrder = CellOrder::RowMajor;
+            else if (strcmp(order, "morton") == 0) args.cellOrder = CellOrder::Morton;
+            else return false;
+        }
+        else if (strcmp(argv[i], "--grid") == 0 && hasValue) {
+            const char* grid = argv[++i];
+            if (strcmp(grid, "dense") == 0) args.gridType = GridType::Dense;
+            else if (strcmp(grid, "hashed") == 0) args.gridType = GridType::Hashed;
+            else return false;
+        }
+        else if (strcmp(argv[i], "--neighbor-list") == 0) args.neighborList = true;
+        else if (strcmp(argv[i], "--skin") == 0 && hasValue) args.skin = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--config") == 0 && hasValue) args.config = SimulationConfig::LoadFromFile(argv[++i]);
+        else if (strcmp(argv[i], "--set") == 0 && hasValue) {
+            const char* eq = strchr(argv[++i], '=');
+            if (!eq) return false;
+            args.config.Set(std::string(argv[i], eq - argv[i]), eq + 1);
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && hasValue) args.bench = argv[++i];
+        else if (strcmp(argv[i], "--count") == 0 && hasValue) args.count = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--camera") == 0 && hasValue) {
+            float3& c = args.camera;
+            if (sscanf(argv[++i], "%f,%f,%f", &c.x, &c.y, &c.z) != 3) return false;
+        }
+        else if (strcmp(argv[i], "--pipeline") == 0 && hasValue) {
+            args.pipeline = atoi(argv[++i]);
+            if (args.pipeline < 1) return false;
+        }
+        else if (strcmp(argv[i], "--stage-threads") == 0 && hasValue) args.stageThreads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--play") == 0 && hasValue) args.play = argv[++i];
+        else if (strcmp(argv[i], "--scrub") == 0 && hasValue) args.scrub = atoi(argv[++i]);
+        else return false;
+    }
+    args.config.Validate();
+    if (args.dt == 0.0f) args.dt = args.config.fixedDt;
+    if (!args.play && !args.config.cachePlay.empty()) args.play = args.config.cachePlay.c_str();
+    return args.frames > 0 && args.warmup >= 0 && args.dt > 0.0f && args.count > 0 && args.grain >= 0 && args.scrub >= 0;
+}
+
+static void LoadScene(const SimulationConfig& config, CPUSolver& solver, ParticleStore& particles)
+{
+    solver.SetConstants(config.GetSolverConstants());
+    solver.DispatchInit(0.0f);
+
+    // same block of particles as ParticleSystem::LoadParticles
+    config.SpawnParticles(particles, &solver.GetPool());
+}
+
+static void Step(CPUSolver& solver, ParticleStore& particles, float dt)
+{
+    solver.DispatchCPUCommands(particles, dt);
+    solver.UpdatePBD(particles, dt);
+}
+
+// times fn over args.frames repetitions (after one untimed run), returns the best ms
+template <typename Fn>
+static double TimeBest(const RunnerArgs& args, Fn&& fn)
+{
+    using Clock = std::chrono::steady_clock;
+    fn();
+
+    double best = 1e30;
+    for (int r = 0; r < args.frames; r++) {
+        Clock::time_point start = Clock::now();
+        fn();
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (ms < best) best = ms;
+    }
+    return best;
+}
+
+template <typename T>
+static bool BenchScanType(const RunnerArgs& args, ThreadPool& pool, const char* typeName)
+{
+    size_t count = (size_t)args.count;
+    std::vector<T> in(count);
+    std::vector<T> expected(count);
+    std::vector<T> out(count);
+
+    // small values like the per-cell particle counts
+    unsigned seed = 12345;
+    for (size_t i = 0; i < count; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        in[i] = (T)((seed >> 24) & 7);
+    }
+
+    PrefixScan<T> scan;
+    bool ok = true;
+    // bytes moved by an ideal scan: read once, write once
+    double gigabytes = 2.0 * count * sizeof(T) / 1e9;
+
+    for (ScanMode mode : { ScanMode::Exclusive, ScanMode::Inclusive }) {
+        const char* modeName = mode == ScanMode::Exclusive ? "exclusive" : "inclusive";
+
+        T total = PrefixScan<T>::ScanSerial(in.data(), expected.data(), count, mode);
+
+        double serialMs = TimeBest(args, [&] { PrefixScan<T>::ScanSerial(in.data(), out.data(), count, mode); });
+        double twoPassMs = TimeBest(args, [&] { scan.ScanTwoPass(pool, in.data(), out.data(), count, mode); });
+        bool twoPassOk = out == expected;
+
+        T lookBackTotal = 0;
+        double lookBackMs = TimeBest(args, [&] { lookBackTotal = scan.Scan(pool, in.data(), out.data(), count, mode); });
+        bool lookBackOk = out == expected && lookBackTotal == total;
+
+        printf("%-8s %-9s serial %8.3f ms  two-pass %8.3f ms (%5.2f GB/s)%s  look-back %8.3f ms (%5.2f GB/s)%s\n",
+            typeName, modeName, serialMs,
+            twoPassMs, gigabytes / (twoPassMs / 1000.0), twoPassOk ? "" : " MISMATCH",
+            lookBackMs, gigabytes / (lookBackMs / 1000.0), lookBackOk ? "" : " MISMATCH");
+
+        ok = ok && twoPassOk && lookBackOk;
+    }
+    return ok;
+}
+
+static int RunScanBench(const RunnerArgs& args)
+{
+    ThreadPool pool(args.threads, args.pin);
+    printf("scan: %lld elements  threads: %u  repetitions: %d (best of)\n",
+        args.count, pool.GetThreadCount(), args.frames);
+
+    bool ok = BenchScanType<uint32_t>(args, pool, "uint32");
+    ok = BenchScanType<uint64_t>(args, pool, "uint64") && ok;
+    return ok ? 0 : 1;
+}
+
+// the scene after --warmup frames, then the scalar field and the welded mesh,
+// once over the whole grid, once block-sparse (mc_sparse) and once gathered
+// (mc_gather). the sizes
+// compare against what CSMarchingCubes used to write: three unshared 32 byte
+// Vertex per triangle
+static int RunMeshBench(const RunnerArgs& args)
+{
+    const SimulationConfig& config = args.config;
+    CPUSolver solver(args.threads, args.pin);
+    ParticleStore particles;
+    LoadScene(config, solver, particles);
+    for (int f = 0; f < args.warmup; f++)
+        Step(solver, particles, args.dt);
+
+    ThreadPool& pool = solver.GetPool();
+    ScalarField field;
+    field.Configure(config.GetMCOrigin(), config.GetMCCellSize(), { config.mcDimX, config.mcDimY, config.mcDimZ }, config.cellSize);
+    MarchingCubes mesh;
+
+    printf("mesh bench: %d particles  grid %dx%dx%d  threads: %u  repetitions: %d (best of)\n",
+        config.GetNumParticles(), config.mcDimX, config.mcDimY, config.mcDimZ, pool.GetThreadCount(), args.frames);
+
+    for (bool sparse : { false, true }) {
+        field.SetSparse(sparse);
+        double fieldMs = TimeBest(args, [&] { field.Build(pool, particles.position, particles.Size()); });
+        double meshMs = TimeBest(args, [&] { mesh.Extract(pool, field, config.mcIso); });
+
+        printf("%-6s  field %8.3f ms  extract %8.3f ms  triangles %d", sparse ? "sparse" : "dense",
+            fieldMs, meshMs, mesh.GetNumTriangles());
+        if (sparse)
+            printf("  blocks %zu/%d", field.GetActiveBlocks().size(), field.GetNumBlocks());
+        printf("\n");
+    }
+
+    // mc_gather: same footprint, per block in float. the difference to the
+    // sparse scatter above is the 1/100 truncation of every splat
+    {
+        ScalarField gathered;
+        gathered.Configure(field.GetOrigin(), field.GetCellSize(), field.GetDim(), config.cellSize);
+        gathered.SetSparse(true);
+        gathered.SetGather(true);
+        MarchingCubes gatheredMesh;
+        double fieldMs = TimeBest(args, [&] { gathered.Build(pool, particles.position, particles.Size()); });
+        double meshMs = TimeBest(args, [&] { gatheredMesh.Extract(pool, gathered, config.mcIso); });
+        printf("gather  field %8.3f ms  extract %8.3f ms  triangles %d  blocks %zu/%d\n",
+            fieldMs, meshMs, gatheredMesh.GetNumTriangles(), gathered.GetActiveBlocks().size(), gathered.GetNumBlocks());
+
+        double maxDiff = 0.0, sumDiff = 0.0;
+        int crossings = 0;
+        for (int i = 0, n = field.GetNumVertices(); i < n; i++) {
+            double d = std::fabs((double)gathered.GetValue(i) - field.GetValue(i));
+            maxDiff = std::max(maxDiff, d);
+            sumDiff += d;
+            crossings += (gathered.GetValue(i) < config.mcIso) != (field.GetValue(i) < config.mcIso);
+        }
+        printf("gather vs scatter: max diff %.4f  mean %.6f  vertices on the other side of mc_iso %d  blocks %s\n",
+            maxDiff, sumDiff / field.GetNumVertices(), crossings,
+            gathered.GetActiveBlocks() == field.GetActiveBlocks() ? "same" : "differ");
+    }
+
+    const double vertexBytes = 32.0;    // Vertex in stdafx.h
+    const double mb = 1.0 / (1024.0 * 1024.0);
+    double unwelded = mesh.GetNumTriangles() * 3 * vertexBytes;
+    double welded = mesh.GetNumVertices() * vertexBytes + mesh.GetIndices().size() * sizeof(uint32_t);
+    double unweldedCapacity = (double)config.GetMCMaxTris() * 3 * vertexBytes;
+    double weldedCapacity = config.GetMCMaxVertices() * vertexBytes + (double)config.GetMCMaxTris() * 3 * sizeof(uint32_t);
+
+    printf("vertices %d (%.2f per triangle)\n", mesh.GetNumVertices(),
+        mesh.GetNumTriangles() > 0 ? (double)mesh.GetNumVertices() / mesh.GetNumTriangles() : 0.0);
+    printf("mesh:    unwelded %8.2f MB  welded %8.2f MB (%.0f%%)\n", unwelded * mb, welded * mb,
+        unwelded > 0.0 ? 100.0 * welded / unwelded : 0.0);
+    printf("buffers: unwelded %8.2f MB  welded %8.2f MB (%.0f%%)\n", unweldedCapacity * mb, weldedCapacity * mb,
+        100.0 * weldedCapacity / unweldedCapacity);
+
+    // what the gpu starts with now that the mesh is counted before it's written,
+    // instead of the worst case above. it grows from there when a frame needs more
+    int reserveTris = std::min(config.mcReserveTris, config.GetMCMaxTris());
+    int reserveVertices = std::min(config.mcReserveTris, config.GetMCMaxVertices());
+    double reserve = reserveVertices * vertexBytes + (double)reserveTris * 3 * sizeof(uint32_t);
+    printf("reserve: mc_reserve_tris %d  %8.2f MB (%.1f%% of welded), this frame %s\n", config.mcReserveTris,
+        reserve * mb, 100.0 * reserve / weldedCapacity,
+        mesh.GetNumTriangles() <= reserveTris && mesh.GetNumVertices() <= reserveVertices ? "fits" : "grows them");
+
+    // mc_compact_vertices: encode the welded mesh, decode it again and see what got lost
+    VertexQuantizer quantizer(field.GetOrigin(), field.GetCellSize(), field.GetDim());
+    const std::vector<MCVertex>& vertices = mesh.GetVertices();
+    std::vector<PackedVertex> packed(vertices.size());
+    double encodeMs = TimeBest(args, [&] {
+        pool.ParallelFor((int)vertices.size(), 4096, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                packed[i] = quantizer.Encode(vertices[i].position, vertices[i].normal);
+        });
+    });
+
+    float3 step = quantizer.GetStep();
+    double maxPosition = 0.0, maxStep = 0.0, maxNormalDeg = 0.0;
+    for (size_t i = 0; i < vertices.size(); i++) {
+        float3 p, n;
+        quantizer.Decode(packed[i], p, n);
+        float3 d = p - vertices[i].position;
+        maxPosition = std::max(maxPosition, (double)std::max({ std::fabs(d.x), std::fabs(d.y), std::fabs(d.z) }));
+        maxStep = std::max(maxStep, (double)std::max({ std::fabs(d.x) / step.x, std::fabs(d.y) / step.y, std::fabs(d.z) / step.z }));
+
+        // zero normals come back as +z on purpose
+        float len = length(vertices[i].normal);
+        if (len > 0.0f) {
+            double c = std::min(1.0, std::max(-1.0, (double)dot(vertices[i].normal / len, n)));
+            maxNormalDeg = std::max(maxNormalDeg, std::acos(c) * 180.0 / 3.14159265358979);
+        }
+    }
+
+    const double packedBytes = sizeof(PackedVertex);
+    double compact = mesh.GetNumVertices() * packedBytes + mesh.GetIndices().size() * sizeof(uint32_t);
+    double compactCapacity = config.GetMCMaxVertices() * packedBytes + (double)config.GetMCMaxTris() * 3 * sizeof(uint32_t);
+    printf("compact: %d B/vertex  encode %.3f ms  mesh %8.2f MB  buffers %8.2f MB (%.0f%% of welded)\n",
+        (int)packedBytes, encodeMs, compact * mb, compactCapacity * mb, 100.0 * compactCapacity / weldedCapacity);
+    printf("compact: max position error %.3g (%.3f steps of %.3g)  max normal error %.4f deg\n",
+        maxPosition, maxStep, (double)std::max({ step.x, step.y, step.z }), maxNormalDeg);
+    return 0;
+}
+
+// the scene after --warmup frames, then the narrow band distance field
+// (sdf_band, 3 cells if it's off in the config) checked against brute force
+// on a sample of the band cells on both sides. outside that's the exact
+// union of spheres. inside it's the same construction the flood makes, the
+// nearest outside cell center q by |center - q| - outside(q), with exact
+// outside distances and every q in reach instead of the flooded seed
+static int RunSDFBench(const RunnerArgs& args)
+{
+    const SimulationConfig& config = args.config;
+    CPUSolver solver(args.threads, args.pin);
+    ParticleStore particles;
+    LoadScene(config, solver, particles);
+    for (int f = 0; f < args.warmup; f++)
+        Step(solver, particles, args.dt);
+
+    ThreadPool& pool = solver.GetPool();
+    int band = config.sdfBand > 0 ? config.sdfBand : 3;
+    DistanceField sdf;
+    sdf.Configure(config.GetNSOrigin(), config.cellSize, config.GetNSDim(), band, config.sdfRadius);
+
+    int3 dim = sdf.GetDim();
+    printf("sdf bench: %d particles  grid %dx%dx%d  band %d cells  radius %g  threads: %u  repetitions: %d (best of)\n",
+        config.GetNumParticles(), dim.x, dim.y, dim.z, band, config.sdfRadius, pool.GetThreadCount(), args.frames);
+
+    double buildMs = TimeBest(args, [&] { sdf.Build(pool, particles.position, particles.Size()); });
+
+    int inside = 0;
+    for (float d : sdf.GetValues())
+        inside += d < 0.0f;
+    printf("build %8.3f ms  band cells %d of %d (%.1f%%)  inside %d\n", buildMs, sdf.GetNumBandCells(),
+        sdf.GetNumCells(), 100.0 * sdf.GetNumBandCells() / sdf.GetNumCells(), inside);
+
+    // exact outside distance per cell, computed when first needed
+    auto cellCenter = [&](int i) {
+        return config.GetNSOrigin() + float3{ i % dim.x + 0.5f, (i / dim.x) % dim.y + 0.5f, i / (dim.x * dim.y) + 0.5f } * config.cellSize;
+    };
+    std::vector<float> exactOutside(sdf.GetNumCells(), NAN);
+    auto outsideAt = [&](int i) {
+        if (std::isnan(exactOutside[i])) {
+            float3 center = cellCenter(i);
+            float nearest = 1e30f;
+            for (int p = 0; p < (int)particles.Size(); p++)
+                nearest = std::min(nearest, length(center - particles.position.Get(p)));
+            exactOutside[i] = nearest - config.sdfRadius;
+        }
+        return exactOutside[i];
+    };
+
+    // the flood only ever reaches band cells, the nearest outside cell of an
+    // inside one in the band is closer than that plus a cell or two
+    const float bandWidth = sdf.GetBandWidth();
+    const int reach = band + 2;
+    auto insideAt = [&](int i) {
+        int3 c = { i % dim.x, (i / dim.x) % dim.y, i / (dim.x * dim.y) };
+        float3 center = cellCenter(i);
+        float inside = bandWidth;
+        for (int z = std::max(c.z - reach, 0); z <= std::min(c.z + reach, dim.z - 1); z++)
+            for (int y = std::max(c.y - reach, 0); y <= std::min(c.y + reach, dim.y - 1); y++)
+                for (int x = std::max(c.x - reach, 0); x <= std::min(c.x + reach, dim.x - 1); x++) {
+                    int q = sdf.CellIndex(x, y, z);
+                    float w = outsideAt(q);
+                    if (w > 0.0f)
+                        inside = std::min(inside, std::max(length(center - cellCenter(q)) - w, 0.0f));
+                }
+        return std::max(std::min(outsideAt(i), -inside), -bandWidth);
+    };
+
+    // brute force on every k-th band cell of each side, jump flooding can
+    // pick a seed that isn't quite the nearest
+    for (bool outside : { true, false }) {
+        std::vector<int> sample;
+        for (int i = 0; i < sdf.GetNumCells(); i++) {
+            float d = sdf.GetValue(i);
+            if (outside ? d > 0.0f && d < bandWidth : d <= 0.0f && d > -bandWidth)
+                sample.push_back(i);
+        }
+        // the inside reference is a box of cells per sample, fewer of those
+        int stride = std::max(1, (int)sample.size() / (outside ? 2000 : 500));
+
+        double maxError = 0.0, sumError = 0.0;
+        int checked = 0, exact = 0;
+        for (size_t k = 0; k < sample.size(); k += stride) {
+            int i = sample[k];
+            double error = std::fabs((double)sdf.GetValue(i) - (outside ? outsideAt(i) : insideAt(i)));
+            maxError = std::max(maxError, error);
+            sumError += error;
+            exact += error < 1e-5;
+            checked++;
+        }
+        printf("%s band vs exact: %d cells checked  exact %d  max error %.4f  mean %.6f\n", outside ? "outside" : "inside ",
+            checked, exact, maxError, checked > 0 ? sumError / checked : 0.0);
+    }
+    return 0;
+}
+
+// MarchingCubes or LodSurface
+template <typename MeshA, typename MeshB>
+static bool SameMesh(const MeshA& a, const MeshB& b)
+{
+    if (a.GetIndices() != b.GetIndices() || a.GetNumVertices() != b.GetNumVertices()) return false;
+    for (int i = 0; i < a.GetNumVertices(); i++) {
+        const MCVertex& va = a.GetVertices()[i];
+        const MCVertex& vb = b.GetVertices()[i];
+        if (va.position.x != vb.position.x || va.position.y != vb.position.y || va.position.z != vb.position.z ||
+            va.normal.x != vb.normal.x || va.normal.y != vb.normal.y || va.normal.z != vb.normal.z)
+            return false;
+    }
+    return true;
+}
+
+// the scene after --warmup frames, then --frames more of it meshed three
+// ways every frame: whole (ExtractSparse), incremental at
+// mc_incremental_tolerance, and incremental at 0, which has to come out the
+// same as the whole one. a long warmup gives the settling shot this is for
+static int RunRemeshBench(const RunnerArgs& args)
+{
+    using Clock = std::chrono::steady_clock;
+    const SimulationConfig& config = args.config;
+    CPUSolver solver(args.threads, args.pin);
+    ParticleStore particles;
+    LoadScene(config, solver, particles);
+    for (int f = 0; f < args.warmup; f++)
+        Step(solver, particles, args.dt);
+
+    ThreadPool& pool = solver.GetPool();
+    ScalarField field;
+    field.Configure(config.GetMCOrigin(), config.GetMCCellSize(), { config.mcDimX, config.mcDimY, config.mcDimZ }, config.cellSize);
+    field.SetSparse(true);
+    field.SetGather(config.mcGather);
+
+    MarchingCubes whole, incremental, exact;
+    incremental.SetIncremental(true, config.mcIncrementalTolerance);
+    exact.SetIncremental(true, 0.0f);
+
+    printf("remesh bench: %d particles  grid %dx%dx%d  tolerance %g  threads: %u  frames: %d (+%d warmup)\n",
+        config.GetNumParticles(), config.mcDimX, config.mcDimY, config.mcDimZ, config.mcIncrementalTolerance,
+        pool.GetThreadCount(), args.frames, args.warmup);
+
+    auto time = [](auto&& fn) {
+        Clock::time_point start = Clock::now();
+        fn();
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    // the first frame builds everything, it's left out of the means
+    double wholeMs = 0.0, incrementalMs = 0.0;
+    long long active = 0, dirty = 0, rebuilt = 0;
+    int mismatches = 0;
+    for (int f = 0; f <= args.frames; f++) {
+        if (f > 0) Step(solver, particles, args.dt);
+        field.Build(pool, particles.position, particles.Size());
+
+        double w = time([&] { whole.Extract(pool, field, config.mcIso); });
+        double i = time([&] { incremental.Extract(pool, field, config.mcIso); });
+        exact.Extract(pool, field, config.mcIso);
+        mismatches += !SameMesh(whole, exact);
+        if (f == 0) continue;
+
+        wholeMs += w;
+        incrementalMs += i;
+        active += (long long)field.GetActiveBlocks().size();
+        dirty += incremental.GetDirtyBlocks();
+        rebuilt += incremental.GetRebuiltBlocks();
+    }
+
+    double n = args.frames;
+    printf("whole        %8.3f ms/frame  triangles %d\n", wholeMs / n, whole.GetNumTriangles());
+    printf("incremental  %8.3f ms/frame  triangles %d  blocks/frame: active %.1f  dirty %.1f  polygonized %.1f\n",
+        incrementalMs / n, incremental.GetNumTriangles(), active / n, dirty / n, rebuilt / n);
+    printf("tolerance 0 vs whole: %s (%d of %d frames differ)\n", mismatches == 0 ? "same" : "DIFFERENT",
+        mismatches, args.frames + 1);
+    return mismatches == 0 ? 0 : 1;
+}
+
+// edges of a mesh that only one triangle uses, after welding vertices closer
+// than tolerance. a closed surface has none
+static int FindOpenEdges(const std::vector<MCVertex>& vertices, const std::vector<uint32_t>& indices, float tolerance)
+{
+    // weld on a grid of tolerance sized cells, looking in the 27 around
+    auto key = [](int x, int y, int z) {
+        return ((long long)(x & 0x1fffff) << 42) | ((long long)(y & 0x1fffff) << 21) | (long long)(z & 0x1fffff);
+    };
+    std::unordered_map<long long, std::vector<int>> cells;
+    std::vector<int> weld(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        float3 p = vertices[i].position;
+        int cx = (int)std::floor(p.x / tolerance), cy = (int)std::floor(p.y / tolerance), cz = (int)std::floor(p.z / tolerance);
+        weld[i] = (int)i;
+        for (int dz = -1; dz <= 1 && weld[i] == (int)i; dz++)
+        for (int dy = -1; dy <= 1 && weld[i] == (int)i; dy++)
+        for (int dx = -1; dx <= 1 && weld[i] == (int)i; dx++) {
+            auto it = cells.find(key(cx + dx, cy + dy, cz + dz));
+            if (it == cells.end()) continue;
+            for (int j : it->second)
+                if (length(vertices[j].position - p) <= tolerance) { weld[i] = j; break; }
+        }
+        if (weld[i] == (int)i) cells[key(cx, cy, cz)].push_back((int)i);
+    }
+
+    // a triangle that welds down to a line has no area, it doesn't close
+    // anything. a lattice point right at the iso value makes those, every
+    // edge from it cuts at the point
+    std::unordered_map<long long, int> uses;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        int w[3] = { weld[indices[t]], weld[indices[t + 1]], weld[indices[t + 2]] };
+        if (w[0] == w[1] || w[1] == w[2] || w[2] == w[0]) continue;
+        for (int k = 0; k < 3; k++) {
+            int a = w[k], b = w[(k + 1) % 3];
+            uses[((long long)std::min(a, b) << 32) | std::max(a, b)]++;
+        }
+    }
+
+    int open = 0;
+    for (const auto& e : uses)
+        open += e.second == 1;
+    return open;
+}
+
+// the scene after --warmup frames, then the welded marching cubes mesh
+// (ExtractSparse) against LodSurface from --camera: once at level 0, which
+// has to be the same mesh, once at mc_lod_levels (3 if it's off in the
+// config). the lod mesh can't have open edges (see FindOpenEdges) or more
+// triangles than the cubes
+static int RunLodBench(const RunnerArgs& args)
+{
+    const SimulationConfig& config = args.config;
+    CPUSolver solver(args.threads, args.pin);
+    ParticleStore particles;
+    LoadScene(config, solver, particles);
+    for (int f = 0; f < args.warmup; f++)
+        Step(solver, particles, args.dt);
+
+    ThreadPool& pool = solver.GetPool();
+    ScalarField field;
+    field.Configure(config.GetMCOrigin(), config.GetMCCellSize(), { config.mcDimX, config.mcDimY, config.mcDimZ }, config.cellSize);
+    field.SetSparse(config.mcSparse);
+    field.SetGather(config.mcGather);
+    field.Build(pool, particles.position, particles.Size());
+
+    int levels = config.mcLodLevels > 0 ? config.mcLodLevels : LodSurface::MAX_LEVELS;
+    const float3 camera = args.camera;
+    printf("lod bench: %d particles  grid %dx%dx%d  camera %g,%g,%g  distance %g  levels %d  threads: %u  repetitions: %d (best of)\n",
+        config.GetNumParticles(), config.mcDimX, config.mcDimY, config.mcDimZ, camera.x, camera.y, camera.z,
+        config.mcLodDistance, levels, pool.GetThreadCount(), args.frames);
+
+    MarchingCubes mesh;
+    double meshMs = TimeBest(args, [&] { mesh.Extract(pool, field, config.mcIso); });
+    printf("cubes      %8.3f ms  triangles %7d  vertices %7d\n", meshMs, mesh.GetNumTriangles(), mesh.GetNumVertices());
+
+    const float tolerance = field.GetCellSize() * 1e-3f;
+    int failures = 0;
+    for (int l : { 0, levels }) {
+        LodSurface lod;
+        double lodMs = TimeBest(args, [&] { lod.Extract(pool, field, config.mcIso, camera, config.mcLodDistance, l); });
+        int open = FindOpenEdges(lod.GetVertices(), lod.GetIndices(), tolerance);
+        failures += open;
+
+        printf("lod %d      %8.3f ms  triangles %7d  vertices %7d  blocks per level", l, lodMs,
+            lod.GetNumTriangles(), lod.GetNumVertices());
+        for (int k = 0; k <= l; k++)
+            printf(" %d", lod.GetBlocksAtLevel(k));
+        printf("\n");
+        if (l == 0 && !SameMesh(mesh, lod)) {
+            printf("           DIFFERENT from cubes\n");
+            failures++;
+        }
+        if (lod.GetNumTriangles() > mesh.GetNumTriangles()) {
+            printf("           MORE triangles than cubes\n");
+            failures++;
+        }
+        printf("           open edges %d\n", open);
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// mean distance in bytes (within one float stream) between the lowest and the
+// highest sorted slot the 27-cell stencil of a particle touches
+template <typename Grid>
+static double MeanStencilSpan(const Grid& grid, const ParticleStore& particles)
+{
+    const int n = (int)particles.Size();
+    double total = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        int lo = n;
+        int hi = 0;
+        grid.ForEachNeighborCell(particles.predictedPosition.Get(i), [&](int start, int count) {
+            if (start < lo) lo = start;
+            if (start + count > hi) hi = start + count;
+        });
+        if (hi > lo) total += (double)(hi - lo) * sizeof(float);
+    }
+    return total / n;
+}
+
+// same scene once per grid layout. the lambda pass is the one that walks the
+// stencil, so that's what gets the counters. single threaded, the counters only
+// follow the calling thread and misses per particle don't depend on the split.
+static int RunMortonBench(const RunnerArgs& args)
+{
+    PerfCounters counters;
+    printf("morton bench: %d particles  simd: %s  frames: %d (+%d warmup)  counters: %s\n",
+        args.config.GetNumParticles(), GetSPHKernels().name, args.frames, args.warmup,
+        counters.IsAvailable() ? "perf_event" : "n/a");
+
+    struct Layout { const char* name; GridType type; CellOrder order; };
+    const Layout layouts[] = {
+        { "rowmajor", GridType::Dense, CellOrder::RowMajor },
+        { "morton", GridType::Dense, CellOrder::Morton },
+        { "hashed", GridType::Hashed, CellOrder::Morton },
+    };
+
+    for (const Layout& layout : layouts) {
+        CPUSolver solver(1);
+        solver.SetGridType(layout.type);
+        solver.SetCellOrder(layout.order);
+        ParticleStore particles;
+        LoadScene(args.config, solver, particles);
+
+        for (int f = 0; f < args.warmup; f++)
+            Step(solver, particles, args.dt);
+
+        using Clock = std::chrono::steady_clock;
+        double buildMs = 0.0;
+        double lambdaMs = 0.0;
+        double span = 0.0;
+        counters.Reset();
+
+        for (int f = 0; f < args.frames; f++) {
+            solver.DispatchInit(args.dt);
+            solver.DispatchPrediction(particles, args.dt);
+
+            Clock::time_point t0 = Clock::now();
+            solver.DispatchNeighborSearch(particles);
+            Clock::time_point t1 = Clock::now();
+
+            counters.Start();
+            solver.ComputeLambda(particles);
+            counters.Stop();
+            Clock::time_point t2 = Clock::now();
+
+            buildMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+            lambdaMs += std::chrono::duration<double, std::milli>(t2 - t1).count();
+            span += layout.type == GridType::Hashed
+                ? MeanStencilSpan(solver.GetHashGrid(), particles)
+                : MeanStencilSpan(solver.GetGrid(), particles);
+
+            // rest of the frame, same as DispatchCPUCommands
+            solver.ComputeDelta(particles);
+            solver.CollisionConstraints(particles);
+            for (int i = 1; i < solver.GetConstants().iterations; i++) {
+                solver.ComputeLambda(particles);
+                solver.ComputeDelta(particles);
+                solver.CollisionConstraints(particles);
+            }
+            solver.ComputeXSPH(particles);
+            solver.UpdatePBD(particles, args.dt);
+        }
+
+        double perParticle = 1.0 / ((double)args.config.GetNumParticles() * args.frames);
+        int numCells = layout.type == GridType::Hashed ? solver.GetHashGrid().GetNumCells() : solver.GetGrid().GetNumCells();
+        printf("%-8s cells %6d  grid build %7.1f ns/p  lambda %7.1f ns/p  stencil span %9.0f B",
+            layout.name, numCells,
+            buildMs * 1e6 * perParticle, lambdaMs * 1e6 * perParticle, span / args.frames);
+
+        if (counters.IsAvailable()) {
+            long long llc = counters.GetCacheMisses();
+            long long l1d = counters.GetL1DMisses();
+            printf("  llc misses %6.2f /p  l1d misses %6.2f /p\n",
+                llc < 0 ? -1.0 : llc * perParticle, l1d < 0 ? -1.0 : l1d * perParticle);
+        } else {
+            printf("  cache misses n/a\n");
+        }
+    }
+    return 0;
+}
+
+// one slot of the --pipeline ring, what the gpu path reads back per frame
+struct PipelineFrame {
+    Float3Stream positions;     // readback
+    ScalarField field;          // mesh stage output
+    MarchingCubes mesh;
+    long long checksum = 0;
+};
+
+static int RunPipeline(const RunnerArgs& args, CPUSolver& solver, ParticleStore& particles)
+{
+    using Clock = std::chrono::steady_clock;
+    const SimulationConfig& config = args.config;
+    const int count = config.GetNumParticles();
+
+    // by default the stage's chunks go on the solver's queues and whichever
+    // worker is idle picks them up, --stage-threads T splits the cores instead
+    std::unique_ptr<ThreadPool> ownPool;
+    if (args.stageThreads > 0)
+        ownPool = std::make_unique<ThreadPool>(args.stageThreads, args.pin);
+    ThreadPool& stagePool = ownPool ? *ownPool : solver.GetPool();
+
+    FramePipeline<PipelineFrame> pipeline(args.pipeline, [&](PipelineFrame& frame, unsigned long long) {
+        frame.field.Build(stagePool, frame.positions, count);
+        frame.checksum = frame.field.GetChecksum();
+        frame.mesh.Extract(stagePool, frame.field, config.mcIso);
+    });
+
+    for (int i = 0; i < pipeline.GetFramesInFlight(); i++) {
+        PipelineFrame& slot = pipeline.GetSlot(i);
+        slot.positions.Resize(count);
+        slot.field.Configure(config.GetMCOrigin(), config.GetMCCellSize(),
+            { config.mcDimX, config.mcDimY, config.mcDimZ }, config.cellSize);
+        slot.field.SetSparse(config.mcSparse);
+        slot.field.SetGather(config.mcGather);
+        slot.mesh.SetIncremental(config.mcIncremental, config.mcIncrementalTolerance);
+    }
+
+    // both before the warmup like the plain loop's cache writer
+    std::unique_ptr<MeshExporter> exporter;
+    std::unique_ptr<ParticleCacheWriter> cache;
+    double cacheMs = 0.0;
+    try {
+        if (!config.meshExportDir.empty())
+            exporter = std::make_unique<MeshExporter>(config.meshExportDir, config.meshExportQueue);
+        if (!config.cacheRecord.empty())
+            cache = std::make_unique<ParticleCacheWriter>(config.cacheRecord, count);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "error: %s\n", e.what());
+        return 1;
+    }
+
+    int presented = 0;
+    long long lastChecksum = 0;
+    int lastTriangles = 0;
+    auto present = [&](PipelineFrame& frame) {
+        lastChecksum = frame.checksum;
+        lastTriangles = frame.mesh.GetNumTriangles();
+        if (exporter)
+            exporter->Submit(presented, frame.mesh.GetVertices(), frame.mesh.GetIndices());
+        presented++;
+    };
+
+    for (int f = 0; f < args.warmup; f++)
+        Step(solver, particles, args.dt);
+
+    Clock::time_point start = Clock::now();
+    for (int f = 0; f < args.frames; f++) {
+        // the oldest frame has to be out of the ring before its slot is reused
+        if (pipeline.IsFull())
+            present(pipeline.Retire());
+
+        PipelineFrame& frame = pipeline.Begin();
+        Step(solver, particles, args.dt);
+        frame.positions = particles.position;
+        pipeline.Submit();
+
+        // while the stage meshes it, the solver's state is the frame's
+        if (cache) {
+            Clock::time_point written = Clock::now();
+            cache->Append(particles, (double)(args.warmup + f + 1) * args.dt);
+            cacheMs += std::chrono::duration<double, std::milli>(Clock::now() - written).count();
+        }
+    }
+    while (pipeline.GetPending() > 0)
+        present(pipeline.Retire());
+    // the last meshes are still on their way to disk, they count
+    if (exporter)
+        exporter->Finish();
+    if (cache) {
+        Clock::time_point written = Clock::now();
+        cache->Finish();
+        cacheMs += std::chrono::duration<double, std::milli>(Clock::now() - written).count();
+    }
+    double totalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    printf("pipeline: %d frames in flight  stage threads: %u%s  presented: %d\n",
+        pipeline.GetFramesInFlight(), stagePool.GetThreadCount(), ownPool ? "" : " (shared)", presented);
+    printf("ms/frame: %.3f  main waited %.3f  stage %.3f\n", totalMs / args.frames,
+        pipeline.GetWaitSeconds() * 1000.0 / args.frames, pipeline.GetStageSeconds() * 1000.0 / args.frames);
+    printf("last field checksum: %lld  triangles: %d\n", lastChecksum, lastTriangles);
+    if (exporter) {
+        double mb = exporter->GetBytesWritten() / (1024.0 * 1024.0);
+        printf("export: %llu frames  %.2f MB  %.1f MB/s while writing  main stalled %.3f ms/frame (queue %d)\n",
+            exporter->GetFramesWritten(), mb, exporter->GetWriteSeconds() > 0.0 ? mb / exporter->GetWriteSeconds() : 0.0,
+            exporter->GetStallSeconds() * 1000.0 / args.frames, exporter->GetQueueFrames());
+    }
+    if (cache) {
+        double mb = cache->GetBytesWritten() / (1024.0 * 1024.0);
+        printf("cache: %d frames  %.2f MB  %.3f ms/frame  %.1f MB/s  -> %s\n", cache->GetNumFrames(), mb,
+            cacheMs / args.frames, cacheMs > 0.0 ? mb / (cacheMs / 1000.0) : 0.0, config.cacheRecord.c_str());
+    }
+    return 0;
+}
+
+// --play: what the renderer does with cache_play, minus the drawing
+static int RunPlayback(const RunnerArgs& args)
+{
+    using Clock = std::chrono::steady_clock;
+    const SimulationConfig& config = args.config;
+
+    ParticleCache cache(args.play);
+    CachePlayer player(cache, config.cachePrefetch);
+    const int numFrames = cache.GetNumFrames();
+    const int count = cache.GetNumParticles();
+
+    ThreadPool pool(args.threads, args.pin);
+    ScalarField field;
+    field.Configure(config.GetMCOrigin(), config.GetMCCellSize(), { config.mcDimX, config.mcDimY, config.mcDimZ }, config.cellSize);
+    field.SetSparse(config.mcSparse);
+    field.SetGather(config.mcGather);
+    MarchingCubes mesh;
+
+    printf("play: %s  %d frames of %d particles (%.2f MB each, %.2f s recorded)  prefetch: %d  threads: %u\n",
+        args.play, numFrames, count, cache.GetFrameBytes() / (1024.0 * 1024.0),
+        cache.GetTime(numFrames - 1) - cache.GetTime(0), config.cachePrefetch, pool.GetThreadCount());
+
+    int frame = 0;
+    int jumps = 0;
+    unsigned seed = 12345;
+    Clock::time_point start = Clock::now();
+    for (int f = 0; f < args.frames; f++) {
+        if (args.scrub > 0 && f > 0 && f % args.scrub == 0) {
+            seed = seed * 1664525u + 1013904223u;
+            frame = (int)((seed >> 8) % (unsigned)numFrames);
+            jumps++;
+        }
+
+        const ParticleStore& particles = player.Get(frame);
+        field.Build(pool, particles.position, count);
+        mesh.Extract(pool, field, config.mcIso);
+        frame = (frame + 1) % numFrames;
+    }
+    double totalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    printf("ms/frame: %.3f  (%.0f fps)  last triangles: %d  scrubs: %d\n", totalMs / args.frames,
+        1000.0 * args.frames / totalMs, mesh.GetNumTriangles(), jumps);
+    printf("prefetch: %llu hits  %llu misses  hit rate %.1f%%  waited %.3f ms/frame\n",
+        player.GetHits(), player.GetMisses(), player.GetHitRate() * 100.0, player.GetWaitSeconds() * 1000.0 / args.frames);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    RunnerArgs args;
+    try {
+        if (!ParseArgs(argc, argv, args)) {
+            PrintUsage();
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        fprintf(stderr, "error: %s\n", e.what());
+        return 1;
+    }
+
+    if (args.bench) {
+        if (strcmp(args.bench, "scan") == 0) return RunScanBench(args);
+        if (strcmp(args.bench, "morton") == 0) return RunMortonBench(args);
+        if (strcmp(args.bench, "mesh") == 0) return RunMeshBench(args);
+        if (strcmp(args.bench, "sdf") == 0) return RunSDFBench(args);
+        if (strcmp(args.bench, "remesh") == 0) return RunRemeshBench(args);
+        if (strcmp(args.bench, "lod") == 0) return RunLodBench(args);
+        PrintUsage();
+        return 1;
+    }
+
+    if (args.play) {
+        try {
+            return RunPlayback(args);
+        } catch (const std::exception& e) {
+            fprintf(stderr, "error: %s\n", e.what());
+            return 1;
+        }
+    }
+
+    CPUSolver solver(args.threads, args.pin);
+    if (args.grain > 0) solver.SetGrain(args.grain);
+    solver.SetCellOrder(args.cellOrder);
+    solver.SetGridType(args.gridType);
+    solver.SetNeighborList(args.neighborList, args.skin);
+    ParticleStore particles;
+    LoadScene(args.config, solver, particles);
+
+    const char* cells = args.gridType == GridType::Hashed ? "hashed"
+                      : args.cellOrder == CellOrder::Morton ? "morton" : "rowmajor";
+    printf("particles: %d  threads: %u  simd: %s  cells: %s  dt: %.5f  frames: %d (+%d warmup)\n",
+        args.config.GetNumParticles(), solver.GetThreadCount(), GetSPHKernels().name, cells, args.dt, args.frames, args.warmup);
+
+    if (args.pipeline > 0)
+        return RunPipeline(args, solver, particles);
+
+    // before the warmup, a bad path shouldn't cost it. the writes are kept
+    // out of the frame times, they're about the solver
+    std::unique_ptr<ParticleCacheWriter> cache;
+    double cacheMs = 0.0;
+    try {
+        if (!args.config.cacheRecord.empty())
+            cache = std::make_unique<ParticleCacheWriter>(args.config.cacheRecord, args.config.GetNumParticles());
+    } catch (const std::exception& e) {
+        fprintf(stderr, "error: %s\n", e.what());
+        return 1;
+    }
+
+    for (int f = 0; f < args.warmup; f++)
+        Step(solver, particles, args.dt);
+
+    using Clock = std::chrono::steady_clock;
+    double totalMs = 0.0;
+    double minMs = 1e30;
+    double maxMs = 0.0;
+
+    for (int f = 0; f < args.frames; f++) {
+        Clock::time_point start = Clock::now();
+        Step(solver, particles, args.dt);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        totalMs += ms;
+        if (ms < minMs) minMs = ms;
+        if (ms > maxMs) maxMs = ms;
+
+        if (cache) {
+            start = Clock::now();
+            cache->Append(particles, (double)(args.warmup + f + 1) * args.dt);
+            cacheMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+    }
+    if (cache) {
+        Clock::time_point start = Clock::now();
+        cache->Finish();
+        cacheMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    double avgMs = totalMs / args.frames;
+    double particlesPerSecond = (double)args.config.GetNumParticles() * args.frames / (totalMs / 1000.0);
+
+    printf("ms/frame: avg %.3f  min %.3f  max %.3f\n", avgMs, minMs, maxMs);
+    printf("particles/second: %.3e\n", particlesPerSecond);
+    printf("simulated %.2f s in %.2f s wall\n", args.frames * args.dt, totalMs / 1000.0);
+    printf("scheduler: grain %d  pinned: %s  steals: %llu\n",
+        solver.GetGrain(), solver.GetPool().IsPinned() ? "yes" : "no", solver.GetPool().GetStealCount());
+
+    if (cache) {
+        double mb = cache->GetBytesWritten() / (1024.0 * 1024.0);
+        printf("cache: %d frames  %.2f MB  %.3f ms/frame  %.1f MB/s  -> %s\n", cache->GetNumFrames(), mb,
+            cacheMs / args.frames, cacheMs > 0.0 ? mb / (cacheMs / 1000.0) : 0.0, args.config.cacheRecord.c_str());
+    }
+    if (args.neighborList) {
+        const NeighborList& list = solver.GetNeighborList();
+        printf("neighbor list: %zu pairs (%.1f per particle)  built %llu times in %d frames\n",
+            list.GetNumPairs(), (double)list.GetNumPairs() / args.config.GetNumParticles(),
+            list.GetBuildCount(), args.frames + args.warmup);
+    }
+
+    return 0;
+}
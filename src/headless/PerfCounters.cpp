@@ -0,0 +1,78 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int OpenCounter(unsigned type, unsigned long long config)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // this thread, any cpu
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long ReadCounter(int fd)
+{
+    if (fd < 0) return -1;
+    long long value = 0;
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) return -1;
+    return value;
+}
+
+PerfCounters::PerfCounters()
+{
+    m_cacheMissFd = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    m_l1dMissFd = OpenCounter(PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+}
+
+PerfCounters::~PerfCounters()
+{
+    if (m_cacheMissFd >= 0) close(m_cacheMissFd);
+    if (m_l1dMissFd >= 0) close(m_l1dMissFd);
+}
+
+void PerfCounters::Reset()
+{
+    if (m_cacheMissFd >= 0) ioctl(m_cacheMissFd, PERF_EVENT_IOC_RESET, 0);
+    if (m_l1dMissFd >= 0) ioctl(m_l1dMissFd, PERF_EVENT_IOC_RESET, 0);
+}
+
+void PerfCounters::Start()
+{
+    if (m_cacheMissFd >= 0) ioctl(m_cacheMissFd, PERF_EVENT_IOC_ENABLE, 0);
+    if (m_l1dMissFd >= 0) ioctl(m_l1dMissFd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+void PerfCounters::Stop()
+{
+    if (m_cacheMissFd >= 0) ioctl(m_cacheMissFd, PERF_EVENT_IOC_DISABLE, 0);
+    if (m_l1dMissFd >= 0) ioctl(m_l1dMissFd, PERF_EVENT_IOC_DISABLE, 0);
+}
+
+long long PerfCounters::GetCacheMisses() const { return ReadCounter(m_cacheMissFd); }
+long long PerfCounters::GetL1DMisses() const { return ReadCounter(m_l1dMissFd); }
+
+#else
+
+PerfCounters::PerfCounters() {}
+PerfCounters::~PerfCounters() {}
+void PerfCounters::Reset() {}
+void PerfCounters::Start() {}
+void PerfCounters::Stop() {}
+long long PerfCounters::GetCacheMisses() const { return -1; }
+long long PerfCounters::GetL1DMisses() const { return -1; }
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+// hardware cache miss counters for the calling thread (linux perf_event_open).
+// everything reports -1 when the counters can't be opened (other platforms,
+// vms without a pmu, perf_event_paranoid too strict), callers print n/a then.
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool IsAvailable() const { return m_cacheMissFd >= 0; }
+
+    // counts accumulate over every Start/Stop pair until Reset
+    void Reset();
+    void Start();
+    void Stop();
+
+    long long GetCacheMisses() const;   // last level, PERF_COUNT_HW_CACHE_MISSES
+    long long GetL1DMisses() const;     // l1 data read misses
+
+private:
+    int m_cacheMissFd = -1;
+    int m_l1dMissFd = -1;
+};
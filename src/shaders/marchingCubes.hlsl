@@ -34,7 +34,9 @@ cbuffer NSConstants : register(b0) {
     float H;            // smoothing
     float RHO_0;        // rest density
     float EPSILON;
-    float3 _pad1;
+    float DAMPING;      // finalize step, DAMPING/VISCOSITY in ParticleSystem.h
+    float VISCOSITY;
+    float _pad1;
 };
 
 cbuffer MCConstants : register(b1) {
@@ -42,8 +44,15 @@ cbuffer MCConstants : register(b1) {
     float mcCellSize;
     int3 mcDim;
     float mcIso;
-    int mcMaxTris;
-    float3 _pad2;
+    int mcMaxTris;      // what the index buffer holds, not the worst case
+    int3 mcBlockDim;    // 8^3 cell blocks
+    int mcMaxVertices;  // what the vertex buffer holds
+    int mcSparse;       // 0: every block is active
+    float mcTolerance;  // mc_incremental: how far the field can move before a block is redone
+    int mcRebuildAll;   // mc_incremental: 1 when there's no last frame to keep anything from
+    float3 mcCameraPos; // mc_lod_levels: where the distances are measured from
+    float mcLodDistance;
+    int mcLodLevels;    // 0: every block at full resolution
 }
 
 // ------- UNUSED BUFFERS HERE --------
@@ -55,9 +64,29 @@ RWStructuredBuffer<GPUParticle> particlesOut    : register(u5);
 RWStructuredBuffer<float> sdfVolume             : register(u9);
 
 RWStructuredBuffer<GPUParticle> particlesIn     : register(u2);
-RWStructuredBuffer<int> mcScalarField           : register(u6); // density field 
-RWStructuredBuffer<Vertex> mcVertexBuffer       : register(u7); // output buffer for triangles
-RWStructuredBuffer<uint> mcArgs                 : register(u8); // stores number of vertices
+RWStructuredBuffer<int> mcScalarField           : register(u6); // density field, x100, or asint(float) with MC_GATHER_FIELD
+#ifdef MC_COMPACT_VERTICES
+RWStructuredBuffer<uint3> mcVertexBuffer        : register(u7); // PackedVertex in VertexCodec.h
+#else
+RWStructuredBuffer<Vertex> mcVertexBuffer       : register(u7); // welded vertices, one per crossing edge
+#endif
+RWStructuredBuffer<uint> mcArgs                 : register(u8); // [0] index count, [1] vertex count, can be over the capacity
+RWStructuredBuffer<uint> mcEdgeMap              : register(u10); // grid edge -> vertex, edge = vertex index * 3 + axis
+RWStructuredBuffer<uint> mcIndexBuffer          : register(u11); // 3 per triangle
+RWStructuredBuffer<uint> mcBlockActive          : register(u12); // 1 per block the splat touched
+RWStructuredBuffer<uint> mcBlockList            : register(u13); // [0] count, then the active block ids
+RWStructuredBuffer<uint> mcBlockArgs            : register(u14); // dispatch args, one group per active block
+RWStructuredBuffer<uint2> mcBlockScan           : register(u15); // per list entry: vertices, indices. then their offsets
+RWStructuredBuffer<float> mcMeshField           : register(u17); // mc_incremental: the field the mesh is built from
+RWStructuredBuffer<uint2> mcBlockState          : register(u18); // mc_incremental: per block dirty/rebuild bits, first vertex last frame
+#ifdef MC_COMPACT_VERTICES
+RWStructuredBuffer<uint3> mcPrevVertexBuffer    : register(u19); // mc_incremental: last frame's mcVertexBuffer
+#else
+RWStructuredBuffer<Vertex> mcPrevVertexBuffer   : register(u19);
+#endif
+RWStructuredBuffer<uint> mcBlockLevel           : register(u20); // mc_lod_levels: per block, its cells are 2^level wide
+
+#define MC_BLOCK_SIZE 8     // ScalarField::BLOCK_SIZE
 
 // from https://graphics.stanford.edu/~mdfisher/MarchingCubes.html
 static const uint edgeTable[256] = {
@@ -371,12 +400,6 @@ float Poly6(float3 r, float h)
     return (coeff / h9) * diff3;
 }
 
-[numthreads(1,1,1)]
-void CSClearArgs()
-{
-    mcArgs[0] = 0;
-}
-
 [numthreads(64,1,1)]
 void CSClearField(uint3 tid : SV_DispatchThreadID)
 {
@@ -384,6 +407,25 @@ void CSClearField(uint3 tid : SV_DispatchThreadID)
     if (tid.x < total) mcScalarField[tid.x] = 0.0f;
 }
 
+// every block that has one of the vertices the splat around center touches as
+// a corner, so the sparse passes see them. blocks share face vertices, hence the lo - 1
+void MarkFieldBlocks(int3 center)
+{
+    int3 lo = max(center - 2, int3(0,0,0));
+    int3 hi = min(center + 2, mcDim);
+    if (any(lo > hi)) return;
+
+    int3 b0 = max(lo - 1, int3(0,0,0)) / MC_BLOCK_SIZE;
+    int3 b1 = min(hi / MC_BLOCK_SIZE, mcBlockDim - 1);
+    for (int bz = b0.z; bz <= b1.z; bz++)
+    for (int by = b0.y; by <= b1.y; by++)
+    for (int bx = b0.x; bx <= b1.x; bx++)
+    {
+        uint block = bx + by*mcBlockDim.x + bz*mcBlockDim.x*mcBlockDim.y;
+        if (mcBlockActive[block] == 0) mcBlockActive[block] = 1;
+    }
+}
+
 [numthreads(64,1,1)]
 void CSBuildScalarField(uint3 tid : SV_DispatchThreadID)
 {
@@ -394,6 +436,8 @@ void CSBuildScalarField(uint3 tid : SV_DispatchThreadID)
     // find the grid vertex this particle is closest to and splat
     int3 center = (int3)floor((pos - mcOrigin) / mcCellSize);
 
+    MarkFieldBlocks(center);
+
     for (int dx = -2; dx <= 2; dx++)
     for (int dy = -2; dy <= 2; dy++)
     for (int dz = -2; dz <= 2; dz++)
@@ -422,12 +466,85 @@ void CSBuildScalarField(uint3 tid : SV_DispatchThreadID)
     }
 }
 
+// mc_gather: the block flags on their own, CSGatherScalarField fills the field
+[numthreads(64,1,1)]
+void CSMarkFieldBlocks(uint3 tid : SV_DispatchThreadID)
+{
+    if ((int)tid.x >= numParticles) return;
+
+    float3 pos = particlesIn[tid.x].position;
+    MarkFieldBlocks((int3)floor((pos - mcOrigin) / mcCellSize));
+}
+
+// mc_gather: one group per listed block, one thread per vertex of its closed
+// range. sums up the particles whose 5x5x5 splat footprint covers the vertex,
+// found through the neighbor search grid, in float and without atomics. the
+// field holds asint(value) then. vertices on a face between two blocks are
+// written by both, with the same value
+[numthreads(9,9,9)]
+void CSGatherScalarField(uint3 gid : SV_GroupID, uint3 gtid : SV_GroupThreadID)
+{
+    uint block = mcBlockList[1 + gid.x];
+    int3 v = int3(block % mcBlockDim.x, (block / mcBlockDim.x) % mcBlockDim.y, block / (mcBlockDim.x * mcBlockDim.y))
+           * MC_BLOCK_SIZE + int3(gtid);
+    if (any(v > mcDim)) return;
+
+    float3 gvPos = mcOrigin + float3(v) * mcCellSize;
+
+    // particles centered on v-2..v+2 lie in [v - 2, v + 3) cells
+    int3 c0 = clamp((int3)floor((gvPos - 2.0f * mcCellSize - gridOrigin) / cellSize), int3(0,0,0), gridDim - 1);
+    int3 c1 = clamp((int3)floor((gvPos + 3.0f * mcCellSize - gridOrigin) / cellSize), int3(0,0,0), gridDim - 1);
+
+    float value = 0.0f;
+    bool touched = false;
+    for (int z = c0.z; z <= c1.z; z++)
+    for (int y = c0.y; y <= c1.y; y++)
+    for (int x = c0.x; x <= c1.x; x++)
+    {
+        int flat = x + y * gridDim.x + z * gridDim.x * gridDim.y;
+        int start = cellStart[flat];
+        int count = cellCount[flat];
+        for (int k = 0; k < count; k++)
+        {
+            float3 pos = particlesOut[start + k].position;
+            int3 center = (int3)floor((pos - mcOrigin) / mcCellSize);
+            if (any(abs(center - v) > 2)) continue;
+
+            value += Poly6(pos - gvPos, H * 2.0f);
+            touched = true;
+        }
+    }
+
+    // CSBuildScalarField's InterlockedMin(-100)
+    bool onBoundary = (v.x <= 0 || v.x >= mcDim.x - 1 ||
+                       v.y <= 0 ||
+                       v.z <= 0 || v.z >= mcDim.z - 1);
+    if (touched && onBoundary) value = min(value, -1.0f);
+
+    mcScalarField[v.x + v.y*(mcDim.x+1) + v.z*(mcDim.x+1)*(mcDim.y+1)] = asint(value);
+}
+
+float LoadField(int fi)
+{
+#ifdef MC_GATHER_FIELD
+    return asfloat(mcScalarField[fi]);
+#else
+    return mcScalarField[fi] / 100.0f;
+#endif
+}
+
+// what the mesh is made of: the field, or with mc_incremental the copy of it
+// that's only refreshed for dirty blocks
 float SampleField(int3 v)
 {
     // clamp to grid bounds
     v = clamp(v, int3(0,0,0), mcDim);
     int fi = v.x + v.y*(mcDim.x+1) + v.z*(mcDim.x+1)*(mcDim.y+1);
-    return mcScalarField[fi] / 100.0f;
+#ifdef MC_INCREMENTAL_MESH
+    return mcMeshField[fi];
+#else
+    return LoadField(fi);
+#endif
 }
 
 float3 ScalarFieldGradient(int3 v)
@@ -439,92 +556,971 @@ float3 ScalarFieldGradient(int3 v)
     return normalize(float3(dx, dy, dz));
 }
 
-[numthreads(64, 1, 1)]
-void CSMarchingCubes(uint3 tid : SV_DispatchThreadID)
+float3 SafeNormalize(float3 v)
 {
-    uint cellCount = (uint)(mcDim.x * mcDim.y * mcDim.z);
-    if (tid.x >= cellCount) return;
+    // flat spots in the field have no gradient, normalize would give NaNs
+    float len = length(v);
+    return len > 0.0f ? v / len : float3(0, 0, 0);
+}
 
-    // unpack flat index -> 3D
-    uint idx = tid.x;
-    int3 c;
-    c.x = idx % mcDim.x;
-    c.y = (idx / mcDim.x) % mcDim.y;
-    c.z = idx / (mcDim.x * mcDim.y);
+int GridVertexIndex(int3 v)
+{
+    return v.x + v.y*(mcDim.x+1) + v.z*(mcDim.x+1)*(mcDim.y+1);
+}
 
-    // 8 corner positions and values
+// VertexQuantizer::Encode in VertexCodec.cpp, the cpu reference for both
+float2 OctEncode(float3 n)
+{
+    float l1 = abs(n.x) + abs(n.y) + abs(n.z);
+    if (l1 <= 0.0f) return float2(0, 0);
+
+    float2 e = n.xy / l1;
+    if (n.z < 0.0f) e = (1.0f - abs(e.yx)) * (e >= 0.0f ? 1.0f : -1.0f);
+    return e;
+}
+
+// 16 bit unorm position over the grid box, w = 0xffff, 16 bit snorm octahedral normal
+uint3 PackVertex(float3 p, float3 n)
+{
+    float3 extent = float3(mcDim) * mcCellSize;
+    uint3 q = (uint3)floor(saturate((p - mcOrigin) / extent) * 65535.0f + 0.5f);
+    int2 o = (int2)floor(clamp(OctEncode(n), -1.0f, 1.0f) * 32767.0f + 0.5f);
+    return uint3(q.x | (q.y << 16), q.z | 0xffff0000u, ((uint)o.x & 0xffffu) | ((uint)o.y << 16));
+}
+
+// cube edge -> (corner offset, axis) of the grid edge that owns it,
+// corners numbered 0 (0,0,0) 1 (1,0,0) 2 (1,0,1) 3 (0,0,1) 4 (0,1,0) 5 (1,1,0) 6 (1,1,1) 7 (0,1,1)
+static const int4 cubeEdgeOwner[12] = {
+    int4(0,0,0,0), int4(1,0,0,2), int4(0,0,1,0), int4(0,0,0,2),
+    int4(0,1,0,0), int4(1,1,0,2), int4(0,1,1,0), int4(0,1,0,2),
+    int4(0,0,0,1), int4(1,0,0,1), int4(1,0,1,1), int4(0,0,1,1)
+};
+
+// ------- meshing --------
+// everything works on 8^3 cell blocks: with mc_sparse only the ones the splat
+// touched, otherwise all of them. CSCompactBlocks lists them, then
+//
+//   CSMCCountBlocks   one group per block, vertices and indices it will write
+//   CSMCScanBlocks    one group in total, block counts -> first vertex/index
+//   CSMCWeldBlocks    one group per block, scans its vertices in groupshared
+//   CSMCEmitBlocks    same for the triangles
+//
+// so every vertex and index has a fixed slot, no atomics on the output and
+// nothing is dropped: mcArgs gets the real totals even when they don't fit,
+// the host grows the buffers and only that frame comes out short. the order
+// is block list, then local thread, the same as MarchingCubes::ExtractSparse,
+// which is the cpu reference for all of this.
+//
+// a block owns its vertices half open, [8b, 8b + 8), except the last one
+// along an axis which also gets the vertices at mcDim. every crossing edge
+// has a touched end, so its owner is in an active block
+
+// group-wide exclusive scan for up to MC_SCAN_SIZE threads. every thread of
+// the group has to call it, threads with nothing to add pass 0
+#define MC_SCAN_SIZE 1024
+groupshared uint gsScan[2][MC_SCAN_SIZE];
+
+uint GroupScanExclusive(uint value, uint index, uint groupSize, out uint total)
+{
+    gsScan[0][index] = value;
+    GroupMemoryBarrierWithGroupSync();
+
+    uint src = 0;
+    for (uint offset = 1; offset < groupSize; offset <<= 1)
+    {
+        uint sum = gsScan[src][index];
+        if (index >= offset) sum += gsScan[src][index - offset];
+        gsScan[1 - src][index] = sum;
+        src = 1 - src;
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    total = gsScan[src][groupSize - 1];
+    uint inclusive = gsScan[src][index];
+    GroupMemoryBarrierWithGroupSync();     // before anyone reuses gsScan
+    return inclusive - value;
+}
+
+int3 BlockCoord(uint block)
+{
+    return int3(block % mcBlockDim.x, (block / mcBlockDim.x) % mcBlockDim.y, block / (mcBlockDim.x * mcBlockDim.y));
+}
+
+// the grid vertex of a 9^3 thread in block b, false if b doesn't own it
+bool OwnedVertex(int3 b, uint3 gtid, out int3 v)
+{
+    v = b * MC_BLOCK_SIZE + int3(gtid);
+    if (any(v > mcDim)) return false;
+
+    [unroll] for (int axis = 0; axis < 3; axis++)
+        if (gtid[axis] == MC_BLOCK_SIZE && b[axis] != mcBlockDim[axis] - 1) return false;
+    return true;
+}
+
+// same inside test as the cube index, so the cells agree with the vertex
+bool EdgeCrosses(int3 v, int axis)
+{
+    int3 b = v + int3(axis == 0, axis == 1, axis == 2);
+    if (any(b > mcDim)) return false;
+    return (SampleField(v) < mcIso) != (SampleField(b) < mcIso);
+}
+
+uint CubeIndex(int3 c)
+{
     int3 corners[8] = {
         c+int3(0,0,0), c+int3(1,0,0), c+int3(1,0,1), c+int3(0,0,1),
         c+int3(0,1,0), c+int3(1,1,0), c+int3(1,1,1), c+int3(0,1,1)
     };
 
-    float val[8];
-    [unroll] for (int i = 0; i < 8; i++) {
-        int3 v = corners[i];
-        int fi = v.x + v.y*(mcDim.x+1) + v.z*(mcDim.x+1)*(mcDim.y+1);
-        val[i] = mcScalarField[fi] / 100.0f;
-        //val[i] = 1.0f;
+    uint cubeIdx = 0;
+    [unroll] for (int i = 0; i < 8; i++)
+        if (SampleField(corners[i]) < mcIso) cubeIdx |= (1u << i);
+    return cubeIdx;
+}
+
+uint CountTriangles(uint cubeIdx)
+{
+    uint n = 0;
+    while (n < 15 && triTable[cubeIdx][n] != -1) n += 3;
+    return n / 3;
+}
+
+// the cell of an 8^3 thread, 0 past the end of the grid (last blocks only)
+uint BlockCellCase(int3 b, uint3 gtid, out int3 c)
+{
+    c = b * MC_BLOCK_SIZE + int3(gtid);
+    if (any(int3(gtid) >= MC_BLOCK_SIZE) || any(c >= mcDim)) return 0;
+    return CubeIndex(c);
+}
+
+// first frame only, after that the flags are reset block by block
+[numthreads(64,1,1)]
+void CSClearBlocks(uint3 tid : SV_DispatchThreadID)
+{
+    uint numBlocks = (uint)(mcBlockDim.x * mcBlockDim.y * mcBlockDim.z);
+    if (tid.x < numBlocks) mcBlockActive[tid.x] = 0;
+}
+
+// one group per block of last frame's list, one thread per vertex of its
+// closed range [8b, 8b + 8]
+[numthreads(9,9,9)]
+void CSClearActiveBlocks(uint3 gid : SV_GroupID, uint3 gtid : SV_GroupThreadID)
+{
+    uint block = mcBlockList[1 + gid.x];
+    int3 v = BlockCoord(block) * MC_BLOCK_SIZE + int3(gtid);
+    if (all(v <= mcDim)) mcScalarField[GridVertexIndex(v)] = 0;
+    if (all(gtid == 0)) mcBlockActive[block] = 0;
+}
+
+// flags -> list in block order, one group walking all blocks a chunk at a time
+[numthreads(MC_SCAN_SIZE,1,1)]
+void CSCompactBlocks(uint3 gtid : SV_GroupThreadID)
+{
+    uint numBlocks = (uint)(mcBlockDim.x * mcBlockDim.y * mcBlockDim.z);
+    uint listed = 0;
+
+    for (uint first = 0; first < numBlocks; first += MC_SCAN_SIZE)
+    {
+        // root uavs aren't bounds checked and ?: reads both sides, hence the ifs
+        uint block = first + gtid.x;
+        uint active = 0;
+        if (block < numBlocks)
+            active = mcSparse == 0 || mcBlockActive[block] != 0 ? 1 : 0;
+
+        uint total;
+        uint slot = listed + GroupScanExclusive(active, gtid.x, MC_SCAN_SIZE, total);
+        if (active) mcBlockList[1 + slot] = block;
+        listed += total;
+    }
+
+    if (gtid.x == 0) mcBlockList[0] = listed;
+}
+
+[numthreads(1,1,1)]
+void CSWriteBlockArgs()
+{
+    mcBlockArgs[0] = mcBlockList[0];
+    mcBlockArgs[1] = 1;
+    mcBlockArgs[2] = 1;
+}
+
+// a block has at most 9^3 * 3 vertices and 8^3 * 15 indices, both fit 16 bits,
+// so one scan does both
+[numthreads(9,9,9)]
+void CSMCCountBlocks(uint3 gid : SV_GroupID, uint3 gtid : SV_GroupThreadID, uint gindex : SV_GroupIndex)
+{
+    int3 b = BlockCoord(mcBlockList[1 + gid.x]);
+
+    uint vertices = 0;
+    int3 v;
+    if (OwnedVertex(b, gtid, v))
+    {
+        [unroll] for (int axis = 0; axis < 3; axis++)
+            if (EdgeCrosses(v, axis)) vertices++;
+    }
+
+    int3 c;
+    uint indices = CountTriangles(BlockCellCase(b, gtid, c)) * 3;
+
+    uint total;
+    GroupScanExclusive(vertices | (indices << 16), gindex, 9 * 9 * 9, total);
+    if (gindex == 0) mcBlockScan[gid.x] = uint2(total & 0xffffu, total >> 16);
+}
+
+// block counts -> offsets in place, plus the totals for the draw and the host
+[numthreads(MC_SCAN_SIZE,1,1)]
+void CSMCScanBlocks(uint3 gtid : SV_GroupThreadID)
+{
+    // loops over every block, the barriers in the scan want a bound that
+    // comes from the cbuffer. past the list the counts are 0
+    uint numBlocks = (uint)(mcBlockDim.x * mcBlockDim.y * mcBlockDim.z);
+    uint numListed = mcBlockList[0];
+    uint2 carry = uint2(0, 0);
+
+    for (uint first = 0; first < numBlocks; first += MC_SCAN_SIZE)
+    {
+        uint slot = first + gtid.x;
+        uint2 count = uint2(0, 0);
+        if (slot < numListed) count = mcBlockScan[slot];
+
+        uint2 total;
+        uint vertexOffset = GroupScanExclusive(count.x, gtid.x, MC_SCAN_SIZE, total.x);
+        uint indexOffset = GroupScanExclusive(count.y, gtid.x, MC_SCAN_SIZE, total.y);
+        if (slot < numListed) mcBlockScan[slot] = carry + uint2(vertexOffset, indexOffset);
+        carry += total;
+    }
+
+    if (gtid.x == 0)
+    {
+        mcArgs[0] = carry.y;
+        mcArgs[1] = carry.x;
     }
+}
+
+// one thread per grid vertex, which owns its +x, +y and +z edge. a crossing
+// edge gets one vertex that every cell around it shares
+[numthreads(9,9,9)]
+void CSMCWeldBlocks(uint3 gid : SV_GroupID, uint3 gtid : SV_GroupThreadID, uint gindex : SV_GroupIndex)
+{
+    uint block = mcBlockList[1 + gid.x];
+    int3 b = BlockCoord(block);
+
+    int3 v;
+    bool owned = OwnedVertex(b, gtid, v);
+    bool crosses[3] = { false, false, false };
+    uint count = 0;
+    if (owned)
+    {
+        [unroll] for (int axis = 0; axis < 3; axis++)
+        {
+            crosses[axis] = EdgeCrosses(v, axis);
+            if (crosses[axis]) count++;
+        }
+    }
+
+    uint total;
+    uint first = mcBlockScan[gid.x].x;
+    uint slot = first + GroupScanExclusive(count, gindex, 9 * 9 * 9, total);
+    if (count == 0) return;
+
+    uint vi = (uint)GridVertexIndex(v);
 
-    // build lookup index
+#ifdef MC_INCREMENTAL_MESH
+    // nothing this block's vertices depend on moved: same vertices in the
+    // same order as last frame, only the block's first slot may differ
+    uint2 state = mcBlockState[block];
+    if ((state.x & 2u) == 0)
+    {
+        [unroll] for (int axis = 0; axis < 3; axis++)
+        {
+            if (!crosses[axis]) continue;
+            mcEdgeMap[vi * 3 + axis] = slot;
+            uint prev = state.y + (slot - first);
+            if (slot < (uint)mcMaxVertices && prev < (uint)mcMaxVertices)
+                mcVertexBuffer[slot] = mcPrevVertexBuffer[prev];
+            slot++;
+        }
+        return;
+    }
+#endif
+    float va = SampleField(v);
+    float3 pa = mcOrigin + float3(v) * mcCellSize;
+
+    [unroll] for (int axis = 0; axis < 3; axis++)
+    {
+        if (!crosses[axis]) continue;
+
+        // the emit pass checks the slot against the capacity, so the map gets it either way
+        mcEdgeMap[vi * 3 + axis] = slot;
+        if (slot < (uint)mcMaxVertices)
+        {
+            // always low end to high end, whichever cell asks
+            int3 dir = int3(axis == 0, axis == 1, axis == 2);
+            float vb = SampleField(v + dir);
+            float t = (mcIso - va) / (vb - va + 1e-9f);
+            float3 p = lerp(pa, pa + float3(dir) * mcCellSize, t);
+            float3 n = SafeNormalize(lerp(ScalarFieldGradient(v), ScalarFieldGradient(v + dir), t));
+
+#ifdef MC_COMPACT_VERTICES
+            mcVertexBuffer[slot] = PackVertex(p, n);
+#else
+            Vertex vert = {p.x, p.y, p.z, 1.0f, float4(n, 1.0f)};
+            mcVertexBuffer[slot] = vert;
+#endif
+        }
+        slot++;
+    }
+}
+
+// one thread per cell, triangles as indices into the welded vertices
+[numthreads(8,8,8)]
+void CSMCEmitBlocks(uint3 gid : SV_GroupID, uint3 gtid : SV_GroupThreadID, uint gindex : SV_GroupIndex)
+{
+    uint block = mcBlockList[1 + gid.x];
+    int3 c;
+    uint cubeIdx = BlockCellCase(BlockCoord(block), gtid, c);
+    uint count = CountTriangles(cubeIdx) * 3;
+
+    uint total;
+    uint slot = mcBlockScan[gid.x].y + GroupScanExclusive(count, gindex, 8 * 8 * 8, total);
+
+#ifdef MC_INCREMENTAL_MESH
+    // where next frame's CSMCWeldBlocks finds this block's vertices
+    if (gindex == 0) mcBlockState[block].y = mcBlockScan[gid.x].x;
+#endif
+
+    for (uint t = 0; t < count; t += 3)
+    {
+        if (slot + t + 3 > (uint)mcMaxTris * 3) return;
+
+        uint tri[3];
+        bool fits = true;
+        [unroll] for (int k = 0; k < 3; k++)
+        {
+            int4 owner = cubeEdgeOwner[triTable[cubeIdx][t + k]];
+            tri[k] = mcEdgeMap[GridVertexIndex(c + owner.xyz) * 3 + owner.w];
+            fits = fits && tri[k] < (uint)mcMaxVertices;
+        }
+
+        // a vertex that didn't fit makes the triangle degenerate, the slot is taken anyway
+        [unroll] for (int k2 = 0; k2 < 3; k2++)
+            mcIndexBuffer[slot + t + k2] = fits ? tri[k2] : 0;
+    }
+}
+
+// ------- incremental meshing (mc_incremental) --------
+// the meshing kernels above read mcMeshField instead of the field. it's only
+// refreshed for dirty blocks, the ones with an own vertex that moved more than
+// mcTolerance. CSMCWeldBlocks redoes the vertices of the dirty blocks and of
+// the blocks around them that read a vertex they changed, and copies the
+// rest from last frame's buffer. count and
+// emit still run for every listed block, they're what moves a clean block's
+// vertices and triangles when the blocks before it grow or shrink.
+// MarchingCubes::ExtractIncremental is the cpu reference, per block like here.
+//
+//   CSMCClearBlockState  dirty/rebuild bits -> 0, the first vertex stays
+//   CSMCDirtyVertices    one thread per grid vertex, flags its owner block
+//   CSMCUpdateMeshField  dirty blocks copy their own vertices over, and flag
+//                        the neighbors that read a vertex that changed
+//   CSMCRebuildBlocks    dirty blocks and the flagged neighbors get redone
+
+// the block that owns grid vertex v, the last one along an axis also has the
+// vertices at mcDim
+uint OwnerBlock(int3 v)
+{
+    int3 b = min(v / MC_BLOCK_SIZE, mcBlockDim - 1);
+    return (uint)(b.x + b.y * mcBlockDim.x + b.z * mcBlockDim.x * mcBlockDim.y);
+}
+
+int3 GridVertexCoord(uint i)
+{
+    return int3(i % (mcDim.x+1), (i / (mcDim.x+1)) % (mcDim.y+1), i / ((mcDim.x+1) * (mcDim.y+1)));
+}
+
+[numthreads(64,1,1)]
+void CSMCClearBlockState(uint3 tid : SV_DispatchThreadID)
+{
+    uint numBlocks = (uint)(mcBlockDim.x * mcBlockDim.y * mcBlockDim.z);
+    if (tid.x < numBlocks) mcBlockState[tid.x].x = 0;
+}
+
+// every thread that sees a change writes the same 1, no atomics needed
+[numthreads(64,1,1)]
+void CSMCDirtyVertices(uint3 tid : SV_DispatchThreadID)
+{
+    uint numVerts = (uint)((mcDim.x+1) * (mcDim.y+1) * (mcDim.z+1));
+    if (tid.x >= numVerts) return;
+
+    if (mcRebuildAll != 0 || abs(LoadField(tid.x) - mcMeshField[tid.x]) > mcTolerance)
+        mcBlockState[OwnerBlock(GridVertexCoord(tid.x))].x = 1;
+}
+
+// the blocks around the owner that read grid vertex v, bit (dx+1) + (dy+1)*3
+// + (dz+1)*9. cells read one vertex up, normals one more either side: layer
+// 0 and 1 of the owner for the block below, layer 7 for the one above.
+// VertexReaders in MarchingCubes.cpp
+uint VertexReaders(int3 v)
+{
+    int3 l = v - min(v / MC_BLOCK_SIZE, mcBlockDim - 1) * MC_BLOCK_SIZE;
+    int3 mask = 2 | (l <= 1 ? 1 : 0) | (l == MC_BLOCK_SIZE - 1 ? 4 : 0);
+
+    uint readers = 0;
+    for (int dz = 0; dz < 3; dz++)
+    for (int dy = 0; dy < 3; dy++)
+    for (int dx = 0; dx < 3; dx++)
+        if (((mask.x >> dx) & (mask.y >> dy) & (mask.z >> dz) & 1) != 0)
+            readers |= 1u << (dx + dy * 3 + dz * 9);
+    return readers;
+}
+
+// the readers go in bits 2 and up of the owner's state, bit 0 isn't touched
+[numthreads(64,1,1)]
+void CSMCUpdateMeshField(uint3 tid : SV_DispatchThreadID)
+{
+    uint numVerts = (uint)((mcDim.x+1) * (mcDim.y+1) * (mcDim.z+1));
+    if (tid.x >= numVerts) return;
+
+    int3 v = GridVertexCoord(tid.x);
+    uint owner = OwnerBlock(v);
+    float value = LoadField(tid.x);
+    if ((mcBlockState[owner].x & 1u) != 0 && value != mcMeshField[tid.x])
+    {
+        mcMeshField[tid.x] = value;
+        InterlockedOr(mcBlockState[owner].x, VertexReaders(v) << 2);
+    }
+}
+
+// a block is redone when it's dirty or a dirty neighbor flagged it. blocks
+// that aren't listed never get to the weld, so unlike the cpu this doesn't
+// need to look at mcBlockActive. only the block's own thread writes bit 1,
+// the neighbors' bits it reads are done by now
+[numthreads(64,1,1)]
+void CSMCRebuildBlocks(uint3 tid : SV_DispatchThreadID)
+{
+    uint numBlocks = (uint)(mcBlockDim.x * mcBlockDim.y * mcBlockDim.z);
+    if (tid.x >= numBlocks) return;
+
+    int3 b = BlockCoord(tid.x);
+    uint dirty = mcBlockState[tid.x].x & 1u;
+    for (int dz = -1; dz <= 1; dz++)
+    for (int dy = -1; dy <= 1; dy++)
+    for (int dx = -1; dx <= 1; dx++)
+    {
+        int3 n = b + int3(dx, dy, dz);
+        if (any(n < 0) || any(n >= mcBlockDim)) continue;
+        // this block seen from n is at -dx, -dy, -dz
+        uint bit = 2 + (1 - dx) + (1 - dy) * 3 + (1 - dz) * 9;
+        dirty |= (mcBlockState[n.x + n.y * mcBlockDim.x + n.z * mcBlockDim.x * mcBlockDim.y].x >> bit) & 1u;
+    }
+    if (dirty != 0) mcBlockState[tid.x].x |= 2u;
+}
+
+// ------- level of detail (mc_lod_levels) --------
+// blocks further from mcCameraPos polygonize a coarser lattice of their grid
+// vertices, welded marching cubes like the full resolution path, with cells
+// 2^level wide. LodSurface is the cpu reference and has the details. same
+// block list, scan and output as the full resolution path, only the per
+// block kernels differ:
+//
+//   CSLodLevels       one thread per block, its level after the 2:1 balance
+//   CSLodCountBlocks  vertices and indices of the block's lattice
+//   CSMCScanBlocks    as above
+//   CSLodWeldBlocks   one thread per lattice point, which owns 3 edges
+//   CSLodEmitBlocks   one thread per cell, its triangles and face fills
+//
+// a lattice point between a coarser block's points takes their mean, so the
+// blocks on both sides of a coarse edge agree where it crosses, and every
+// lattice edge is filed in mcEdgeMap under the grid edge it starts with
+// (FileEdge). a block one level finer than the block across a face fills
+// the gap between their lines on that face
+
+// most directed triangle sides one face fill looks at: 5 triangles in the
+// coarse cell and in each of the 4 fine ones. LOD_FILL_SIDES in LodSurface.cpp
+#define MC_LOD_FILL_SIDES (5 * 3 * 5)
+
+// cube index corners, as in CubeIndex
+static const int3 cubeCorner[8] = {
+    int3(0,0,0), int3(1,0,0), int3(1,0,1), int3(0,0,1),
+    int3(0,1,0), int3(1,1,0), int3(1,1,1), int3(0,1,1)
+};
+
+uint BlockIndex(int3 b)
+{
+    return (uint)(b.x + b.y * mcBlockDim.x + b.z * mcBlockDim.x * mcBlockDim.y);
+}
+
+uint LatticeIndex(int3 p)
+{
+    return (uint)(p.x + p.y * 9 + p.z * 81);
+}
+
+uint LodLevel(uint block)
+{
+    return mcBlockLevel[block];
+}
+
+// before the balance. a block the grid cuts short has no coarse lattice that fits
+int DesiredLevel(int3 b)
+{
+    if (any((b + 1) * MC_BLOCK_SIZE > mcDim)) return 0;
+
+    float3 center = mcOrigin + (float3(b) + 0.5f) * MC_BLOCK_SIZE * mcCellSize;
+    float d = length(center - mcCameraPos);
+    int level = 0;
+    while (level < mcLodLevels && d >= mcLodDistance * (float)(1 << level)) level++;
+    return level;
+}
+
+// no block more than its distance in blocks above any other block's wish
+[numthreads(64,1,1)]
+void CSLodLevels(uint3 tid : SV_DispatchThreadID)
+{
+    uint numBlocks = (uint)(mcBlockDim.x * mcBlockDim.y * mcBlockDim.z);
+    if (tid.x >= numBlocks) return;
+
+    int3 b = BlockCoord(tid.x);
+    int level = DesiredLevel(b);
+    for (int dz = -mcLodLevels; dz <= mcLodLevels; dz++)
+    for (int dy = -mcLodLevels; dy <= mcLodLevels; dy++)
+    for (int dx = -mcLodLevels; dx <= mcLodLevels; dx++)
+    {
+        int3 n = b + int3(dx, dy, dz);
+        if (any(n < 0) || any(n >= mcBlockDim)) continue;
+        int distance = max(abs(dx), max(abs(dy), abs(dz)));
+        level = min(level, DesiredLevel(n) + distance);
+    }
+    mcBlockLevel[tid.x] = (uint)level;
+}
+
+// the blocks with grid vertex v in their closed range, lo to hi per axis
+void TouchingBlocks(int3 v, out int3 lo, out int3 hi)
+{
+    hi = min(v / MC_BLOCK_SIZE, mcBlockDim - 1);
+    lo = hi;
+    [unroll] for (int axis = 0; axis < 3; axis++)
+        if (v[axis] > 0 && v[axis] % MC_BLOCK_SIZE == 0) lo[axis] = min(v[axis] / MC_BLOCK_SIZE - 1, hi[axis]);
+}
+
+// the field as every block touching grid vertex v agrees on it: the coarsest
+// one decides, between its lattice points it's the mean of the 2 or 4 around
+float LodValue(int3 v)
+{
+    int3 lo, hi;
+    TouchingBlocks(v, lo, hi);
+
+    uint level = 0;
+    for (int bz = lo.z; bz <= hi.z; bz++)
+    for (int by = lo.y; by <= hi.y; by++)
+    for (int bx = lo.x; bx <= hi.x; bx++)
+        level = max(level, LodLevel(BlockIndex(int3(bx, by, bz))));
+
+    int s = 1 << level;
+    int3 from = v - v % s;
+    int3 to = from + int3(v % s != 0) * s;
+
+    float sum = 0.0f;
+    int count = 0;
+    for (int pz = from.z; pz <= to.z; pz += s)
+    for (int py = from.y; py <= to.y; py += s)
+    for (int px = from.x; px <= to.x; px += s)
+    {
+        sum += SampleField(int3(px, py, pz));
+        count++;
+    }
+    return sum / count;
+}
+
+// LodSurface::FileEdge: where the lattice edge from grid vertex v along axis
+// starts the way every block that has it files it, how long it is, and the
+// block that makes its vertex
+int3 FileEdge(int3 v, int axis, out int length, out uint maker)
+{
+    int3 lo, hi;
+    TouchingBlocks(v, lo, hi);
+    lo[axis] = hi[axis];    // along the edge, the block it runs into
+
+    uint level = 0;
+    for (int bz = lo.z; bz <= hi.z; bz++)
+    for (int by = lo.y; by <= hi.y; by++)
+    for (int bx = lo.x; bx <= hi.x; bx++)
+        level = max(level, LodLevel(BlockIndex(int3(bx, by, bz))));
+
+    length = 1 << level;
+    int u = axis == 0 ? 1 : 0, w = axis == 2 ? 1 : 2;
+    if (v[u] % length != 0 || v[w] % length != 0) length >>= 1;
+
+    int3 start = v;
+    start[axis] -= v[axis] % length;
+    maker = 0xffffffffu;
+    for (int bz2 = hi.z; bz2 >= lo.z; bz2--)
+    for (int by2 = hi.y; by2 >= lo.y; by2--)
+    for (int bx2 = hi.x; bx2 >= lo.x; bx2--)
+    {
+        uint block = BlockIndex(int3(bx2, by2, bz2));
+        if (maker == 0xffffffffu && (1u << LodLevel(block)) <= (uint)length) maker = block;
+    }
+    return start;
+}
+
+// lattice cells per side, short for a block past the end of the grid
+int3 LodLatticeSize(int3 b, uint level)
+{
+    return min(MC_BLOCK_SIZE, mcDim - b * MC_BLOCK_SIZE) >> level;
+}
+
+// the block's lattice values, LatticeIndex order. every thread of the group calls it
+groupshared float gsLodValue[9 * 9 * 9];
+
+void LoadLodLattice(int3 b, uint level, uint gindex, uint groupSize)
+{
+    int3 n = LodLatticeSize(b, level);
+    for (uint i = gindex; i < 9 * 9 * 9; i += groupSize)
+    {
+        int3 p = int3(i % 9, (i / 9) % 9, i / 81);
+        if (all(p <= n)) gsLodValue[i] = LodValue(b * MC_BLOCK_SIZE + p * (1 << level));
+    }
+    GroupMemoryBarrierWithGroupSync();
+}
+
+uint LodCubeIndex(int3 c)
+{
     uint cubeIdx = 0;
-    [unroll] for (int i2 = 0; i2 < 8; i2++)
-        if (val[i2] < mcIso) cubeIdx |= (1u << i2);
-
-    if (edgeTable[cubeIdx] == 0) return;
-
-    // interpolate edge vertices
-    float3 worldCorners[8];
-    [unroll] for (int i3 = 0; i3 < 8; i3++)
-        worldCorners[i3] = mcOrigin + float3(corners[i3]) * mcCellSize;
-
-    float3 edgeVerts[12];
-    float3 edgeNormals[12];
-    #define LERP_EDGE(e, a, b) \
-    { \
-        float t = (mcIso - val[a]) / (val[b] - val[a] + 1e-9f); \
-        edgeVerts[e] = lerp(worldCorners[a], worldCorners[b], t); \
-        edgeNormals[e] = normalize(lerp( \
-            ScalarFieldGradient(corners[a]), \
-            ScalarFieldGradient(corners[b]), t)); \
+    [unroll] for (int i = 0; i < 8; i++)
+        if (gsLodValue[LatticeIndex(c + cubeCorner[i])] < mcIso) cubeIdx |= (1u << i);
+    return cubeIdx;
+}
+
+bool OnLatticeSide(int3 p, int axis, int3 n)
+{
+    int u = axis == 0 ? 1 : 0, w = axis == 2 ? 1 : 2;
+    return p[u] == 0 || p[u] == n[u] || p[w] == 0 || p[w] == n[w];
+}
+
+// the mcEdgeMap entry of lattice edge p along axis. only an edge on the
+// block's boundary can be part of a longer one
+uint LodEdgeKey(int3 b, uint level, int3 n, int3 p, int axis)
+{
+    int3 v = b * MC_BLOCK_SIZE + p * (1 << level);
+    if (OnLatticeSide(p, axis, n))
+    {
+        int length;
+        uint maker;
+        v = FileEdge(v, axis, length, maker);
     }
+    return (uint)GridVertexIndex(v) * 3 + axis;
+}
+
+// whether the block makes the vertex of lattice edge p along axis: it's the
+// maker and the edge starts at p. length is the whole edge's, in grid cells
+bool LodMakesVertex(int3 b, uint block, uint level, int3 n, int3 p, int axis, out int length)
+{
+    length = 1 << level;
+    if (p[axis] == n[axis]) return false;
+
+    // a longer edge is two of this block's at most, one of them has to cross
+    int3 dir = int3(axis == 0, axis == 1, axis == 2);
+    bool crosses = (gsLodValue[LatticeIndex(p)] < mcIso) != (gsLodValue[LatticeIndex(p + dir)] < mcIso);
+    bool nextCrosses = false;
+    if (p[axis] + 1 < n[axis])
+        nextCrosses = (gsLodValue[LatticeIndex(p + dir)] < mcIso) != (gsLodValue[LatticeIndex(p + dir * 2)] < mcIso);
+    if (!crosses && !nextCrosses) return false;
 
-    if (edgeTable[cubeIdx] & 0x001) LERP_EDGE(0,  0, 1)
-    if (edgeTable[cubeIdx] & 0x002) LERP_EDGE(1,  1, 2)
-    if (edgeTable[cubeIdx] & 0x004) LERP_EDGE(2,  2, 3)
-    if (edgeTable[cubeIdx] & 0x008) LERP_EDGE(3,  3, 0)
-    if (edgeTable[cubeIdx] & 0x010) LERP_EDGE(4,  4, 5)
-    if (edgeTable[cubeIdx] & 0x020) LERP_EDGE(5,  5, 6)
-    if (edgeTable[cubeIdx] & 0x040) LERP_EDGE(6,  6, 7)
-    if (edgeTable[cubeIdx] & 0x080) LERP_EDGE(7,  7, 4)
-    if (edgeTable[cubeIdx] & 0x100) LERP_EDGE(8,  0, 4)
-    if (edgeTable[cubeIdx] & 0x200) LERP_EDGE(9,  1, 5)
-    if (edgeTable[cubeIdx] & 0x400) LERP_EDGE(10, 2, 6)
-    if (edgeTable[cubeIdx] & 0x800) LERP_EDGE(11, 3, 7)
-
-    // emit triangles
-    for (int t = 0; triTable[cubeIdx][t] != -1; t += 3)
+    if (OnLatticeSide(p, axis, n))
     {
-        float3 v0 = edgeVerts[triTable[cubeIdx][t]];
-        float3 v1 = edgeVerts[triTable[cubeIdx][t+1]];
-        float3 v2 = edgeVerts[triTable[cubeIdx][t+2]];
+        int3 v = b * MC_BLOCK_SIZE + p * (1 << level);
+        uint maker;
+        int3 start = FileEdge(v, axis, length, maker);
+        if (maker != block || any(start != v)) return false;
+    }
+
+    int3 q = p;
+    q[axis] += length >> level;
+    return (gsLodValue[LatticeIndex(p)] < mcIso) != (gsLodValue[LatticeIndex(q)] < mcIso);
+}
 
-        float3 n0 = edgeNormals[triTable[cubeIdx][t]];
-        float3 n1 = edgeNormals[triTable[cubeIdx][t+1]];
-        float3 n2 = edgeNormals[triTable[cubeIdx][t+2]];
+// whether cell c fills the face on side hi of axis a: even in the face's
+// axes, on the block's face, and the block across it one level coarser
+bool LodFills(int3 b, uint level, int3 n, int3 c, int a, int hi)
+{
+    int u = a == 0 ? 1 : 0, w = a == 2 ? 1 : 2;
+    if (c[u] % 2 != 0 || c[w] % 2 != 0 || c[a] != (hi != 0 ? n[a] - 1 : 0)) return false;
 
-        uint slot;
-        InterlockedAdd(mcArgs[0], 3u, slot);
+    int3 nb = b;
+    nb[a] += hi != 0 ? 1 : -1;
+    if (any(nb < 0) || any(nb >= mcBlockDim)) return false;
+    return LodLevel(BlockIndex(nb)) == level + 1;
+}
 
-        if (slot + 3 > (uint)mcMaxTris * 3) return; 
-        
-        Vertex v0_vert = {v0.x, v0.y, v0.z, 1.0f, float4(n0, 1.0f)};
-        Vertex v1_vert = {v1.x, v1.y, v1.z, 1.0f, float4(n1, 1.0f)};
-        Vertex v2_vert = {v2.x, v2.y, v2.z, 1.0f, float4(n2, 1.0f)};
+// side k of triangle t of cube index cubeIdx, as the cube edges it runs
+// between. false unless it's in the cube's face on side hi of axis a
+bool LodFaceSide(uint cubeIdx, uint t, uint k, int a, int hi, out int4 oa, out int4 ob)
+{
+    oa = cubeEdgeOwner[triTable[cubeIdx][t + k]];
+    ob = cubeEdgeOwner[triTable[cubeIdx][t + (k + 1) % 3]];
+    return oa.w != a && ob.w != a && oa[a] == hi && ob[a] == hi;
+}
+
+// a side that runs the other way round of one that's already there cancels it
+void LodAddSide(uint from, uint to, inout uint sideFrom[MC_LOD_FILL_SIDES], inout uint sideTo[MC_LOD_FILL_SIDES], inout uint numSides)
+{
+    uint m = 0;
+    while (m < numSides && (sideFrom[m] != to || sideTo[m] != from)) m++;
+    if (m < numSides)
+    {
+        numSides--;
+        sideFrom[m] = sideFrom[numSides];
+        sideTo[m] = sideTo[numSides];
+    }
+    else
+    {
+        sideFrom[numSides] = from;
+        sideTo[numSides] = to;
+        numSides++;
+    }
+}
+
+// a vertex that didn't fit makes the triangle degenerate, the slot is taken anyway
+void WriteLodTriangle(uint slot, uint tri[3])
+{
+    if (slot + 3 > (uint)mcMaxTris * 3) return;
+
+    bool fits = tri[0] < (uint)mcMaxVertices && tri[1] < (uint)mcMaxVertices && tri[2] < (uint)mcMaxVertices;
+    [unroll] for (int k = 0; k < 3; k++)
+        mcIndexBuffer[slot + k] = fits ? tri[k] : 0;
+}
+
+// fillFace in LodSurface::PolygonizeBlock, for cell c and the face LodFills
+// said yes to: the sides both the coarse cell across and the 4 fine cells
+// leave in the face, less the ones that cancel, go round the gap. they're
+// chained into loops and fanned the other way round. the number of indices,
+// written from slot on when emit
+uint LodFillFace(int3 b, uint level, int3 n, int3 c, int a, int hi, bool emit, uint slot)
+{
+    int u = a == 0 ? 1 : 0, w = a == 2 ? 1 : 2;
+    int3 du = int3(u == 0, u == 1, u == 2), dw = int3(w == 0, w == 1, w == 2);
+    int s = 1 << level;
+
+    // the 9 points of the square are both sides' corners on it, if they
+    // agree neither side has a line in it
+    int3 face = c + int3(a == 0, a == 1, a == 2) * hi;
+    uint below = 0;
+    for (int k0 = 0; k0 < 9; k0++)
+        if (gsLodValue[LatticeIndex(face + du * (k0 % 3) + dw * (k0 / 3))] < mcIso) below++;
+    if (below == 0 || below == 9) return 0;
+
+    uint sideFrom[MC_LOD_FILL_SIDES], sideTo[MC_LOD_FILL_SIDES];
+    uint numSides = 0;
+
+    // the coarse cell, from the field as the coarse block has it
+    int3 corner = b * MC_BLOCK_SIZE + c * s;
+    corner[a] = b[a] * MC_BLOCK_SIZE + (hi != 0 ? n[a] * s : -2 * s);
+    uint coarseIdx = 0;
+    [unroll] for (int i = 0; i < 8; i++)
+        if (LodValue(corner + cubeCorner[i] * 2 * s) < mcIso) coarseIdx |= (1u << i);
+
+    for (uint t = 0; t < 15 && triTable[coarseIdx][t] != -1; t += 3)
+    {
+        for (uint k = 0; k < 3; k++)
+        {
+            int4 oa, ob;
+            if (!LodFaceSide(coarseIdx, t, k, a, 1 - hi, oa, ob)) continue;
+
+            int length;
+            uint maker;
+            uint from = (uint)GridVertexIndex(FileEdge(corner + oa.xyz * 2 * s, oa.w, length, maker)) * 3 + oa.w;
+            uint to = (uint)GridVertexIndex(FileEdge(corner + ob.xyz * 2 * s, ob.w, length, maker)) * 3 + ob.w;
+            LodAddSide(from, to, sideFrom, sideTo, numSides);
+        }
+    }
+
+    for (int f = 0; f < 4; f++)
+    {
+        int3 cell = c + du * (f & 1) + dw * (f >> 1);
+        uint cubeIdx = LodCubeIndex(cell);
+        for (uint t2 = 0; t2 < 15 && triTable[cubeIdx][t2] != -1; t2 += 3)
+        {
+            for (uint k2 = 0; k2 < 3; k2++)
+            {
+                int4 oa, ob;
+                if (!LodFaceSide(cubeIdx, t2, k2, a, hi, oa, ob)) continue;
+
+                uint from = LodEdgeKey(b, level, n, cell + oa.xyz, oa.w);
+                uint to = LodEdgeKey(b, level, n, cell + ob.xyz, ob.w);
+                LodAddSide(from, to, sideFrom, sideTo, numSides);
+            }
+        }
+    }
+
+    // every loop fanned from its first point, as LodSurface does
+    bool used[MC_LOD_FILL_SIDES];
+    for (uint m = 0; m < numSides; m++) used[m] = false;
+
+    uint count = 0;
+    for (uint k3 = 0; k3 < numSides; k3++)
+    {
+        uint first = 0, prev = 0;
+        uint len = 0;
+        for (int e = (int)k3; e >= 0 && !used[e];)
+        {
+            used[e] = true;
+            uint cur = sideTo[e];
+            if (len == 0) first = cur;
+            if (len >= 2)
+            {
+                if (emit)
+                {
+                    uint tri[3] = { mcEdgeMap[first], mcEdgeMap[prev], mcEdgeMap[cur] };
+                    WriteLodTriangle(slot + count, tri);
+                }
+                count += 3;
+            }
+            prev = cur;
+            len++;
+
+            int next = -1;
+            for (uint m2 = 0; m2 < numSides && next < 0; m2++)
+                if (!used[m2] && sideTo[m2] == sideFrom[e]) next = (int)m2;
+            e = next;
+        }
+    }
+    return count;
+}
 
-        mcVertexBuffer[slot] = v0_vert;
-        mcVertexBuffer[slot+1] = v1_vert;
-        mcVertexBuffer[slot+2] = v2_vert;
+// the cell's marching cubes indices and its face fills'
+uint LodCellIndices(int3 b, uint level, int3 n, int3 c, out uint cubeIdx)
+{
+    cubeIdx = LodCubeIndex(c);
+    uint count = CountTriangles(cubeIdx) * 3;
+    for (int a = 0; a < 3; a++)
+    for (int hi = 0; hi < 2; hi++)
+        if (LodFills(b, level, n, c, a, hi)) count += LodFillFace(b, level, n, c, a, hi, false, 0);
+    return count;
+}
 
+// at most 9^3 * 3 vertices and 8^3 * 15 indices per block plus the fills on
+// its faces, both still fit 16 bits
+[numthreads(9,9,9)]
+void CSLodCountBlocks(uint3 gid : SV_GroupID, uint3 gtid : SV_GroupThreadID, uint gindex : SV_GroupIndex)
+{
+    uint block = mcBlockList[1 + gid.x];
+    int3 b = BlockCoord(block);
+    uint level = LodLevel(block);
+    int3 n = LodLatticeSize(b, level);
+    LoadLodLattice(b, level, gindex, 9 * 9 * 9);
+
+    uint vertices = 0;
+    uint indices = 0;
+    int3 p = int3(gtid);
+    if (all(p <= n))
+    {
+        [unroll] for (int axis = 0; axis < 3; axis++)
+        {
+            int length;
+            if (LodMakesVertex(b, block, level, n, p, axis, length)) vertices++;
+        }
     }
+
+    uint cubeIdx;
+    if (all(p < n)) indices = LodCellIndices(b, level, n, p, cubeIdx);
+
+    uint total;
+    GroupScanExclusive(vertices | (indices << 16), gindex, 9 * 9 * 9, total);
+    if (gindex == 0) mcBlockScan[gid.x] = uint2(total & 0xffffu, total >> 16);
+}
+
+// lattice point order, then axis, like CSMCWeldBlocks. the vertex goes under
+// the grid edge its lattice edge starts with, which is this point's
+[numthreads(9,9,9)]
+void CSLodWeldBlocks(uint3 gid : SV_GroupID, uint3 gtid : SV_GroupThreadID, uint gindex : SV_GroupIndex)
+{
+    uint block = mcBlockList[1 + gid.x];
+    int3 b = BlockCoord(block);
+    uint level = LodLevel(block);
+    int3 n = LodLatticeSize(b, level);
+    LoadLodLattice(b, level, gindex, 9 * 9 * 9);
+
+    int3 p = int3(gtid);
+    bool made[3] = { false, false, false };
+    int lengths[3] = { 0, 0, 0 };
+    uint count = 0;
+    if (all(p <= n))
+    {
+        [unroll] for (int axis = 0; axis < 3; axis++)
+        {
+            made[axis] = LodMakesVertex(b, block, level, n, p, axis, lengths[axis]);
+            if (made[axis]) count++;
+        }
+    }
+
+    uint total;
+    uint slot = mcBlockScan[gid.x].x + GroupScanExclusive(count, gindex, 9 * 9 * 9, total);
+    if (count == 0) return;
+
+    int3 v = b * MC_BLOCK_SIZE + p * (1 << level);
+    uint vi = (uint)GridVertexIndex(v);
+    float va = gsLodValue[LatticeIndex(p)];
+    float3 pa = mcOrigin + float3(v) * mcCellSize;
+    float3 na = ScalarFieldGradient(v);
+
+    [unroll] for (int axis2 = 0; axis2 < 3; axis2++)
+    {
+        if (!made[axis2]) continue;
+
+        mcEdgeMap[vi * 3 + axis2] = slot;
+        if (slot < (uint)mcMaxVertices)
+        {
+            // the whole edge, low end to high end, whichever block asks
+            int3 dir = int3(axis2 == 0, axis2 == 1, axis2 == 2);
+            int3 w = v + dir * lengths[axis2];
+            float vb = gsLodValue[LatticeIndex(p + dir * (lengths[axis2] >> level))];
+            float t = (mcIso - va) / (vb - va + 1e-9f);
+            float3 pos = lerp(pa, mcOrigin + float3(w) * mcCellSize, t);
+            float3 nrm = SafeNormalize(lerp(na, ScalarFieldGradient(w), t));
+
+#ifdef MC_COMPACT_VERTICES
+            mcVertexBuffer[slot] = PackVertex(pos, nrm);
+#else
+            Vertex vert = {pos.x, pos.y, pos.z, 1.0f, float4(nrm, 1.0f)};
+            mcVertexBuffer[slot] = vert;
+#endif
+        }
+        slot++;
+    }
+}
+
+// cell order, the cell's marching cubes triangles then its face fills. the
+// vertices can be any block's, every block has welded before this runs
+[numthreads(8,8,8)]
+void CSLodEmitBlocks(uint3 gid : SV_GroupID, uint3 gtid : SV_GroupThreadID, uint gindex : SV_GroupIndex)
+{
+    uint block = mcBlockList[1 + gid.x];
+    int3 b = BlockCoord(block);
+    uint level = LodLevel(block);
+    int3 n = LodLatticeSize(b, level);
+    LoadLodLattice(b, level, gindex, 8 * 8 * 8);
+
+    int3 c = int3(gtid);
+    uint cubeIdx = 0;
+    uint count = 0;
+    if (all(c < n)) count = LodCellIndices(b, level, n, c, cubeIdx);
+
+    uint total;
+    uint slot = mcBlockScan[gid.x].y + GroupScanExclusive(count, gindex, 8 * 8 * 8, total);
+    if (count == 0) return;
+
+    for (uint t = 0; t < 15 && triTable[cubeIdx][t] != -1; t += 3)
+    {
+        uint tri[3];
+        [unroll] for (int k = 0; k < 3; k++)
+        {
+            int4 owner = cubeEdgeOwner[triTable[cubeIdx][t + k]];
+            tri[k] = mcEdgeMap[LodEdgeKey(b, level, n, c + owner.xyz, owner.w)];
+        }
+        WriteLodTriangle(slot, tri);
+        slot += 3;
+    }
+
+    for (int a = 0; a < 3; a++)
+    for (int hi = 0; hi < 2; hi++)
+        if (LodFills(b, level, n, c, a, hi)) slot += LodFillFace(b, level, n, c, a, hi, true, slot);
 }
@@ -34,7 +34,9 @@ cbuffer NSConstants : register(b0) {
     float H;            // smoothing
     float RHO_0;        // rest density
     float EPSILON;
-    float3 _pad1;
+    float DAMPING;      // finalize step, DAMPING/VISCOSITY in ParticleSystem.h
+    float VISCOSITY;
+    float _pad1;
 };
 
 cbuffer MCConstants : register(b1) {
@@ -56,11 +58,20 @@ RWStructuredBuffer<GPUParticle> particlesOut    : register(u5);
 RWStructuredBuffer<int> mcScalarField         : register(u6);
 RWStructuredBuffer<Vertex> mcVertexBuffer       : register(u7); // needs to match Vertex in stdafx.h
 RWStructuredBuffer<uint> mcArgs                 : register(u8); 
-RWStructuredBuffer<float> sdfVolume        : register(u9);
+RWStructuredBuffer<float> sdfVolume        : register(u9);  // one per cell, same layout as cellStart
+RWStructuredBuffer<float4> sdfSeeds         : register(u16); // two halves, the floods ping-pong between them
+
+// per dispatch, root constants
+cbuffer SDFPass : register(b2) {
+    int sdfStep;        // flood: how far away the neighbors are looked at
+    int sdfSrc;         // half of sdfSeeds that's read, the other one is written
+    float sdfRadius;
+    float sdfBand;      // in world units
+};
 
 // values for uniform grid search
 #define STATUS_SHIFT 30
-#define VALUE_MASK   0x3FFFFFFF
+#define VALUE_MASK   0x3FFFFFFF  // 30-bit payload, silently wraps past ~1 billion
 #define TILE 256
 groupshared int gs[TILE];
 groupshared int gs_exclusivePrefix;
@@ -503,3 +514,139 @@ void CSComputeXSPH(uint3 tid : SV_DispatchThreadID)
     particlesIn[pi.originalIndex].density = density;
     particlesIn[pi.originalIndex].xsph = xsph;
 }
+
+// step 6: finalize, same math as ParticleSystem::UpdatePBD on the host.
+// keeps the particle state on the gpu so the next step doesn't need a round trip
+[numthreads(64, 1, 1)]
+void CSFinalize(uint3 tid : SV_DispatchThreadID)
+{
+    int i = (int)tid.x;
+    if (i >= numParticles || dt <= 0.0f) return;
+
+    float3 pos  = particlesIn[i].position;
+    float3 pred = particlesIn[i].predictedPosition;
+
+    // derive velocity from the displacement, then apply XSPH
+    particlesIn[i].velocity = (DAMPING / dt) * (pred - pos) + particlesIn[i].xsph * VISCOSITY;
+    particlesIn[i].position = pred;
+}
+
+// ----------------- NARROW BAND SDF --------------------
+// DistanceField on the cpu, same passes and the same step sizes. one thread
+// per neighbor search cell, reads the grid the last DispatchNeighborSearch
+// built. a seed is xyz = position, w = distance it already stands for, < 0 none
+
+int3 SDFCellCoord(uint i)
+{
+    return int3(i % gridDim.x, (i / gridDim.x) % gridDim.y, i / (gridDim.x * gridDim.y));
+}
+
+float3 SDFCellCenter(int3 c)
+{
+    return gridOrigin + (float3(c) + 0.5f) * cellSize;
+}
+
+// every cell takes the particle inside it closest to its center
+[numthreads(64, 1, 1)]
+void CSSDFSeed(uint3 tid : SV_DispatchThreadID)
+{
+    if ((int)tid.x >= numCells) return;
+    float3 center = SDFCellCenter(SDFCellCoord(tid.x));
+
+    float4 seed = float4(0, 0, 0, -1);
+    float best = 0.0f;
+    int start = cellStart[tid.x];
+    int count = cellCount[tid.x];
+    for (int k = 0; k < count; k++) {
+        float3 p = particlesOut[start + k].position;
+        float d = length(center - p);
+        if (seed.w < 0.0f || d < best) {
+            seed = float4(p, 0.0f);
+            best = d;
+        }
+    }
+    sdfSeeds[tid.x] = seed;
+}
+
+// one jump flooding step: the best of our own seed and the 26 step cells away
+[numthreads(64, 1, 1)]
+void CSSDFFlood(uint3 tid : SV_DispatchThreadID)
+{
+    if ((int)tid.x >= numCells) return;
+    int3 c = SDFCellCoord(tid.x);
+    float3 center = SDFCellCenter(c);
+    uint src = sdfSrc * numCells;
+    uint dst = (1 - sdfSrc) * numCells;
+
+    float4 best = sdfSeeds[src + tid.x];
+    float bestScore = best.w >= 0.0f ? length(center - best.xyz) - best.w : 0.0f;
+
+    for (int dz = -1; dz <= 1; dz++)
+    for (int dy = -1; dy <= 1; dy++)
+    for (int dx = -1; dx <= 1; dx++)
+    {
+        int3 n = c + int3(dx, dy, dz) * sdfStep;
+        if (any(n < int3(0,0,0)) || any(n >= gridDim)) continue;
+
+        float4 s = sdfSeeds[src + n.x + n.y * gridDim.x + n.z * gridDim.x * gridDim.y];
+        if (s.w < 0.0f) continue;
+        float score = length(center - s.xyz) - s.w;
+        if (best.w < 0.0f || score < bestScore) {
+            best = s;
+            bestScore = score;
+        }
+    }
+    sdfSeeds[dst + tid.x] = best;
+}
+
+// outside distance into sdfVolume, checked against the 27 cells around the
+// flooded particle. the cells it puts outside seed the inside flood
+[numthreads(64, 1, 1)]
+void CSSDFOutside(uint3 tid : SV_DispatchThreadID)
+{
+    if ((int)tid.x >= numCells) return;
+    float3 center = SDFCellCenter(SDFCellCoord(tid.x));
+    float4 s = sdfSeeds[sdfSrc * numCells + tid.x];
+
+    float nearest = sdfBand + sdfRadius;
+    if (s.w >= 0.0f) {
+        nearest = length(center - s.xyz);
+        int3 sc = clamp((int3)floor((s.xyz - gridOrigin) / cellSize), int3(0,0,0), gridDim - int3(1,1,1));
+        for (int dz = -1; dz <= 1; dz++)
+        for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            int3 n = sc + int3(dx, dy, dz);
+            if (any(n < int3(0,0,0)) || any(n >= gridDim)) continue;
+
+            int flat = n.x + n.y * gridDim.x + n.z * gridDim.x * gridDim.y;
+            int start = cellStart[flat];
+            int count = cellCount[flat];
+            for (int k = 0; k < count; k++)
+                nearest = min(nearest, length(center - particlesOut[start + k].position));
+        }
+    }
+
+    float outside = nearest - sdfRadius;
+    sdfVolume[tid.x] = outside;
+    sdfSeeds[(1 - sdfSrc) * numCells + tid.x] = outside > 0.0f ? float4(center, outside) : float4(0, 0, 0, -1);
+}
+
+// inside distance through the nearest outside cell, both clamped to the band
+[numthreads(64, 1, 1)]
+void CSSDFResolve(uint3 tid : SV_DispatchThreadID)
+{
+    if ((int)tid.x >= numCells) return;
+
+    float outside = sdfVolume[tid.x];
+    if (outside > 0.0f) {
+        sdfVolume[tid.x] = min(outside, sdfBand);
+        return;
+    }
+
+    float3 center = SDFCellCenter(SDFCellCoord(tid.x));
+    float4 s = sdfSeeds[sdfSrc * numCells + tid.x];
+    float inside = sdfBand;
+    if (s.w >= 0.0f) inside = max(length(center - s.xyz) - s.w, 0.0f);
+    sdfVolume[tid.x] = max(min(outside, -inside), -sdfBand);
+}
@@ -5,6 +5,10 @@ cbuffer VPBuffer : register(b0)
     float4x4 vp;
     float3 camPos;
     float _pad;
+    float3 meshOrigin;      // mc grid box, for VSMainPacked
+    float _pad1;
+    float3 meshExtent;
+    float _pad2;
 };
 
 struct PSInput
@@ -25,6 +29,26 @@ PSInput VSMain(
     return result;
 }
 
+// mc_compact_vertices: PackedVertex (VertexCodec.h), the input assembler has
+// already turned the unorm position into [0, 1] and the snorm normal into [-1, 1]
+PSInput VSMainPacked(
+    float4 position : POSITION,
+    float2 normal : NORMAL
+) {
+    float3 worldPos = meshOrigin + position.xyz * meshExtent;
+
+    // octahedral decode, OctDecode in VertexCodec.cpp
+    float3 n = float3(normal, 1.0 - abs(normal.x) - abs(normal.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(normal.yx)) * (normal >= 0.0 ? 1.0 : -1.0);
+
+    PSInput result;
+    result.position = mul(float4(worldPos, 1.0), vp);
+    result.worldPos = worldPos;
+    result.normal = n;     // PSMain normalizes
+    return result;
+}
+
 float4 PSMain(PSInput input) : SV_TARGET
 {
     float3 camPos2 = float3(1.0, 1.0, 1.0);
@@ -33,17 +33,6 @@ struct Vertex
     XMFLOAT4 normal;
 };
 
-struct Particle {
-    XMFLOAT3 position;
-    XMFLOAT3 predictedPosition;
-    XMFLOAT3 velocity;
-    float density;
-    float lambda;
-    XMFLOAT3 xsph;
-    XMFLOAT3 delta;
-    std::vector<int> neighbors;
-};
-
 struct GPUParticle {
     XMFLOAT3 position;
     float _pad0;
@@ -78,12 +67,23 @@ struct MCConstants {
     XMINT3 mcDims;
     float mcIso;
     int mcMaxTris;
-    float _pad[3];
+    XMINT3 mcBlockDim;
+    int mcMaxVertices;
+    int mcSparse;
+    float mcTolerance;
+    int mcRebuildAll;
+    XMFLOAT3 mcCameraPos;
+    float mcLodDistance;
+    int mcLodLevels;
 };
 
 struct VPConstantBuffer {
     XMFLOAT4X4 vp;
     XMFLOAT3 camPos;
     float _pad;
+    XMFLOAT3 meshOrigin;    // mc grid box, for decoding PackedVertex
+    float _pad1;
+    XMFLOAT3 meshExtent;
+    float _pad2;
 };
 